@@ -66,6 +66,20 @@ enum {
 static ys_allocator_t *FixedSizedAllocators[YS_MAXALLOCATORS];
 unsigned long Maxmem;		/* TODO: Get rid of this */
 
+/* 
+ * Maxmem is updated atomically as documents may be parsed by several
+ * threads. 17-10-26
+ */
+static inline void
+ys_add_maxmem(long n)
+{
+#ifdef WIN32
+	InterlockedExchangeAdd((volatile LONG *)&Maxmem, n);
+#else
+	__sync_fetch_and_add(&Maxmem, (unsigned long)n);
+#endif
+}
+
 static void *
 safe_malloc(size_t n) 
 {
@@ -156,7 +170,7 @@ ys_grow_allocator(ys_allocator_t *a)
 			__FILE__, __func__, a, a->size, a->nbytes);
 	}
 
-	Maxmem += a->nbytes;
+	ys_add_maxmem((long)a->nbytes);
 }
 
 static void
@@ -235,7 +249,7 @@ ys_destroy_allocator(ys_allocator_t * a)
 		free(buflink->buffer);
 		free(buflink);
 
-		Maxmem -= a->nbytes;
+		ys_add_maxmem(-(long)a->nbytes);
 	}
 	free(a);
 }
@@ -286,7 +300,7 @@ ys_allocmem(size_t size)
 		 * largest allocator, then we simply use malloc.
 		 */
 		void *p = safe_malloc(a_size);
-		Maxmem += a_size;
+		ys_add_maxmem((long)a_size);
 		if (Ys_debug >= 1) {
 			fprintf(stderr,"Allocating memory %p req(%d), alloc(%d)\n", p, size, a_size);
 		}
@@ -318,7 +332,7 @@ ys_freemem(void *p, size_t size)
 
 	a = ys_find_allocator(size, &a_size);
 	if (a >= YS_MAXALLOCATORS) {
-		Maxmem -= a_size;
+		ys_add_maxmem(-(long)a_size);
 		if (Ys_debug >= 1) {
 			fprintf(stderr,"Freeing memory %p req(%d), alloc(%d)\n", p, size, a_size);
 		}
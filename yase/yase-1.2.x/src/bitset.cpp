@@ -25,6 +25,10 @@
  * Dibyendu Majumdar
  * 14 April 2001
  */
+// 17-10-26: Sets are held in chunks of 65536 bits, each a sorted array,
+//           a bitmap or a list of runs, whichever is smallest. Members
+//           are found by counting trailing zeros of bitmap words 
+//           instead of testing one bit at a time.
 
 #include "bitset.h"
 #include "util.h"
@@ -32,6 +36,573 @@
 #define NBYTES(n)	(sizeof(unsigned)*n)
 #define ESIZE		(sizeof(unsigned)*8)
 
+enum {
+	YS_BS_WORDS = YS_BS_CHUNKBITS / 64	/* of a bitmap */
+};
+
+/**
+ * Count trailing zeros in a non-zero 64 bit value.
+ */
+static inline int
+ys_ctz64(ys_uint64_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(x);
+#else
+	int n = 0;
+	if ((x & 0xffffffffULL) == 0) { n += 32; x >>= 32; }
+	if ((x & 0xffff) == 0) { n += 16; x >>= 16; }
+	if ((x & 0xff) == 0) { n += 8; x >>= 8; }
+	if ((x & 0xf) == 0) { n += 4; x >>= 4; }
+	if ((x & 0x3) == 0) { n += 2; x >>= 2; }
+	if ((x & 0x1) == 0) { n += 1; }
+	return n;
+#endif
+}
+
+static inline unsigned
+ys_popcount64(ys_uint64_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (unsigned) ((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static void
+ys_bs_nomem(void)
+{
+	fprintf(stdout, "Error allocating memory\n");
+	exit(1);
+}
+
+/**
+ * The number of bits in chunk i.
+ */
+static unsigned
+ys_bs_width(ys_bitset_t *bs, unsigned i)
+{
+	unsigned left = bs->size - i * YS_BS_CHUNKBITS;
+	return left < YS_BS_CHUNKBITS ? left : YS_BS_CHUNKBITS;
+}
+
+/**
+ * Empties a chunk, releasing its memory.
+ */
+static void
+ys_bs_chunk_free(ys_bs_chunk_t *c)
+{
+	free(c->u.values);
+	c->u.values = 0;
+	c->type = YS_BS_ARRAY;
+	c->card = 0;
+	c->n = 0;
+	c->alloc = 0;
+}
+
+/**
+ * Makes room for n values in an array or list of runs.
+ */
+static void
+ys_bs_reserve(ys_bs_chunk_t *c, unsigned n)
+{
+	if (n <= c->alloc)
+		return;
+	unsigned alloc = c->alloc > 0 ? c->alloc : 4;
+	while (alloc < n)
+		alloc *= 2;
+	ys_uint16_t *p = (ys_uint16_t *) realloc(c->u.values, 
+		alloc * sizeof *p);
+	if (p == 0)
+		ys_bs_nomem();
+	c->u.values = p;
+	c->alloc = alloc;
+}
+
+static ys_uint64_t *
+ys_bs_newwords(void)
+{
+	ys_uint64_t *words = (ys_uint64_t *) malloc(YS_BS_WORDS * sizeof *words);
+	if (words == 0)
+		ys_bs_nomem();
+	return words;
+}
+
+/**
+ * Sets bits first to last of a bitmap.
+ */
+static void
+ys_bs_setrange(ys_uint64_t *words, unsigned first, unsigned last)
+{
+	unsigned i = first / 64, j = last / 64;
+	ys_uint64_t fm = ~0ULL << (first % 64);
+	ys_uint64_t lm = ~0ULL >> (63 - last % 64);
+	if (i == j) {
+		words[i] |= fm & lm;
+		return;
+	}
+	words[i] |= fm;
+	for (i++; i < j; i++)
+		words[i] = ~0ULL;
+	words[j] |= lm;
+}
+
+/**
+ * Clears bits first to last of a bitmap.
+ */
+static void
+ys_bs_clearrange(ys_uint64_t *words, unsigned first, unsigned last)
+{
+	unsigned i = first / 64, j = last / 64;
+	ys_uint64_t fm = ~0ULL << (first % 64);
+	ys_uint64_t lm = ~0ULL >> (63 - last % 64);
+	if (i == j) {
+		words[i] &= ~(fm & lm);
+		return;
+	}
+	words[i] &= ~fm;
+	for (i++; i < j; i++)
+		words[i] = 0;
+	words[j] &= ~lm;
+}
+
+/**
+ * Finds the first bit of a bitmap at or after from that is set, or
+ * clear if flip is all ones. Returns YS_BS_CHUNKBITS if there is none.
+ */
+static unsigned
+ys_bs_scan(const ys_uint64_t *words, unsigned from, ys_uint64_t flip)
+{
+	if (from >= YS_BS_CHUNKBITS)
+		return YS_BS_CHUNKBITS;
+	unsigned i = from / 64;
+	ys_uint64_t w = (words[i] ^ flip) & (~0ULL << (from % 64));
+	while (w == 0) {
+		if (++i == YS_BS_WORDS)
+			return YS_BS_CHUNKBITS;
+		w = words[i] ^ flip;
+	}
+	return i * 64 + ys_ctz64(w);
+}
+
+/**
+ * The index of the first value >= v in a sorted array.
+ */
+static unsigned
+ys_bs_find(const ys_uint16_t *values, unsigned n, unsigned v)
+{
+	unsigned lo = 0, hi = n;
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+		if (values[mid] < v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * As ys_bs_find(), but starting at values[from] and doubling the
+ * step, for when successive values are looked up in order.
+ */
+static unsigned
+ys_bs_gallop(const ys_uint16_t *values, unsigned n, unsigned from, 
+	unsigned v)
+{
+	unsigned step = 1;
+	if (from >= n || values[from] >= v)
+		return from;
+	while (from + step < n && values[from + step] < v) {
+		from += step;
+		step *= 2;
+	}
+	unsigned hi = from + step < n ? from + step : n;
+	return from + 1 + ys_bs_find(values + from + 1, hi - from - 1, v);
+}
+
+/**
+ * The index of the first run that ends at or after v.
+ */
+static unsigned
+ys_bs_findrun(const ys_uint16_t *runs, unsigned n, unsigned v)
+{
+	unsigned lo = 0, hi = n;
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+		if (runs[2*mid+1] < v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static ys_bool_t
+ys_bs_chunk_has(const ys_bs_chunk_t *c, unsigned v)
+{
+	unsigned i;
+	if (c->card == 0)
+		return BOOL_FALSE;
+	switch (c->type) {
+	case YS_BS_BITMAP:
+		return (c->u.words[v / 64] >> (v % 64)) & 1;
+	case YS_BS_ARRAY:
+		i = ys_bs_find(c->u.values, c->n, v);
+		return i < c->n && c->u.values[i] == v;
+	default:
+		i = ys_bs_findrun(c->u.values, c->n, v);
+		return i < c->n && c->u.values[2*i] <= v;
+	}
+}
+
+/**
+ * Writes the members of a chunk to a bitmap.
+ */
+static void
+ys_bs_chunk_words(const ys_bs_chunk_t *c, ys_uint64_t *words)
+{
+	unsigned i;
+	if (c->type == YS_BS_BITMAP) {
+		memcpy(words, c->u.words, YS_BS_WORDS * sizeof *words);
+		return;
+	}
+	memset(words, 0, YS_BS_WORDS * sizeof *words);
+	if (c->type == YS_BS_ARRAY) {
+		for (i = 0; i < c->n; i++)
+			words[c->u.values[i] / 64] |= 1ULL << (c->u.values[i] % 64);
+	}
+	else {
+		for (i = 0; i < c->n; i++)
+			ys_bs_setrange(words, c->u.values[2*i], c->u.values[2*i+1]);
+	}
+}
+
+static void
+ys_bs_tobitmap(ys_bs_chunk_t *c)
+{
+	if (c->type == YS_BS_BITMAP)
+		return;
+	ys_uint64_t *words = ys_bs_newwords();
+	ys_bs_chunk_words(c, words);
+	free(c->u.values);
+	c->u.words = words;
+	c->type = YS_BS_BITMAP;
+	c->n = 0;
+	c->alloc = 0;
+}
+
+/**
+ * Turns a bitmap or runs into an array; card must be at most
+ * YS_BS_ARRAYMAX.
+ */
+static void
+ys_bs_toarray(ys_bs_chunk_t *c)
+{
+	unsigned i, k = 0;
+	if (c->type == YS_BS_ARRAY)
+		return;
+	unsigned alloc = c->card > 0 ? c->card : 1;
+	ys_uint16_t *values = (ys_uint16_t *) malloc(alloc * sizeof *values);
+	if (values == 0)
+		ys_bs_nomem();
+	if (c->type == YS_BS_BITMAP) {
+		for (i = 0; i < YS_BS_WORDS; i++) {
+			ys_uint64_t w = c->u.words[i];
+			while (w != 0) {
+				values[k++] = (ys_uint16_t) (i * 64 + ys_ctz64(w));
+				w &= w - 1;
+			}
+		}
+	}
+	else {
+		for (i = 0; i < c->n; i++) {
+			unsigned v;
+			for (v = c->u.values[2*i]; v <= c->u.values[2*i+1]; v++)
+				values[k++] = (ys_uint16_t) v;
+		}
+	}
+	free(c->u.values);
+	c->u.values = values;
+	c->type = YS_BS_ARRAY;
+	c->n = k;
+	c->alloc = alloc;
+}
+
+/**
+ * Turns a bitmap into nruns runs.
+ */
+static void
+ys_bs_toruns(ys_bs_chunk_t *c, unsigned nruns)
+{
+	ys_uint16_t *values = (ys_uint16_t *) malloc(2 * nruns * sizeof *values);
+	unsigned k = 0;
+	if (values == 0)
+		ys_bs_nomem();
+	unsigned first = ys_bs_scan(c->u.words, 0, 0);
+	while (first < YS_BS_CHUNKBITS) {
+		unsigned end = ys_bs_scan(c->u.words, first, ~0ULL);
+		values[k++] = (ys_uint16_t) first;
+		values[k++] = (ys_uint16_t) (end - 1);
+		first = ys_bs_scan(c->u.words, end, 0);
+	}
+	free(c->u.words);
+	c->u.values = values;
+	c->type = YS_BS_RUNS;
+	c->n = k / 2;
+	c->alloc = 2 * nruns;
+}
+
+/**
+ * Moves a chunk held as a bitmap, whose members have been counted, to
+ * the smallest form.
+ */
+static void
+ys_bs_settle(ys_bs_chunk_t *c)
+{
+	const ys_uint64_t *words = c->u.words;
+	/* runs take less room than a bitmap and the array */
+	unsigned limit = YS_BS_WORDS * 2;
+	unsigned nruns = 0, i;
+	ys_uint64_t carry = 0;
+
+	if (c->card == 0) {
+		ys_bs_chunk_free(c);
+		return;
+	}
+	if (2 * limit > c->card)
+		limit = c->card / 2 + 1;
+	for (i = 0; i < YS_BS_WORDS && nruns < limit; i++) {
+		ys_uint64_t w = words[i];
+		/* bits that start a run */
+		nruns += ys_popcount64(w & ~((w << 1) | carry));
+		carry = w >> 63;
+	}
+	if (nruns < limit)
+		ys_bs_toruns(c, nruns);
+	else if (c->card <= YS_BS_ARRAYMAX)
+		ys_bs_toarray(c);
+}
+
+/**
+ * Counts the members of a chunk held as a bitmap, and moves it to the
+ * smallest form.
+ */
+static void
+ys_bs_pack(ys_bs_chunk_t *c)
+{
+	unsigned card = 0, i;
+	for (i = 0; i < YS_BS_WORDS; i++)
+		card += ys_popcount64(c->u.words[i]);
+	c->card = card;
+	ys_bs_settle(c);
+}
+
+static void
+ys_bs_chunk_copy(ys_bs_chunk_t *dst, const ys_bs_chunk_t *src)
+{
+	ys_bs_chunk_free(dst);
+	if (src->card == 0)
+		return;
+	if (src->type == YS_BS_BITMAP) {
+		dst->u.words = ys_bs_newwords();
+		memcpy(dst->u.words, src->u.words, YS_BS_WORDS * sizeof *src->u.words);
+	}
+	else {
+		unsigned n = src->type == YS_BS_RUNS ? 2 * src->n : src->n;
+		ys_bs_reserve(dst, n);
+		memcpy(dst->u.values, src->u.values, n * sizeof *src->u.values);
+	}
+	dst->type = src->type;
+	dst->card = src->card;
+	dst->n = src->n;
+}
+
+/**
+ * Replaces the values of an array chunk.
+ */
+static void
+ys_bs_setarray(ys_bs_chunk_t *c, ys_uint16_t *values, unsigned n, 
+	unsigned alloc)
+{
+	free(c->u.values);
+	c->u.values = values;
+	c->type = YS_BS_ARRAY;
+	c->card = n;
+	c->n = n;
+	c->alloc = alloc;
+	if (n == 0)
+		ys_bs_chunk_free(c);
+}
+
+static void
+ys_bs_chunk_or(ys_bs_chunk_t *c1, const ys_bs_chunk_t *c2)
+{
+	unsigned i;
+	if (c2->card == 0)
+		return;
+	if (c1->card == 0) {
+		ys_bs_chunk_copy(c1, c2);
+		return;
+	}
+	if (c1->type == YS_BS_ARRAY && c2->type == YS_BS_ARRAY && 
+		c1->n + c2->n <= YS_BS_ARRAYMAX) {
+		unsigned n = c1->n + c2->n, j = 0, k = 0;
+		ys_uint16_t *values = (ys_uint16_t *) malloc(n * sizeof *values);
+		if (values == 0)
+			ys_bs_nomem();
+		const ys_uint16_t *a = c1->u.values, *b = c2->u.values;
+		for (i = 0; i < c1->n || j < c2->n; ) {
+			if (j == c2->n || (i < c1->n && a[i] < b[j]))
+				values[k++] = a[i++];
+			else if (i == c1->n || b[j] < a[i])
+				values[k++] = b[j++];
+			else {
+				values[k++] = a[i++];
+				j++;
+			}
+		}
+		ys_bs_setarray(c1, values, k, n);
+		return;
+	}
+	ys_bs_tobitmap(c1);
+	ys_uint64_t *words = c1->u.words;
+	switch (c2->type) {
+	case YS_BS_ARRAY:
+		for (i = 0; i < c2->n; i++)
+			words[c2->u.values[i] / 64] |= 1ULL << (c2->u.values[i] % 64);
+		break;
+	case YS_BS_RUNS:
+		for (i = 0; i < c2->n; i++)
+			ys_bs_setrange(words, c2->u.values[2*i], c2->u.values[2*i+1]);
+		break;
+	default:
+		c1->card = 0;
+		for (i = 0; i < YS_BS_WORDS; i++) {
+			words[i] |= c2->u.words[i];
+			c1->card += ys_popcount64(words[i]);
+		}
+		ys_bs_settle(c1);
+		return;
+	}
+	ys_bs_pack(c1);
+}
+
+/**
+ * Keeps the members of an array chunk that are (keep) or are not in 
+ * another chunk.
+ */
+static void
+ys_bs_filter(ys_bs_chunk_t *c1, const ys_bs_chunk_t *c2, ys_bool_t keep)
+{
+	unsigned i, j = 0, k = 0;
+	ys_uint16_t *a = c1->u.values;
+	for (i = 0; i < c1->n; i++) {
+		ys_bool_t has;
+		if (c2->type == YS_BS_ARRAY) {
+			j = ys_bs_gallop(c2->u.values, c2->n, j, a[i]);
+			has = j < c2->n && c2->u.values[j] == a[i];
+		}
+		else
+			has = ys_bs_chunk_has(c2, a[i]);
+		if ((has != 0) == (keep != 0))
+			a[k++] = a[i];
+	}
+	c1->n = k;
+	c1->card = k;
+	if (k == 0)
+		ys_bs_chunk_free(c1);
+}
+
+static void
+ys_bs_chunk_and(ys_bs_chunk_t *c1, const ys_bs_chunk_t *c2)
+{
+	unsigned i;
+	if (c1->card == 0)
+		return;
+	if (c2->card == 0) {
+		ys_bs_chunk_free(c1);
+		return;
+	}
+	if (c1->type == YS_BS_ARRAY) {
+		ys_bs_filter(c1, c2, BOOL_TRUE);
+		return;
+	}
+	if (c2->type == YS_BS_ARRAY) {
+		/* The result is no larger than c2 */
+		unsigned k = 0;
+		ys_uint16_t *values = (ys_uint16_t *) malloc(c2->n * sizeof *values);
+		if (values == 0)
+			ys_bs_nomem();
+		for (i = 0; i < c2->n; i++) {
+			if (ys_bs_chunk_has(c1, c2->u.values[i]))
+				values[k++] = c2->u.values[i];
+		}
+		ys_bs_setarray(c1, values, k, c2->n);
+		return;
+	}
+	ys_bs_tobitmap(c1);
+	ys_uint64_t *words = c1->u.words;
+	if (c2->type == YS_BS_BITMAP) {
+		c1->card = 0;
+		for (i = 0; i < YS_BS_WORDS; i++) {
+			words[i] &= c2->u.words[i];
+			c1->card += ys_popcount64(words[i]);
+		}
+		ys_bs_settle(c1);
+		return;
+	}
+	else {
+		/* Clear the gaps between the runs */
+		unsigned next = 0;
+		for (i = 0; i < c2->n; i++) {
+			if (c2->u.values[2*i] > next)
+				ys_bs_clearrange(words, next, c2->u.values[2*i] - 1);
+			next = c2->u.values[2*i+1] + 1;
+		}
+		if (next < YS_BS_CHUNKBITS)
+			ys_bs_clearrange(words, next, YS_BS_CHUNKBITS - 1);
+	}
+	ys_bs_pack(c1);
+}
+
+static void
+ys_bs_chunk_andnot(ys_bs_chunk_t *c1, const ys_bs_chunk_t *c2)
+{
+	unsigned i;
+	if (c1->card == 0 || c2->card == 0)
+		return;
+	if (c1->type == YS_BS_ARRAY) {
+		ys_bs_filter(c1, c2, BOOL_FALSE);
+		return;
+	}
+	ys_bs_tobitmap(c1);
+	ys_uint64_t *words = c1->u.words;
+	switch (c2->type) {
+	case YS_BS_ARRAY:
+		for (i = 0; i < c2->n; i++)
+			words[c2->u.values[i] / 64] &= ~(1ULL << (c2->u.values[i] % 64));
+		break;
+	case YS_BS_RUNS:
+		for (i = 0; i < c2->n; i++)
+			ys_bs_clearrange(words, c2->u.values[2*i], c2->u.values[2*i+1]);
+		break;
+	default:
+		c1->card = 0;
+		for (i = 0; i < YS_BS_WORDS; i++) {
+			words[i] &= ~c2->u.words[i];
+			c1->card += ys_popcount64(words[i]);
+		}
+		ys_bs_settle(c1);
+		return;
+	}
+	ys_bs_pack(c1);
+}
+
 /**
  * Allocate a new bitset.
  */
@@ -39,19 +610,15 @@ ys_bitset_t *
 ys_bs_alloc( unsigned size )
 {
 	ys_bitset_t *bs = (ys_bitset_t *)calloc(1, sizeof(ys_bitset_t));
-	if (bs == 0) {
-		fprintf(stdout, "Error allocating memory\n");
-		exit(1);
-	}
-        bs->n = YS_DIVIDE_AND_ROUNDUP(size, ESIZE);
-
-        bs->data = (unsigned *)calloc(bs->n, sizeof(unsigned));
-	if (bs->data == 0) {
-		fprintf(stdout, "Error allocating memory\n");
-		exit(1);
-	}
-        bs->size = size;
-        return bs;
+	if (bs == 0)
+		ys_bs_nomem();
+	bs->n = YS_DIVIDE_AND_ROUNDUP(size, YS_BS_CHUNKBITS);
+	bs->chunks = (ys_bs_chunk_t *)calloc(bs->n > 0 ? bs->n : 1, 
+		sizeof(ys_bs_chunk_t));
+	if (bs->chunks == 0)
+		ys_bs_nomem();
+	bs->size = size;
+	return bs;
 }
 
 /**
@@ -60,31 +627,54 @@ ys_bs_alloc( unsigned size )
 ys_bool_t
 ys_bs_ismember( ys_bitset_t *bs, unsigned bit )
 {
-	unsigned n;
-        if ( bit >= bs->size )
-        	return BOOL_FALSE;
-        n = bit / ESIZE;
-        bit = bit % ESIZE;
-        if (bs->data[n] & (1 << bit))
-			return BOOL_TRUE;
+	if ( bit >= bs->size )
 		return BOOL_FALSE;
+	return ys_bs_chunk_has(&bs->chunks[bit / YS_BS_CHUNKBITS], 
+		bit % YS_BS_CHUNKBITS);
 }
 
 /**
- * Add a new member.
+ * Add a new member. Returns non-zero if it was already a member.
  */
 unsigned
 ys_bs_addmember( ys_bitset_t *bs, unsigned bit )
 {
-	unsigned n;
-        unsigned oldbit = 0;
-        if ( bit >= bs->size )
-        	return oldbit;
-        n = bit / ESIZE;
-        bit = bit % ESIZE;
-        oldbit = bs->data[n] & (1 << bit);
-        bs->data[n] |= (1 << bit);
-        return oldbit;
+	if ( bit >= bs->size )
+		return 0;
+	ys_bs_chunk_t *c = &bs->chunks[bit / YS_BS_CHUNKBITS];
+	unsigned v = bit % YS_BS_CHUNKBITS;
+	if (c->type == YS_BS_RUNS) {
+		if (ys_bs_chunk_has(c, v))
+			return 1;
+		if (c->card < YS_BS_ARRAYMAX)
+			ys_bs_toarray(c);
+		else
+			ys_bs_tobitmap(c);
+	}
+	if (c->type == YS_BS_ARRAY) {
+		/* Members are mostly added in order */
+		unsigned i = c->n > 0 && c->u.values[c->n-1] < v ? c->n :
+			ys_bs_find(c->u.values, c->n, v);
+		if (i < c->n && c->u.values[i] == v)
+			return 1;
+		if (c->n < YS_BS_ARRAYMAX) {
+			ys_bs_reserve(c, c->n + 1);
+			memmove(c->u.values + i + 1, c->u.values + i, 
+				(c->n - i) * sizeof *c->u.values);
+			c->u.values[i] = (ys_uint16_t) v;
+			c->n++;
+			c->card++;
+			return 0;
+		}
+		ys_bs_tobitmap(c);
+	}
+	ys_uint64_t *w = &c->u.words[v / 64];
+	ys_uint64_t mask = 1ULL << (v % 64);
+	if (*w & mask)
+		return 1;
+	*w |= mask;
+	c->card++;
+	return 0;
 }
 
 /**
@@ -94,10 +684,17 @@ void
 ys_bs_setall( ys_bitset_t *bs )
 {
 	unsigned i;
-        unsigned bit = ~0;
-        for (i = 0; i < bs->n; i++) {
-        	bs->data[i] = bit;
-        }
+	for (i = 0; i < bs->n; i++) {
+		ys_bs_chunk_t *c = &bs->chunks[i];
+		unsigned width = ys_bs_width(bs, i);
+		ys_bs_chunk_free(c);
+		ys_bs_reserve(c, 2);
+		c->u.values[0] = 0;
+		c->u.values[1] = (ys_uint16_t) (width - 1);
+		c->type = YS_BS_RUNS;
+		c->n = 1;
+		c->card = width;
+	}
 }
 
 /**
@@ -107,10 +704,8 @@ void
 ys_bs_clear( ys_bitset_t *bs )
 {
 	unsigned i;
-        unsigned bit = 0;
-        for (i = 0; i < bs->n; i++) {
-        	bs->data[i] = bit;
-        }
+	for (i = 0; i < bs->n; i++)
+		ys_bs_chunk_free(&bs->chunks[i]);
 }
 
 /**
@@ -119,10 +714,48 @@ ys_bs_clear( ys_bitset_t *bs )
 void
 ys_bs_complement( ys_bitset_t *bs )
 {
-	unsigned i;
-        for (i = 0; i < bs->n; i++) {
-        	bs->data[i] = ~(bs->data[i]);
-        }
+	unsigned i, j;
+	for (i = 0; i < bs->n; i++) {
+		ys_bs_chunk_t *c = &bs->chunks[i];
+		unsigned width = ys_bs_width(bs, i);
+		if (c->type == YS_BS_ARRAY && c->card > 0) {
+			ys_bs_tobitmap(c);
+		}
+		if (c->type == YS_BS_BITMAP) {
+			for (j = 0; j < YS_BS_WORDS; j++)
+				c->u.words[j] = ~c->u.words[j];
+			if (width < YS_BS_CHUNKBITS)
+				ys_bs_clearrange(c->u.words, width, YS_BS_CHUNKBITS - 1);
+			ys_bs_pack(c);
+			continue;
+		}
+		/* The gaps between the runs become the runs */
+		unsigned alloc = 2 * (c->n + 1);
+		ys_uint16_t *values = (ys_uint16_t *) malloc(alloc * sizeof *values);
+		unsigned k = 0, next = 0;
+		if (values == 0)
+			ys_bs_nomem();
+		for (j = 0; j < c->n; j++) {
+			if (c->u.values[2*j] > next) {
+				values[k++] = (ys_uint16_t) next;
+				values[k++] = c->u.values[2*j] - 1;
+			}
+			next = c->u.values[2*j+1] + 1;
+		}
+		if (next < width) {
+			values[k++] = (ys_uint16_t) next;
+			values[k++] = (ys_uint16_t) (width - 1);
+		}
+		unsigned card = width - c->card;
+		free(c->u.values);
+		c->u.values = values;
+		c->type = YS_BS_RUNS;
+		c->n = k / 2;
+		c->alloc = alloc;
+		c->card = card;
+		if (card == 0)
+			ys_bs_chunk_free(c);
+	}
 }
 
 /**
@@ -131,12 +764,54 @@ ys_bs_complement( ys_bitset_t *bs )
 void
 ys_bs_delmember( ys_bitset_t *bs, unsigned bit )
 {
-	unsigned n;
-        if ( bit >= bs->size )
-        	return;
-        n = bit / ESIZE;
-        bit = bit % ESIZE;
-        bs->data[n] &= ~(1 << bit);
+	if ( bit >= bs->size )
+		return;
+	ys_bs_chunk_t *c = &bs->chunks[bit / YS_BS_CHUNKBITS];
+	unsigned v = bit % YS_BS_CHUNKBITS;
+	unsigned i;
+	if (!ys_bs_chunk_has(c, v))
+		return;
+	switch (c->type) {
+	case YS_BS_ARRAY:
+		i = ys_bs_find(c->u.values, c->n, v);
+		memmove(c->u.values + i, c->u.values + i + 1, 
+			(c->n - i - 1) * sizeof *c->u.values);
+		c->n--;
+		break;
+	case YS_BS_BITMAP:
+		c->u.words[v / 64] &= ~(1ULL << (v % 64));
+		break;
+	default: {
+		ys_uint16_t *r;
+		i = ys_bs_findrun(c->u.values, c->n, v);
+		r = c->u.values + 2*i;
+		if (r[0] == r[1]) {
+			memmove(r, r + 2, 2 * (c->n - i - 1) * sizeof *r);
+			c->n--;
+		}
+		else if (r[0] == v)
+			r[0]++;
+		else if (r[1] == v)
+			r[1]--;
+		else {
+			/* Split the run */
+			ys_bs_reserve(c, 2 * (c->n + 1));
+			r = c->u.values + 2*i;
+			memmove(r + 2, r, 2 * (c->n - i) * sizeof *r);
+			r[1] = (ys_uint16_t) (v - 1);
+			r[2] = (ys_uint16_t) (v + 1);
+			c->n++;
+		}
+		break;
+	}
+	}
+	c->card--;
+	if (c->card == 0)
+		ys_bs_chunk_free(c);
+	else if (c->type == YS_BS_BITMAP && c->card <= YS_BS_ARRAYMAX / 2)
+		/* well below the limit, so that a set does not keep changing 
+		 * form as members are added and removed */
+		ys_bs_toarray(c);
 }
 
 /**
@@ -145,13 +820,12 @@ ys_bs_delmember( ys_bitset_t *bs, unsigned bit )
 ys_bitset_t *
 ys_bs_union( ys_bitset_t *bs1, ys_bitset_t *bs2 )
 {
-        unsigned i;
+	unsigned i;
 
-        assert(bs1->size == bs2->size);
-        for (i = 0; i < bs1->n; i++) {
-        	bs1->data[i] |= bs2->data[i];
-	}
-        return bs1;
+	assert(bs1->size == bs2->size);
+	for (i = 0; i < bs1->n; i++)
+		ys_bs_chunk_or(&bs1->chunks[i], &bs2->chunks[i]);
+	return bs1;
 }
 
 /**
@@ -160,16 +834,10 @@ ys_bs_union( ys_bitset_t *bs1, ys_bitset_t *bs2 )
 ys_bitset_t *
 ys_bs_union2( ys_bitset_t *bs1, ys_bitset_t *bs2, ys_bitset_t *bs3 )
 {
-        unsigned i;
-
-        assert(bs1->size == bs2->size);
-        if (bs3 == 0)
-        	bs3 = ys_bs_alloc(bs1->size);
-
-        for (i = 0; i < bs1->n; i++) {
-        	bs3->data[i] = bs1->data[i] | bs2->data[i];
-	}
-        return bs3;
+	assert(bs1->size == bs2->size);
+	if (bs3 == bs2)
+		return ys_bs_union(bs3, bs1);
+	return ys_bs_union(ys_bs_clone(bs3, bs1), bs2);
 }
 
 /**
@@ -180,11 +848,10 @@ ys_bs_intersect( ys_bitset_t *bs1, ys_bitset_t *bs2 )
 {
 	unsigned i;
 
-        assert(bs1->size == bs2->size);
-        for (i = 0; i < bs1->n; i++) {
-        	bs1->data[i] &= bs2->data[i];
-        }
-        return bs1;
+	assert(bs1->size == bs2->size);
+	for (i = 0; i < bs1->n; i++)
+		ys_bs_chunk_and(&bs1->chunks[i], &bs2->chunks[i]);
+	return bs1;
 }
 
 /**
@@ -193,16 +860,10 @@ ys_bs_intersect( ys_bitset_t *bs1, ys_bitset_t *bs2 )
 ys_bitset_t *
 ys_bs_intersect2( ys_bitset_t *bs1, ys_bitset_t *bs2, ys_bitset_t *bs3 )
 {
-	unsigned i;
-
-        assert(bs1->size == bs2->size);
-        if (bs3 == 0)
-        	bs3 = ys_bs_alloc(bs1->size);
-
-        for (i = 0; i < bs1->n; i++) {
-        	bs3->data[i] = bs1->data[i] & bs2->data[i];
-        }
-        return bs1;
+	assert(bs1->size == bs2->size);
+	if (bs3 == bs2)
+		return ys_bs_intersect(bs3, bs1);
+	return ys_bs_intersect(ys_bs_clone(bs3, bs1), bs2);
 }
 
 /**
@@ -213,11 +874,10 @@ ys_bs_minus( ys_bitset_t *bs1, ys_bitset_t *bs2 )
 {
 	unsigned i;
 
-        assert(bs1->size == bs2->size);
-        for (i = 0; i < bs1->n; i++) {
-        	bs1->data[i] = bs1->data[i] & ~(bs2->data[i]);
-        }
-        return bs1;
+	assert(bs1->size == bs2->size);
+	for (i = 0; i < bs1->n; i++)
+		ys_bs_chunk_andnot(&bs1->chunks[i], &bs2->chunks[i]);
+	return bs1;
 }
 
 /**
@@ -226,16 +886,14 @@ ys_bs_minus( ys_bitset_t *bs1, ys_bitset_t *bs2 )
 ys_bitset_t *
 ys_bs_minus2( ys_bitset_t *bs1, ys_bitset_t *bs2, ys_bitset_t *bs3 )
 {
-	unsigned i;
-
-        assert(bs1->size == bs2->size);
-        if (bs3 == 0)
-        	bs3 = ys_bs_alloc(bs1->size);
-
-        for (i = 0; i < bs1->n; i++) {
-        	bs3->data[i] = bs1->data[i] & ~(bs2->data[i]);
-        }
-        return bs1;
+	assert(bs1->size == bs2->size);
+	if (bs3 != 0 && bs3 == bs2) {
+		ys_bitset_t *bs = ys_bs_minus(ys_bs_clone(0, bs1), bs2);
+		ys_bs_clone(bs3, bs);
+		ys_bs_destroy(bs);
+		return bs3;
+	}
+	return ys_bs_minus(ys_bs_clone(bs3, bs1), bs2);
 }
 
 /** 
@@ -246,37 +904,17 @@ ys_bs_clone( ys_bitset_t *bs1, ys_bitset_t *bs2 )
 {
 	unsigned i;
 
-        if (bs1 == 0)
-        	bs1 = ys_bs_alloc(bs2->size);
-        for (i = 0; i < bs1->n; i++) {
-        	bs1->data[i] = bs2->data[i];
-        }
-        return bs1;
-}
-
-/**
- * Slower version of iterate()
- */
-void
-ys_bs_iterate1( ys_bitset_t *bs, int flag, ys_bool_t (*f)( void *, unsigned, ys_bool_t ), void *arg )
-{
-        unsigned i;
-        for (i = 0; i < bs->size; i++) {
-		unsigned n, bit;
-                ys_bool_t is_set;
-
-	        n = i / ESIZE;
-	        bit = i % ESIZE;
-        	is_set = (bs->data[n] & (1 << bit));
-                if ( is_set ) {
-	                if ( !f(arg, i, BOOL_TRUE) )
-        	        	break;
-                }
-                else if ( flag == YS_BS_ITER_ALL ) {
-	                if ( !f(arg, i, BOOL_FALSE) )
-        	        	break;
-                }
-        }
+	if (bs1 == 0)
+		bs1 = ys_bs_alloc(bs2->size);
+	if (bs1 == bs2)
+		return bs1;
+	if (bs1->size != bs2->size) {
+		ys_bs_clear(bs1);
+		ys_bs_resize(bs1, bs2->size);
+	}
+	for (i = 0; i < bs1->n; i++)
+		ys_bs_chunk_copy(&bs1->chunks[i], &bs2->chunks[i]);
+	return bs1;
 }
 
 /**
@@ -287,28 +925,53 @@ ys_bs_iterate1( ys_bitset_t *bs, int flag, ys_bool_t (*f)( void *, unsigned, ys_
 void
 ys_bs_iterate( ys_bitset_t *bs, int flag, ys_bool_t (*f)( void *, unsigned, ys_bool_t ), void *arg )
 {
-        unsigned i, j;
-        unsigned bit = 0;
-        for (i = 0; i < bs->n && bit < bs->size; i++) {
-	        unsigned mask = 1;
-		for (j = 0; j < ESIZE && bit < bs->size; j++) {
-                	ys_bool_t is_set;
-
-	        	is_set = (bs->data[i] & mask) != 0;
+	unsigned i, j, bit;
 
-	                if ( is_set ) {
-		                if ( !f(arg, bit, BOOL_TRUE) )
-	        	        	return;
-	                }
-	                else if ( flag == YS_BS_ITER_ALL ) {
-		                if ( !f(arg, bit, BOOL_FALSE) )
-	        	        	return;
-	                }
-                        if (++bit == bs->size)
-                        	return;
-                        mask <<= 1;
-                }
-        }
+	if (flag == YS_BS_ITER_ALL) {
+		unsigned next = ys_bs_next(bs, 0);
+		for (bit = 0; bit < bs->size; bit++) {
+			ys_bool_t is_set = bit == next;
+			if (is_set)
+				next = ys_bs_next(bs, bit + 1);
+			if (!f(arg, bit, is_set))
+				return;
+		}
+		return;
+	}
+	for (i = 0; i < bs->n; i++) {
+		const ys_bs_chunk_t *c = &bs->chunks[i];
+		unsigned base = i * YS_BS_CHUNKBITS;
+		if (c->card == 0)
+			continue;
+		switch (c->type) {
+		case YS_BS_ARRAY:
+			for (j = 0; j < c->n; j++) {
+				if (!f(arg, base + c->u.values[j], BOOL_TRUE))
+					return;
+			}
+			break;
+		case YS_BS_RUNS:
+			for (j = 0; j < c->n; j++) {
+				for (bit = c->u.values[2*j]; bit <= c->u.values[2*j+1]; 
+					bit++) {
+					if (!f(arg, base + bit, BOOL_TRUE))
+						return;
+				}
+			}
+			break;
+		default:
+			for (j = 0; j < YS_BS_WORDS; j++) {
+				ys_uint64_t w = c->u.words[j];
+				while (w != 0) {
+					bit = j * 64 + ys_ctz64(w);
+					if (!f(arg, base + bit, BOOL_TRUE))
+						return;
+					w &= w - 1;
+				}
+			}
+			break;
+		}
+	}
 }
 
 /**
@@ -316,53 +979,194 @@ ys_bs_iterate( ys_bitset_t *bs, int flag, ys_bool_t (*f)( void *, unsigned, ys_b
  */
 unsigned ys_bs_count( ys_bitset_t *bs )
 {
-	/* This array was generated using bt.c */
-static unsigned bitcount[] = {
-0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,1,2,2,3,2,3,3,4,2,3,3,4,3,4,
-4,5,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,
-5,5,6,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,
-4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,
-6,5,6,6,7,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,
-4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,
-5,5,6,5,6,6,7,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,
-4,5,5,6,5,6,6,7,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,4,5,5,6,5,6,6,
-7,5,6,6,7,6,7,7,8};
-
-	unsigned n;
-	unsigned char *cp;
-	unsigned u;
+	unsigned i;
 	unsigned count = 0;
-	unsigned left;
-	unsigned last;
-	unsigned mask;
-
-	n = bs->n-1;
-	cp = (unsigned char *)bs->data;
-	for (u = 0, count = 0; u < NBYTES(n); u++) {
-		count += bitcount[*cp];
-		cp++;
-	}
-	left = bs->size - (n * ESIZE);
-	last = bs->data[n];
-	for (u = 0, mask = 1; u < left; u++) {
-		if (mask & last)
-			count++;
-		mask <<= 1;
-	}
+	for (i = 0; i < bs->n; i++)
+		count += bs->chunks[i].card;
 	return count;
 }	
 
+unsigned
+ys_bs_next( ys_bitset_t *bs, unsigned bit )
+{
+	unsigned i, v, k;
+
+	for (i = bit / YS_BS_CHUNKBITS, v = bit % YS_BS_CHUNKBITS; i < bs->n; 
+		i++, v = 0) {
+		const ys_bs_chunk_t *c = &bs->chunks[i];
+		if (c->card == 0)
+			continue;
+		switch (c->type) {
+		case YS_BS_ARRAY:
+			k = ys_bs_find(c->u.values, c->n, v);
+			if (k < c->n)
+				return i * YS_BS_CHUNKBITS + c->u.values[k];
+			break;
+		case YS_BS_RUNS:
+			k = ys_bs_findrun(c->u.values, c->n, v);
+			if (k < c->n) 
+				return i * YS_BS_CHUNKBITS + 
+					(c->u.values[2*k] > v ? c->u.values[2*k] : v);
+			break;
+		default:
+			k = ys_bs_scan(c->u.words, v, 0);
+			if (k < YS_BS_CHUNKBITS)
+				return i * YS_BS_CHUNKBITS + k;
+			break;
+		}
+	}
+	return bs->size;
+}
+
+unsigned
+ys_bs_getmembers( ys_bitset_t *bs, unsigned bit, unsigned *members, 
+	unsigned max )
+{
+	unsigned i, v, k, n = 0;
+
+	for (i = bit / YS_BS_CHUNKBITS, v = bit % YS_BS_CHUNKBITS; 
+		i < bs->n && n < max; i++, v = 0) {
+		const ys_bs_chunk_t *c = &bs->chunks[i];
+		unsigned base = i * YS_BS_CHUNKBITS;
+		if (c->card == 0)
+			continue;
+		switch (c->type) {
+		case YS_BS_ARRAY:
+			for (k = ys_bs_find(c->u.values, c->n, v); k < c->n && n < max;
+				k++)
+				members[n++] = base + c->u.values[k];
+			break;
+		case YS_BS_RUNS:
+			for (k = ys_bs_findrun(c->u.values, c->n, v); k < c->n && 
+				n < max; k++) {
+				if (c->u.values[2*k] > v)
+					v = c->u.values[2*k];
+				for (; v <= c->u.values[2*k+1] && n < max; v++)
+					members[n++] = base + v;
+			}
+			break;
+		default: {
+			unsigned j = v / 64;
+			ys_uint64_t w = c->u.words[j] & (~0ULL << (v % 64));
+			for (;;) {
+				while (w != 0 && n < max) {
+					members[n++] = base + j * 64 + ys_ctz64(w);
+					w &= w - 1;
+				}
+				if (n == max || ++j == YS_BS_WORDS)
+					break;
+				w = c->u.words[j];
+			}
+			break;
+		}
+		}
+	}
+	return n;
+}
+
+void
+ys_bs_resize( ys_bitset_t *bs, unsigned size )
+{
+	unsigned n = YS_DIVIDE_AND_ROUNDUP(size, YS_BS_CHUNKBITS);
+	unsigned i;
+
+	for (i = n; i < bs->n; i++)
+		ys_bs_chunk_free(&bs->chunks[i]);
+	if (n != bs->n) {
+		ys_bs_chunk_t *p = (ys_bs_chunk_t *) realloc(bs->chunks, 
+			(n > 0 ? n : 1) * sizeof *p);
+		if (p == 0)
+			ys_bs_nomem();
+		for (i = bs->n; i < n; i++)
+			memset(&p[i], 0, sizeof p[i]);
+		bs->chunks = p;
+	}
+	if (size < bs->size && size % YS_BS_CHUNKBITS != 0) {
+		ys_bs_chunk_t *c = &bs->chunks[n-1];
+		if (c->card > 0) {
+			ys_bs_tobitmap(c);
+			ys_bs_clearrange(c->u.words, size % YS_BS_CHUNKBITS, 
+				YS_BS_CHUNKBITS - 1);
+			ys_bs_pack(c);
+		}
+	}
+	bs->n = n;
+	bs->size = size;
+}
+
+unsigned long
+ys_bs_memory( ys_bitset_t *bs )
+{
+	unsigned long bytes = sizeof *bs + bs->n * sizeof *bs->chunks;
+	unsigned i;
+	for (i = 0; i < bs->n; i++) {
+		const ys_bs_chunk_t *c = &bs->chunks[i];
+		if (c->type == YS_BS_BITMAP)
+			bytes += YS_BS_WORDS * sizeof *c->u.words;
+		else
+			bytes += c->alloc * sizeof *c->u.values;
+	}
+	return bytes;
+}
+
+unsigned
+ys_bs_nwords( unsigned size )
+{
+	return YS_DIVIDE_AND_ROUNDUP(size, ESIZE);
+}
+
+void
+ys_bs_getwords( ys_bitset_t *bs, unsigned *words )
+{
+	unsigned bit;
+	memset(words, 0, ys_bs_nwords(bs->size) * sizeof *words);
+	for (bit = ys_bs_next(bs, 0); bit < bs->size; 
+		bit = ys_bs_next(bs, bit + 1))
+		words[bit / ESIZE] |= 1U << (bit % ESIZE);
+}
+
+void
+ys_bs_setwords( ys_bitset_t *bs, const unsigned *words )
+{
+	unsigned nwords = ys_bs_nwords(bs->size);
+	unsigned i, j;
+
+	assert(ESIZE == 32);
+	ys_bs_clear(bs);
+	for (i = 0; i < bs->n; i++) {
+		ys_bs_chunk_t *c = &bs->chunks[i];
+		unsigned first = i * (YS_BS_CHUNKBITS / ESIZE);
+		unsigned width = ys_bs_width(bs, i);
+		ys_bs_tobitmap(c);
+		for (j = 0; j < YS_BS_WORDS; j++) {
+			unsigned k = first + 2*j;
+			ys_uint64_t w = 0;
+			if (k < nwords)
+				w = words[k];
+			if (k + 1 < nwords)
+				w |= (ys_uint64_t) words[k+1] << 32;
+			c->u.words[j] = w;
+		}
+		if (width < YS_BS_CHUNKBITS)
+			ys_bs_clearrange(c->u.words, width, YS_BS_CHUNKBITS - 1);
+		ys_bs_pack(c);
+	}
+}
+
 /**
  * Free memory allocated to a bitset.
  */
 void
 ys_bs_destroy( ys_bitset_t *bs )
 {
-	free(bs->data);
-	bs->data = 0;
+	ys_bs_clear(bs);
+	free(bs->chunks);
+	bs->chunks = 0;
 	free(bs);
 }
 
+#ifdef TEST_BITSET
+
 ys_bool_t
 printset( void *arg, unsigned bit, ys_bool_t is_set )
 {
@@ -440,8 +1244,338 @@ int testbitset(void)
         return 0;
 }
 
-int ymain()
+/*
+ * Checks the sets against a plain array of bits, as sets were held
+ * before, with members chosen at random.
+ */
+
+typedef struct {
+	unsigned *data;
+	unsigned size;
+	unsigned n;
+} ys_flatset_t;
+
+static ys_flatset_t *
+flat_alloc( unsigned size )
+{
+	ys_flatset_t *fs = (ys_flatset_t *)calloc(1, sizeof *fs);
+	fs->n = YS_DIVIDE_AND_ROUNDUP(size, ESIZE);
+	fs->data = (unsigned *)calloc(fs->n, sizeof(unsigned));
+	fs->size = size;
+	return fs;
+}
+
+static void
+flat_destroy( ys_flatset_t *fs )
+{
+	free(fs->data);
+	free(fs);
+}
+
+static int
+flat_ismember( ys_flatset_t *fs, unsigned bit )
+{
+	return bit < fs->size && (fs->data[bit / ESIZE] & (1U << (bit % ESIZE)));
+}
+
+static void
+flat_addmember( ys_flatset_t *fs, unsigned bit )
+{
+	fs->data[bit / ESIZE] |= 1U << (bit % ESIZE);
+}
+
+static unsigned long ys_bs_seed = 1;
+
+static unsigned
+ys_bs_random( unsigned n )
+{
+	ys_bs_seed = ys_bs_seed * 1103515245UL + 12345UL;
+	return (unsigned) ((ys_bs_seed >> 8) % n);
+}
+
+/**
+ * Adds members to a set and its reference: about one in every in 
+ * each of the first half of the chunks, and in the others runs of 
+ * about len members.
+ */
+static void
+fill( ys_bitset_t *bs, ys_flatset_t *fs, unsigned every, unsigned len )
+{
+	unsigned bit;
+	for (bit = 0; bit < bs->size; bit++) {
+		unsigned in;
+		if ((bit / YS_BS_CHUNKBITS) % 2 == 0)
+			in = ys_bs_random(every) == 0;
+		else
+			in = (bit / len) % every == 0;
+		if (in) {
+			ys_bs_addmember(bs, bit);
+			flat_addmember(fs, bit);
+		}
+	}
+}
+
+static void
+check( ys_bitset_t *bs, ys_flatset_t *fs )
+{
+	unsigned bit, count = 0;
+	unsigned next = ys_bs_next(bs, 0);
+	for (bit = 0; bit < fs->size; bit++) {
+		int in = flat_ismember(fs, bit) != 0;
+		assert(in == (ys_bs_ismember(bs, bit) != 0));
+		if (in) {
+			assert(next == bit);
+			next = ys_bs_next(bs, bit + 1);
+			count++;
+		}
+	}
+	assert(next == bs->size);
+	assert(ys_bs_count(bs) == count);
+	assert(count_using_iterator(bs) == count);
+}
+
+static void
+testrandom( unsigned size )
+{
+	static const unsigned every[] = { 1, 2, 7, 30, 300, 5000 };
+	unsigned i, j, k, bit;
+
+	for (i = 0; i < sizeof every / sizeof every[0]; i++) {
+		for (j = 0; j < sizeof every / sizeof every[0]; j++) {
+			ys_bitset_t *a = ys_bs_alloc(size), *b = ys_bs_alloc(size);
+			ys_flatset_t *fa = flat_alloc(size), *fb = flat_alloc(size);
+			fill(a, fa, every[i], 100);
+			fill(b, fb, every[j], 3);
+			check(a, fa);
+			check(b, fb);
+
+			ys_bitset_t *c = ys_bs_union2(a, b, 0);
+			ys_flatset_t *fc = flat_alloc(size);
+			for (k = 0; k < fc->n; k++)
+				fc->data[k] = fa->data[k] | fb->data[k];
+			check(c, fc);
+			ys_bs_intersect2(a, b, c);
+			for (k = 0; k < fc->n; k++)
+				fc->data[k] = fa->data[k] & fb->data[k];
+			check(c, fc);
+			ys_bs_minus2(a, b, c);
+			for (k = 0; k < fc->n; k++)
+				fc->data[k] = fa->data[k] & ~fb->data[k];
+			check(c, fc);
+			ys_bs_complement(c);
+			for (k = 0; k < fc->n; k++)
+				fc->data[k] = ~fc->data[k];
+			if (size % ESIZE != 0)
+				fc->data[fc->n-1] &= (1U << (size % ESIZE)) - 1;
+			check(c, fc);
+			for (k = 0; k < 2000; k++) {
+				bit = ys_bs_random(size);
+				if (k % 2 == 0) {
+					ys_bs_delmember(c, bit);
+					fc->data[bit / ESIZE] &= ~(1U << (bit % ESIZE));
+				}
+				else {
+					ys_bs_addmember(c, bit);
+					flat_addmember(fc, bit);
+				}
+			}
+			check(c, fc);
+
+			unsigned *words = (unsigned *)malloc(ys_bs_nwords(size) * 
+				sizeof *words);
+			ys_bs_getwords(c, words);
+			assert(memcmp(words, fc->data, fc->n * sizeof *words) == 0);
+			ys_bs_setwords(a, words);
+			check(a, fc);
+			free(words);
+
+			ys_bs_destroy(a);
+			ys_bs_destroy(b);
+			ys_bs_destroy(c);
+			flat_destroy(fa);
+			flat_destroy(fb);
+			flat_destroy(fc);
+		}
+	}
+
+	ys_bitset_t *a = ys_bs_alloc(size);
+	ys_flatset_t *fa = flat_alloc(size);
+	fill(a, fa, 3, 10);
+	ys_bs_resize(a, size / 2);
+	ys_flatset_t *fb = flat_alloc(size);
+	for (bit = 0; bit < size / 2; bit++) {
+		if (flat_ismember(fa, bit))
+			flat_addmember(fb, bit);
+	}
+	check(a, fb);
+	ys_bs_resize(a, size);
+	check(a, fb);
+	ys_bs_destroy(a);
+	flat_destroy(fa);
+	flat_destroy(fb);
+}
+
+/*
+ * Compares the memory used and the time taken with sets held as plain
+ * arrays of bits, as they were before, for sets of size bits of
+ * increasing density. The sets are built in order, as a query builds
+ * them; a is random, and b half random and half runs.
+ */
+
+static double
+seconds( clock_t start )
 {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void
+bench( unsigned size, int passes )
+{
+	static const unsigned every[] = { 100000, 10000, 1000, 100, 10, 2 };
+	unsigned i, k, bit;
+	int p;
+
+	printf("%9s %9s %10s %10s  %-14s %-14s %-14s %-14s\n", 
+		"density", "members", "KB", "flat KB", "build", "and/or/not", 
+		"iterate", "count");
+	for (i = 0; i < sizeof every / sizeof every[0]; i++) {
+		ys_bitset_t *a = 0, *b = 0;
+		ys_flatset_t *fa = 0, *fb = 0;
+		unsigned long total = 0;
+		double t[4], ft[4];
+
+		clock_t start = clock();
+		for (p = 0; p < passes; p++) {
+			if (a != 0) {
+				ys_bs_destroy(a);
+				ys_bs_destroy(b);
+			}
+			a = ys_bs_alloc(size);
+			b = ys_bs_alloc(size);
+			ys_bs_seed = 1;
+			for (bit = ys_bs_random(every[i]); bit < size; 
+				bit += 1 + ys_bs_random(2 * every[i]))
+				ys_bs_addmember(a, bit);
+			for (bit = ys_bs_random(every[i]); bit < size; 
+				bit += 1 + ys_bs_random(2 * every[i])) {
+				if ((bit / YS_BS_CHUNKBITS) % 2 == 0) {
+					ys_bs_addmember(b, bit);
+					continue;
+				}
+				for (k = 0; k < 64 && bit < size; k++, bit++)
+					ys_bs_addmember(b, bit);
+				bit += 63 * every[i];
+			}
+		}
+		t[0] = seconds(start);
+		start = clock();
+		for (p = 0; p < passes; p++) {
+			if (fa != 0) {
+				flat_destroy(fa);
+				flat_destroy(fb);
+			}
+			fa = flat_alloc(size);
+			fb = flat_alloc(size);
+			ys_bs_seed = 1;
+			for (bit = ys_bs_random(every[i]); bit < size; 
+				bit += 1 + ys_bs_random(2 * every[i]))
+				flat_addmember(fa, bit);
+			for (bit = ys_bs_random(every[i]); bit < size; 
+				bit += 1 + ys_bs_random(2 * every[i])) {
+				if ((bit / YS_BS_CHUNKBITS) % 2 == 0) {
+					flat_addmember(fb, bit);
+					continue;
+				}
+				for (k = 0; k < 64 && bit < size; k++, bit++)
+					flat_addmember(fb, bit);
+				bit += 63 * every[i];
+			}
+		}
+		ft[0] = seconds(start);
+
+		ys_bitset_t *c = ys_bs_alloc(size);
+		start = clock();
+		for (p = 0; p < passes; p++) {
+			ys_bs_intersect2(a, b, c);
+			ys_bs_union2(a, b, c);
+			ys_bs_minus2(a, b, c);
+		}
+		t[1] = seconds(start);
+		ys_flatset_t *fc = flat_alloc(size);
+		start = clock();
+		for (p = 0; p < passes; p++) {
+			for (k = 0; k < fc->n; k++)
+				fc->data[k] = fa->data[k] & fb->data[k];
+			for (k = 0; k < fc->n; k++)
+				fc->data[k] = fa->data[k] | fb->data[k];
+			for (k = 0; k < fc->n; k++)
+				fc->data[k] = fa->data[k] & ~fb->data[k];
+		}
+		ft[1] = seconds(start);
+
+		start = clock();
+		for (p = 0; p < passes; p++)
+			total += count_using_iterator(a);
+		t[2] = seconds(start);
+		start = clock();
+		for (p = 0; p < passes; p++) {
+			/* as BitSetIterator did */
+			for (bit = 0; bit < size; bit++) {
+				if (flat_ismember(fa, bit))
+					total--;
+			}
+		}
+		ft[2] = seconds(start);
+
+		start = clock();
+		for (p = 0; p < passes; p++)
+			total += ys_bs_count(a);
+		t[3] = seconds(start);
+		start = clock();
+		for (p = 0; p < passes; p++) {
+			unsigned n = 0;
+			for (k = 0; k < fa->n; k++)
+				n += ys_popcount64(fa->data[k]);
+			total -= n;
+		}
+		ft[3] = seconds(start);
+		assert(total == 0);
+
+		printf("%9.5f %9u %10.1f %10.1f ", (double) ys_bs_count(a) / size,
+			ys_bs_count(a),
+			(ys_bs_memory(a) + ys_bs_memory(b)) / 2048.0,
+			(double) NBYTES(fa->n) / 1024.0);
+		for (k = 0; k < 4; k++)
+			printf(" %6.2f/%-6.2f", t[k] * 1000 / passes, 
+				ft[k] * 1000 / passes);
+		printf("\n");
+		ys_bs_destroy(a);
+		ys_bs_destroy(b);
+		ys_bs_destroy(c);
+		flat_destroy(fa);
+		flat_destroy(fb);
+		flat_destroy(fc);
+	}
+	printf("KB is the average of the two sets; times are ms per pass, "
+		"this/flat\n");
+}
+
+/*
+ * Usage: bitset [bench [size [passes]]]
+ */
+int main(int argc, char *argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		unsigned size = argc > 2 ? strtoul(argv[2], 0, 10) : 10000000;
+		int passes = argc > 3 ? atoi(argv[3]) : 10;
+		bench(size, passes);
+		return 0;
+	}
 	testbitset();
+	testrandom(3 * YS_BS_CHUNKBITS + 1000);
+	testrandom(100);
+	printf("bitset: OK\n");
 	return 0;
-}
\ No newline at end of file
+}
+
+#endif
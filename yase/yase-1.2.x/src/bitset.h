@@ -30,10 +30,38 @@
 
 #include "yase.h"
 
+/**
+ * A set is held in chunks of YS_BS_CHUNKBITS bits, each in whichever 
+ * form is smallest: a sorted array of its members (at most 
+ * YS_BS_ARRAYMAX), a bitmap, or a list of runs of members. An empty
+ * chunk takes no memory beyond its ys_bs_chunk_t.
+ */
+enum {
+	YS_BS_CHUNKBITS = 65536,
+	YS_BS_ARRAYMAX = 4096
+};
+
+enum {
+	YS_BS_ARRAY,
+	YS_BS_BITMAP,
+	YS_BS_RUNS
+};
+
 typedef struct {
-	unsigned *data;
+	unsigned char type;	/* YS_BS_ARRAY, YS_BS_BITMAP or YS_BS_RUNS */
+	unsigned card;		/* no of members */
+	unsigned n;		/* values in the array, or runs */
+	unsigned alloc;		/* of values */
+	union {
+		ys_uint16_t *values;	/* members, or first and last of runs */
+		ys_uint64_t *words;	/* bitmap */
+	} u;
+} ys_bs_chunk_t;
+
+typedef struct {
+	ys_bs_chunk_t *chunks;
 	unsigned size;		/* no of bits in this set */
-	unsigned n;		/* data[n] */
+	unsigned n;		/* chunks[n] */
 } ys_bitset_t;
 
 enum {
@@ -58,6 +86,32 @@ extern ys_bitset_t * ys_bs_minus2( ys_bitset_t *bs1, ys_bitset_t *bs2, ys_bitset
 extern ys_bitset_t * ys_bs_clone( ys_bitset_t *bs1, ys_bitset_t *bs2 );
 extern void ys_bs_iterate( ys_bitset_t *bs, int flag, ys_bool_t (*f)( void *, unsigned, ys_bool_t ), void *arg );
 extern unsigned ys_bs_count( ys_bitset_t *bs );
+/**
+ * Returns the first member >= bit, or bs->size if there is none.
+ */
+extern unsigned ys_bs_next( ys_bitset_t *bs, unsigned bit );
+/**
+ * Stores up to max members >= bit in members, in order, and returns
+ * how many were stored.
+ */
+extern unsigned ys_bs_getmembers( ys_bitset_t *bs, unsigned bit, 
+	unsigned *members, unsigned max );
+/**
+ * Changes the number of bits; members past the new size are removed.
+ */
+extern void ys_bs_resize( ys_bitset_t *bs, unsigned size );
+/**
+ * The bytes of memory used by the set.
+ */
+extern unsigned long ys_bs_memory( ys_bitset_t *bs );
+/**
+ * The set as a plain array of words, bit i being bit i % 32 of word
+ * i / 32, as it is saved to files. ys_bs_nwords() gives the number of
+ * words for a set of size bits.
+ */
+extern unsigned ys_bs_nwords( unsigned size );
+extern void ys_bs_getwords( ys_bitset_t *bs, unsigned *words );
+extern void ys_bs_setwords( ys_bitset_t *bs, const unsigned *words );
 
 YASE_NS_BEGIN
 
@@ -66,25 +120,36 @@ class BitSetIterator
 private:
 	unsigned bit;
 	ys_bitset_t *bs;
+	unsigned members[128];		/* found ahead */
+	unsigned nmembers;
+	unsigned next;
 public:
 	BitSetIterator(ys_bitset_t *bs)
 	{
 		this->bs = bs;
-		bit = 0;
+		reset();
 	}
 	int getNext() 
 	{	
-		while (bit < bs->size) {
-			ys_bool_t ismbr = ys_bs_ismember(bs, bit);
-			bit++;
-			if (ismbr)
-				return bit-1;
+		if (next == nmembers) {
+			if (bs == 0 || bit >= bs->size)
+				return -1;
+			nmembers = ys_bs_getmembers(bs, bit, members, 
+				sizeof members / sizeof members[0]);
+			next = 0;
+			if (nmembers == 0) {
+				bit = bs->size;
+				return -1;
+			}
+			bit = members[nmembers-1] + 1;
 		}
-		return -1;
+		return members[next++];
 	}
 	void reset()
 	{
 		bit = 0;
+		nmembers = 0;
+		next = 0;
 	}
 	unsigned getCount() const
 	{
@@ -95,6 +160,38 @@ public:
 	}
 };
 
+/**
+ * Tests bits for membership in increasing order, finding the next
+ * member with ys_bs_next() only when a bit passes the last one found;
+ * this is cheaper than ys_bs_ismember() for each bit when the set is
+ * sparse. A bit smaller than one tested before may be wrongly reported
+ * as not being a member.
+ */
+class BitSetFilter
+{
+private:
+	ys_bitset_t *bs;
+	unsigned member;		/* the first member >= the last bit */
+public:
+	BitSetFilter(ys_bitset_t *bs = 0)
+	{
+		reset(bs);
+	}
+	void reset(ys_bitset_t *bs)
+	{
+		this->bs = bs;
+		member = bs != 0 ? ys_bs_next(bs, 0) : 0;
+	}
+	bool contains(unsigned bit)
+	{
+		if (bs == 0)
+			return false;
+		if (bit > member)
+			member = ys_bs_next(bs, bit);
+		return bit == member;
+	}
+};
+
 YASE_NS_END
 
 #endif
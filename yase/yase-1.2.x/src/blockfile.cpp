@@ -21,15 +21,53 @@
 *    Website: www.mazumdar.demon.co.uk/yase_index.html
 */
 
+/*
+ * 17-10-26: Replaced the 25 entry LRU list with a sharded buffer pool.
+ *           Blocks are located through a hash table and replaced using
+ *           the CLOCK algorithm.
+ * 17-10-26: Added read-only memory mapped access.
+ * 17-10-26: Blocks are pinned through handles of their own, so that any
+ *           number of readers can share a frame.
+ */
+
 #include "blockfile.h"
 #include "btree.h"
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+static int
+ys_blockfile_init_shard( ys_bufshard_t *shard, size_t nframes )
+{
+	shard->nframes = nframes;
+	shard->hand = 0;
+	shard->nbuckets = 16;
+	while (shard->nbuckets < nframes*2)
+		shard->nbuckets *= 2;
+	shard->frames = (ys_frame_t **) calloc(nframes, sizeof(ys_frame_t *));
+	shard->buckets = (ys_frame_t **) calloc(shard->nbuckets, sizeof(ys_frame_t *));
+	if (shard->frames == NULL || shard->buckets == NULL) {
+		perror("calloc");
+		fprintf(stderr, "Unable to allocate buffer pool\n");
+		return -1;
+	}
+	if (ys_mutex_init( &shard->latch ) != 0)
+		return -1;
+	return 0;
+}
+
+/**
+ * Opens a block file with a buffer pool of nframes blocks. If nframes
+ * is 0, YS_BLOCKFILE_DEFAULT_FRAMES is used.
+ */
 ys_blockfile_t *
-ys_blockfile_open( const char *name, const char *mode )
+ys_blockfile_open_cache( const char *name, const char *mode, size_t nframes )
 {
 	struct stat statbuf;
 	ys_blockfile_t *file;
-	int i;
+	size_t i;
 
 	file = (ys_blockfile_t*) calloc(1, sizeof(ys_blockfile_t));
 	if (file == NULL) {
@@ -52,34 +90,124 @@ ys_blockfile_open( const char *name, const char *mode )
 		return NULL;
 	}
 	file->lastblock = statbuf.st_size/sizeof(ys_blockdata_t);
-	assert(file->lastblock*sizeof(ys_blockdata_t) == statbuf.st_size);
+	assert(statbuf.st_size % sizeof(ys_blockdata_t) == 0);
+	ys_mutex_init( &file->iolatch );
 
-	ys_list_init( &file->blocks );
-	for (i = 0; i < 25; i++) {
-		ys_block_t *block;
-		block = (ys_block_t *)calloc(1, sizeof(ys_block_t));
-		if (block == NULL) {
-			perror("calloc");
-			fprintf(stderr, "Unable to allocate a block\n");
+	if (nframes == 0)
+		nframes = YS_BLOCKFILE_DEFAULT_FRAMES;
+	file->nshards = nframes / (YS_BLOCKFILE_MIN_FRAMES*4);
+	if (file->nshards < 1)
+		file->nshards = 1;
+	else if (file->nshards > YS_BLOCKFILE_MAX_SHARDS)
+		file->nshards = YS_BLOCKFILE_MAX_SHARDS;
+	nframes = (nframes + file->nshards - 1) / file->nshards;
+	if (nframes < YS_BLOCKFILE_MIN_FRAMES)
+		nframes = YS_BLOCKFILE_MIN_FRAMES;
+	file->capacity = nframes * file->nshards;
+	file->shards = (ys_bufshard_t *) calloc(file->nshards, sizeof(ys_bufshard_t));
+	if (file->shards == NULL) {
+		perror("calloc");
+		fprintf(stderr, "Unable to allocate buffer pool\n");
+		ys_file_close(file->file);
+		free(file);
+		return NULL;
+	}
+	for (i = 0; i < file->nshards; i++) {
+		if (ys_blockfile_init_shard( &file->shards[i], nframes ) != 0) {
+			file->nshards = i+1;
 			ys_blockfile_close(file);
 			return NULL;
 		}
-		block->blocknum = 0;
-		block->dirty = BOOL_FALSE;
-		ys_list_append( &file->blocks, block );
 	}
 
 	return file;
 }
 
-static ys_block_t *
-ys_blockfile_find( ys_blockfile_t *file, ys_blocknum_t blocknum )
+ys_blockfile_t *
+ys_blockfile_open( const char *name, const char *mode )
 {
-	ys_block_t *block;
+	return ys_blockfile_open_cache( name, mode, 0 );
+}
+
+/**
+ * Opens a block file for reading and maps it into memory. Blocks
+ * returned by ys_blockfile_get() then point directly into the mapping,
+ * so a cache miss costs neither a system call nor a copy. If the file
+ * cannot be mapped, ordinary reads are used instead.
+ */
+ys_blockfile_t *
+ys_blockfile_open_mapped( const char *name, size_t nframes )
+{
+	ys_blockfile_t *file;
+
+	file = ys_blockfile_open_cache( name, "r", nframes );
+	if (file == NULL)
+		return NULL;
+#ifndef WIN32
+	if (file->lastblock > 0) {
+		int fd = open(name, O_RDONLY);
+		size_t len = file->lastblock * sizeof(ys_blockdata_t);
+		void *map = MAP_FAILED;
+		if (fd >= 0) {
+			map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+			close(fd);
+		}
+		if (map == MAP_FAILED) {
+			perror("mmap");
+			fprintf(stderr, "Unable to map %s, using buffered reads\n",
+				name);
+		}
+		else {
+			/* Index lookups jump around the file */
+			madvise(map, len, MADV_RANDOM);
+			file->map = (const ys_uchar_t *) map;
+			file->maplen = len;
+		}
+	}
+#endif
+	return file;
+}
+
+/**
+ * Tells the operating system that a block will be needed soon. Only
+ * has an effect on mapped files.
+ */
+void
+ys_blockfile_prefetch( ys_blockfile_t *file, ys_blocknum_t blocknum )
+{
+#ifndef WIN32
+	if (file->map == NULL || blocknum < 1 || blocknum > file->lastblock)
+		return;
+	madvise((void *)(file->map + (blocknum-1) * sizeof(ys_blockdata_t)),
+		sizeof(ys_blockdata_t), MADV_WILLNEED);
+#endif
+}
+
+static inline ys_bufshard_t *
+ys_blockfile_shard( ys_blockfile_t *file, ys_blocknum_t blocknum )
+{
+	return &file->shards[blocknum % file->nshards];
+}
+
+static inline size_t
+ys_blockfile_hash( ys_blockfile_t *file, ys_bufshard_t *shard, 
+	ys_blocknum_t blocknum )
+{
+	/* Blocks in a shard are congruent modulo nshards, so dividing
+	 * first spreads consecutive blocks over consecutive buckets.
+	 */
+	return (blocknum / file->nshards) & (shard->nbuckets-1);
+}
+
+static ys_frame_t *
+ys_blockfile_find( ys_blockfile_t *file, ys_bufshard_t *shard, 
+	ys_blocknum_t blocknum )
+{
+	ys_frame_t *block;
 
-	for (block = (ys_block_t *)ys_list_first( &file->blocks ); 
+	for (block = shard->buckets[ys_blockfile_hash( file, shard, blocknum )]; 
 	     block != NULL;
-	     block = (ys_block_t *)ys_list_next( &file->blocks, block )) {
+	     block = block->hashnext) {
 		if (block->blocknum == blocknum) {
 			return block;
 		}
@@ -87,155 +215,346 @@ ys_blockfile_find( ys_blockfile_t *file, ys_blocknum_t blocknum )
 	return NULL;
 }
 
+static void
+ys_blockfile_hash_insert( ys_blockfile_t *file, ys_bufshard_t *shard, 
+	ys_frame_t *block )
+{
+	size_t h = ys_blockfile_hash( file, shard, block->blocknum );
+	block->hashnext = shard->buckets[h];
+	shard->buckets[h] = block;
+}
+
+static void
+ys_blockfile_hash_remove( ys_blockfile_t *file, ys_bufshard_t *shard, 
+	ys_frame_t *block )
+{
+	ys_frame_t **pp = &shard->buckets[ys_blockfile_hash( file, shard, block->blocknum )];
+	while (*pp != NULL) {
+		if (*pp == block) {
+			*pp = block->hashnext;
+			break;
+		}
+		pp = &(*pp)->hashnext;
+	}
+	block->hashnext = NULL;
+}
+
 static int
-ys_blockfile_write( ys_blockfile_t *file, ys_block_t *block )
+ys_blockfile_write( ys_blockfile_t *file, ys_frame_t *block )
 {
 	ys_filepos_t pos;
+	int rc = 0;
 	if ( !block->dirty )
 		return 0;
 	pos = (ys_filepos_t)(block->blocknum-1) * sizeof(ys_blockdata_t);
+	ys_mutex_lock( &file->iolatch );
 	if ( ys_file_setpos( file->file, &pos ) < 0 ) {
 		fprintf(stderr, "Unable to seek to pos %lu block %lu\n",
 			pos, block->blocknum);
-		return -1;
+		rc = -1;
 	}
-	if ( ys_file_write( &block->bd, 1, sizeof block->bd, file->file )
-		!= sizeof block->bd ) {
+	else if ( ys_file_write( block->bd, 1, sizeof *block->bd, file->file )
+		!= sizeof *block->bd ) {
 		fprintf(stderr, "Unable to write block %lu\n",
 			block->blocknum);
-		return -1;
+		rc = -1;
 	}
-	block->dirty = BOOL_FALSE;
-	return 0;
+	ys_mutex_unlock( &file->iolatch );
+	if (rc == 0)
+		block->dirty = BOOL_FALSE;
+	return rc;
 }	
 
 static int
-ys_blockfile_read( ys_blockfile_t *file, ys_block_t *block )
+ys_blockfile_read( ys_blockfile_t *file, ys_frame_t *block )
 {
 	ys_filepos_t pos;
+	int rc = 0;
+	block->dirty = BOOL_FALSE;
+	block->offsets_valid = BOOL_FALSE;
+	if (file->map != NULL) {
+		if (block->blocknum > file->lastblock) {
+			fprintf(stderr, "Unable to read block %lu\n",
+				block->blocknum);
+			return -1;
+		}
+		block->bd = (ys_blockdata_t *)(file->map + 
+			(block->blocknum-1) * sizeof(ys_blockdata_t));
+		return 0;
+	}
+	block->bd = &block->data;
 	pos = (ys_filepos_t)(block->blocknum-1) * sizeof(ys_blockdata_t);
+	ys_mutex_lock( &file->iolatch );
 	if ( ys_file_setpos( file->file, &pos ) < 0 ) {
 		fprintf(stderr, "Unable to seek to pos %lu block %lu\n",
 			pos, block->blocknum);
-		return -1;
+		rc = -1;
 	}
-	if ( ys_file_read( &block->bd, 1, sizeof block->bd, file->file )
-		!= sizeof block->bd ) {
+	else if ( ys_file_read( block->bd, 1, sizeof *block->bd, file->file )
+		!= sizeof *block->bd ) {
 		fprintf(stderr, "Unable to read block %lu\n",
 			block->blocknum);
-		return -1;
+		rc = -1;
 	}
-	block->dirty = BOOL_FALSE;
-	return 0;
+	ys_mutex_unlock( &file->iolatch );
+	return rc;
 }	
 
-static ys_block_t *
-ys_blockfile_getempty( ys_blockfile_t *file )
+/**
+ * Finds a frame that can be reused. Frames are allocated on demand until
+ * the shard is full; after that the CLOCK hand sweeps the frames, giving
+ * recently used frames a second chance. Pinned frames are never chosen.
+ * Must be called with the shard latch held.
+ */
+static ys_frame_t *
+ys_blockfile_getempty( ys_blockfile_t *file, ys_bufshard_t *shard )
 {
-	ys_block_t *block;
+	ys_frame_t *block;
+	size_t i;
 
-	block = ys_blockfile_find( file, 0 );
-	if (block != NULL)
-		return block;
-	for (block = (ys_block_t *)ys_list_last( &file->blocks ); 
-	     block != NULL;
-	     block = (ys_block_t *)ys_list_prev( &file->blocks, block )) {
-		if (block->ref == 0) {
-			break;
+	if (shard->nused < shard->nframes) {
+		block = (ys_frame_t *)calloc(1, sizeof(ys_frame_t));
+		if (block == NULL) {
+			perror("calloc");
+			fprintf(stderr, "Unable to allocate a block\n");
+			return NULL;
 		}
+		block->bd = &block->data;
+		shard->frames[shard->nused++] = block;
+		return block;
 	}
-	if (block == NULL)
-		return NULL;
-	if (ys_blockfile_write( file, block ) == 0 ) {
+	for (i = 0; i < shard->nframes*2; i++) {
+		block = shard->frames[shard->hand];
+		if (++shard->hand == shard->nframes)
+			shard->hand = 0;
+		if (block->ref > 0)
+			continue;
+		if (block->usage && block->blocknum != 0) {
+			block->usage = BOOL_FALSE;
+			continue;
+		}
+		if (block->blocknum != 0) {
+			if (ys_blockfile_write( file, block ) != 0)
+				return NULL;
+			ys_blockfile_hash_remove( file, shard, block );
+			block->blocknum = 0;
+			shard->evictions++;
+		}
 		return block;
 	}
+	fprintf(stderr, "All %lu blocks in the buffer pool are in use\n",
+		(unsigned long)shard->nframes);
 	return NULL;
 }
 
-static void
-ys_blockfile_make_lru( ys_blockfile_t *file, ys_block_t *block )
+/**
+ * Pins a frame, returning a handle for it. Must be called with the 
+ * shard latch held.
+ */
+static ys_block_t *
+ys_blockfile_pin( ys_bufshard_t *shard, ys_frame_t *frame )
 {
-	ys_block_t *firstblock;
+	ys_block_t *block = shard->freeblocks;
 
-	firstblock = (struct ys_block_t *) ys_list_first( &file->blocks );
-	if (block != firstblock) {	
-		ys_list_remove( &file->blocks, block );
-		ys_list_insert_before( &file->blocks, 
-			firstblock,
-			block );
+	if (block != NULL)
+		shard->freeblocks = block->next;
+	else {
+		block = (ys_block_t *)malloc(sizeof(ys_block_t));
+		if (block == NULL) {
+			perror("malloc");
+			fprintf(stderr, "Unable to allocate a block\n");
+			return NULL;
+		}
 	}
+	frame->ref++;
+	frame->usage = BOOL_TRUE;
+	block->frame = frame;
+	block->shard = shard;
+	block->next = NULL;
+	block->blocknum = frame->blocknum;
+	block->bd = frame->bd;
+	block->offsets = frame->offsets;
+	block->offsets_valid = frame->offsets_valid;
+	block->dirty = BOOL_FALSE;
+	return block;
 }
 
+/**
+ * Gets a block, reading it from disk if it is not in the buffer pool.
+ * The block is pinned and must be released with ys_blockfile_put().
+ * Each call returns a handle of its own, holding the caller's cursor,
+ * so any number of threads may have the same block pinned.
+ */
 ys_block_t *
 ys_blockfile_get( ys_blockfile_t *file, ys_blocknum_t blocknum )
 {
+	ys_bufshard_t *shard = ys_blockfile_shard( file, blocknum );
+	ys_frame_t *frame;
 	ys_block_t *block;
 
-	block = ys_blockfile_find( file, blocknum );
-	if (block != NULL) {
-		block->ref++;
-		ys_blockfile_make_lru( file, block );
+	ys_mutex_lock( &shard->latch );
+	frame = ys_blockfile_find( file, shard, blocknum );
+	if (frame != NULL) {
+		shard->hits++;
+		block = ys_blockfile_pin( shard, frame );
+		ys_mutex_unlock( &shard->latch );
 		return block;
 	}
-	block = ys_blockfile_getempty( file );
-	if (block == NULL)
+	shard->misses++;
+	frame = ys_blockfile_getempty( file, shard );
+	if (frame == NULL) {
+		ys_mutex_unlock( &shard->latch );
 		return NULL;
-	block->blocknum = blocknum;
-	block->dirty = BOOL_FALSE;
-	block->ref = 1;
-	if (ys_blockfile_read( file, block ) == 0) {
-		ys_blockfile_make_lru( file, block );
-		return block;
 	}
-	return NULL;
+	frame->blocknum = blocknum;
+	frame->ref = 0;
+	if (ys_blockfile_read( file, frame ) != 0) {
+		frame->blocknum = 0;
+		ys_mutex_unlock( &shard->latch );
+		return NULL;
+	}
+	ys_blockfile_hash_insert( file, shard, frame );
+	block = ys_blockfile_pin( shard, frame );
+	ys_mutex_unlock( &shard->latch );
+	return block;
 }
 
+/**
+ * Unpins a block. The frame is marked dirty if the block is.
+ */
 int
 ys_blockfile_put( ys_blockfile_t *file, ys_block_t *block )
 {
-	assert( block->ref > 0 );
-	block->ref--;
+	ys_bufshard_t *shard = block->shard;
+	ys_frame_t *frame = block->frame;
+
+	ys_mutex_lock( &shard->latch );
+	assert( frame->ref > 0 );
+	frame->ref--;
+	if (block->dirty)
+		frame->dirty = BOOL_TRUE;
+	block->frame = NULL;
+	block->next = shard->freeblocks;
+	shard->freeblocks = block;
+	ys_mutex_unlock( &shard->latch );
 	return 0;
 }
 
+/**
+ * Latches the shard of a pinned block, so that state kept with its 
+ * frame, such as the offsets of keys, can be filled in safely.
+ */
+void
+ys_blockfile_latch( ys_block_t *block )
+{
+	ys_mutex_lock( &block->shard->latch );
+}
+
+void
+ys_blockfile_unlatch( ys_block_t *block )
+{
+	ys_mutex_unlock( &block->shard->latch );
+}
+
 ys_block_t *
 ys_blockfile_new( ys_blockfile_t *file )
 {
+	ys_bufshard_t *shard;
+	ys_frame_t *frame;
 	ys_block_t *block;
+	ys_blocknum_t blocknum;
 
-	block = ys_blockfile_getempty( file );
-	if (block == NULL)
+	assert(file->map == NULL);
+	ys_mutex_lock( &file->iolatch );
+	blocknum = ++file->lastblock;
+	ys_mutex_unlock( &file->iolatch );
+
+	shard = ys_blockfile_shard( file, blocknum );
+	ys_mutex_lock( &shard->latch );
+	frame = ys_blockfile_getempty( file, shard );
+	if (frame == NULL) {
+		ys_mutex_unlock( &shard->latch );
 		return NULL;
-	block->blocknum = ++file->lastblock;
-	block->dirty = BOOL_FALSE;
-	block->ref = 1;
-	memset(&block->bd, 0, sizeof block->bd);
-	ys_blockfile_make_lru( file, block );
+	}
+	frame->blocknum = blocknum;
+	frame->dirty = BOOL_FALSE;
+	frame->ref = 0;
+	frame->bd = &frame->data;
+	frame->offsets_valid = BOOL_FALSE;
+	memset(frame->bd, 0, sizeof *frame->bd);
+	ys_blockfile_hash_insert( file, shard, frame );
+	block = ys_blockfile_pin( shard, frame );
+	ys_mutex_unlock( &shard->latch );
 	return block;
 }
 
+/**
+ * Returns the buffer pool counters summed over all shards.
+ */
+void
+ys_blockfile_getstats( ys_blockfile_t *file, ys_blockfile_stats_t *stats )
+{
+	size_t i;
+
+	memset(stats, 0, sizeof *stats);
+	stats->frames = file->capacity;
+	for (i = 0; i < file->nshards; i++) {
+		ys_bufshard_t *shard = &file->shards[i];
+		ys_mutex_lock( &shard->latch );
+		stats->hits += shard->hits;
+		stats->misses += shard->misses;
+		stats->evictions += shard->evictions;
+		ys_mutex_unlock( &shard->latch );
+	}
+}
+
 int 
 ys_blockfile_close( ys_blockfile_t *file )
 {
-	ys_block_t *block;
+	ys_frame_t *block;
 	int rc = 0;
 	int count = 0;
+	size_t i, j;
 
-	while ( (block = (ys_block_t *)ys_list_first( &file->blocks )) != NULL ) {
-		if (block->ref != 0)
-			count++;
-		if (block->blocknum != 0) {
-			if (ys_blockfile_write( file, block ) != 0) {
-				rc = -1;
+	if (Ys_debug && file->shards != NULL) {
+		ys_blockfile_stats_t stats;
+		ys_blockfile_getstats( file, &stats );
+		fprintf(stderr, "Block cache: %lu frames, %lu hits, %lu misses, %lu evictions\n",
+			(unsigned long)stats.frames, stats.hits, stats.misses, 
+			stats.evictions);
+	}
+	for (i = 0; i < file->nshards; i++) {
+		ys_bufshard_t *shard = &file->shards[i];
+		for (j = 0; j < shard->nused; j++) {
+			block = shard->frames[j];
+			if (block->ref != 0)
+				count++;
+			if (block->blocknum != 0) {
+				if (ys_blockfile_write( file, block ) != 0) {
+					rc = -1;
+				}
 			}
+			free(block);
+		}
+		while (shard->freeblocks != NULL) {
+			ys_block_t *next = shard->freeblocks->next;
+			free(shard->freeblocks);
+			shard->freeblocks = next;
 		}
-		ys_list_remove( &file->blocks, block );
-		free(block);
+		free(shard->frames);
+		free(shard->buckets);
+		ys_mutex_destroy( &shard->latch );
 	}
+	free(file->shards);
+#ifndef WIN32
+	if (file->map != NULL)
+		munmap((void *)file->map, file->maplen);
+#endif
 	if (ys_file_close(file->file) != 0) {
 		rc = -1;
 		fprintf(stderr, "Error closing block file\n");
 	}
+	ys_mutex_destroy( &file->iolatch );
 	free(file);
 	if (count)
 		fprintf(stderr, "warning: %d blocks were still in use\n",
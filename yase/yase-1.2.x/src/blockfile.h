@@ -25,29 +25,90 @@
 
 #include "yase.h"
 #include "ystdio.h"
-#include "list.h"
+#include "ysthread.h"
 
 typedef struct ys_blockfile_t ys_blockfile_t;
 typedef struct ys_block_t ys_block_t;
+typedef struct ys_frame_t ys_frame_t;
+
+enum {
+	YS_BLOCKFILE_DEFAULT_FRAMES = 64,	/* default capacity of the buffer pool */
+	YS_BLOCKFILE_MIN_FRAMES = 8,		/* minimum frames in a shard */
+	YS_BLOCKFILE_MAX_SHARDS = 8
+};
+
+/**
+ * Buffer pool statistics.
+ */
+typedef struct {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	size_t frames;
+} ys_blockfile_stats_t;
+
+/**
+ * The buffer pool is split into shards; a block always lives in
+ * shard (blocknum % nshards). Each shard has its own latch, hash table
+ * and CLOCK hand so that threads working on different blocks rarely
+ * contend. The latch is held while a block is looked up, loaded or 
+ * evicted, not while it is pinned.
+ */
+typedef struct {
+	ys_mutex_t latch;
+	ys_frame_t **frames;
+	size_t nframes;
+	size_t nused;			/* frames allocated so far */
+	size_t hand;			/* CLOCK hand */
+	ys_frame_t **buckets;		/* blocknum -> frame hash chains */
+	ys_block_t *freeblocks;		/* handles not in use */
+	size_t nbuckets;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+} ys_bufshard_t;
 
 struct ys_blockfile_t {
 	ys_file_t *file;
+	const ys_uchar_t *map;		/* read-only mapping of the file, or NULL */
+	size_t maplen;
+	ys_mutex_t iolatch;		/* protects file position and lastblock */
 	size_t lastblock;
-	ys_list_t blocks;
+	size_t capacity;
+	size_t nshards;
+	ys_bufshard_t *shards;
 };
 
 extern ys_blockfile_t *
 ys_blockfile_open( const char *name, const char *mode );
 
+extern ys_blockfile_t *
+ys_blockfile_open_cache( const char *name, const char *mode, size_t nframes );
+
+extern ys_blockfile_t *
+ys_blockfile_open_mapped( const char *name, size_t nframes );
+
 extern ys_block_t *
 ys_blockfile_get( ys_blockfile_t *file, ys_blocknum_t blocknum );
 
+extern void
+ys_blockfile_prefetch( ys_blockfile_t *file, ys_blocknum_t blocknum );
+
 extern int
 ys_blockfile_put( ys_blockfile_t *file, ys_block_t *block );
 
 extern ys_block_t *
 ys_blockfile_new( ys_blockfile_t *file );
 
+extern void
+ys_blockfile_latch( ys_block_t *block );
+
+extern void
+ys_blockfile_unlatch( ys_block_t *block );
+
+extern void
+ys_blockfile_getstats( ys_blockfile_t *file, ys_blockfile_stats_t *stats );
+
 extern int 
 ys_blockfile_close( ys_blockfile_t *file );
 
@@ -24,9 +24,21 @@
 // 25-12-02: C++ version started on
 // 31-12-02: Revised (first working version)
 // 02-01-03: Revised to use re-written tokenizer classes
+// 17-10-26: Terms are found with Collection::findTerm(), which looks in 
+//           every segment.
+// 17-10-26: Deleted documents are removed from the result of NOT.
+// 17-10-26: Terms may be prefix, wildcard or fuzzy patterns.
+// 17-10-26: Added "phrases" and NEAR, matched with the positions of 
+//           terms if the collection records them.
+// 17-10-26: Added getCacheKey().
+// 17-10-26: Queries are evaluated with cursors over the postings 
+//           instead of a bitset for every term.
+// 17-10-26: Results are kept in a bitset, now compact when sparse.
 
 #include "boolsearch.h"
 
+#include <algorithm>
+
 enum {
 	T_LPAREN = 1,
 	T_RPAREN,
@@ -34,11 +46,248 @@ enum {
 	T_OR,
 	T_NOT,
 	T_TERM,
+	T_PHRASE,
+	T_NEAR,
 	T_EOI
 };
 
 YASE_NS_BEGIN
 
+/**
+ * A cursor over the documents matching part of a boolean query, in
+ * docnum order. A cursor starts at its first document.
+ */
+class BoolCursor {
+public:
+	virtual ~BoolCursor() {}
+	/**
+	 * The most documents the cursor can return.
+	 */
+	virtual ys_doccnt_t estimate() const = 0;
+	virtual bool atEnd() const = 0;
+	virtual ys_docnum_t docnum() const = 0;
+	virtual void next() = 0;
+	/**
+	 * Advances to the first document with docnum >= target.
+	 */
+	virtual void skipTo(ys_docnum_t target) = 0;
+};
+
+class EmptyCursor : public BoolCursor {
+public:
+	ys_doccnt_t estimate() const { return 0; }
+	bool atEnd() const { return true; }
+	ys_docnum_t docnum() const { return 0; }
+	void next() {}
+	void skipTo(ys_docnum_t target) {}
+};
+
+/**
+ * A term, or the terms a pattern expands to. skipTo() uses the skip
+ * tables of the postings.
+ */
+class TermBoolCursor : public BoolCursor {
+	YASENS TermUnion terms;
+public:
+	int open(const YASENS Collection *collection, const YASENS TermRef *refs,
+		int n) {
+		return terms.open(collection, refs, n);
+	}
+	ys_doccnt_t estimate() const { return terms.getTf(); }
+	bool atEnd() const { return terms.atEnd(); }
+	ys_docnum_t docnum() const { return terms.docnum(); }
+	void next() { terms.next(); }
+	void skipTo(ys_docnum_t target) { terms.skipTo(target); }
+};
+
+/**
+ * A list of documents, such as those matching a phrase.
+ */
+class DocListCursor : public BoolCursor {
+	ys_docnum_t *docs;
+	ys_doccnt_t ndocs;
+	ys_doccnt_t alloc;
+	ys_doccnt_t cur;
+public:
+	DocListCursor() { docs = 0; ndocs = 0; alloc = 0; cur = 0; }
+	~DocListCursor() { free(docs); }
+	/**
+	 * Appends a document; they must be added in docnum order.
+	 * Returns false if out of memory.
+	 */
+	bool add(ys_docnum_t docnum);
+	ys_doccnt_t estimate() const { return ndocs; }
+	bool atEnd() const { return cur >= ndocs; }
+	ys_docnum_t docnum() const { return docs[cur]; }
+	void next() { cur++; }
+	void skipTo(ys_docnum_t target);
+};
+
+/**
+ * The members of a bitset, which the cursor owns.
+ */
+class BitsetCursor : public BoolCursor {
+	ys_bitset_t *bs;
+	ys_doccnt_t count;
+	unsigned bit;
+	void seek(unsigned from) { bit = ys_bs_next(bs, from); }
+public:
+	BitsetCursor(ys_bitset_t *bs) {
+		this->bs = bs;
+		count = ys_bs_count(bs);
+		seek(0);
+	}
+	~BitsetCursor() { ys_bs_destroy(bs); }
+	ys_doccnt_t estimate() const { return count; }
+	bool atEnd() const { return bit >= bs->size; }
+	ys_docnum_t docnum() const { return bit; }
+	void next() { seek(bit+1); }
+	void skipTo(ys_docnum_t target) { 
+		if (bit < target) 
+			seek(target); 
+	}
+};
+
+/**
+ * Every document that has not been deleted; the positive side of a
+ * NOT on its own.
+ */
+class AllCursor : public BoolCursor {
+	ys_doccnt_t N;
+	YASENS BitSetFilter deleted;
+	ys_docnum_t doc;
+	void seek(ys_docnum_t from) {
+		for (doc = from; doc < N && deleted.contains(doc); doc++)
+			;
+	}
+public:
+	AllCursor(const YASENS Collection *collection) {
+		N = collection->getN();
+		deleted.reset(collection->getDeleted());
+		seek(0);
+	}
+	ys_doccnt_t estimate() const { return N; }
+	bool atEnd() const { return doc >= N; }
+	ys_docnum_t docnum() const { return doc; }
+	void next() { seek(doc+1); }
+	void skipTo(ys_docnum_t target) { 
+		if (doc < target) 
+			seek(target); 
+	}
+};
+
+/**
+ * The operands of an AND or OR, which it owns.
+ */
+class BoolOperands {
+public:
+	BoolCursor **cursors;
+	int n;
+	int alloc;
+	BoolOperands() { cursors = 0; n = 0; alloc = 0; }
+	~BoolOperands() {
+		for (int i = 0; i < n; i++)
+			delete cursors[i];
+		delete [] cursors;
+	}
+	void add(BoolCursor *cursor);
+	/**
+	 * Takes the only operand back.
+	 */
+	BoolCursor *release() {
+		n = 0;
+		return cursors[0];
+	}
+};
+
+/**
+ * Documents matched by all of the positive operands and none of the
+ * negated ones. The positive operands are ordered by their estimates,
+ * so that the rarest leads and the others skip to its documents; the 
+ * negated ones are checked for each document found.
+ */
+class AndCursor : public BoolCursor {
+	BoolOperands positive;
+	BoolOperands negated;
+	bool end;
+	void align();
+public:
+	AndCursor() { end = false; }
+	void add(BoolCursor *cursor, bool negate) {
+		if (negate)
+			negated.add(cursor);
+		else
+			positive.add(cursor);
+	}
+	/**
+	 * Returns the operand if there is only one, and it is not 
+	 * negated, else 0.
+	 */
+	BoolCursor *single() {
+		if (positive.n == 1 && negated.n == 0)
+			return positive.release();
+		return 0;
+	}
+	/**
+	 * Moves to the first document; called once all of the operands 
+	 * have been added. NOT on its own is taken from all documents.
+	 */
+	void start(const YASENS Collection *collection);
+	ys_doccnt_t estimate() const { 
+		return positive.cursors[0]->estimate(); 
+	}
+	bool atEnd() const { return end; }
+	ys_docnum_t docnum() const { return positive.cursors[0]->docnum(); }
+	void next() {
+		positive.cursors[0]->next();
+		align();
+	}
+	void skipTo(ys_docnum_t target) {
+		if (end || docnum() >= target)
+			return;
+		positive.cursors[0]->skipTo(target);
+		align();
+	}
+};
+
+/**
+ * Documents matched by any of the operands, merged with a heap.
+ */
+class OrCursor : public BoolCursor {
+	BoolOperands operands;
+	int *heap;
+	int nheap;
+	ys_doccnt_t total;
+	bool before(int a, int b) const {
+		return operands.cursors[a]->docnum() < operands.cursors[b]->docnum();
+	}
+	void siftDown(int i);
+	void pop() {
+		heap[0] = heap[--nheap];
+		siftDown(0);
+	}
+public:
+	OrCursor() { heap = 0; nheap = 0; total = 0; }
+	~OrCursor() { delete [] heap; }
+	void add(BoolCursor *cursor) { 
+		operands.add(cursor); 
+		total += cursor->estimate();
+	}
+	BoolCursor *single() {
+		if (operands.n == 1)
+			return operands.release();
+		return 0;
+	}
+	void start();
+	ys_doccnt_t estimate() const { return total; }
+	bool atEnd() const { return nheap == 0; }
+	ys_docnum_t docnum() const { 
+		return operands.cursors[heap[0]]->docnum(); 
+	}
+	void next();
+	void skipTo(ys_docnum_t target);
+};
+
 class BoolSearchResultItem : public SearchResultItem {
 public:
 	void setDocnum(ys_docnum_t docnum) {
@@ -46,27 +295,35 @@ public:
 	}
 };
 
+/**
+ * Holds the documents found in a bitset, which takes about two bytes
+ * a document when they are sparse.
+ */
 class BoolSearchResultSet : public SearchResultSet {
 	ys_bitset_t *bitset;
-	YASENS BitSetIterator* iterator;
+	YASENS BitSetIterator iterator;
 	BoolSearchResultItem item;
 public:
-	BoolSearchResultSet(ys_bitset_t *bitset, double e) {
-		this->bitset = bitset;
-		elapsed = e;
-		iterator = new YASENS BitSetIterator(bitset);
-		count = iterator->getCount();  
+	/**
+	 * Takes the documents of the cursor.
+	 */
+	BoolSearchResultSet(BoolCursor *cursor, ys_doccnt_t N)
+		: bitset(ys_bs_alloc(N)), iterator(bitset) {
+		for (; cursor != 0 && !cursor->atEnd(); cursor->next())
+			ys_bs_addmember(bitset, cursor->docnum());
+		count = iterator.getCount();
 	}
 	~BoolSearchResultSet() {
-		delete iterator;
+		ys_bs_destroy(bitset);
 	}
 	SearchResultItem *getNext() {
-		int doc = iterator->getNext();
+		int doc = iterator.getNext();
 		if (doc == -1)
 			return 0;
 		item.setDocnum(doc);
 		return &item;
 	}
+	void setElapsedTime(double e) { elapsed = e; }
 	bool contains(ys_docnum_t docnum)
 	{
 		return ys_bs_ismember(bitset, docnum) != 0;
@@ -75,6 +332,171 @@ public:
 
 YASE_NS_END
 
+void
+YASENS DocListCursor::skipTo(ys_docnum_t target)
+{
+	if (cur >= ndocs || docs[cur] >= target)
+		return;
+	/* Gallop from docs[lo] < target until docs[hi] >= target, */
+	ys_doccnt_t lo = cur, hi, step = 1;
+	while (lo + step < ndocs && docs[lo+step] < target) {
+		lo += step;
+		step *= 2;
+	}
+	hi = lo + step < ndocs ? lo + step : ndocs;
+	/* then search between them */
+	while (hi - lo > 1) {
+		ys_doccnt_t mid = lo + (hi - lo) / 2;
+		if (docs[mid] < target)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	cur = hi;
+}
+
+bool
+YASENS DocListCursor::add(ys_docnum_t docnum)
+{
+	if (ndocs == alloc) {
+		ys_doccnt_t n = alloc > 0 ? alloc * 2 : 64;
+		ys_docnum_t *p = (ys_docnum_t *) realloc(docs, n * sizeof *docs);
+		if (p == 0) {
+			fprintf(stderr, "Error: ran out of memory\n");
+			return false;
+		}
+		docs = p;
+		alloc = n;
+	}
+	docs[ndocs++] = docnum;
+	return true;
+}
+
+void
+YASENS BoolOperands::add(BoolCursor *cursor)
+{
+	if (n == alloc) {
+		int size = alloc > 0 ? alloc * 2 : 4;
+		BoolCursor **p = new BoolCursor *[size];
+		for (int i = 0; i < n; i++)
+			p[i] = cursors[i];
+		delete [] cursors;
+		cursors = p;
+		alloc = size;
+	}
+	cursors[n++] = cursor;
+}
+
+static bool
+ys_bool_rarer(const YASENS BoolCursor *a, const YASENS BoolCursor *b)
+{
+	return a->estimate() < b->estimate();
+}
+
+void
+YASENS AndCursor::start(const YASENS Collection *collection)
+{
+	if (positive.n == 0)
+		positive.add(new YASENS AllCursor(collection));
+	std::stable_sort(positive.cursors, positive.cursors + positive.n, 
+		ys_bool_rarer);
+	align();
+}
+
+/**
+ * Moves to the first document, from the current one of the leading 
+ * operand, that all of the positive operands hold and no negated one
+ * does.
+ */
+void
+YASENS AndCursor::align()
+{
+	BoolCursor **pos = positive.cursors;
+	while (!pos[0]->atEnd()) {
+		ys_docnum_t doc = pos[0]->docnum();
+		int i;
+		for (i = 1; i < positive.n; i++) {
+			pos[i]->skipTo(doc);
+			if (pos[i]->atEnd() || pos[i]->docnum() > doc)
+				break;
+		}
+		if (i < positive.n) {
+			if (pos[i]->atEnd())
+				break;
+			pos[0]->skipTo(pos[i]->docnum());
+			continue;
+		}
+		for (i = 0; i < negated.n; i++) {
+			negated.cursors[i]->skipTo(doc);
+			if (!negated.cursors[i]->atEnd() && 
+				negated.cursors[i]->docnum() == doc)
+				break;
+		}
+		if (i == negated.n)
+			return;
+		pos[0]->next();
+	}
+	end = true;
+}
+
+void
+YASENS OrCursor::siftDown(int i)
+{
+	int c = heap[i];
+	for (;;) {
+		int child = 2*i+1;
+		if (child >= nheap)
+			break;
+		if (child+1 < nheap && before(heap[child+1], heap[child]))
+			child++;
+		if (!before(heap[child], c))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = c;
+}
+
+void
+YASENS OrCursor::start()
+{
+	heap = new int[operands.n];
+	nheap = 0;
+	for (int i = 0; i < operands.n; i++) {
+		if (!operands.cursors[i]->atEnd())
+			heap[nheap++] = i;
+	}
+	for (int i = nheap/2 - 1; i >= 0; i--)
+		siftDown(i);
+}
+
+void
+YASENS OrCursor::next()
+{
+	ys_docnum_t doc = docnum();
+	while (nheap > 0 && docnum() == doc) {
+		BoolCursor *c = operands.cursors[heap[0]];
+		c->next();
+		if (c->atEnd())
+			pop();
+		else
+			siftDown(0);
+	}
+}
+
+void
+YASENS OrCursor::skipTo(ys_docnum_t target)
+{
+	while (nheap > 0 && docnum() < target) {
+		BoolCursor *c = operands.cursors[heap[0]];
+		c->skipTo(target);
+		if (c->atEnd())
+			pop();
+		else
+			siftDown(0);
+	}
+}
+
 YASENS BoolSearch::BoolSearch(YASENS Collection *collection)
 	: YASENS Search(collection)
 {
@@ -83,6 +505,7 @@ YASENS BoolSearch::BoolSearch(YASENS Collection *collection)
 	bitset = 0;
 	resultSet = 0;
 	termbuf[0] = 0;
+	nearDistance = YS_NEAR_DISTANCE;
 }
 
 YASENS BoolSearch::~BoolSearch()
@@ -117,6 +540,18 @@ YASENS BoolSearch::getToken()
 			tok = T_EOI;
 			break;
 		}
+		else if (ch == '"') {
+			/* The words are split up by addOperand() */
+			for (cp++; *cp != 0 && *cp != '"'; cp++) {
+				if (len < YS_TERM_LEN)
+					termbuf[len++] = *cp;
+			}
+			termbuf[len] = 0;
+			if (*cp == '"')
+				cp++;
+			tok = T_PHRASE;
+			break;
+		}
 		else if (tokenizer.isWordChar(ch)) {
 			tokenizer.reset();
 			int state = YASENS CharTokenizer::TC_AGAIN;
@@ -137,6 +572,13 @@ YASENS BoolSearch::getToken()
 					tok = T_OR;
 				else if (strcmp((const char *)termbuf, "not") == 0)
 					tok = T_NOT;
+				else if (strcmp((const char *)termbuf, "near") == 0) {
+					tok = T_NEAR;
+					nearDistance = YS_NEAR_DISTANCE;
+					if (cp[0] == '/' && isdigit(cp[1]))
+						nearDistance = strtoul((const char *)cp+1, 
+							(char **)&cp, 10);
+				}
 				else
 					tok = T_TERM;
 			}
@@ -161,6 +603,8 @@ YASENS BoolSearch::getToken()
 			case T_OR: tokname = "T_OR"; break;
 			case T_NOT: tokname = "T_NOT"; break;
 			case T_TERM: tokname = "T_TERM"; break;
+			case T_PHRASE: tokname = "T_PHRASE"; break;
+			case T_NEAR: tokname = "T_NEAR"; break;
 			default: tokname = "T_EOI"; break;
 		}
 		printf("TOKEN = %s(%s)\n", tokname, termbuf);
@@ -180,89 +624,320 @@ YASENS BoolSearch::matchToken(int tok)
 }
 
 /**
- * Parse OR expressions.
+ * Parse OR expressions. A union of more than N/YS_BOOL_DENSE_RATIO
+ * documents is made into a bitset.
  */
-ys_bitset_t *
+YASENS BoolCursor *
 YASENS BoolSearch::parseOrExpr()
 {
-	ys_bitset_t *bs1, *bs2;
+	YASENS OrCursor *orCursor = new YASENS OrCursor();
+	YASENS BoolCursor *c = parseAndExpr();
 
-	bs1 = parseAndExpr();
-	while (bs1 != 0 && curtok == T_OR) {
+	while (c != 0) {
+		orCursor->add(c);
+		if (curtok != T_OR)
+			break;
 		matchToken(T_OR);
-		bs2 = parseAndExpr();
-		if (bs2 == 0) {
-			return 0;
-		}
-		/* printf("performing OR\n"); */
-		ys_bs_union(bs1,bs2);
-		ys_bs_destroy(bs2);
+		c = parseAndExpr();
+	}
+	if (c == 0) {
+		delete orCursor;
+		return 0;
 	}
-	return bs1;
+	c = orCursor->single();
+	if (c != 0) {
+		delete orCursor;
+		return c;
+	}
+	orCursor->start();
+	if (orCursor->estimate() > collection->getN() / YS_BOOL_DENSE_RATIO)
+		return makeDense(orCursor);
+	return orCursor;
 }
 
 /**
- * Parse AND expressions.
+ * Parse AND expressions, with the operands of NOT taken away from
+ * the others.
  */
-ys_bitset_t *
+YASENS BoolCursor *
 YASENS BoolSearch::parseAndExpr()
 {
-	ys_bitset_t *bs1, *bs2;
+	YASENS AndCursor *andCursor = new YASENS AndCursor();
+	bool negated;
+	YASENS BoolCursor *c = parseNotExpr(&negated);
 
-	bs1 = parseNotExpr();
-	while (bs1 != 0 && curtok == T_AND) {
+	while (c != 0) {
+		andCursor->add(c, negated);
+		if (curtok != T_AND)
+			break;
 		matchToken(T_AND);
-		bs2 = parseNotExpr();
-		if (bs2 == 0) {
-			return 0;
-		}
-		/* printf("performing AND\n"); */
-		ys_bs_intersect(bs1,bs2);
-		ys_bs_destroy(bs2);
+		c = parseNotExpr(&negated);
 	}
-	return bs1;
+	if (c == 0) {
+		delete andCursor;
+		return 0;
+	}
+	c = andCursor->single();
+	if (c != 0) {
+		delete andCursor;
+		return c;
+	}
+	andCursor->start(collection);
+	return andCursor;
 }
 
-ys_bitset_t *
-YASENS BoolSearch::parseNotExpr()
+/**
+ * Parses an operand of AND, setting negated if it follows an odd 
+ * number of NOTs.
+ */
+YASENS BoolCursor *
+YASENS BoolSearch::parseNotExpr(bool *negated)
 {
-	ys_bitset_t *bs1 = 0;
+	YASENS BoolCursor *c = 0;
 
+	*negated = false;
 	if (curtok == T_NOT) {
 		matchToken(T_NOT);
-		bs1 = parseNotExpr();
-		if (bs1 == 0) {
-			return 0;
-		}
-		/* printf("performing NOT\n"); */
-		ys_bs_complement(bs1);
+		c = parseNotExpr(negated);
+		*negated = !*negated;
 	}
 	else if (curtok == T_LPAREN) {
 		matchToken(T_LPAREN);
-		bs1 = parseExpr();
+		c = parseExpr();
 		matchToken(T_RPAREN);
 	}
-	else if (curtok == T_TERM) {
-		bs1 = ys_bs_alloc(collection->getN());
-		bitset = bs1;
-		findTerms();
-		bitset = 0;
-		matchToken(T_TERM);
+	else if (curtok == T_TERM || curtok == T_PHRASE) {
+		c = parsePositional();
 	}
 	else {
 		// ys_query_output_message(query->outp, YS_QRY_MSG_ERROR, "Syntax error: Unexpected input\n", query->termbuf);
-		bs1 = 0;
+		c = 0;
 	}
 		
-	return bs1;
+	return c;
 }
 
-ys_bitset_t *
+YASENS BoolCursor *
 YASENS BoolSearch::parseExpr()
 {
 	return parseOrExpr();
 }
 
+/**
+ * Replaces a cursor with a bitset of its documents.
+ */
+YASENS BoolCursor *
+YASENS BoolSearch::makeDense(YASENS BoolCursor *cursor)
+{
+	ys_bitset_t *bs = ys_bs_alloc(collection->getN());
+	for (; !cursor->atEnd(); cursor->next())
+		ys_bs_addmember(bs, cursor->docnum());
+	delete cursor;
+	return new YASENS BitsetCursor(bs);
+}
+
+static ys_bool_t ys_select_document( void *arg1, ys_docnum_t docnum, 
+	ys_doccnt_t dtf );
+
+/**
+ * Parses a term, a phrase, or terms and phrases joined by NEAR. A 
+ * term on its own is looked up as before, and may be a pattern.
+ * Operands past YS_POSITIONS_MAXTERMS words are left out.
+ */
+YASENS BoolCursor *
+YASENS BoolSearch::parsePositional()
+{
+	PositionalTerm terms[YS_POSITIONS_MAXTERMS];
+	ys_uchar_t text[YS_TERM_LEN+1];
+	int nterms = 0, noperands = 0;
+	ys_docpos_t distance = 0;
+	bool phrase = curtok == T_PHRASE;
+
+	strcpy((char *)text, (const char *)termbuf);
+	matchToken(curtok);
+	if (!phrase && curtok != T_NEAR)
+		return findTerms(text);
+	nterms = addOperand(text, phrase, noperands++, terms, nterms);
+	while (curtok == T_NEAR) {
+		if (nearDistance > distance)
+			distance = nearDistance;
+		matchToken(T_NEAR);
+		if (curtok != T_TERM && curtok != T_PHRASE) {
+			curtok = T_EOI;
+			return 0;
+		}
+		phrase = curtok == T_PHRASE;
+		strcpy((char *)text, (const char *)termbuf);
+		matchToken(curtok);
+		if (nterms < YS_POSITIONS_MAXTERMS)
+			nterms = addOperand(text, phrase, noperands++, terms, nterms);
+	}
+	return evaluatePositional(terms, nterms, noperands, distance);
+}
+
+/**
+ * Adds the words of a phrase, or a single term, to terms. Returns the
+ * new number of terms.
+ */
+int
+YASENS BoolSearch::addOperand(const ys_uchar_t *text, bool phrase, 
+	int operand, PositionalTerm *terms, int nterms)
+{
+	YASENS StringTokenizer st;
+	const ys_uchar_t *word = text;
+	ys_docpos_t offset = 0;
+
+	if (phrase) {
+		st.setInput(text);
+		word = st.nextToken();
+		if (word == 0)
+			word = st.endInput();
+	}
+	while (word != 0 && nterms < YS_POSITIONS_MAXTERMS) {
+		PositionalTerm *t = &terms[nterms++];
+		t->key[0] = strlen((const char *)word);
+		memcpy(t->key+1, word, t->key[0]+1);
+		if (collection->isStemmed())
+			stem(t->key);
+		t->operand = operand;
+		t->offset = offset++;
+		if (!phrase)
+			break;
+		word = st.nextToken();
+		if (word == 0)
+			word = st.endInput();
+	}
+	return nterms;
+}
+
+/**
+ * Finds the documents that hold all of the terms, and then, using the
+ * terms' positions, those where each phrase occurs and the phrases are
+ * near each other. A phrase with no words matches nothing.
+ */
+YASENS BoolCursor *
+YASENS BoolSearch::evaluatePositional(const PositionalTerm *terms, 
+	int nterms, int noperands, ys_docpos_t distance)
+{
+	YASENS TermRef *refs = new YASENS TermRef[nterms];
+	int i, o = 0;
+
+	for (i = 0; i < nterms; i++) {
+		if (i == 0 || terms[i].operand != terms[i-1].operand)
+			o++;
+		if (!collection->findTerm(terms[i].key, &refs[i])) 
+			break;
+	}
+	if (i < nterms || o < noperands) {
+		delete [] refs;
+		return new YASENS EmptyCursor();
+	}
+	if (!collection->hasPositions()) {
+		YASENS AndCursor *andCursor = new YASENS AndCursor();
+		for (i = 0; i < nterms; i++) {
+			YASENS TermBoolCursor *c = new YASENS TermBoolCursor();
+			andCursor->add(c, false);
+			if (c->open(collection, &refs[i], 1) != 0) {
+				delete andCursor;
+				delete [] refs;
+				return new YASENS EmptyCursor();
+			}
+		}
+		delete [] refs;
+		andCursor->start(collection);
+		return andCursor;
+	}
+
+	YASENS DocListCursor *found = new YASENS DocListCursor();
+
+	YASENS PositionsCursor *cursors = new YASENS PositionsCursor[nterms];
+	const ys_docpos_t *lists[YS_POSITIONS_MAXTERMS];
+	ys_doccnt_t counts[YS_POSITIONS_MAXTERMS];
+	ys_docpos_t offsets[YS_POSITIONS_MAXTERMS];
+	const ys_docpos_t *oplists[YS_POSITIONS_MAXTERMS];
+	ys_doccnt_t opcounts[YS_POSITIONS_MAXTERMS];
+	ys_docpos_t *starts[YS_POSITIONS_MAXTERMS];
+	ys_doccnt_t startsalloc[YS_POSITIONS_MAXTERMS];
+
+	for (o = 0; o < noperands; o++) {
+		starts[o] = 0;
+		startsalloc[o] = 0;
+	}
+	for (i = 0; i < nterms; i++) {
+		if (cursors[i].open(collection, &refs[i]) != 0)
+			break;
+	}
+	while (i == nterms) {
+		/* Move the cursors to the next document holding every term */
+		ys_docnum_t doc = 0;
+		int agree = 0;
+		for (i = 0; agree < nterms; i = (i+1) % nterms) {
+			cursors[i].skipTo(doc);
+			if (cursors[i].atEnd())
+				break;
+			if (cursors[i].docnum() > doc) {
+				doc = cursors[i].docnum();
+				agree = 1;
+			}
+			else
+				agree++;
+		}
+		if (agree < nterms)
+			break;
+
+		/* Each term of the phrase must follow the one before */
+		bool match = true;
+		for (o = 0, i = 0; o < noperands && match; o++) {
+			int k;
+			ys_doccnt_t least = 0;
+			for (k = 0; i < nterms && terms[i].operand == o; i++, k++) {
+				lists[k] = cursors[i].positions();
+				counts[k] = cursors[i].dtf();
+				offsets[k] = terms[i].offset;
+				if (lists[k] == 0)
+					match = false;
+				if (k == 0 || counts[k] < least)
+					least = counts[k];
+			}
+			if (!match)
+				break;
+			if (k == 1) {
+				oplists[o] = lists[0];
+				opcounts[o] = counts[0];
+				continue;
+			}
+			if (least > startsalloc[o]) {
+				free(starts[o]);
+				starts[o] = (ys_docpos_t *) malloc(least * sizeof *starts[o]);
+				startsalloc[o] = starts[o] != 0 ? least : 0;
+				if (starts[o] == 0) {
+					fprintf(stderr, "Error: ran out of memory\n");
+					match = false;
+					break;
+				}
+			}
+			opcounts[o] = ys_positions_phrase(lists, counts, offsets, k, 
+				starts[o]);
+			oplists[o] = starts[o];
+			match = opcounts[o] > 0;
+		}
+		/* and the phrases must be near each other */
+		if (match && noperands > 1)
+			match = ys_positions_near(oplists, opcounts, noperands, 
+				distance);
+		if (match && !found->add(doc))
+			break;
+		cursors[0].next();
+		i = nterms;
+	}
+
+	for (o = 0; o < noperands; o++)
+		free(starts[o]);
+	delete [] cursors;
+	delete [] refs;
+	return found;
+}
+
 bool 
 YASENS BoolSearch::selectDocument(ys_docnum_t docnum, ys_doccnt_t dtf)
 {
@@ -286,73 +961,130 @@ ys_select_document( void *arg1, ys_docnum_t docnum, ys_doccnt_t dtf )
 }
 
 /**
- * Called for each term found in the index. Retrieves all documents
- * for the term and saves them in the result tree.
- * Note that this function may be called to process exact as well as partial
- * matches. It is called for all terms after the first term that is found
- * - until it returns BOOL_FALSE. 
+ * Returns a cursor over the documents holding a term, or any of the
+ * terms a pattern expands to; if these are dense, their postings are
+ * merged into a bitset instead.
  */
-bool 
-YASENS BoolSearch::findDocs(ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t position, 
-					   ys_doccnt_t tf)
+YASENS BoolCursor *
+YASENS BoolSearch::findTerms(const ys_uchar_t *cp)
 {
-	if (key1[0] != key2[0])
-		return false;
-
-	if (strncmp( (const char *)key1+1, (const char *)key2+1, key1[0] ) == 0) {
-		collection->getPostFile()->iterate( position, ys_select_document, this );
-		return true;
+ 	ys_uchar_t key[YS_MAXKEYSIZE+1];
+	YASENS TermRef *refs;
+	int n = 0;
+		
+	/* printf("searching term %s\n", query->termbuf); */
+	if (YASENS Collection::isPattern(cp)) {
+		refs = new YASENS TermRef[collection->getMaxExpansion()];
+		n = collection->expandTerm(cp, refs);
 	}
-
-	return false;
+	else {
+		key[0] = strlen((const char *)cp);
+		memcpy(key+1, cp, key[0]+1);
+		if (collection->isStemmed())
+			stem(key);
+		refs = new YASENS TermRef[1];
+		if (collection->findTerm( key, &refs[0] ))
+			n = 1;
+	}
+	if (n <= 0) {
+		delete [] refs;
+		return new YASENS EmptyCursor();
+	}
+	ys_doccnt_t tf = 0;
+	for (int i = 0; i < n; i++)
+		tf += refs[i].tf;
+	if (n > 1 && tf > collection->getN() / YS_BOOL_DENSE_RATIO) {
+		/* The bitset merges the terms' postings */
+		bitset = ys_bs_alloc(collection->getN());
+		for (int i = 0; i < n; i++)
+			collection->iterate( &refs[i], ys_select_document, this );
+		YASENS BoolCursor *c = new YASENS BitsetCursor(bitset);
+		bitset = 0;
+		delete [] refs;
+		return c;
+	}
+	YASENS TermBoolCursor *c = new YASENS TermBoolCursor();
+	int rc = c->open(collection, refs, n);
+	delete [] refs;
+	if (rc != 0) {
+		delete c;
+		return new YASENS EmptyCursor();
+	}
+	return c;
 }
 
-/**
- * Called for each term found in the index. Retrieves all documents
- * for the term and saves them in the result tree.
- * Note that this function may be called to process exact as well as partial
- * matches. It is called for all terms after the first term that is found
- * - until it returns BOOL_FALSE. 
- */
-static ys_bool_t 
-ys_find_docs( ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t position, ys_doccnt_t tf, 
-	void *arg )
+bool
+YASENS BoolSearch::getCacheKey(char *key, size_t size)
 {
-	YASENS BoolSearch *search = (YASENS BoolSearch *)arg;
-	return search->findDocs(key1, key2, position, tf);
-}
+	YASENS StringTokenizer st;
+	const ys_uchar_t *word;
+	char buf[32];
+	bool ok = true;
 
-void
-YASENS BoolSearch::findTerms()
-{
- 	ys_uchar_t key[YS_MAXKEYSIZE+1];
-	ys_uchar_t *cp = termbuf;
-		
-	/* printf("searching term %s\n", query->termbuf); */
-	key[0] = strlen((const char *)cp);
-	memcpy(key+1, cp, key[0]+1);
-	if (collection->isStemmed())
-		stem(key);
-	ys_btree_iterate( collection->getIndex(), key, ys_find_docs, this );
+	key[0] = 0;
+	tokptr = input;
+	for (getToken(); ok && curtok != T_EOI; getToken()) {
+		const char *op = 0;
+		switch (curtok) {
+		case T_TERM: 
+			ok = addKeyWord(key, size, termbuf);
+			continue;
+		case T_PHRASE: 
+			ok = addKeyText(key, size, key[0] ? " \"" : "\"");
+			st.setInput(termbuf);
+			word = st.nextToken();
+			if (word == 0)
+				word = st.endInput();
+			while (ok && word != 0) {
+				ok = addKeyWord(key, size, word);
+				word = st.nextToken();
+				if (word == 0)
+					word = st.endInput();
+			}
+			ok = ok && addKeyText(key, size, " \"");
+			continue;
+		case T_NEAR:
+			snprintf(buf, sizeof buf, "NEAR/%lu", 
+				(unsigned long) nearDistance);
+			op = buf;
+			break;
+		case T_LPAREN: op = "("; break;
+		case T_RPAREN: op = ")"; break;
+		case T_AND: op = "AND"; break;
+		case T_OR: op = "OR"; break;
+		default: op = "NOT"; break;
+		}
+		if (key[0] != 0)
+			ok = addKeyText(key, size, " ");
+		ok = ok && addKeyText(key, size, op);
+	}
+	return ok;
 }
 
-
+/**
+ * A query with a syntax error matches nothing.
+ */
 YASENS SearchResultSet *
 YASENS BoolSearch::executeQuery()
 {
+	YASENS BoolCursor *cursor = 0;
+
 	startTimer();
 	tokptr = input;
 	getToken();
 	/* printf("parsing expr\n"); */
-	bitset = 0;
 	if (curtok != T_EOI) {
-		bitset = parseExpr();
+		cursor = parseExpr();
 		if (curtok != T_EOI) {
 			// ys_query_output_message(query->outp, YS_QRY_MSG_ERROR, "Syntax error in expression at '%s'\n", query->termbuf);
-			bitset = 0;
+			delete cursor;
+			cursor = 0;
 		}
 	}
+	YASENS BoolSearchResultSet *rs = new YASENS BoolSearchResultSet(cursor, 
+		collection->getN());
+	delete cursor;
 	stopTimer();
-	return new YASENS BoolSearchResultSet(bitset, elapsed);
+	rs->setElapsedTime(elapsed);
+	return rs;
 }
-
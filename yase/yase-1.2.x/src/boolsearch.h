@@ -28,36 +28,77 @@
 #include "bitset.h"
 #include "stem.h"
 #include "tokenizer.h"
+#include "positions.h"
+
+enum {
+	YS_NEAR_DISTANCE = 10,		/* default window of NEAR */
+	YS_BOOL_DENSE_RATIO = 16	/* unions of more than N/16 documents 
+					   are kept as bitsets */
+};
 
 YASE_NS_BEGIN
 
 class BoolSearchResultSet;
+class BoolCursor;
 
+/**
+ * Evaluates boolean queries: terms joined by AND, OR and NOT, with
+ * parentheses. A "quoted phrase" matches documents holding its words
+ * in that order, and a NEAR b, or a NEAR/n b, documents where a and b
+ * start within n words (default YS_NEAR_DISTANCE) of each other, in 
+ * either order; a and b may be terms or phrases, and a chain of NEARs
+ * uses the largest n. These use the positions recorded by yasemakedb 
+ * -P; without them, the words need only occur in the same document.
+ * Terms in phrases and NEAR are not expanded as patterns, and only the
+ * first YS_POSITIONS_MAXTERMS words are used.
+ *
+ * The query is evaluated with cursors over the terms' postings, in
+ * docnum order. AND is driven by its rarest operand, the others 
+ * skipping ahead to its documents, and NOT removes documents from
+ * the AND it is part of; OR merges its operands, unless they hold so 
+ * many documents that a bitset is cheaper.
+ */
 class BoolSearch : public Search {
 private:
+	struct PositionalTerm {
+		ys_uchar_t key[YS_MAXKEYSIZE+1];	/* length prefixed */
+		int operand;			/* phrase or term of NEAR */
+		ys_docpos_t offset;		/* within the phrase */
+	};
+
 	ys_uchar_t *tokptr;			  /* boolean query lexer */
 	int curtok;				  /* boolean query current token */
-	ys_bitset_t *bitset;			  /* boolean query bitset */
+	ys_bitset_t *bitset;			  /* filled by selectDocument() */
 	ys_uchar_t termbuf[YS_TERM_LEN+1];	  /* boolean query term */
+	ys_docpos_t nearDistance;		  /* of the last NEAR token */
 	BoolSearchResultSet *resultSet;
-	YASENS CharTokenizer tokenizer;
+	YASENS TPatternTokenizer<YASENS CharTokenizer> tokenizer;
 public:
 	BoolSearch(YASENS Collection *collection);
 	~BoolSearch();
 	bool parseQuery() { return true; }
+	/**
+	 * The key is the query's tokens, with the words of terms and 
+	 * phrases as they are looked up.
+	 */
+	bool getCacheKey(char *key, size_t size);
 	SearchResultSet *executeQuery();
 private:
 	int getToken();
 	void matchToken(int tok);
-	ys_bitset_t *parseOrExpr();
-	ys_bitset_t *parseAndExpr();
-	ys_bitset_t *parseNotExpr();
-	ys_bitset_t *parseExpr();
-	void findTerms();
+	BoolCursor *parseOrExpr();
+	BoolCursor *parseAndExpr();
+	BoolCursor *parseNotExpr(bool *negated);
+	BoolCursor *parseExpr();
+	BoolCursor *parsePositional();
+	int addOperand(const ys_uchar_t *text, bool phrase, int operand,
+		PositionalTerm *terms, int nterms);
+	BoolCursor *evaluatePositional(const PositionalTerm *terms, 
+		int nterms, int noperands, ys_docpos_t distance);
+	BoolCursor *findTerms(const ys_uchar_t *term);
+	BoolCursor *makeDense(BoolCursor *cursor);
 public:
 	bool selectDocument(ys_docnum_t docnum, ys_doccnt_t dtf);
-	bool findDocs(ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t position, 
-					   ys_doccnt_t tf);
 
 };
 
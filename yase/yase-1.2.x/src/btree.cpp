@@ -40,6 +40,14 @@
  * DM 03-12-12 Implemented B+Tree 
  * DM 03-12-02 Found a bug in ys_block_set_curkey() and fixed it.
  * DM 07-02-03 Added ys_btree_find() and ys_btree_verify().
+ *    17-10-26 Trees are bulk loaded through ys_btree_load_begin(),
+ *             ys_btree_load_add() and ys_btree_load_end(), which keep 
+ *             the separator keys in memory instead of re-reading a temporary
+ *             file for each level. ys_btree_create() reads yase.words once.
+ *             Blocks can be left partly empty with a fill factor.
+ *    17-10-26 The offsets of keys are kept with the buffer pool frame and
+ *             shared by the block's readers; each reader has its own 
+ *             cursor in the ys_block_t returned by ys_blockfile_get().
  */
 /***
  * To test the code here in standalone mode, try:
@@ -120,7 +128,7 @@ static int ys_block_insert(ys_block_t *block, ys_uchar_t *key, ys_blocknum_t bn,
 static inline ys_bool_t
 ys_block_isleaf(ys_block_t *block)
 {
-	return (block->bd.flags & YS_BTREENODE_ISLEAF);
+	return (block->bd->flags & YS_BTREENODE_ISLEAF);
 }
 
 /**
@@ -130,7 +138,7 @@ ys_block_isleaf(ys_block_t *block)
 static inline ys_bool_t
 ys_block_iseof(ys_block_t *block)
 {
-	return (block->curknum > block->bd.keycount);
+	return (block->curknum > block->bd->keycount);
 }
 
 /**
@@ -186,13 +194,14 @@ ys_block_init(ys_block_t *block, ys_flag_t flags)
 {
 	block->curknum = 1;
 	ys_block_init_curkey(block);
-	/* block->offsets */
-
-	block->bd.flags |= flags;
-	block->bd.freespace = sizeof block->bd.keyspace;
-	block->bd.keycount = 0;
-	block->bd.lowernode = 0;
-	/* block->bd.keyspace */
+	block->frame->offsets_valid = BOOL_TRUE;
+	block->offsets_valid = BOOL_TRUE;
+
+	block->bd->flags |= flags;
+	block->bd->freespace = sizeof block->bd->keyspace;
+	block->bd->keycount = 0;
+	block->bd->lowernode = 0;
+	/* block->bd->keyspace */
 }
 
 /**
@@ -395,10 +404,10 @@ ys_block_calc_offsets(ys_block_t *block)
 	ys_uchar_t *cp, *ks;
 	ys_keycnt_t k;
 	
-	assert(block->bd.keycount <= Max_key_count);
+	assert(block->bd->keycount <= Max_key_count);
 
-	ks = cp = block->bd.keyspace;
-	for (k = 0; k < block->bd.keycount; k++) {
+	ks = cp = block->bd->keyspace;
+	for (k = 0; k < block->bd->keycount; k++) {
 		ys_len_t prefix_len, key_len;
 		ys_len_t bnsize, vlsize, ctsize;
 		ys_doccnt_t ct;
@@ -408,6 +417,8 @@ ys_block_calc_offsets(ys_block_t *block)
 			ctsize, ct);
 		cp += (key_len+bnsize+vlsize+ctsize);
 	}
+	block->frame->offsets_valid = BOOL_TRUE;
+	block->offsets_valid = BOOL_TRUE;
 }
 
 /**
@@ -417,14 +428,23 @@ static ys_uchar_t *
 ys_block_curentry(ys_block_t *block)
 {
 	ys_uchar_t *cp;
-	assert(block->curknum > 0 && block->curknum <= block->bd.keycount+1);
+	assert(block->curknum > 0 && block->curknum <= block->bd->keycount+1);
+
+	if (!block->offsets_valid) {
+		/* the offsets are shared by all readers of the block */
+		ys_blockfile_latch(block);
+		if (!block->frame->offsets_valid)
+			ys_block_calc_offsets(block);
+		ys_blockfile_unlatch(block);
+		block->offsets_valid = BOOL_TRUE;
+	}
 
-	if (block->curknum == block->bd.keycount+1)
+	if (block->curknum == block->bd->keycount+1)
 		/* Beyond last key */
-		cp = &block->bd.keyspace
-			[sizeof block->bd.keyspace - block->bd.freespace];
+		cp = &block->bd->keyspace
+			[sizeof block->bd->keyspace - block->bd->freespace];
 	else
-		cp = &block->bd.keyspace
+		cp = &block->bd->keyspace
 			[block->offsets[block->curknum-1]];
 	return cp;
 }
@@ -443,9 +463,9 @@ ys_block_read_curkey(ys_block_t *block)
 	ys_doccnt_t ct;
 	
 	assert(block->curknum > 0);
-	assert(block->curknum <= block->bd.keycount+1);
+	assert(block->curknum <= block->bd->keycount+1);
 
-	if (block->bd.keycount == 0 || ys_block_iseof(block)) {
+	if (block->bd->keycount == 0 || ys_block_iseof(block)) {
 		/* empty block or EOF */
 		ys_block_init_curkey(block);
 		return;
@@ -487,13 +507,13 @@ ys_block_curentry_len(ys_block_t *block)
 static int
 ys_block_goto(ys_block_t *block, ys_keycnt_t k)
 {
-	assert(k <= block->bd.keycount+1);
+	assert(k <= block->bd->keycount+1);
 
 	if (k == 0) {
 		/* This can only be requested when the block is
 		 * empty.
 		 */
-		assert(block->bd.keycount == 0);
+		assert(block->bd->keycount == 0);
 		block->curknum = k = 1;
 	}
 
@@ -534,7 +554,7 @@ static inline void
 ys_block_gobottom(ys_block_t *block)
 {
 	/* if keycount is 0, ys_block_goto() will adjust automatically */
-	ys_block_goto(block, block->bd.keycount);
+	ys_block_goto(block, block->bd->keycount);
 }
 
 /**
@@ -556,18 +576,19 @@ ys_block_write_entry(ys_uchar_t *cp, ys_uchar_t *key, ys_len_t prefix_len,
 }
 
 /**
- * Add an entry to the block.
+ * Add an entry to the block. Unless the block is empty, reserve bytes
+ * of key space are left free.
  */
 static int 
 block_addentry(ys_block_t *block, ys_uchar_t *key, ys_blocknum_t bn, ys_filepos_t vl,
-	ys_doccnt_t ct)
+	ys_doccnt_t ct, ys_keyoffset_t reserve = 0)
 {
 	ys_elen_t entry_len;
 	ys_len_t prefix_len, key_len;
 	ys_len_t bnsize, vlsize, ctsize;
 	ys_uchar_t *cp;
 	
-	if (block->bd.keycount == Max_key_count)
+	if (block->bd->keycount == Max_key_count)
 		return -1;
 
 #if _DUMP_TREE_READ_WRITE
@@ -588,7 +609,9 @@ block_addentry(ys_block_t *block, ys_uchar_t *key, ys_blocknum_t bn, ys_filepos_
 	entry_len = ENTRY_LEN(key_len,bnsize,vlsize,ctsize);
 
 	/* is there space for the new entry ? */
-	if (entry_len > block->bd.freespace)
+	if (entry_len > block->bd->freespace ||
+		(block->bd->keycount > 0 && 
+		 entry_len + reserve > block->bd->freespace))
 		return -1;
 
 	/* go past the current entry - if we are already at EOF,
@@ -597,12 +620,12 @@ block_addentry(ys_block_t *block, ys_uchar_t *key, ys_blocknum_t bn, ys_filepos_
 	cp = ys_block_curentry(block);
 	cp += ys_block_curentry_len(block);
 
-	if (block->bd.keycount > 0)
+	if (block->bd->keycount > 0)
 		/* when keycount == 0, curknum is already 1 */
 		block->curknum++;
-	block->bd.keycount++;
-	block->offsets[block->curknum-1] = cp - block->bd.keyspace;
-	block->bd.freespace -= entry_len;
+	block->bd->keycount++;
+	block->offsets[block->curknum-1] = cp - block->bd->keyspace;
+	block->bd->freespace -= entry_len;
 
 	ys_block_set_curkey(block, key, prefix_len, key_len, BOOL_TRUE,
 		bn, bnsize, vl, vlsize, ct, ctsize);
@@ -645,9 +668,9 @@ ys_block_dump(ys_block_t *block)
 
 	knum = block->curknum;
 	printf("Block number = %ld\n", block->blocknum);
-	printf("      keycount = %d\n", block->bd.keycount);
-	printf("      lowernode = %ld\n", block->bd.lowernode);
-	for (i = 1; i <= block->bd.keycount; i++) {
+	printf("      keycount = %d\n", block->bd->keycount);
+	printf("      lowernode = %ld\n", block->bd->lowernode);
+	for (i = 1; i <= block->bd->keycount; i++) {
 		ys_block_goto(block, i);
 #if _DUMP_TREE_READ_WRITE
 		printf("block# %lu: read '%.*s(%d,%d)',%ld(%d),%ld(%d),%ld(%d)\n", 
@@ -663,9 +686,9 @@ ys_block_dump(ys_block_t *block)
 		printf(", ptr = %ld\n", block->curptr);
 	}
 	printf("free space calculated = %d\n", 
-		sizeof block->bd.keyspace-space_used);
-	printf("free space reported = %d\n", block->bd.freespace);
-	assert((sizeof block->bd.keyspace)-space_used == block->bd.freespace);
+		sizeof block->bd->keyspace-space_used);
+	printf("free space reported = %d\n", block->bd->freespace);
+	assert((sizeof block->bd->keyspace)-space_used == block->bd->freespace);
 	ys_block_goto(block, knum);
 }
 
@@ -680,20 +703,20 @@ ys_block_check_integrity(ys_block_t *block)
 	ys_keyoffset_t space_used = 0;
 
 	knum = block->curknum;
-	for (i = 1; i <= block->bd.keycount; i++) {
+	for (i = 1; i <= block->bd->keycount; i++) {
 		ys_block_goto(block, i);
 		space_used += ys_block_curentry_len(block);
 	}
-	if ((sizeof block->bd.keyspace)-space_used != block->bd.freespace) {
+	if ((sizeof block->bd->keyspace)-space_used != block->bd->freespace) {
 		printf("Block number = %ld\n", block->blocknum);
-		printf("      keycount = %d\n", block->bd.keycount);
-		printf("      lowernode = %ld\n", block->bd.lowernode);
-		printf("      total key space = %d\n", sizeof block->bd.keyspace);
+		printf("      keycount = %d\n", block->bd->keycount);
+		printf("      lowernode = %ld\n", block->bd->lowernode);
+		printf("      total key space = %d\n", sizeof block->bd->keyspace);
 		printf("      free space calculated = %d\n", 
- 			sizeof block->bd.keyspace-space_used);
-		printf("      free space reported = %d\n", block->bd.freespace);
+ 			sizeof block->bd->keyspace-space_used);
+		printf("      free space reported = %d\n", block->bd->freespace);
 		space_used = 0;
-		for (i = 1; i <= block->bd.keycount; i++) {
+		for (i = 1; i <= block->bd->keycount; i++) {
 			int len;
 			ys_block_goto(block, i);
 			len = ys_block_curentry_len(block);
@@ -707,7 +730,7 @@ ys_block_check_integrity(ys_block_t *block)
 			space_used += len;
 		}
 	}
-	assert((sizeof block->bd.keyspace)-space_used == block->bd.freespace);
+	assert((sizeof block->bd->keyspace)-space_used == block->bd->freespace);
 	ys_block_goto(block, knum);
 }
 
@@ -757,126 +780,225 @@ ys_get_record(ys_file_t *fp, ys_bool_t yaseformat)
 	
 /***
 * Build a tree from the bottom up.
-* First build the leaf nodes. Build a list of keys that should
-* go to the parent nodes and save these to a temporary file.
-* Once all leaf nodes are built, repeat the process, only this time
-* use the temporary file as the source for keys, building the parent 
-* nodes, while creating another temporary file to store grand-parent
-* keys. Repeat until no more keys to process.
-* The process progressively rises higher up the tree until the
-* root node is built.
+* Keys arrive in ascending order and are added to the current leaf
+* until it is full. The key that does not fit becomes a separator: it
+* is kept in memory, with a pointer to the next leaf, which is started
+* with the separator's left child as its lower node. Once all leaf nodes
+* are built, the separators are loaded in the same way to build the
+* parent nodes, collecting the grand-parent keys, and so on until a 
+* level fits in one block, which is the root.
+* Each block is filled up to the fill factor, so that keys can later be
+* inserted without splitting every block.
 */
-int
-ys_btree_create( const char *treename, const char *inputname )
-{
-	ys_file_t *fp = NULL;
-	ys_file_t *tempfp = NULL;
-	char tempfile[1024];
-	int tempfnum = 0;
-	ys_block_t *block = NULL;
-	ys_blocknum_t rootblock = 0;
-	ys_blocknum_t firstblocknum = 0;
-	ys_blocknum_t lastblocknum = 0;
-	ys_bool_t leaflevel = BOOL_TRUE;
+struct ys_btree_loader_t {
 	ys_blockfile_t *file;
-	ys_block_t *headerblock = NULL;
-	ys_header_t *header = NULL;
+	ys_block_t *headerblock;
+	ys_block_t *block;		/* block being filled */
+	ys_bool_t leaflevel;
+	ys_blocknum_t firstblocknum;	/* first block of the level below */
+	ys_blocknum_t levelblocknum;	/* first block of this level */
+	ys_blocknum_t lastblocknum;
+	ys_keyoffset_t reserve;		/* key space left free in a block */
+	ys_entry_t *seps;		/* keys for the next level */
+	size_t nseps;
+	size_t nalloc;
+	ys_uchar_t lastkey[YS_MAXKEYSIZE+1];
+	unsigned long nkeys;
+	int rc;
+};
 
-	file = ys_blockfile_open( treename, "w+" );
-	if (file == NULL)
-		return -1;
+/**
+ * Adds an entry to the current level. e->bn is the entry's right
+ * child, 0 in leaves.
+ */
+static int
+ys_btree_load_entry( ys_btree_loader_t *loader, ys_entry_t *e )
+{
+	ys_block_t *block = loader->block;
+
+	if (block == NULL) {
+		block = ys_block_new(loader->file, loader->leaflevel);
+		if (block == NULL)
+			return -1;
+		block->bd->lowernode = loader->firstblocknum;
+		loader->levelblocknum = block->blocknum;
+		loader->lastblocknum = block->blocknum;
+		loader->block = block;
+	}
+	if (block_addentry(block, e->key, e->bn, e->vl, e->doccnt,
+		loader->reserve) == 0)
+		return 0;
 
-	fp = ys_file_open( inputname, "r", YS_FILE_ABORT_ON_ERROR );
-	if (fp == NULL) {
-		fprintf(stderr, "Failed to open file %s\n",
-			inputname );
-		return -1;
+	if (loader->nseps == loader->nalloc) {
+		size_t nalloc = loader->nalloc == 0 ? 64 : loader->nalloc*2;
+		ys_entry_t *seps = (ys_entry_t *) realloc(loader->seps, 
+			nalloc * sizeof *seps);
+		if (seps == NULL) {
+			fprintf(stderr, "Error: ran out of memory\n");
+			return -1;
+		}
+		loader->seps = seps;
+		loader->nalloc = nalloc;
 	}
-	headerblock = ys_blockfile_new( file );
+	block->dirty = BOOL_TRUE;
+	ys_blockfile_put( loader->file, block );
+	block = ys_block_new( loader->file, loader->leaflevel );
+	loader->block = block;
+	if (block == NULL)
+		return -1;
+	loader->lastblocknum = block->blocknum;
+	block->bd->lowernode = e->bn;
+	e->bn = block->blocknum;
+	loader->seps[loader->nseps++] = *e;
+	return 0;
+}
 
-	while ( fp != NULL ) {
-		ys_rec_t *rec;
-		ys_file_rewind(fp);
-		while ( (rec = ys_get_record(fp, leaflevel)) != NULL ) {
+/**
+ * Starts loading a new tree. fillfactor is the percentage of each block 
+ * to fill; 0 fills blocks completely.
+ */
+ys_btree_loader_t *
+ys_btree_load_begin( const char *treename, int fillfactor )
+{
+	ys_btree_loader_t *loader;
 
-			ys_entry_t e;
-			int status;
+	if (fillfactor <= 0 || fillfactor > 100)
+		fillfactor = 100;
+	loader = (ys_btree_loader_t *) calloc(1, sizeof *loader);
+	if (loader == NULL) {
+		fprintf(stderr, "Error: ran out of memory\n");
+		return NULL;
+	}
+	loader->file = ys_blockfile_open( treename, "w+" );
+	if (loader->file == NULL) {
+		free(loader);
+		return NULL;
+	}
+	loader->headerblock = ys_blockfile_new( loader->file );
+	loader->leaflevel = BOOL_TRUE;
+	loader->reserve = (ys_keyoffset_t) 
+		((YS_BTREE_MAXKEYSPACE * (100 - fillfactor)) / 100);
+	return loader;
+}
 
-			e.key[0] = strlen(rec->word);
-			memcpy(e.key+1, rec->word, e.key[0]+1);
-			e.vl = rec->posting_offset;
-			if (leaflevel) e.bn = 0;
-			else e.bn = rec->blockptr;
-			e.doccnt = rec->doccnt;
+/**
+ * Adds the next key to the leaves. Keys must be added in ascending 
+ * order.
+ */
+int
+ys_btree_load_add( ys_btree_loader_t *loader, ys_uchar_t *key, 
+	ys_filepos_t value, ys_doccnt_t doccnt )
+{
+	ys_entry_t e;
 
+	if (loader->rc != 0)
+		return -1;
+	if (key[0] > YS_MAXKEYSIZE || (loader->nkeys > 0 && 
+		ys_key_compare(key, loader->lastkey) <= 0)) {
+		fprintf(stderr, "Error: cannot add key %.*s to the btree\n", 
+			key[0], key+1);
+		loader->rc = -1;
+		return -1;
+	}
+	memcpy(e.key, key, key[0]+1);
+	memcpy(loader->lastkey, key, key[0]+1);
+	loader->nkeys++;
+	e.vl = value;
+	e.doccnt = doccnt;
+	e.bn = 0;
 #ifdef TEST_BTREE
-			if (leaflevel) {
-				Keys_added++;
-			}
+	Keys_added++;
 #endif
-				
-			if (block == NULL) {
-				block = ys_block_new(file, leaflevel);
-				assert(block->ref == 1);
-				lastblocknum = block->blocknum;
-				block->bd.lowernode = firstblocknum;
-				rootblock = block->blocknum;
-			}
+	if (ys_btree_load_entry(loader, &e) != 0)
+		loader->rc = -1;
+	return loader->rc;
+}
 
-#ifdef TEST_BTREE
-			/* When testing we force Max_key_count
-			 * to be a small so that we can trigger
-			 * node splits more often.
-			 */
-			if (block->bd.keycount == Max_key_count)
-				status = -1;
-			else
-#endif
-			status = block_addentry( block, e.key, e.bn, 
-				e.vl, e.doccnt);
-			if (status != 0) {
-				if (tempfp == NULL) {
-					sprintf(tempfile, "tmp.%d.btree", 
-						++tempfnum);
-					tempfp = ys_file_open(tempfile, "w+",
-						YS_FILE_ABORT_ON_ERROR);
-					firstblocknum = block->blocknum;
-				}
-				block->dirty = BOOL_TRUE;
-				assert(block->ref == 1);
-				ys_blockfile_put( file, block );
-				block = ys_block_new( file, leaflevel );
-				assert(block->ref == 1);
-				lastblocknum = block->blocknum;
-				block->bd.lowernode = e.bn;
-				e.bn = block->blocknum;
-				ys_file_printf(tempfp, "%s:%ld:%ld:%ld\n", 
-					e.key+1, e.vl, e.doccnt, e.bn);
-			}
-		}
-		ys_file_close(fp);
-		fp = tempfp;
-		tempfp = NULL;
-		leaflevel = BOOL_FALSE;
-		block->dirty = BOOL_TRUE;
-		ys_blockfile_put( file, block );
-		block = NULL;
+/**
+ * Builds the upper levels from the separators, writes the header and 
+ * closes the tree. The loader is freed.
+ */
+int
+ys_btree_load_end( ys_btree_loader_t *loader )
+{
+	ys_header_t *header;
+	int rc = loader->rc;
+
+	if (rc == 0 && loader->block == NULL) {
+		/* no keys, the root is an empty leaf */
+		loader->block = ys_block_new(loader->file, BOOL_TRUE);
+		if (loader->block == NULL)
+			rc = -1;
+		else
+			loader->levelblocknum = loader->lastblocknum = 
+				loader->block->blocknum;
 	}
-		
-	header = (ys_header_t *)&headerblock->bd;
-	header->root = rootblock;
-	header->lastblock= lastblocknum;
-	headerblock->dirty = BOOL_TRUE;
-	ys_blockfile_put( file, headerblock );
-	ys_blockfile_close( file );
+	while (rc == 0) {
+		ys_entry_t *keys = loader->seps;
+		size_t i, nkeys = loader->nseps;
+
+		loader->block->dirty = BOOL_TRUE;
+		ys_blockfile_put( loader->file, loader->block );
+		loader->block = NULL;
+		if (nkeys == 0)
+			break;
 
-	while (tempfnum > 0) {
-		sprintf(tempfile, "tmp.%d.btree", 
-			tempfnum--);
-		remove(tempfile);
+		loader->seps = NULL;
+		loader->nseps = loader->nalloc = 0;
+		loader->leaflevel = BOOL_FALSE;
+		loader->firstblocknum = loader->levelblocknum;
+		for (i = 0; i < nkeys && rc == 0; i++)
+			rc = ys_btree_load_entry(loader, &keys[i]);
+		free(keys);
+		if (loader->block == NULL)
+			rc = -1;
+	}
+	if (loader->block != NULL)
+		ys_blockfile_put( loader->file, loader->block );
+	if (rc == 0) {
+		header = (ys_header_t *)loader->headerblock->bd;
+		header->root = loader->levelblocknum;
+		header->lastblock = loader->lastblocknum;
+		loader->headerblock->dirty = BOOL_TRUE;
 	}
+	ys_blockfile_put( loader->file, loader->headerblock );
+	ys_blockfile_close( loader->file );
+	free(loader->seps);
+	free(loader);
+	return rc;
+}
 
-	return 0;
+/**
+ * Build a tree from the terms in a yase.words file.
+ */
+int
+ys_btree_create( const char *treename, const char *inputname )
+{
+	ys_file_t *fp = NULL;
+	ys_btree_loader_t *loader = NULL;
+	ys_rec_t *rec;
+	ys_uchar_t key[YS_MAXKEYSIZE+1];
+
+	fp = ys_file_open( inputname, "r", YS_FILE_ABORT_ON_ERROR );
+	if (fp == NULL) {
+		fprintf(stderr, "Failed to open file %s\n",
+			inputname );
+		return -1;
+	}
+	loader = ys_btree_load_begin( treename, 0 );
+	if (loader == NULL) {
+		ys_file_close(fp);
+		return -1;
+	}
+	while ( (rec = ys_get_record(fp, BOOL_TRUE)) != NULL ) {
+		key[0] = strlen(rec->word);
+		memcpy(key+1, rec->word, key[0]);
+		if (ys_btree_load_add( loader, key, rec->posting_offset, 
+			rec->doccnt ) != 0)
+			break;
+	}
+	ys_file_close(fp);
+	return ys_btree_load_end( loader );
 }
 
 int
@@ -931,9 +1053,9 @@ ys_bplustree_create( const char *treename, const char *inputname )
 			if (block == NULL) {
 				/* first block on this level */
 				block = ys_block_new(file, leaflevel);
-				assert(block->ref == 1);
+				assert(block->frame->ref == 1);
 				lastblocknum = block->blocknum;
-				block->bd.lowernode = firstblocknum;
+				block->bd->lowernode = firstblocknum;
 				rootblock = block->blocknum;
 			}
 
@@ -942,7 +1064,7 @@ ys_bplustree_create( const char *treename, const char *inputname )
 			 * to be a small so that we can trigger
 			 * node splits more often.
 			 */
-			if (block->bd.keycount == Max_key_count)
+			if (block->bd->keycount == Max_key_count)
 				status = -1;
 			else
 #endif
@@ -960,13 +1082,13 @@ ys_bplustree_create( const char *treename, const char *inputname )
 				block->dirty = BOOL_TRUE;
 				nblock = ys_block_new( file, leaflevel );
 				if (leaflevel) {
-					block->bd.lowernode = nblock->blocknum;
+					block->bd->lowernode = nblock->blocknum;
 				}
-				assert(block->ref == 1);
+				assert(block->frame->ref == 1);
 				ys_blockfile_put( file, block );
 				// block = ys_block_new( file, leaflevel );
 				block = nblock;
-				assert(block->ref == 1);
+				assert(block->frame->ref == 1);
 				lastblocknum = block->blocknum;
 				if (leaflevel) {
 					status = block_addentry( block, e.key, e.bn, 
@@ -976,10 +1098,10 @@ ys_bplustree_create( const char *treename, const char *inputname )
 							__FILE__, __LINE__);
 						exit(1);
 					}
-					block->bd.lowernode = 0;
+					block->bd->lowernode = 0;
 				}
 				else {
-					block->bd.lowernode = e.bn;
+					block->bd->lowernode = e.bn;
 					e.vl = 0;
 					e.doccnt = 0;
 				}
@@ -997,7 +1119,7 @@ ys_bplustree_create( const char *treename, const char *inputname )
 		block = NULL;
 	}
 		
-	header = (ys_header_t *)&headerblock->bd;
+	header = (ys_header_t *)headerblock->bd;
 	header->root = rootblock;
 	header->lastblock= lastblocknum;
 	headerblock->dirty = BOOL_TRUE;
@@ -1037,11 +1159,11 @@ ys_btree_create_empty( const char *treename )
 	lastblocknum = block->blocknum;
 	rootblock = block->blocknum;
 
-	block->bd.lowernode = 0;
+	block->bd->lowernode = 0;
 	block->dirty = BOOL_TRUE;
 	ys_blockfile_put( file, block );
 		
-	header = (ys_header_t *)&headerblock->bd;
+	header = (ys_header_t *)headerblock->bd;
 	header->root = rootblock;
 	header->lastblock = lastblocknum;
 	headerblock->dirty = BOOL_TRUE;
@@ -1063,8 +1185,7 @@ ys_block_getblock(ys_blockfile_t *file, ys_blocknum_t bn)
 	block = ys_blockfile_get( file, bn );
 	block->curknum = 1;
 	ys_block_init_curkey(block);
-	/* block->offsets */
-	ys_block_calc_offsets(block);
+	/* block->offsets are calculated on first use */
 
 	return block;
 }
@@ -1085,7 +1206,7 @@ ys_btree_dump_blocks( const char *treename )
 	if (file == NULL)
 		return;
 	headerblock = ys_blockfile_get( file, 1 );
-	header = (ys_header_t *)&headerblock->bd;
+	header = (ys_header_t *)headerblock->bd;
 
 	/* printf("root block = %lu\n", header->root); */
 	for (blocknum = 2; blocknum <= header->lastblock; blocknum++) {
@@ -1099,10 +1220,11 @@ ys_btree_dump_blocks( const char *treename )
 }
 
 /**
- * Open a BTree.
+ * Open a BTree with a buffer pool of nblocks blocks (0 selects the
+ * default size).
  */
 ys_btree_t *
-ys_btree_open_mode( const char *treename, const char *mode )
+ys_btree_open_cache( const char *treename, const char *mode, size_t nblocks )
 {
 	ys_btree_t *tree;
 
@@ -1112,17 +1234,67 @@ ys_btree_open_mode( const char *treename, const char *mode )
 		fprintf(stderr, "Cannot ys_allocate a btree\n");
 		return NULL;
 	}
-	tree->file = ys_blockfile_open( treename, mode );
+	tree->file = ys_blockfile_open_cache( treename, mode, nblocks );
 	if (tree->file == NULL) {
 		free(tree);
 		return NULL;
 	}
 	tree->headerblock = ys_blockfile_get( tree->file, 1 );
-	tree->header = (ys_header_t *)&tree->headerblock->bd;
+	tree->header = (ys_header_t *)tree->headerblock->bd;
 	tree->root = tree->header->root;	
 	return tree;
 }
 
+/**
+ * Open a BTree for reading through a memory mapping. The root and the
+ * level below it are needed by every search, so the operating system is
+ * asked to read them ahead.
+ */
+ys_btree_t *
+ys_btree_open_mapped( const char *treename, size_t nblocks )
+{
+	ys_btree_t *tree;
+	ys_block_t *block;
+	ys_keycnt_t k;
+
+	tree = (ys_btree_t *) calloc(1, sizeof(ys_btree_t));
+	if (tree == NULL) {
+		perror("calloc");
+		fprintf(stderr, "Cannot ys_allocate a btree\n");
+		return NULL;
+	}
+	tree->file = ys_blockfile_open_mapped( treename, nblocks );
+	if (tree->file == NULL) {
+		free(tree);
+		return NULL;
+	}
+	tree->headerblock = ys_blockfile_get( tree->file, 1 );
+	tree->header = (ys_header_t *)tree->headerblock->bd;
+	tree->root = tree->header->root;	
+
+	if (tree->file->map != NULL) {
+		block = ys_block_getblock( tree->file, tree->root );
+		if (!ys_block_isleaf(block)) {
+			ys_blockfile_prefetch( tree->file, block->bd->lowernode );
+			for (k = 1; k <= block->bd->keycount; k++) {
+				ys_block_goto( block, k );
+				ys_blockfile_prefetch( tree->file, block->curptr );
+			}
+		}
+		ys_blockfile_put( tree->file, block );
+	}
+	return tree;
+}
+
+/**
+ * Open a BTree.
+ */
+ys_btree_t *
+ys_btree_open_mode( const char *treename, const char *mode )
+{
+	return ys_btree_open_cache(treename, mode, 0);
+}
+
 /**
  * Open a BTree.
  */
@@ -1171,8 +1343,8 @@ ys_block_search_bplus(ys_block_t *block, ys_uchar_t *key, ys_filepos_t *valueptr
 	ys_doccnt_t *doccntptr, ys_blocknum_t *blockptr)
 {
 	ys_keycnt_t i;
-	*blockptr = block->bd.lowernode;
-	for (i = 1; i <= block->bd.keycount+1; i++) {
+	*blockptr = block->bd->lowernode;
+	for (i = 1; i <= block->bd->keycount+1; i++) {
 		int result;
 		ys_block_goto(block, i);
 		if (ys_block_iseof(block))
@@ -1202,8 +1374,8 @@ ys_block_search(ys_block_t *block, ys_uchar_t *key, ys_filepos_t *valueptr,
 	ys_doccnt_t *doccntptr, ys_blocknum_t *blockptr)
 {
 	ys_keycnt_t i;
-	*blockptr = block->bd.lowernode;
-	for (i = 1; i <= block->bd.keycount+1; i++) {
+	*blockptr = block->bd->lowernode;
+	for (i = 1; i <= block->bd->keycount+1; i++) {
 		int result;
 		ys_block_goto(block, i);
 		if (ys_block_iseof(block))
@@ -1265,7 +1437,7 @@ ys_bplustree_iterate( ys_btree_t *tree, ys_uchar_t *key, ys_pfn_btree_iterator_t
 	for (;;) {
 		ys_block_goto( block, block->curknum+1 );			
 		if ( ys_block_iseof( block ) ) {
-			blockptr = block->bd.lowernode;
+			blockptr = block->bd->lowernode;
 			if (blockptr == 0)
 				break;
 			ys_blockfile_put( tree->file, block );
@@ -1359,10 +1531,10 @@ have_found:
 			ys_blockfile_put( tree->file, block );
 			block = ys_block_getblock( tree->file, blockptr );
 			while ( !ys_block_isleaf(block) ) {
-				ys_blockfile_put( tree->file, block );
 				stack_push( blockptr );	
 				kstack_push( block->curknum );	
-				blockptr = block->bd.lowernode;
+				blockptr = block->bd->lowernode;
+				ys_blockfile_put( tree->file, block );
 				block = ys_block_getblock( tree->file, blockptr );
 			}
 			ys_block_goto(block, 1);
@@ -1432,17 +1604,17 @@ ys_block_insert(ys_block_t *block, ys_uchar_t *key, ys_blocknum_t bn, ys_filepos
 	ys_uchar_t keysaved[sizeof block->curkey] = {0};
 	ys_keycnt_t i = 0;
 	
-	if (block->bd.keycount == Max_key_count)
+	if (block->bd->keycount == Max_key_count)
 		return -1;
 	
-	if (block->curknum == block->bd.keycount+1) {
+	if (block->curknum == block->bd->keycount+1) {
 		/* new entry will be the last one */
 #if 0
 		printf("inserting %.*s before EOF\n", key[0], key+1);
 #endif
 		return block_addentry(block, key, bn, vl, ct);
 	}
-	assert(block->curknum > 0 && block->curknum <= block->bd.keycount);
+	assert(block->curknum > 0 && block->curknum <= block->bd->keycount);
 #if 0
 	printf("inserting %.*s before %.*s\n", key[0], key+1,
 		block->curkey[0], block->curkey+1);
@@ -1502,23 +1674,23 @@ ys_block_insert(ys_block_t *block, ys_uchar_t *key, ys_blocknum_t bn, ys_filepos
 	else ctsize = ys_calc_bytesize(ct);
 	entry_len = ENTRY_LEN(key_len,bnsize,vlsize,ctsize);
 
-	if (entry_len > block->bd.freespace)
+	if (entry_len > block->bd->freespace)
 		return -1;
 
 	/* first we make room for the new entry */
 	cp = ys_block_curentry(block);
-	ep = &block->bd.keyspace[sizeof block->bd.keyspace - block->bd.freespace];
+	ep = &block->bd->keyspace[sizeof block->bd->keyspace - block->bd->freespace];
 	memmove(cp+entry_len, cp, ep-cp);
-	for (i = block->bd.keycount; i >= block->curknum; i--) {
+	for (i = block->bd->keycount; i >= block->curknum; i--) {
 		block->offsets[i] = block->offsets[i-1];
 		block->offsets[i] += entry_len;
 	}
 
 	/* now we write the new entry */
-	if (block->bd.keycount > 0)
+	if (block->bd->keycount > 0)
 		block->curknum++;
-	block->bd.keycount++;
-	block->bd.freespace -= entry_len;
+	block->bd->keycount++;
+	block->bd->freespace -= entry_len;
 	ys_block_set_curkey(block, key, prefix_len, key_len, BOOL_TRUE,
 		bn, bnsize, vl, vlsize, ct, ctsize);
 	cp = ys_block_write_entry(cp, key, prefix_len, key_len, 
@@ -1529,7 +1701,7 @@ ys_block_insert(ys_block_t *block, ys_uchar_t *key, ys_blocknum_t bn, ys_filepos
 	 */
 	if (newentry_len != oldentry_len || key_len1 != key_len2) {
 
-		assert(block->offsets[block->curknum-1] == cp - block->bd.keyspace);
+		assert(block->offsets[block->curknum-1] == cp - block->bd->keyspace);
 #ifdef TEST_BTREE
 		Keys_rewritten++;
 #endif	
@@ -1537,21 +1709,21 @@ ys_block_insert(ys_block_t *block, ys_uchar_t *key, ys_blocknum_t bn, ys_filepos
 		printf("rewriting %.*s\n", keysaved[0], keysaved+1);
 		printf("oldentry_len = %d, newentry_len = %d\n",
 			oldentry_len, newentry_len);
-		printf("freespace before = %d\n", block->bd.freespace);
+		printf("freespace before = %d\n", block->bd->freespace);
 #endif
 
-		ep = &block->bd.keyspace[sizeof block->bd.keyspace - block->bd.freespace];
+		ep = &block->bd->keyspace[sizeof block->bd->keyspace - block->bd->freespace];
 		if (ep > cp) 
 			memmove(cp+newentry_len, cp+oldentry_len, 
 				(ep-cp)-oldentry_len);
 		ys_block_write_entry(cp, keysaved, prefix_len2, key_len2,
 			bn2, bnsize2, vl2, vlsize2, ct2, ctsize2);
-		for (i = block->curknum+1; i <= block->bd.keycount; i++) {
+		for (i = block->curknum+1; i <= block->bd->keycount; i++) {
 			block->offsets[i-1] += (oldentry_len-newentry_len);
 		}
-		block->bd.freespace += (oldentry_len-newentry_len);
+		block->bd->freespace += (oldentry_len-newentry_len);
 #if 0
-		printf("freespace after = %d\n", block->bd.freespace);
+		printf("freespace after = %d\n", block->bd->freespace);
 #endif
 	}
 
@@ -1666,19 +1838,19 @@ ys_btree_insert(ys_btree_t *tree, ys_uchar_t *key, ys_filepos_t value, ys_doccnt
 		 * variable length we will have to calculate the
 		 * number of keys in terms of space used.
 		 */
-		total_space = sizeof block->bd.keyspace; 
+		total_space = sizeof block->bd->keyspace; 
 		space_consumed = 0;
-		for (i = 1; i <= block->bd.keycount; i++) {
+		for (i = 1; i <= block->bd->keycount; i++) {
 			ys_block_goto(block, i);
 			space_consumed += ys_block_curentry_len(block);
 			if (space_consumed >= total_space/2)
 				break;
 		}
 #ifdef TEST_BTREE
-		if (i > block->bd.keycount)
-			i = (block->bd.keycount+1)/2;
+		if (i > block->bd->keycount)
+			i = (block->bd->keycount+1)/2;
 #endif
-		assert(i <= block->bd.keycount-2);
+		assert(i <= block->bd->keycount-2);
 		m = i++;	/* this key will go up to the parent node*/
 
 		/* now let's calculate the space occupied by
@@ -1698,30 +1870,30 @@ ys_btree_insert(ys_btree_t *tree, ys_uchar_t *key, ys_filepos_t value, ys_doccnt
 		entry_len = ENTRY_LEN(key_len,bnsize,vlsize,ctsize);
 		
 		cp = ys_block_curentry(block);
-		ep = &block->bd.keyspace[sizeof block->bd.keyspace - 
-			block->bd.freespace];
+		ep = &block->bd->keyspace[sizeof block->bd->keyspace - 
+			block->bd->freespace];
 		space_consumed = (ep-cp)-entry_len;
 		cp += entry_len;	
-		block->bd.freespace += (space_consumed+entry_len);
+		block->bd->freespace += (space_consumed+entry_len);
 
 		/* copy the entries - we need to expand the first key
 		 * to its full size.
 		 */
 		ys_block_goto(rightblock, 1);
 		cp1 = ys_block_curentry(rightblock);
-		rightblock->bd.keycount = block->bd.keycount-i+1;	
+		rightblock->bd->keycount = block->bd->keycount-i+1;	
 		prefix_len = 0;
 		key_len = keysaved[0];
 		entry_len = ENTRY_LEN(key_len,bnsize,vlsize,ctsize);
 		cp1 = ys_block_write_entry(cp1, keysaved, prefix_len, key_len,
 			bn, bnsize, vl, vlsize, ct, ctsize);
 		memcpy(cp1, cp, space_consumed);
-		rightblock->bd.freespace -= (space_consumed+entry_len);
+		rightblock->bd->freespace -= (space_consumed+entry_len);
 		ys_block_calc_offsets(rightblock);
 
 		i = m;
 		ys_block_goto(block, i);
-		rightblock->bd.lowernode = block->curptr;
+		rightblock->bd->lowernode = block->curptr;
 		rightblock->dirty = BOOL_TRUE;
 		if (ys_key_compare(k, block->curkey) < 0) {
 			ys_blockfile_put( tree->file, rightblock );
@@ -1735,8 +1907,8 @@ ys_btree_insert(ys_btree_t *tree, ys_uchar_t *key, ys_filepos_t value, ys_doccnt
 		vl = block->curvalue;
 		ct = block->curdoccnt;
 		cp = ys_block_curentry(block);
-		block->bd.freespace += ys_block_curentry_len(block);
-		block->bd.keycount = m-1;
+		block->bd->freespace += ys_block_curentry_len(block);
+		block->bd->keycount = m-1;
 		memset(cp, 0, ep-cp);	
 
 		/* now that we have split the block, we can insert
@@ -1765,7 +1937,7 @@ ys_btree_insert(ys_btree_t *tree, ys_uchar_t *key, ys_filepos_t value, ys_doccnt
 			/* We have to create a new Root Node */
 			block = ys_block_new(tree->file, BOOL_FALSE);
 			blockptr = block->blocknum;
-			block->bd.lowernode = leftchild;
+			block->bd->lowernode = leftchild;
 			ys_block_goto(block, 1);
 			tree->root = blockptr;
 			tree->header->root = tree->root;
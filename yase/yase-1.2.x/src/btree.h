@@ -74,11 +74,51 @@ enum {
 	YS_BTREENODE_VALID = 2
 };
 
+/**
+ * A frame of the buffer pool, holding one block of the file. Any 
+ * number of readers may have a frame pinned at once, each through its
+ * own ys_block_t.
+ */
+struct ys_frame_t {
+	/* following fields are maintained by the buffer pool */
+	ys_frame_t     *hashnext;
+	ys_bool_t      usage;		/* CLOCK reference bit */
+	ys_bool_t      dirty;
+	ys_blocknum_t  blocknum;
+	int            ref;		/* number of pins */
+
+	/* To allow random access to keys we maintain their offsets
+	 * from the beginning of bd->keyspace[]. This allows us to
+	 * do binary searches for example. The array of offsets
+	 * is populated on first use after a block is read, under the 
+	 * shard latch, and stays valid for as long as the block is 
+	 * cached. It is also updated when keys are added, modified or 
+	 * deleted.
+	 */
+	ys_bool_t      offsets_valid;
+	ys_keyoffset_t offsets[YS_BTREE_MAXKEYCOUNT]; 
+
+	/* bd points to data, or directly into the file when the 
+	 * block file is memory mapped.
+	 */
+	ys_blockdata_t *bd;
+	ys_blockdata_t data;
+};
+
+/**
+ * A pinned block: a frame together with the cursor of the reader
+ * that pinned it.
+ */
 struct ys_block_t {
-	ys_link_t      link;
-	ys_bool_t        dirty;
+	/* following fields are set by the buffer pool */
+	ys_frame_t     *frame;
+	ys_bufshard_t  *shard;
+	ys_block_t     *next;		/* next unused handle */
 	ys_blocknum_t  blocknum;
-	ys_int16_t     ref;
+	ys_blockdata_t *bd;		/* frame->bd */
+	ys_keyoffset_t *offsets;	/* frame->offsets */
+	ys_bool_t      offsets_valid;	/* set once frame->offsets are known */
+	ys_bool_t      dirty;		/* passed to the frame when unpinned */
 
 	ys_flag_t      status;	/* YS_BTREENODE_INVALID or YS_BTREENODE_VALID */
 
@@ -97,15 +137,6 @@ struct ys_block_t {
 	ys_len_t       curvalue_size;
 	ys_len_t       curdoccnt_size;
 	ys_len_t       curptr_size;
-
-	/* To allow random access to keys we maintain their offsets
-	 * from the beginning of bd.keyspace[]. This allows us to
-	 * do binary searches for example. The array of offsets
-	 * is populated when a block is read. It is also updated
-	 * when keys are added, modified or deleted.
-	 */
-	ys_keyoffset_t offsets[YS_BTREE_MAXKEYCOUNT]; 
-	ys_blockdata_t bd;
 };
 
 typedef struct {
@@ -126,6 +157,24 @@ ys_btree_create_empty( const char *treename );
 extern int
 ys_btree_create( const char *treename, const char *inputfile );
 
+/**
+ * Bulk loading: keys are added in ascending order, and the tree is
+ * built bottom up as they arrive; the upper levels are written by 
+ * ys_btree_load_end(), which frees the loader. fillfactor is the 
+ * percentage of each block to fill, or 0 to fill blocks completely.
+ */
+typedef struct ys_btree_loader_t ys_btree_loader_t;
+
+extern ys_btree_loader_t *
+ys_btree_load_begin( const char *treename, int fillfactor );
+
+extern int
+ys_btree_load_add( ys_btree_loader_t *loader, ys_uchar_t *key, 
+	ys_filepos_t value, ys_doccnt_t doccnt );
+
+extern int
+ys_btree_load_end( ys_btree_loader_t *loader );
+
 /*
 extern int
 ys_bplustree_create( const char *treename, const char *inputfile );
@@ -140,6 +189,12 @@ ys_btree_open( const char *treename );
 extern ys_btree_t *
 ys_btree_open_mode( const char *treename, const char *mode );
 
+extern ys_btree_t *
+ys_btree_open_cache( const char *treename, const char *mode, size_t nblocks );
+
+extern ys_btree_t *
+ys_btree_open_mapped( const char *treename, size_t nblocks );
+
 extern int
 ys_btree_close( ys_btree_t *tree );
 
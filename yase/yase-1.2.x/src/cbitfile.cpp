@@ -22,6 +22,10 @@
 */ 
 
 // 29 Nov 2002
+// 17 Oct 2026: Bits are now read a block at a time into a 64 bit buffer,
+//              and gamma codes are decoded using count-leading-zeros.
+// 17 Oct 2026: Added patchBytes().
+// 17 Oct 2026: Added setBufferSize().
 
 #include "cbitfile.h"
 
@@ -46,13 +50,15 @@ YASENS BitFile::dumpBits(ys_bits_t v, FILE *fp)
 YASENS BitFile::BitFile()
 {
 	pch = 0;
-	gch = 0;
 	pmask = 0;
-	gmask = 0;
 	pnbit = 0;
-	gnbit = 0;
 	ppos = 0;
 	gpos = 0;
+	gbuf = 0;
+	gnbits = 0;
+	gblockpos = 0;
+	gblocklen = 0;
+	gblockoff = 0;
 
 	file = 0;
 }
@@ -86,9 +92,10 @@ YASENS BitFile::open(const char *filename, const char *mode)
 void 
 YASENS BitFile::resetg() 
 {
-	gch = 0;
-	gnbit = 0;
-	gmask = MASK_VALUE;
+	gbuf = 0;
+	gnbits = 0;
+	gblocklen = 0;
+	gblockoff = 0;
 }
 
 void 
@@ -116,23 +123,43 @@ YASENS BitFile::flush()
 	}
 }
 
+/**
+ * Tops up gbuf with 32 bit words until it holds more than 32 bits,
+ * reading the file a block at a time.
+ */
 void 
 YASENS BitFile::fill()
 {
-	resetg();
-	if (!ys_file_eof(file)) {
-		if (debug) {
-			ys_filepos_t pos;
-			ys_file_getpos(file, &pos);
-			assert(pos == gpos);
+	while (gnbits <= WORDBITS) {
+		if (gblockoff + 4 > gblocklen) {
+			if (gblockoff < gblocklen)
+				/* partial word left after getBytes() */
+				ys_file_setpos(file, &gpos);
+			else if (ys_file_eof(file))
+				return;
+			gblockpos = gpos;
+			gblocklen = ys_file_read( (void *) gblock, 1, sizeof gblock, file );
+			gblockoff = 0;
+			if (gblocklen < 4) {
+				gblocklen = 0;
+				return;
+			}
 		}
-		//file.seek( gpos );
-		ys_file_read( (void *) &gch, 1, sizeof gch, file );
-		gnbit = BITS;
+		unsigned int w;
+		memcpy(&w, gblock + gblockoff, 4);
+		gblockoff += 4;
 		gpos += 4;
+		gbuf |= ((ys_uint64_t) w) << (64 - WORDBITS - gnbits);
+		gnbits += WORDBITS;
 	}
 }
 
+int
+YASENS BitFile::setBufferSize( size_t size )
+{
+	return ys_file_setbuf(file, size);
+}
+
 void 
 YASENS BitFile::close()
 {
@@ -148,12 +175,21 @@ YASENS BitFile::close()
 bool
 YASENS BitFile::geof() const
 {
-	return gnbit == 0 && ys_file_eof(file);
+	return gnbits == 0 && gblockoff + 4 > gblocklen && ys_file_eof(file);
 }
 
 void 
 YASENS BitFile::setgpos( ys_filepos_t pos )
 {
+	if (gblocklen > 0 && pos >= gblockpos && 
+		pos+4 <= gblockpos+(ys_filepos_t)gblocklen) {
+		/* Already in the read buffer, so no need to seek */
+		gbuf = 0;
+		gnbits = 0;
+		gblockoff = pos - gblockpos;
+		gpos = pos;
+		return;
+	}
 	resetg();
 	gpos = pos;
 	ys_file_setpos(file, &pos);
@@ -165,9 +201,94 @@ YASENS BitFile::getgpos() const
 	return gpos;
 }
 
+ys_uint64_t
+YASENS BitFile::getgbitpos() const
+{
+	return (ys_uint64_t)gpos * 8 - gnbits;
+}
+
+void
+YASENS BitFile::setgbitpos( ys_uint64_t bitpos )
+{
+	int skip = (int)(bitpos % WORDBITS);
+	setgpos( (ys_filepos_t)(bitpos / WORDBITS) * 4 );
+	if (skip > 0) {
+		fill();
+		gbuf <<= skip;
+		gnbits -= skip;
+	}
+}
+
+void
+YASENS BitFile::putBytes( const void *buf, size_t n )
+{
+	assert(pnbit == BITS);
+	ys_file_write( buf, 1, n, file );
+	ppos += n;
+}
+
+void
+YASENS BitFile::alignPut()
+{
+	static const ys_uchar_t zeros[4] = { 0, 0, 0, 0 };
+	flush();
+	if (ppos % 4 != 0)
+		putBytes( zeros, 4 - ppos % 4 );
+}
+
+void
+YASENS BitFile::getBytes( void *buf, size_t n )
+{
+	ys_uint64_t bitpos = getgbitpos();
+	assert(bitpos % 8 == 0);
+	ys_filepos_t pos = (ys_filepos_t)(bitpos / 8);
+	gbuf = 0;
+	gnbits = 0;
+	if (gblocklen == 0 || pos < gblockpos || 
+		pos+(ys_filepos_t)n > gblockpos+(ys_filepos_t)gblocklen) {
+		resetg();
+		ys_file_setpos(file, &pos);
+		gpos = pos + n;
+		if (n > sizeof gblock) {
+			if (ys_file_read( buf, 1, n, file ) != n)
+				memset(buf, 0, n);
+			return;
+		}
+		/* refill the read buffer starting at pos */
+		gblockpos = pos;
+		gblocklen = ys_file_read( (void *) gblock, 1, sizeof gblock, file );
+		if (gblocklen < n) {
+			memset(gblock + gblocklen, 0, n - gblocklen);
+			gblocklen = n;
+		}
+	}
+	memcpy(buf, gblock + (pos - gblockpos), n);
+	gblockoff = pos - gblockpos + n;
+	gpos = pos + n;
+}
+
+void
+YASENS BitFile::alignGet()
+{
+	ys_uint64_t bitpos = getgbitpos();
+	if (bitpos % WORDBITS != 0)
+		setgbitpos( bitpos + WORDBITS - bitpos % WORDBITS );
+}
+
+void
+YASENS BitFile::patchBytes( ys_filepos_t pos, const void *buf, size_t n )
+{
+	resetg();
+	ys_file_setpos(file, &pos);
+	ys_file_write( buf, 1, n, file );
+	ys_file_setpos(file, &ppos);
+}
+
 void 
 YASENS BitFile::setppos( ys_filepos_t pos )
 {
+	/* the read buffer may be stale once we start writing */
+	resetg();
 	resetp();
 	ppos = pos;
 	ys_file_setpos(file, &pos);
@@ -191,17 +312,18 @@ int main()
 		"11111111111111000000000000001111100001111111111100000" 
 		"00000000001111111111111111110101010111010101100010101";
 
-	char *ibits = new char[sizeof obits];
+	const int nbits = sizeof obits;
+	char *ibits = new char[nbits];
 	int i;
 
 	bf.open("test", 0);
 	bf.setppos(0);
-	for (i = 0; i < sizeof obits; i++) {
+	for (i = 0; i < nbits; i++) {
   		bf.putBit( obits[i] == '1' ? 1 : 0 );
 	}
   	bf.flush();
 	bf.setgpos(0);
-  	for (i = 0; i < sizeof obits-1; i++) {
+  	for (i = 0; i < nbits-1; i++) {
   		ys_bits_t bit = bf.getBit();
   		ibits[i] = (bit != 0) ? '1' : '0';
   	}
@@ -215,7 +337,7 @@ int main()
 	bf.setgpos(0);
 	while (!bf.geof()) {
 		ys_bits_t bit = bf.getBit();
-		if (i < sizeof obits)
+		if (i < nbits)
 			ibits[i] = (bit != 0) ? '1' : '0';
 		i++;
     	}
@@ -259,6 +381,61 @@ int main()
 	bf.close();
 	printf("64 bit gamma test ok\n");
 	remove("test");
+
+	/* Compare the block decoder against the bit at a time decoder
+	 * on a skewed distribution similar to docnum gaps and dtfs.
+	 */
+	enum { N = 4000000 };
+	ys_uint32_t *values = new ys_uint32_t[N];
+	ys_uint32_t *decoded = new ys_uint32_t[N];
+	srand(1);
+	for (i = 0; i < N; i++) {
+		int bits = rand() % 17;
+		values[i] = 1 + (rand() & ((1 << bits)-1));
+	}
+	bf.open("test", 0);
+	bf.setppos(0);
+	for (i = 0; i < N; i++)
+		bf.gammaEncode(values[i]);
+	bf.flush();
+
+	clock_t start = clock();
+	bf.setgpos(0);
+	for (i = 0; i < N; i++)
+		decoded[i] = bf.gammaDecodeBitwise();
+	double t1 = (double)(clock()-start)/CLOCKS_PER_SEC;
+	if (memcmp(values, decoded, N * sizeof *values) != 0) {
+		fprintf(stderr, "Bitwise decode failed !\n");
+		exit(1);
+	}
+
+	memset(decoded, 0, N * sizeof *decoded);
+	start = clock();
+	bf.setgpos(0);
+	for (i = 0; i < N; i++)
+		decoded[i] = bf.gammaDecode();
+	double t2 = (double)(clock()-start)/CLOCKS_PER_SEC;
+	if (memcmp(values, decoded, N * sizeof *values) != 0) {
+		fprintf(stderr, "Block decode failed !\n");
+		exit(1);
+	}
+
+	memset(decoded, 0, N * sizeof *decoded);
+	start = clock();
+	bf.setgpos(0);
+	for (i = 0; i < N; i += 128)
+		bf.gammaDecodeBatch(decoded+i, N-i < 128 ? N-i : 128);
+	double t3 = (double)(clock()-start)/CLOCKS_PER_SEC;
+	if (memcmp(values, decoded, N * sizeof *values) != 0) {
+		fprintf(stderr, "Batch decode failed !\n");
+		exit(1);
+	}
+	bf.close();
+	remove("test");
+	printf("decoded %d gamma codes: bitwise %.3fs, block %.3fs, batch %.3fs\n",
+		N, t1, t2, t3);
+	delete [] values;
+	delete [] decoded;
 	
 	return 0;
 }
@@ -29,25 +29,56 @@
 
 typedef ys_uint32_t ys_bits_t;
 
+/**
+ * Count leading zeros in a non-zero 64 bit value.
+ */
+static inline int
+ys_clz64(ys_uint64_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_clzll(x);
+#else
+	int n = 0;
+	if ((x >> 32) == 0) { n += 32; x <<= 32; }
+	if ((x >> 48) == 0) { n += 16; x <<= 16; }
+	if ((x >> 56) == 0) { n += 8; x <<= 8; }
+	if ((x >> 60) == 0) { n += 4; x <<= 4; }
+	if ((x >> 62) == 0) { n += 2; x <<= 2; }
+	if ((x >> 63) == 0) { n += 1; }
+	return n;
+#endif
+}
+
 YASE_NS_BEGIN
 
 class BitFile {
 
 private:
 	ys_bits_t pch;
-	ys_bits_t gch;
 	ys_bits_t pmask;
-	ys_bits_t gmask;
 	ys_uint16_t pnbit;
-	ys_uint16_t gnbit;
 	ys_filepos_t ppos;
 	ys_filepos_t gpos;
 
+	/* Bits are read a block at a time. Unread bits are kept left
+	 * aligned in gbuf; gnbits of them are valid and the rest are 0.
+	 */
+	enum {
+		GBLOCKSIZE = 4096
+	};
+	ys_uint64_t gbuf;
+	int gnbits;
+	ys_filepos_t gblockpos;		/* file position of gblock[0] */
+	size_t gblocklen;
+	size_t gblockoff;
+	ys_uchar_t gblock[GBLOCKSIZE];
+
 	ys_file_t *file;
 
 	enum {
 		BITS = sizeof(ys_bits_t)*8,
-		MASK_VALUE = 1 << (BITS-1)
+		MASK_VALUE = 1 << (BITS-1),
+		WORDBITS = 32
 	};
 
 private:
@@ -62,6 +93,8 @@ public:
 	BitFile();
 	~BitFile();
 	int open(const char *filename, const char *mode = 0);
+	/** Sets the size of the stdio buffer; call right after open() */
+	int setBufferSize(size_t size);
 	void putBit(ys_bits_t bit);
 	ys_bits_t getBit();
 	void flush();
@@ -71,10 +104,43 @@ public:
 	void setppos(ys_filepos_t pos);
 	ys_filepos_t getgpos() const;
 	void setgpos(ys_filepos_t pos);
+	/**
+	 * Bit positions allow a reader to resume decoding in the
+	 * middle of a word.
+	 */
+	ys_uint64_t getgbitpos() const;
+	void setgbitpos(ys_uint64_t bitpos);
+	/**
+	 * Byte level access for byte oriented codecs. putBytes() must
+	 * be called on a word boundary (after flush()). getBytes() must
+	 * start on a byte boundary. alignPut() and alignGet() move to the
+	 * next word boundary, so that bit coded data can follow.
+	 */
+	void putBytes(const void *buf, size_t n);
+	void getBytes(void *buf, size_t n);
+	void alignPut();
+	void alignGet();
+	/**
+	 * Overwrites n bytes at pos, leaving the put position alone.
+	 * The read buffer is discarded; call setgpos() before reading.
+	 */
+	void patchBytes(ys_filepos_t pos, const void *buf, size_t n);
 	void gammaEncode(ys_uint32_t x);
 	ys_uint32_t gammaDecode();
+	/**
+	 * Decodes n gamma codes into values[].
+	 */
+	void gammaDecodeBatch(ys_uint32_t *values, size_t n);
+	/**
+	 * Reference decoder that reads one bit at a time. 
+	 */
+	ys_uint32_t gammaDecodeBitwise();
 	void gammaEncode64(ys_uint64_t x);
 	ys_uint64_t gammaDecode64();
+	/**
+	 * Number of bits taken by the gamma code for x.
+	 */
+	static int gammaLength(ys_uint32_t x);
 
 	static void dumpBits(ys_bits_t v, FILE *fp);
 	static void setDebug(int value) { debug = value; }
@@ -99,11 +165,14 @@ inline ys_bits_t
 YASENS BitFile::getBit()
 {
 	ys_bits_t bit;
-	if ( gnbit == 0 )
+	if ( gnbits == 0 ) {
 		fill();
-	bit = ((gch & gmask) != 0) ? 1 : 0;
-	gmask >>= 1;
-	gnbit--;
+		if ( gnbits == 0 )
+			return 0;
+	}
+	bit = (ys_bits_t)(gbuf >> 63);
+	gbuf <<= 1;
+	gnbits--;
 	return bit;
 }
 
@@ -122,8 +191,15 @@ YASENS BitFile::gammaEncode(ys_uint32_t x)
 		putBit( (x >> nbits) & 0x1 );
 }
 
+inline int
+YASENS BitFile::gammaLength(ys_uint32_t x)
+{
+	assert(x > 0);
+	return 2 * (63 - ys_clz64((ys_uint64_t) x)) + 1;
+}
+
 inline ys_uint32_t 
-YASENS BitFile::gammaDecode()
+YASENS BitFile::gammaDecodeBitwise()
 {
 	int nbits = 0;
 	ys_bits_t bit = 0;
@@ -142,6 +218,40 @@ YASENS BitFile::gammaDecode()
 	return x;
 }
 
+/**
+ * A gamma code is n zeros followed by the n+1 bits of the value. With at
+ * least 33 bits in gbuf, the zeros are counted with a single clz and the
+ * value is extracted with a single shift.
+ */
+inline ys_uint32_t 
+YASENS BitFile::gammaDecode()
+{
+	if (gnbits <= WORDBITS)
+		fill();
+	int nzeros = gbuf != 0 ? ys_clz64(gbuf) : 64;
+	if (nzeros >= gnbits || nzeros >= WORDBITS)
+		/* truncated or corrupt code */
+		return gammaDecodeBitwise();
+	gbuf <<= nzeros;
+	gnbits -= nzeros;
+	if (gnbits <= WORDBITS)
+		fill();
+	int len = nzeros+1;
+	if (len > gnbits)
+		return gammaDecodeBitwise();
+	ys_uint32_t x = (ys_uint32_t)(gbuf >> (64-len));
+	gbuf <<= len;
+	gnbits -= len;
+	return x;
+}
+
+inline void
+YASENS BitFile::gammaDecodeBatch(ys_uint32_t *values, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		values[i] = gammaDecode();
+}
+
 inline void 
 YASENS BitFile::gammaEncode64(ys_uint64_t x)
 {
@@ -22,28 +22,136 @@
 */
 
 // Created 7-12-02
+// 17-10-26: Document weights are loaded into a WeightTable when the
+//           collection is opened read only.
+// 17-10-26: The index may be split into segments (see segment.h). 
+//           Terms are looked up with findTerm(), and their postings
+//           read with iterate() or a TermCursor.
+// 17-10-26: iterate() and TermCursor skip deleted documents.
+// 17-10-26: findTerm() uses the segment's term dictionary if there is one.
+// 17-10-26: Added expandTerm() and TermUnion, for prefix, wildcard and 
+//           fuzzy query terms.
+// 17-10-26: Opens the positions file of each segment, and added 
+//           PositionsCursor.
+// 17-10-26: Deleted documents are found with a BitSetFilter, as the
+//           postings are read in docnum order.
+// 17-10-26: Added getGeneration() and hasChanged().
 
 #include "collection.h"
+#include "stem.h"
+
+#include <algorithm>
+
+/**
+ * Terms matched by a query pattern, before they are looked up.
+ */
+struct ys_expansion_t {
+	struct Candidate {
+		ys_uchar_t key[YS_MAXKEYSIZE+2];	/* null terminated */
+		ys_doccnt_t tf;
+		int distance;
+	} *terms;
+	int nterms;
+	int nalloc;
+	const ys_uchar_t *prefix;	/* for range scans */
+	bool failed;
+};
+
+static ys_bool_t
+ys_expansion_add(void *arg, const ys_uchar_t *key, ys_doccnt_t tf, 
+	int distance)
+{
+	ys_expansion_t *e = (ys_expansion_t *) arg;
+	if (e->nterms == e->nalloc) {
+		int n = e->nalloc == 0 ? 64 : e->nalloc * 2;
+		ys_expansion_t::Candidate *terms = (ys_expansion_t::Candidate *)
+			realloc(e->terms, n * sizeof *terms);
+		if (terms == 0) {
+			fprintf(stderr, "Error allocating memory\n");
+			e->failed = true;
+			return BOOL_FALSE;
+		}
+		e->terms = terms;
+		e->nalloc = n;
+	}
+	ys_expansion_t::Candidate *c = &e->terms[e->nterms++];
+	memcpy(c->key, key, key[0]+1);
+	c->key[key[0]+1] = 0;
+	c->tf = tf;
+	c->distance = distance;
+	return BOOL_TRUE;
+}
+
+/**
+ * Range scan callback; stops at the first key without the prefix.
+ */
+static ys_bool_t
+ys_expansion_prefix(ys_uchar_t *searchkey, ys_uchar_t *key, 
+	ys_filepos_t value, ys_doccnt_t doccnt, void *arg)
+{
+	ys_expansion_t *e = (ys_expansion_t *) arg;
+	if (key[0] < e->prefix[0] || 
+		memcmp(key+1, e->prefix+1, e->prefix[0]) != 0)
+		return BOOL_FALSE;
+	return ys_expansion_add(arg, key, doccnt, 0);
+}
+
+static ys_bool_t
+ys_kgram_collect(ys_uchar_t *searchkey, ys_uchar_t *key, 
+	ys_filepos_t value, ys_doccnt_t doccnt, void *arg)
+{
+	YASENS KGramIndex *kgrams = (YASENS KGramIndex *) arg;
+	return kgrams->add(key, doccnt) == 0;
+}
+
+static bool
+ys_candidate_less(const ys_expansion_t::Candidate &a, 
+	const ys_expansion_t::Candidate &b)
+{
+	return strcmp((const char *)a.key+1, (const char *)b.key+1) < 0;
+}
+
+/* Closest first, then those in most documents */
+static bool
+ys_candidate_better(const ys_expansion_t::Candidate &a, 
+	const ys_expansion_t::Candidate &b)
+{
+	if (a.distance != b.distance)
+		return a.distance < b.distance;
+	if (a.tf != b.tf)
+		return a.tf > b.tf;
+	return ys_candidate_less(a, b);
+}
 
 ys_btree_t *
-YASENS Collection::openIndex(const char *home, const char *mode)
+YASENS Collection::openIndex(const char *home, int segment, const char *mode, 
+	size_t nblocks)
 {
 	char path[1024];
-	snprintf(path, sizeof path, "%s/%s", home, "yase.btree");
-	ys_btree_t *tree = ys_btree_open_mode( path, mode );
+	ys_seg_filename(home, segment, "btree", path, sizeof path);
+	ys_btree_t *tree;
+	if (strcmp(mode, "r") == 0)
+		tree = ys_btree_open_mapped( path, nblocks );
+	else
+		tree = ys_btree_open_cache( path, mode, nblocks );
 	return tree;
 }
 
 YASENS PostFile *
-YASENS Collection::openPostings(const char *home, const char *mode)
+YASENS Collection::openPostings(const char *home, int segment, 
+	const char *mode, int format)
 {
 	char path[1024];
-	snprintf(path, sizeof path, "%s/%s", home, "yase.postings");
+	ys_seg_filename(home, segment, "postings", path, sizeof path);
 	YASENS PostFile *postings_file = new YASENS PostFile();
 	if (postings_file->open( path, mode ) != 0) {
 		delete postings_file;
 		return 0;
 	}
+	if (postings_file->set_format(format) != 0) {
+		delete postings_file;
+		return 0;
+	}
 	return postings_file;
 }
 
@@ -53,18 +161,13 @@ YASENS Collection::openPostings(const char *home, const char *mode)
 int
 YASENS Collection::open(const char *home, const char *mode)
 {
-	tree = openIndex( home, mode );
-	if (tree == 0) {
-		snprintf(errmsg, sizeof errmsg, "Error: cannot open YASE Index\n");
-		return -1;
-	}
-
 	docdb = ys_dbopen( home, mode, "" );
 	if (docdb == NULL) {
 		snprintf(errmsg, sizeof errmsg, "Error: cannot open YASE files\n");
 		return -1;
 	}
 	else {
+		deleted = ys_dbgetdeleted(docdb);
 		ys_docnum_t N = 0, numfiles;
 		ys_doccnt_t maxdoctermfreq, maxtermfreq;
 		ys_bool_t stemmed;
@@ -75,44 +178,306 @@ YASENS Collection::open(const char *home, const char *mode)
 		this->maxtf = maxtermfreq;
 		this->maxdtf = maxdoctermfreq;
 		this->numFiles = numfiles;
+		this->postingsFormat = ys_dbgetpostingsformat(docdb);
+		this->generation = ys_dbgetopengeneration(docdb);
 	}
 
-	postings_file = openPostings( home, mode );
-	if (postings_file == 0) {
-		snprintf(errmsg, sizeof errmsg, "Error: cannot open Postings file\n" );
+	ys_seglist_t list;
+	if (ys_seg_read(home, N, &list) != 0) {
+		snprintf(errmsg, sizeof errmsg, "Error: cannot read segment list\n");
 		return -1;
 	}
+	for (nsegments = 0; nsegments < list.nsegs; nsegments++) {
+		int id = list.segs[nsegments].id;
+		segments[nsegments] = list.segs[nsegments];
+		trees[nsegments] = openIndex( home, id, mode, cacheBlocks );
+		if (trees[nsegments] == 0) {
+			snprintf(errmsg, sizeof errmsg, "Error: cannot open YASE Index\n");
+			return -1;
+		}
+		postings[nsegments] = openPostings( home, id, mode, postingsFormat );
+		if (postings[nsegments] == 0) {
+			ys_btree_close( trees[nsegments] );
+			snprintf(errmsg, sizeof errmsg, "Error: cannot open Postings file\n" );
+			return -1;
+		}
+		char path[1024];
+		ys_seg_filename(home, id, "dict", path, sizeof path);
+		dicts[nsegments] = ys_termdict_open( path );
+		if (hasPositions()) {
+			ys_seg_filename(home, id, "positions", path, sizeof path);
+			positions[nsegments] = ys_positions_open( path );
+			if (positions[nsegments] == 0) {
+				snprintf(errmsg, sizeof errmsg, "Error: cannot open Positions file\n" );
+				nsegments++;
+				return -1;
+			}
+		}
+	}
+
+	if (strcmp(mode, "r") == 0 && weightBits != 0) {
+		weights = new YASENS WeightTable();
+		if (weights->load(docdb, N, weightBits) != 0) {
+			snprintf(errmsg, sizeof errmsg, "Error: cannot load document weights\n" );
+			return -1;
+		}
+	}
 
 	return 0;
 }
 
+bool
+YASENS Collection::findTerm(const ys_uchar_t *key, YASENS TermRef *ref) const
+{
+	ys_uchar_t k[YS_MAXKEYSIZE+1];
+
+	memset(k, 0, sizeof k);
+	memcpy(k, key, key[0]+1);
+	ref->tf = 0;
+	ref->nparts = 0;
+	for (int i = 0; i < nsegments; i++) {
+		ys_filepos_t position;
+		ys_doccnt_t tf;
+		if (dicts[i] != 0) {
+			if (!ys_termdict_find( dicts[i], k, &position, &tf ))
+				continue;
+		}
+		else if (!ys_btree_find( trees[i], k, &position, &tf ))
+			continue;
+		ref->parts[ref->nparts].segment = i;
+		ref->parts[ref->nparts].position = (ys_postoff_t) position;
+		ref->parts[ref->nparts].tf = tf;
+		ref->nparts++;
+		ref->tf += tf;
+	}
+	return ref->nparts > 0;
+}
+
+bool
+YASENS Collection::isPattern(const ys_uchar_t *term)
+{
+	return strpbrk((const char *)term, "*?~") != 0;
+}
+
+/**
+ * Loads every term of every segment into the bigram index.
+ */
+int
+YASENS Collection::buildKGrams()
+{
+	ys_uchar_t k[YS_MAXKEYSIZE+1];
+
+	if (kgrams != 0)
+		return 0;
+	kgrams = new YASENS KGramIndex();
+	for (int i = 0; i < nsegments; i++) {
+		memset(k, 0, sizeof k);
+		if (dicts[i] != 0)
+			ys_termdict_iterate( dicts[i], k, ys_kgram_collect, kgrams );
+		else
+			ys_btree_iterate( trees[i], k, ys_kgram_collect, kgrams );
+	}
+	if (kgrams->build() != 0) {
+		delete kgrams;
+		kgrams = 0;
+		snprintf(errmsg, sizeof errmsg, "Error: cannot build term index\n");
+		return -1;
+	}
+	return 0;
+}
+
+int
+YASENS Collection::expandTerm(const ys_uchar_t *pattern, YASENS TermRef *refs)
+{
+	ys_uchar_t word[YS_MAXKEYSIZE+2];
+	const char *tilde = strchr((const char *)pattern, '~');
+	size_t len = tilde != 0 ? tilde - (const char *)pattern : 
+		strlen((const char *)pattern);
+	ys_expansion_t e;
+	int i, n;
+
+	if (len >= YS_MAXKEYSIZE || 
+		strspn((const char *)pattern, "*?") >= len)
+		return 0;
+	word[0] = (ys_uchar_t) len;
+	memcpy(word+1, pattern, len);
+	word[len+1] = 0;
+	memset(&e, 0, sizeof e);
+
+	if (tilde != 0) {
+		int maxdist;
+		if (strpbrk((const char *)word+1, "*?") != 0)
+			return 0;
+		if (tilde[1] == 0)
+			maxdist = len <= 2 ? 0 : (len <= 5 ? 1 : 2);
+		else if (isdigit((unsigned char)tilde[1]) && tilde[2] == 0)
+			maxdist = tilde[1] - '0';
+		else
+			return 0;
+		if (stemmed) {
+			stem(word);
+			word[word[0]+1] = 0;
+		}
+		if (buildKGrams() != 0)
+			return -1;
+		kgrams->fuzzy(word+1, maxdist, ys_expansion_add, &e);
+	}
+	else if (len > 1 && strchr((const char *)word+1, '*') == 
+		(const char *)word+len && strchr((const char *)word+1, '?') == 0) {
+		ys_uchar_t k[YS_MAXKEYSIZE+1];
+		memset(k, 0, sizeof k);
+		k[0] = (ys_uchar_t) (len-1);
+		memcpy(k+1, word+1, len-1);
+		e.prefix = k;
+		for (i = 0; i < nsegments && !e.failed; i++) {
+			if (dicts[i] != 0)
+				ys_termdict_iterate( dicts[i], k, ys_expansion_prefix, &e );
+			else
+				ys_btree_iterate( trees[i], k, ys_expansion_prefix, &e );
+		}
+	}
+	else {
+		if (buildKGrams() != 0)
+			return -1;
+		kgrams->wildcard(word+1, ys_expansion_add, &e);
+	}
+	if (e.failed) {
+		free(e.terms);
+		return -1;
+	}
+
+	/* A prefix may be found in several segments */
+	std::sort(e.terms, e.terms + e.nterms, ys_candidate_less);
+	for (i = 0, n = 0; i < e.nterms; i++) {
+		if (n > 0 && !ys_candidate_less(e.terms[n-1], e.terms[i])) {
+			e.terms[n-1].tf += e.terms[i].tf;
+			continue;
+		}
+		e.terms[n++] = e.terms[i];
+	}
+	if (n > maxExpansion) {
+		std::nth_element(e.terms, e.terms + maxExpansion, e.terms + n,
+			ys_candidate_better);
+		n = maxExpansion;
+		std::sort(e.terms, e.terms + n, ys_candidate_less);
+	}
+	e.nterms = 0;
+	for (i = 0; i < n; i++) {
+		if (findTerm(e.terms[i].key, &refs[e.nterms]))
+			e.nterms++;
+	}
+	free(e.terms);
+	return e.nterms;
+}
+
+void
+YASENS Collection::iterate(const YASENS TermRef *refs, int n,
+	ys_pfn_postings_iterator_t *pfunc, void *arg) const
+{
+	if (n == 1) {
+		iterate(refs, pfunc, arg);
+		return;
+	}
+	YASENS TermUnion u;
+	if (u.open(this, refs, n) != 0)
+		return;
+	while (!u.atEnd()) {
+		if (!pfunc(arg, u.docnum(), u.dtf()))
+			break;
+		u.next();
+	}
+}
+
+void
+YASENS Collection::iterate(const YASENS TermRef *ref, 
+	ys_pfn_postings_iterator_t *pfunc, void *arg) const
+{
+	LiveFilter filter;
+	filter.deleted.reset(deleted);
+	filter.pfunc = pfunc;
+	filter.arg = arg;
+	if (deleted != 0) {
+		pfunc = skipDeleted;
+		arg = &filter;
+	}
+	for (int i = 0; i < ref->nparts; i++)
+		postings[ref->parts[i].segment]->iterate(ref->parts[i].position,
+			pfunc, arg);
+}
+
+ys_bool_t
+YASENS Collection::skipDeleted(void *arg, ys_docnum_t docnum, ys_doccnt_t dtf)
+{
+	LiveFilter *filter = (LiveFilter *) arg;
+	if (filter->deleted.contains(docnum))
+		return true;
+	return filter->pfunc(filter->arg, docnum, dtf);
+}
+
+int
+YASENS Collection::getDocWeights(ys_docnum_t first, ys_docnum_t n, 
+	float *wts, ys_doccnt_t *maxdtfs) const
+{
+	if (weights == 0)
+		return ys_dbgetdocwtdtfs(docdb, first, n, wts, maxdtfs);
+	for (ys_docnum_t i = 0; i < n; i++)
+		weights->get(first+i, &wts[i], &maxdtfs[i]);
+	return 0;
+}
+
 /**
  * Close a document collection.
  */
 void
 YASENS Collection::close()
 {
-	if (tree != NULL) 
-		ys_btree_close( tree );
-	if (postings_file != NULL) 
-		delete postings_file;
+	for (int i = 0; i < nsegments; i++) {
+		if (trees[i] != NULL) 
+			ys_btree_close( trees[i] );
+		if (dicts[i] != NULL)
+			ys_termdict_close( dicts[i] );
+		if (positions[i] != NULL)
+			ys_positions_close( positions[i] );
+		delete postings[i];
+		trees[i] = 0;
+		dicts[i] = 0;
+		postings[i] = 0;
+		positions[i] = 0;
+	}
+	nsegments = 0;
 	if (docdb != NULL) 
 		ys_dbclose(docdb);
-	tree = 0;
-	postings_file = 0;
+	delete weights;
+	delete kgrams;
 	docdb = 0;
+	deleted = 0;
+	weights = 0;
+	kgrams = 0;
 }
 
 YASENS Collection::Collection()
 {
-	tree = 0;
-	postings_file = 0;
+	nsegments = 0;
+	for (int i = 0; i < YS_MAXSEGMENTS; i++) {
+		trees[i] = 0;
+		dicts[i] = 0;
+		postings[i] = 0;
+		positions[i] = 0;
+	}
 	docdb = 0;
+	deleted = 0;
 	N = 0;
 	stemmed = false;
 	maxtf = 0;
 	maxdtf = 0;
 	numFiles = 0;
+	postingsFormat = 0;
+	generation = 0;
+	cacheBlocks = 0;
+	weightBits = 32;
+	weights = 0;
+	maxExpansion = YS_MAXEXPANSION;
+	kgrams = 0;
 }
 
 YASENS Collection::~Collection()
@@ -120,3 +485,355 @@ YASENS Collection::~Collection()
 	close();
 }
 
+int
+YASENS TermCursor::openPart(int p)
+{
+	part = p;
+	return cursor.open(collection->getPostFile(ref.parts[p].segment), 
+		ref.parts[p].position);
+}
+
+int
+YASENS TermCursor::open(const YASENS Collection *collection, 
+	const YASENS TermRef *ref)
+{
+	this->collection = collection;
+	this->ref = *ref;
+	deleted = collection->getDeleted();
+	isDeleted.reset(deleted);
+	bound = 0.0;
+	if (ref->nparts == 0)
+		return 0;
+	if (openPart(0) != 0)
+		return -1;
+	bound = cursor.getBound();
+	for (int i = 1; i < ref->nparts && bound > 0.0; i++) {
+		/* The cursor restores its own position before reading */
+		YASENS PostFile *pf = collection->getPostFile(ref->parts[i].segment);
+		ys_doccnt_t tf = pf->get_term_frequency(ref->parts[i].position);
+		float b = pf->has_bound(tf) ? pf->read_bound() : 0.0f;
+		if (b == 0.0)
+			bound = 0.0;
+		else if (b > bound)
+			bound = b;
+	}
+	if (deleted != 0)
+		skipDeleted();
+	return 0;
+}
+
+/**
+ * Segments that end before target are passed over without reading
+ * their postings.
+ */
+void
+YASENS TermCursor::skipTo(ys_docnum_t target)
+{
+	while (part+1 < ref.nparts && target >= 
+		collection->getSegment(ref.parts[part+1].segment)->firstdoc) {
+		if (openPart(part+1) != 0)
+			return;
+	}
+	cursor.skipTo(target);
+	if (cursor.atEnd() && part+1 < ref.nparts)
+		openPart(part+1);
+	if (deleted != 0)
+		skipDeleted();
+}
+
+void
+YASENS TermCursor::skipDeleted()
+{
+	while (!cursor.atEnd() && isDeleted.contains(cursor.docnum())) {
+		cursor.next();
+		if (cursor.atEnd() && part+1 < ref.nparts)
+			openPart(part+1);
+	}
+}
+
+YASENS PositionsCursor::PositionsCursor()
+{
+	collection = 0;
+	ref.nparts = 0;
+	part = 0;
+	cp = 0;
+	nextcp = 0;
+	pos = 0;
+	posalloc = 0;
+	deleted = 0;
+	damaged = false;
+}
+
+YASENS PositionsCursor::~PositionsCursor()
+{
+	free(pos);
+}
+
+int
+YASENS PositionsCursor::openPart(int p)
+{
+	part = p;
+	if (cursor.open(collection->getPostFile(ref.parts[p].segment), 
+		ref.parts[p].position) != 0)
+		return -1;
+	cp = ys_positions_at(collection->getPositions(ref.parts[p].segment),
+		cursor.getPositionsOffset());
+	nextcp = 0;
+	damaged = cp == 0;
+	return 0;
+}
+
+int
+YASENS PositionsCursor::open(const YASENS Collection *collection, 
+	const YASENS TermRef *ref)
+{
+	assert(collection->hasPositions());
+	this->collection = collection;
+	this->ref = *ref;
+	deleted = collection->getDeleted();
+	isDeleted.reset(deleted);
+	if (ref->nparts == 0)
+		return 0;
+	if (openPart(0) != 0)
+		return -1;
+	while (!cursor.atEnd() && deleted != 0 && 
+		isDeleted.contains(cursor.docnum()))
+		step();
+	return 0;
+}
+
+/**
+ * Moves to the next posting, stepping over the positions of the 
+ * current one unless they have been decoded.
+ */
+void
+YASENS PositionsCursor::step()
+{
+	if (nextcp != 0)
+		cp = nextcp;
+	else if (cp != 0)
+		cp = ys_positions_skip(collection->getPositions(
+			ref.parts[part].segment), cp, cursor.dtf());
+	nextcp = 0;
+	damaged = cp == 0;
+	cursor.next();
+	if (cursor.atEnd() && part+1 < ref.nparts)
+		openPart(part+1);
+}
+
+void
+YASENS PositionsCursor::next()
+{
+	do
+		step();
+	while (!cursor.atEnd() && deleted != 0 && 
+		isDeleted.contains(cursor.docnum()));
+}
+
+void
+YASENS PositionsCursor::skipTo(ys_docnum_t target)
+{
+	while (part+1 < ref.nparts && target >= 
+		collection->getSegment(ref.parts[part+1].segment)->firstdoc) {
+		if (openPart(part+1) != 0)
+			return;
+	}
+	while (!cursor.atEnd() && (cursor.docnum() < target || (deleted != 0 &&
+		isDeleted.contains(cursor.docnum()))))
+		step();
+}
+
+const ys_docpos_t *
+YASENS PositionsCursor::positions()
+{
+	ys_doccnt_t dtf = cursor.dtf();
+	if (damaged)
+		return 0;
+	if (dtf > posalloc) {
+		ys_docpos_t *p = (ys_docpos_t *) realloc(pos, dtf * sizeof *pos);
+		if (p == 0) {
+			fprintf(stderr, "Error: ran out of memory\n");
+			return 0;
+		}
+		pos = p;
+		posalloc = dtf;
+	}
+	if (nextcp == 0) {
+		nextcp = ys_positions_decode(collection->getPositions(
+			ref.parts[part].segment), cp, pos, dtf);
+		if (nextcp == 0) {
+			damaged = true;
+			return 0;
+		}
+	}
+	return pos;
+}
+
+YASENS TermUnion::TermUnion()
+{
+	cursors = 0;
+	ncursors = 0;
+	heap = 0;
+	nheap = 0;
+	pending = 0;
+	npending = 0;
+	end = true;
+	doc = 0;
+	curdtf = 0;
+	tf = 0;
+	maxTermTf = 0;
+	bound = 0.0;
+}
+
+YASENS TermUnion::~TermUnion()
+{
+	delete [] cursors;
+	delete [] heap;
+	delete [] pending;
+}
+
+int
+YASENS TermUnion::open(const YASENS Collection *collection, 
+	const YASENS TermRef *refs, int n)
+{
+	delete [] cursors;
+	delete [] heap;
+	delete [] pending;
+	ncursors = n > 0 ? n : 0;
+	cursors = new YASENS TermCursor[ncursors+1];
+	heap = new int[ncursors+1];
+	pending = new int[ncursors+1];
+	nheap = 0;
+	npending = 0;
+	end = true;
+	tf = 0;
+	maxTermTf = 0;
+	bound = 0.0;
+
+	for (int i = 0; i < ncursors; i++) {
+		if (cursors[i].open(collection, &refs[i]) != 0)
+			return -1;
+		tf += refs[i].tf;
+		if (refs[i].tf > maxTermTf)
+			maxTermTf = refs[i].tf;
+		float b = cursors[i].getBound();
+		if (i == 0 || b == 0.0 || (bound > 0.0 && b > bound))
+			bound = b;
+		if (ncursors > 1 && !cursors[i].atEnd())
+			push(i);
+	}
+	if (ncursors == 1) {
+		end = cursors[0].atEnd();
+		if (!end) {
+			doc = cursors[0].docnum();
+			curdtf = cursors[0].dtf();
+		}
+		return 0;
+	}
+	settle();
+	return 0;
+}
+
+void
+YASENS TermUnion::siftUp(int i)
+{
+	int c = heap[i];
+	while (i > 0 && before(c, heap[(i-1)/2])) {
+		heap[i] = heap[(i-1)/2];
+		i = (i-1)/2;
+	}
+	heap[i] = c;
+}
+
+void
+YASENS TermUnion::siftDown(int i)
+{
+	int c = heap[i];
+	for (;;) {
+		int child = 2*i+1;
+		if (child >= nheap)
+			break;
+		if (child+1 < nheap && before(heap[child+1], heap[child]))
+			child++;
+		if (!before(heap[child], c))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = c;
+}
+
+void
+YASENS TermUnion::push(int c)
+{
+	heap[nheap] = c;
+	siftUp(nheap++);
+}
+
+/**
+ * Takes the cursors at the smallest docnum off the heap.
+ */
+void
+YASENS TermUnion::settle()
+{
+	npending = 0;
+	end = nheap == 0;
+	if (end)
+		return;
+	doc = cursors[heap[0]].docnum();
+	curdtf = 0;
+	while (nheap > 0 && cursors[heap[0]].docnum() == doc) {
+		int c = heap[0];
+		if (cursors[c].dtf() > curdtf)
+			curdtf = cursors[c].dtf();
+		pending[npending++] = c;
+		heap[0] = heap[--nheap];
+		if (nheap > 0)
+			siftDown(0);
+	}
+}
+
+void
+YASENS TermUnion::nextUnion()
+{
+	for (int i = 0; i < npending; i++) {
+		int c = pending[i];
+		cursors[c].next();
+		if (!cursors[c].atEnd())
+			push(c);
+	}
+	settle();
+}
+
+void
+YASENS TermUnion::skipTo(ys_docnum_t target)
+{
+	if (end || doc >= target)
+		return;
+	if (ncursors == 1) {
+		cursors[0].skipTo(target);
+		end = cursors[0].atEnd();
+		if (!end) {
+			doc = cursors[0].docnum();
+			curdtf = cursors[0].dtf();
+		}
+		return;
+	}
+	for (int i = 0; i < npending; i++) {
+		int c = pending[i];
+		cursors[c].skipTo(target);
+		if (!cursors[c].atEnd())
+			push(c);
+	}
+	while (nheap > 0 && cursors[heap[0]].docnum() < target) {
+		int c = heap[0];
+		cursors[c].skipTo(target);
+		if (cursors[c].atEnd()) {
+			heap[0] = heap[--nheap];
+			if (nheap == 0)
+				break;
+		}
+		siftDown(0);
+	}
+	settle();
+}
@@ -26,44 +26,391 @@
 
 #include "yase.h"
 #include "btree.h"
+#include "termdict.h"
+#include "kgram.h"
 #include "postfile.h"
+#include "positions.h"
 #include "docdb.h"
+#include "weighttable.h"
+#include "segment.h"
+#include "bitset.h"
+
+enum {
+	YS_MAXEXPANSION = 64	/* default terms a query pattern expands to */
+};
 
 YASE_NS_BEGIN
 
+/**
+ * A term's postings in each segment of a collection that holds it,
+ * in docnum order. See Collection::findTerm().
+ */
+struct TermRef {
+	ys_doccnt_t tf;			/* over all segments */
+	int nparts;
+	struct {
+		int segment;		/* index into the collection's segments */
+		ys_postoff_t position;	/* start of postings */
+		ys_doccnt_t tf;
+	} parts[YS_MAXSEGMENTS];
+};
+
 class Collection {
 
 private:
-	YASENS PostFile *postings_file;
+	int nsegments;
+	ys_segment_t segments[YS_MAXSEGMENTS];
+	ys_btree_t *trees[YS_MAXSEGMENTS];
+	ys_termdict_t *dicts[YS_MAXSEGMENTS];	/* 0 if there is none */
+	YASENS PostFile *postings[YS_MAXSEGMENTS];
+	ys_positions_t *positions[YS_MAXSEGMENTS];	/* 0 if not recorded */
 	ys_docdb_t *docdb;
-	ys_btree_t *tree;
+	ys_bitset_t *deleted;		/* owned by docdb */
 	ys_bool_t stemmed;
 	ys_doccnt_t N;
 	ys_doccnt_t maxtf;
 	ys_doccnt_t maxdtf;
 	ys_doccnt_t numFiles;
+	int postingsFormat;
+	ys_uint32_t generation;		/* of docdb when opened */
+	size_t cacheBlocks;
+	int weightBits;
+	YASENS WeightTable *weights;
+	int maxExpansion;
+	YASENS KGramIndex *kgrams;	/* built on first use */
 	char errmsg[256];
 
+	struct LiveFilter {
+		YASENS BitSetFilter deleted;
+		ys_pfn_postings_iterator_t *pfunc;
+		void *arg;
+	};
+	static ys_bool_t skipDeleted(void *arg, ys_docnum_t docnum, 
+		ys_doccnt_t dtf);
+	int buildKGrams();
+
 public:
 	Collection();
 	~Collection();
 
+	/**
+	 * Sets the size of the index buffer pool in blocks. Must be
+	 * called before open(); 0 selects the default.
+	 */
+	void setCacheSize(size_t nblocks) { cacheBlocks = nblocks; }
+	/**
+	 * Sets the precision of the document weight table loaded by 
+	 * open() in read only mode: 32 (the default), 16 or 8 bits, or 
+	 * 0 to read weights from yase.docptrs as needed. Must be called 
+	 * before open().
+	 */
+	void setWeightBits(int bits) { weightBits = bits; }
+	int getWeightBits() const { return weightBits; }
+	/**
+	 * Sets the most terms a query pattern may expand to (see 
+	 * expandTerm()); 0 selects the default.
+	 */
+	void setMaxExpansion(int n) { 
+		maxExpansion = n > 0 ? n : YS_MAXEXPANSION; 
+	}
+	int getMaxExpansion() const { return maxExpansion; }
 	int open(const char *home, const char *mode);
 	void close();
 
-	ys_btree_t *getIndex() const { return tree; }
+	int getNumSegments() const { return nsegments; }
+	const ys_segment_t *getSegment(int i) const { return &segments[i]; }
+	ys_btree_t *getIndex(int segment = 0) const { return trees[segment]; }
 	ys_docdb_t *getDocDb() const { return docdb; }
-	YASENS PostFile *getPostFile() const { return postings_file; }
+	/**
+	 * Returns the generation of the database when the collection was
+	 * opened (see ys_dbgetopengeneration()).
+	 */
+	ys_uint32_t getGeneration() const { return generation; }
+	/**
+	 * Tells whether documents have been added or deleted, or segments
+	 * merged, since the collection was opened; it must then be opened
+	 * again to see the changes.
+	 */
+	bool hasChanged() const { 
+		return ys_dbgetgeneration(docdb) != generation; 
+	}
+	YASENS PostFile *getPostFile(int segment = 0) const { 
+		return postings[segment]; 
+	}
+	/**
+	 * Does the collection record the positions of terms (see 
+	 * positions.h) ?
+	 */
+	bool hasPositions() const { 
+		return (postingsFormat & YS_POSTINGS_POSITIONS) != 0; 
+	}
+	const ys_positions_t *getPositions(int segment = 0) const {
+		return positions[segment];
+	}
+	/**
+	 * Looks up a term (a length prefixed key) in every segment, in
+	 * its term dictionary if it has one, else in its btree.
+	 * Returns false if no segment holds it.
+	 */
+	bool findTerm(const ys_uchar_t *key, TermRef *ref) const;
+	/**
+	 * Evaluates a function for each posting of a term, in docnum
+	 * order. Deleted documents are skipped.
+	 */
+	void iterate(const TermRef *ref, ys_pfn_postings_iterator_t *pfunc, 
+		void *arg) const;
+	/**
+	 * Does a query term hold wildcards (* or ?), or end with ~ or ~N 
+	 * for a fuzzy match ?
+	 */
+	static bool isPattern(const ys_uchar_t *term);
+	/**
+	 * Expands a query pattern into the terms of the collection that 
+	 * match it, found as by findTerm(). A pattern with a single * at
+	 * the end is a prefix, and is expanded by a range scan of each
+	 * segment's term dictionary (or btree); other wildcards, and 
+	 * word~N (within N edits of word, the stemmed word if the 
+	 * collection is stemmed), use a bigram index of all terms that is
+	 * built when first needed. word~ allows 1 edit for words of 3 to
+	 * 5 characters and 2 for longer words. If more than 
+	 * getMaxExpansion() terms match, the closest ones, then the ones
+	 * in most documents, are kept. refs must have room for 
+	 * getMaxExpansion() terms. Returns the number of terms, or -1 on 
+	 * error.
+	 */
+	int expandTerm(const ys_uchar_t *pattern, TermRef *refs);
+	/**
+	 * Evaluates a function for each document holding any of n terms,
+	 * in docnum order, as TermUnion does.
+	 */
+	void iterate(const TermRef *refs, int n, 
+		ys_pfn_postings_iterator_t *pfunc, void *arg) const;
+	/**
+	 * Returns the deleted documents, or 0 if there are none.
+	 */
+	ys_bitset_t *getDeleted() const { return deleted; }
 	const char *getError() const { return errmsg; }
 	ys_bool_t isStemmed() const { return stemmed; };
 	ys_doccnt_t getN() const { return N; }
 	ys_doccnt_t getMaxTf() const { return maxtf; }
 	ys_doccnt_t getMaxDtf() const { return maxdtf; }
 	ys_doccnt_t getNumFiles() const { return numFiles; }
-	static ys_btree_t *openIndex(const char *home, const char *mode);
-	static YASENS PostFile *openPostings(const char *home, const char *mode);
+	int getPostingsFormat() const { return postingsFormat; }
+	/**
+	 * Retrieves a document's weight and max dtf. Returns -1 on
+	 * error.
+	 */
+	int getDocWeight(ys_docnum_t docnum, float *wt, ys_doccnt_t *maxdtf) const;
+	/**
+	 * Retrieves the weights and max dtfs of n documents from first.
+	 */
+	int getDocWeights(ys_docnum_t first, ys_docnum_t n, float *wts, 
+		ys_doccnt_t *maxdtfs) const;
+	static ys_btree_t *openIndex(const char *home, int segment, 
+		const char *mode, size_t nblocks = 0);
+	static YASENS PostFile *openPostings(const char *home, int segment, 
+		const char *mode, int format = YS_POSTINGS_V1);
+};
+
+/**
+ * A TermCursor walks a term's postings across all segments, moving
+ * from one segment's PostingsCursor to the next. Deleted documents
+ * are skipped.
+ */
+class TermCursor {
+private:
+	const YASENS Collection *collection;
+	YASENS TermRef ref;
+	int part;
+	YASENS PostingsCursor cursor;
+	float bound;
+	ys_bitset_t *deleted;
+	YASENS BitSetFilter isDeleted;
+
+	int openPart(int p);
+	void skipDeleted();
+public:
+	TermCursor() : collection(0), part(0), bound(0.0), deleted(0) { 
+		ref.nparts = 0; 
+	}
+	/**
+	 * Positions the cursor at the first posting of the term. Returns
+	 * -1 on error.
+	 */
+	int open(const YASENS Collection *collection, const YASENS TermRef *ref);
+	ys_bool_t atEnd() const { return cursor.atEnd(); }
+	ys_docnum_t docnum() const { return cursor.docnum(); }
+	ys_doccnt_t dtf() const { return cursor.dtf(); }
+	ys_doccnt_t getTf() const { return ref.tf; }
+	/**
+	 * Upper bound on log_dtf/document weight for the term, or 0 if
+	 * the postings in some segment do not record one.
+	 */
+	float getBound() const { return bound; }
+	/**
+	 * Largest dtf in the current block, or 0 if the postings
+	 * have no skip table.
+	 */
+	ys_doccnt_t blockMaxDtf() const { return cursor.blockMaxDtf(); }
+	void next();
+	/**
+	 * Advances to the first posting with docnum >= target.
+	 */
+	void skipTo(ys_docnum_t target);
+};
+
+/**
+ * A PositionsCursor walks a term's postings across all segments, like
+ * a TermCursor, and decodes its positions in the current document. As 
+ * the positions of each document passed must be stepped over, it does
+ * not use the skip table, and skipTo() reads every posting before the
+ * target. The collection must record positions.
+ */
+class PositionsCursor {
+private:
+	const YASENS Collection *collection;
+	YASENS TermRef ref;
+	int part;
+	YASENS PostingsCursor cursor;
+	const ys_uchar_t *cp;		/* positions of the current document */
+	const ys_uchar_t *nextcp;	/* of the next, once decoded */
+	ys_docpos_t *pos;
+	ys_doccnt_t posalloc;
+	ys_bitset_t *deleted;
+	YASENS BitSetFilter isDeleted;
+	bool damaged;
+
+	int openPart(int p);
+	void step();
+
+private:
+	PositionsCursor(const PositionsCursor&);
+	PositionsCursor& operator=(const PositionsCursor&);
+
+public:
+	PositionsCursor();
+	~PositionsCursor();
+	/**
+	 * Positions the cursor at the first posting of the term. Returns
+	 * -1 on error.
+	 */
+	int open(const YASENS Collection *collection, const YASENS TermRef *ref);
+	ys_bool_t atEnd() const { return cursor.atEnd(); }
+	ys_docnum_t docnum() const { return cursor.docnum(); }
+	ys_doccnt_t dtf() const { return cursor.dtf(); }
+	void next();
+	/**
+	 * Advances to the first posting with docnum >= target.
+	 */
+	void skipTo(ys_docnum_t target);
+	/**
+	 * Returns the dtf positions of the term in the current document,
+	 * in ascending order, or 0 if the positions file is damaged.
+	 */
+	const ys_docpos_t *positions();
+};
+
+/**
+ * A TermUnion walks the postings of several terms as if they were one,
+ * for a query pattern that expanded to them. The terms' TermCursors 
+ * are merged through a heap ordered by docnum, and each document is 
+ * returned once, with the largest dtf of the terms it contains. The 
+ * tf is the sum of the terms' tfs, which may count a document more
+ * than once. With a single term it simply follows its TermCursor.
+ */
+class TermUnion {
+private:
+	YASENS TermCursor *cursors;
+	int ncursors;
+	int *heap;			/* cursors past doc, by docnum */
+	int nheap;
+	int *pending;			/* cursors at doc */
+	int npending;
+	bool end;
+	ys_docnum_t doc;
+	ys_doccnt_t curdtf;
+	ys_doccnt_t tf;
+	ys_doccnt_t maxTermTf;
+	float bound;
+
+	bool before(int a, int b) const { 
+		return cursors[a].docnum() < cursors[b].docnum(); 
+	}
+	void siftUp(int i);
+	void siftDown(int i);
+	void push(int c);
+	void settle();
+	void nextUnion();
+
+private:
+	TermUnion(const TermUnion&);
+	TermUnion& operator=(const TermUnion&);
+
+public:
+	TermUnion();
+	~TermUnion();
+	/**
+	 * Positions the cursor at the first document holding any of the
+	 * n terms. Returns -1 on error.
+	 */
+	int open(const YASENS Collection *collection, const YASENS TermRef *refs,
+		int n);
+	ys_bool_t atEnd() const { return end; }
+	ys_docnum_t docnum() const { return doc; }
+	ys_doccnt_t dtf() const { return curdtf; }
+	ys_doccnt_t getTf() const { return tf; }
+	/**
+	 * The largest tf of the terms, whose idf is the smallest.
+	 */
+	ys_doccnt_t getMaxTermTf() const { return maxTermTf; }
+	/**
+	 * Upper bound on log_dtf/document weight over all of the terms,
+	 * or 0 if one of them does not record one.
+	 */
+	float getBound() const { return bound; }
+	void next();
+	/**
+	 * Advances to the first document with docnum >= target.
+	 */
+	void skipTo(ys_docnum_t target);
 };
 
 YASE_NS_END
 
+inline int
+YASENS Collection::getDocWeight(ys_docnum_t docnum, float *wt, 
+	ys_doccnt_t *maxdtf) const
+{
+	if (weights != 0) {
+		weights->get(docnum, wt, maxdtf);
+		return 0;
+	}
+	return ys_dbgetdocwtdtf(docdb, docnum, wt, maxdtf);
+}
+
+inline void
+YASENS TermCursor::next()
+{
+	cursor.next();
+	if (cursor.atEnd() && part+1 < ref.nparts)
+		openPart(part+1);
+	if (deleted != 0)
+		skipDeleted();
+}
+
+inline void
+YASENS TermUnion::next()
+{
+	if (ncursors != 1) {
+		nextUnion();
+		return;
+	}
+	cursors[0].next();
+	end = cursors[0].atEnd();
+	if (!end) {
+		doc = cursors[0].docnum();
+		curdtf = cursors[0].dtf();
+	}
+}
+
 #endif
@@ -29,10 +29,42 @@
 * DM 25-11-00 added support for logicalname, anchor
 * DM 19-02-02 Changed delimiter from % to ^
 * DM 08-12-02 Added support for saving max term frequency per document.
+*    17-10-26 Added postings format to yase.info. Older files are shorter
+*             and read back as format 0 (v1).
+*    17-10-26 Added ys_dbgetdocwtdtfs() to read weights in bulk.
+*    17-10-26 Fixed record size in ys_dbgetdocmaxdtf() and ys_dbgetdocwtdtf(),
+*             which used the size of the maxdtf pointer.
+*    17-10-26 Added mode "a" to ys_dbopen(), to add documents to an
+*             existing database. Document numbers are kept per database
+*             instead of in a static variable.
+*    17-10-26 Added ys_dbdeletedoc() and ys_dbisdeleted(). Deleted 
+*             documents are recorded in yase.deleted.
+*    17-10-26 Documents are now added to the binary document store
+*             (yase.store, see docstore.h) instead of yase.files and
+*             yase.docs, which are still read for older documents.
+*             Added ys_dbgetdocref() and ys_dbconvert().
+*    17-10-26 Added ys_dbgetdocumentrefs() to read the documents of a
+*             page of results together.
+*    17-10-26 Added a generation number to yase.info, which changes 
+*             whenever documents are added or deleted. Older files 
+*             read back as generation 0.
+*    17-10-26 yase.deleted keeps its format, the bitset being converted
+*             with ys_bs_getwords() and ys_bs_setwords().
+*    17-10-26 Added ys_dbgetopengeneration(). yase.info is read before
+*             yase.deleted when a database is opened, and is unbuffered
+*             so that ys_dbgetgeneration() sees changes made by other 
+*             processes.
+*    18-10-26 A rebuilt database carries on from the generation of the
+*             one it replaces, so that readers and cached results of
+*             the old one do not take it for their own.
+*    18-10-26 ys_nexttok() keeps its place in the caller's variable 
+*             instead of a static one, for server threads.
 */
 
 #include "docdb.h"
+#include "docstore.h"
 #include "ystdio.h"
+#include "bitset.h"
 
 struct ys_docdb_info_t {
 	ys_docnum_t numdocs;
@@ -40,22 +72,38 @@ struct ys_docdb_info_t {
 	ys_doccnt_t maxdoctermfreq;
 	ys_doccnt_t maxtermfreq;
 	ys_bool_t   stemmed;
+	ys_uint32_t postings_format;
+	ys_uint32_t generation;
 };
 
 struct ys_docdb_t {
-	ys_file_t *yasefiles;		/* yase.files */
-	ys_file_t *yasedocs;		/* yase.docs */
+	ys_file_t *yasefiles;		/* yase.files, opened when needed */
+	ys_file_t *yasedocs;		/* yase.docs, opened when needed */
 	ys_file_t *yasedocptrs;		/* yase.docptrs */
 	ys_file_t *yaseinfo;		/* yase.info */
+	ys_docstore_t *store;		/* yase.store, 0 if there is none */
+	bool writing;			/* documents are being added */
+	ys_docdata_t textfile;		/* fields read from yase.files */
+	ys_docdata_t textdoc;		/* and yase.docs */
+	ys_docdata_t *texts;		/* the same, for each document read
+					 * by ys_dbgetdocumentrefs() */
+	size_t ntexts;
 	const char *rootpath;
-	ys_docnum_t docnum;
+	ys_docnum_t docnum;		/* last document added */
+	ys_docnum_t nextdoc;		/* number of the next document */
 	struct ys_docdb_info_t info;
+	ys_bitset_t *deleted;		/* 0 if no document is deleted */
+	bool deleted_changed;		/* yase.deleted must be written */
+	ys_uint32_t opengeneration;	/* generation when opened */
+	char dbpath[1024];
 };
 
-/* Records in yase.docptrs are marked with a boolean flag */
+/* Records in yase.docptrs are marked with the kind of record they
+ * point to; STORED_DOC records point to a block of yase.store */
 enum {
 	MULTIDOC_FILE = 1,
-	SINGLEDOC_FILE = 0
+	SINGLEDOC_FILE = 0,
+	STORED_DOC = 2
 };
 
 /* Delimiter character used to separate fields. Cannot use : as urls
@@ -63,10 +111,107 @@ enum {
  */
 static char DELIMITER = '^';
 
+/**
+ * Returns the generation to start a new yase.info from: the one in 
+ * the yase.info being replaced, so that a rebuilt database never has
+ * the generation of an older one. A new database starts from 0, so
+ * that builds of the same documents are identical.
+ */
+static ys_uint32_t
+ys_dbinitialgeneration(const char *path)
+{
+	struct ys_docdb_info_t info;
+	FILE *fp = fopen(path, "rb");
+	if (fp == 0)
+		return 0;
+	/* Older files are shorter and read back as generation 0 */
+	memset(&info, 0, sizeof info);
+	size_t n = fread(&info, 1, sizeof info, fp);
+	fclose(fp);
+	return n > 0 ? info.generation : 0;
+}
+
+/**
+ * Loads yase.deleted, if there is one. The file holds the number of 
+ * bits followed by the words of a ys_bitset_t.
+ */
+static int
+ys_dbreaddeleted(ys_docdb_t *db, const char *path)
+{
+	unsigned size;
+	FILE *fp = fopen(path, "rb");
+	if (fp == 0)
+		return 0;
+	if (fread(&size, sizeof size, 1, fp) == 1) {
+		unsigned n = ys_bs_nwords(size);
+		unsigned *words = (unsigned *) malloc((n > 0 ? n : 1) * 
+			sizeof *words);
+		if (words != 0 && fread(words, sizeof *words, n, fp) == n) {
+			db->deleted = ys_bs_alloc(size);
+			ys_bs_setwords(db->deleted, words);
+			free(words);
+			fclose(fp);
+			return 0;
+		}
+		free(words);
+	}
+	fprintf(stderr, "Unable to read %s\n", path);
+	fclose(fp);
+	return -1;
+}
+
+/**
+ * Replaces yase.deleted. It is written to a temporary file first so 
+ * that readers never see a partial file.
+ */
+static int
+ys_dbwritedeleted(ys_docdb_t *db)
+{
+	char path[1024];
+	char tmppath[1024];
+	FILE *fp;
+
+	snprintf(path, sizeof path, "%s/%s", db->dbpath, "yase.deleted");
+	snprintf(tmppath, sizeof tmppath, "%s/%s", db->dbpath, "tmp.deleted");
+	fp = fopen(tmppath, "wb");
+	if (fp == 0) {
+		perror(tmppath);
+		return -1;
+	}
+	unsigned n = ys_bs_nwords(db->deleted->size);
+	unsigned *words = (unsigned *) malloc((n > 0 ? n : 1) * sizeof *words);
+	if (words == 0) {
+		fprintf(stderr, "Error: ran out of memory\n");
+		fclose(fp);
+		remove(tmppath);
+		return -1;
+	}
+	ys_bs_getwords(db->deleted, words);
+	fwrite(&db->deleted->size, sizeof db->deleted->size, 1, fp);
+	fwrite(words, sizeof *words, n, fp);
+	free(words);
+	if (ferror(fp) || fclose(fp) != 0) {
+		fprintf(stderr, "Unable to write to %s\n", tmppath);
+		remove(tmppath);
+		return -1;
+	}
+#ifdef WIN32
+	/* rename() fails if the target exists */
+	remove(path);
+#endif
+	if (rename(tmppath, path) != 0) {
+		perror(path);
+		return -1;
+	}
+	db->deleted_changed = false;
+	return ys_dbnewgeneration(db);
+}
+
 /**
  * Opens a document database (except the index).
  * @param   dbpath location of the database files.
- * @param   mode   "r" (read) or "w" (write).
+ * @param   mode   "r" (read), "r+" (update), "w" (write) or "a" (add 
+ *                 documents to an existing database).
  * @returns        handle
  */ 
 ys_docdb_t *
@@ -74,6 +219,11 @@ ys_dbopen(const char *dbpath, const char *mode, const char *rootpath)
 {
 	ys_docdb_t *db;
 	char path[1024];
+	bool append = strcmp(mode, "a") == 0;
+	bool create = strcmp(mode, "w") == 0;
+
+	if (append)
+		mode = "r+";
 
 	db = (ys_docdb_t *) calloc(1, sizeof *db);
 	if (db == 0) {
@@ -82,25 +232,64 @@ ys_dbopen(const char *dbpath, const char *mode, const char *rootpath)
 		return 0;
 	}
 
-	snprintf(path, sizeof path, "%s/%s", dbpath, "yase.files");
-	db->yasefiles = ys_file_open( path, mode, 0 );
-	snprintf(path, sizeof path, "%s/%s", dbpath, "yase.docs");
-	db->yasedocs = ys_file_open( path, mode, 0 );
 	snprintf(path, sizeof path, "%s/%s", dbpath, "yase.docptrs");
 	db->yasedocptrs = ys_file_open( path, mode, 0 );
 	snprintf(path, sizeof path, "%s/%s", dbpath, "yase.info");
+	/* Read before yase.info is truncated; ys_dbaddinfo() moves it on */
+	if (create)
+		db->info.generation = ys_dbinitialgeneration(path);
 	db->yaseinfo = ys_file_open( path, mode, 0 );
+	/* Unbuffered, for ys_dbgetgeneration() to see changes made by
+	 * other processes */
+	if (db->yaseinfo != 0)
+		ys_file_setbuf( db->yaseinfo, 0 );
+	if (create) {
+		/* Older databases kept documents in these */
+		snprintf(path, sizeof path, "%s/%s", dbpath, "yase.files");
+		remove(path);
+		snprintf(path, sizeof path, "%s/%s", dbpath, "yase.docs");
+		remove(path);
+	}
+	snprintf(path, sizeof path, "%s/%s", dbpath, "yase.store");
+	db->store = ys_docstore_open(path, create ? "w" : append ? "a" : "r");
+	db->writing = create || append;
 
-	if (db->yasefiles == 0 || db->yasedocs == 0 || 
-		db->yasedocptrs == 0 || db->yaseinfo == 0) {
-		fprintf(stderr, "Failed to open yase.files, "
-			"yase.docs, yase.docptrs or yase.info\n");
+	if (db->yasedocptrs == 0 || db->yaseinfo == 0 ||
+		(db->store == 0 && db->writing)) {
+		fprintf(stderr, "Failed to open yase.docptrs, "
+			"yase.info or yase.store\n");
 		ys_dbclose(db);
 		db = 0;;
 	}		
 	else {
 		db->rootpath = rootpath;
 		db->docnum = 0;
+		db->nextdoc = 0;
+		strncpy(db->dbpath, dbpath, sizeof db->dbpath-1);
+		snprintf(path, sizeof path, "%s/%s", dbpath, "yase.deleted");
+		if (create)
+			remove(path);
+		else {
+			/* The generation is read first, so that it is never
+			 * newer than the deleted documents */
+			db->opengeneration = ys_dbgetgeneration(db);
+			if (ys_dbreaddeleted(db, path) != 0) {
+				ys_dbclose(db);
+				db = 0;
+			}
+		}
+	}
+	if (db != 0 && append) {
+		ys_docnum_t numdocs, numfiles;
+		ys_doccnt_t maxdoctermfreq, maxtermfreq;
+		ys_bool_t stemmed;
+		if (ys_dbgetinfo(db, &numdocs, &numfiles, &maxdoctermfreq,
+			&maxtermfreq, &stemmed) != 0) {
+			ys_dbclose(db);
+			return 0;
+		}
+		db->docnum = numdocs-1;
+		db->nextdoc = numdocs;
 	}
 	return db;	
 }
@@ -115,6 +304,10 @@ ys_dbclose(ys_docdb_t *db)
 {
 	int rc = 0;
 	if (db != 0) {
+		if (db->deleted_changed && ys_dbwritedeleted(db) != 0)
+			rc = -1;
+		if (db->deleted != 0)
+			ys_bs_destroy(db->deleted);
 		if (db->yasefiles != 0) {
 			if (ys_file_close(db->yasefiles) != 0) {
 				fprintf(stderr, "Error closing yase.files\n");
@@ -139,13 +332,19 @@ ys_dbclose(ys_docdb_t *db)
 				rc = -1;
 			}
 		}
+		if (db->store != 0 && ys_docstore_close(db->store) != 0) {
+			fprintf(stderr, "Error closing yase.store\n");
+			rc = -1;
+		}
+		free(db->texts);
 		free(db);
 	}
 	return rc;
 }
 
 /**
- * Add a file to the document database.
+ * Add a file to the document database. Its fields are stored with 
+ * each of its documents, by ys_dbadddocptr().
  * @param   db       handle to the database
  * @param   docfile  structure ys_docdata_t containing information regarding
  *                   file to be added
@@ -154,44 +353,20 @@ ys_dbclose(ys_docdb_t *db)
 int
 ys_dbaddfile(ys_docdb_t *db, ys_docdata_t *docfile)
 {
-	ys_filepos_t pos;
-	const char *filename = docfile->filename;
-	const char *logicalname = docfile->logicalname;
-	const char *rootpath;
-
 	/* At least the file should have a name that can be retrieved */
-	if (strlen(logicalname) == 0) {
+	if (strlen(docfile->logicalname) == 0) {
 		fprintf(stderr, "Document file data is corrupt\n");
-		fprintf(stderr, "Filename='%s'\n", filename);
-		fprintf(stderr, "Logicalname='%s'\n", logicalname);
-		return -1;
-	}
-
-	/* If this file is relative to rootpath, we remove the common part */
-	rootpath = db->rootpath;
-	if (rootpath != 0) {
-		size_t len = strlen(rootpath);
-		if (strncmp(logicalname, rootpath, len) == 0)
-			logicalname += len;
-	}
-
-	ys_file_getpos(db->yasefiles, &pos);
-	ys_file_printf(db->yasefiles, "%s%c%s%c%s%c%s%c%s%c%s%c%s%c\n",
-		logicalname,
-		DELIMITER, docfile->title, DELIMITER, docfile->author, 
-		DELIMITER, docfile->type, DELIMITER, docfile->size, 
-		DELIMITER, docfile->datecreated, 
-		DELIMITER, docfile->keywords, DELIMITER);
-	if (ys_file_error(db->yasefiles)) {
-		fprintf(stderr, "Unable to write to yase.files\n");
+		fprintf(stderr, "Filename='%s'\n", docfile->filename);
+		fprintf(stderr, "Logicalname='%s'\n", docfile->logicalname);
 		return -1;
 	}
-	docfile->offset = pos;
+	docfile->offset = 0;
 	return 0;
 }
 
 /**
- * Add a document to the document database.
+ * Add a document to the document database. Its fields are stored by
+ * ys_dbadddocptr().
  * @param db      handle to the open database
  * @param docfile file to which the document belongs
  * @param doc     document to be added
@@ -200,22 +375,11 @@ ys_dbaddfile(ys_docdb_t *db, ys_docdata_t *docfile)
 int
 ys_dbadddoc(ys_docdb_t *db, ys_docdata_t *docfile, ys_docdata_t *doc)
 {
-	ys_filepos_t pos;
-
 	if (strlen(doc->title) == 0) {
 		fprintf(stderr, "Document does not have a title\n");
 		strncpy(doc->title, "Untitled", sizeof doc->title);
 	}
-	ys_file_getpos(db->yasedocs, &pos);
-	ys_file_write(&docfile->offset, 1, sizeof docfile->offset, db->yasedocs);
-	ys_file_printf(db->yasedocs, "%s%c%s%c%s%c\n", 
-		doc->title, DELIMITER, doc->anchor, DELIMITER,
-		doc->keywords, DELIMITER);
-	if (ys_file_error(db->yasedocs)) {
-		fprintf(stderr, "Unable to write to yase.docs\n");
-		return -1;
-	}
-	doc->offset = pos;
+	doc->offset = 0;
 	return 0;
 }
 
@@ -231,21 +395,33 @@ int
 ys_dbadddocptr(ys_docdb_t *db, ys_docdata_t *docfile, ys_docdata_t *doc,
 	ys_docnum_t *dn)
 {
-	static ys_docnum_t docnum = 0;
+	ys_docnum_t docnum = db->nextdoc;
 	ys_filepos_t pos;
-	char type;
+	char type = STORED_DOC;
 	float wt = 0.0;
 	ys_filepos_t offset;
 	ys_doccnt_t maxdtf = 0;
+	const char *fields[YS_DOCFIELD_COUNT];
+	const char *logicalname = docfile->logicalname;
 
-	if (doc != 0) {
-		pos = doc->offset;
-		type = MULTIDOC_FILE;
+	/* If this file is relative to rootpath, we remove the common part */
+	if (db->rootpath != 0) {
+		size_t len = strlen(db->rootpath);
+		if (strncmp(logicalname, db->rootpath, len) == 0)
+			logicalname += len;
 	}
-	else {
-		pos = docfile->offset;
-		type = SINGLEDOC_FILE;
-	}	
+	fields[YS_DOCFIELD_LOGICALNAME] = logicalname;
+	fields[YS_DOCFIELD_FILETITLE] = docfile->title;
+	fields[YS_DOCFIELD_AUTHOR] = docfile->author;
+	fields[YS_DOCFIELD_TYPE] = docfile->type;
+	fields[YS_DOCFIELD_SIZE] = docfile->size;
+	fields[YS_DOCFIELD_DATECREATED] = docfile->datecreated;
+	fields[YS_DOCFIELD_FILEKEYWORDS] = docfile->keywords;
+	fields[YS_DOCFIELD_TITLE] = doc != 0 ? doc->title : "";
+	fields[YS_DOCFIELD_ANCHOR] = doc != 0 ? doc->anchor : "";
+	fields[YS_DOCFIELD_KEYWORDS] = doc != 0 ? doc->keywords : "";
+	if (ys_docstore_add(db->store, docnum, fields, &pos) != 0)
+		return -1;
 	offset = docnum * (sizeof offset + sizeof type + sizeof wt + sizeof maxdtf);
 	ys_file_setpos(db->yasedocptrs, &offset);
 	ys_file_write(&type, 1, sizeof type, db->yasedocptrs);
@@ -256,7 +432,7 @@ ys_dbadddocptr(ys_docdb_t *db, ys_docdata_t *docfile, ys_docdata_t *doc,
 		fprintf(stderr, "Unable to write to yase.docptrs\n");
 		return -1;
 	}
-	*dn = db->docnum = docnum++;
+	*dn = db->docnum = db->nextdoc++;
 	return 0;
 }
 
@@ -348,7 +524,7 @@ ys_dbgetdocmaxdtf(ys_docdb_t *db, ys_docnum_t docnum, ys_doccnt_t *maxdtf)
 	char type;
 	ys_doccnt_t temp = 0;
 
-	pos = docnum * (sizeof pos + sizeof type + sizeof f + sizeof maxdtf);
+	pos = docnum * (sizeof pos + sizeof type + sizeof f + sizeof temp);
 	pos += (sizeof type + sizeof pos + sizeof f);
 	ys_file_setpos(db->yasedocptrs, &pos);
 	ys_file_read(&temp, 1, sizeof temp, db->yasedocptrs);
@@ -368,7 +544,7 @@ ys_dbgetdocwtdtf(ys_docdb_t *db, ys_docnum_t docnum, float *wt, ys_doccnt_t *max
 	char type;
 	ys_doccnt_t temp = 0;
 
-	pos = docnum * (sizeof pos + sizeof type + sizeof f + sizeof maxdtf);
+	pos = docnum * (sizeof pos + sizeof type + sizeof f + sizeof temp);
 	pos += (sizeof type + sizeof pos);
 	ys_file_setpos(db->yasedocptrs, &pos);
 	ys_file_read(&f, 1, sizeof f, db->yasedocptrs);
@@ -382,6 +558,49 @@ ys_dbgetdocwtdtf(ys_docdb_t *db, ys_docnum_t docnum, float *wt, ys_doccnt_t *max
 	return 0;
 }
 
+/**
+ * Retrieve the weights and max dtfs of n consecutive documents, 
+ * reading yase.docptrs sequentially.
+ * @param   db      document database handle
+ * @param   first   first document
+ * @param   n       number of documents
+ * @param   wts     receives n weights
+ * @param   maxdtfs receives n max dtfs
+ * @returns         0 on success, -1 on failure
+ */
+int
+ys_dbgetdocwtdtfs(ys_docdb_t *db, ys_docnum_t first, ys_docnum_t n, 
+	float *wts, ys_doccnt_t *maxdtfs)
+{
+	enum { BATCH = 256 };
+	float f;
+	ys_filepos_t pos;
+	char type;
+	ys_doccnt_t maxdtf;
+	const size_t recsize = sizeof pos + sizeof type + sizeof f + sizeof maxdtf;
+	ys_uchar_t buf[BATCH * (sizeof pos + sizeof type + sizeof f + sizeof maxdtf)];
+
+	pos = first * recsize;
+	ys_file_setpos(db->yasedocptrs, &pos);
+	while (n > 0) {
+		ys_docnum_t count = n < BATCH ? n : BATCH;
+		ys_file_read(buf, recsize, count, db->yasedocptrs);
+		if (ys_file_error(db->yasedocptrs)) {
+			fprintf(stderr, "Unable to read from yase.docptrs\n");
+			return -1;
+		}
+		for (ys_docnum_t i = 0; i < count; i++) {
+			const ys_uchar_t *rec = buf + i * recsize + sizeof type + sizeof pos;
+			memcpy(&f, rec, sizeof f);
+			memcpy(&maxdtf, rec + sizeof f, sizeof maxdtf);
+			*wts++ = f;
+			*maxdtfs++ = maxdtf;
+		}
+		n -= count;
+	}
+	return 0;
+}
+
 ys_docnum_t
 ys_dbnumdocs(ys_docdb_t *db)
 {
@@ -389,13 +608,15 @@ ys_dbnumdocs(ys_docdb_t *db)
 }
 
 /** 
- * Similar to strtok except that the token is copied to a buffer and
- * adjacent delimiters cause multiple tokens to be returned.
+ * Similar to strtok_r except that the token is copied to a buffer and
+ * adjacent delimiters cause multiple tokens to be returned. The place
+ * reached is kept in *hold, not in a static variable, as server 
+ * threads read document data at the same time.
  */
 static const char *
-ys_nexttok(char *inp, char delimiter, char *out, size_t outsize)
+ys_nexttok(char *inp, char delimiter, char *out, size_t outsize, 
+	char **hold)
 {
-    static char *hold = "";
     size_t size_count;
     char *output = out;
 
@@ -405,7 +626,7 @@ ys_nexttok(char *inp, char delimiter, char *out, size_t outsize)
     }
 
     if ( inp == NULL ) {
-        inp = hold;
+        inp = *hold;
     }
 
     if ( *inp == 0 ) {
@@ -415,7 +636,7 @@ ys_nexttok(char *inp, char delimiter, char *out, size_t outsize)
     if ( *inp == delimiter ) {
         *out = 0;
         inp++;
-        hold = inp;
+        *hold = inp;
         return output;
     }
 
@@ -446,17 +667,35 @@ ys_nexttok(char *inp, char delimiter, char *out, size_t outsize)
     if ( *inp == delimiter || *inp == '\n' )
         inp++;
     
-    hold = inp;
+    *hold = inp;
 
     return output;
 }
 
+/**
+ * Opens yase.files or yase.docs for reading, if it is not open.
+ */
+static ys_file_t *
+ys_dbopentext(ys_docdb_t *db, ys_file_t **fp, const char *name)
+{
+	char path[1024];
+
+	if (*fp == 0) {
+		snprintf(path, sizeof path, "%s/%s", db->dbpath, name);
+		*fp = ys_file_open( path, "r", 0 );
+	}
+	return *fp;
+}
+
 static int
 ys_read_docdata( ys_docdb_t *db, ys_docdata_t *data, ys_filepos_t pos )
 {
 	char buf[4096];
+	char *hold;
 	ys_filepos_t offset;
 
+	if (ys_dbopentext(db, &db->yasedocs, "yase.docs") == 0)
+		return -1;
 	ys_file_setpos(db->yasedocs, &pos);
 	ys_file_read(&offset, 1, sizeof offset, db->yasedocs);
 	ys_file_gets(buf, sizeof buf, db->yasedocs);
@@ -465,9 +704,9 @@ ys_read_docdata( ys_docdb_t *db, ys_docdata_t *data, ys_filepos_t pos )
 		return -1;
 	}
 
-	ys_nexttok(buf, DELIMITER, data->title, sizeof data->title);
-	ys_nexttok(0, DELIMITER, data->anchor, sizeof data->anchor);
-	ys_nexttok(0, DELIMITER, data->keywords, sizeof data->keywords);
+	ys_nexttok(buf, DELIMITER, data->title, sizeof data->title, &hold);
+	ys_nexttok(0, DELIMITER, data->anchor, sizeof data->anchor, &hold);
+	ys_nexttok(0, DELIMITER, data->keywords, sizeof data->keywords, &hold);
 	data->offset = offset;
 	if (strlen(data->title) == 0) {
 		fprintf(stderr, "Document data is corrupt\n");
@@ -480,7 +719,10 @@ static int
 ys_read_docfiledata( ys_docdb_t *db, ys_docdata_t *data, ys_filepos_t pos )
 {
 	char buf[4096];
+	char *hold;
 
+	if (ys_dbopentext(db, &db->yasefiles, "yase.files") == 0)
+		return -1;
 	ys_file_setpos(db->yasefiles, &pos);
 	ys_file_gets(buf, sizeof buf, db->yasefiles);
 	if (ys_file_error(db->yasefiles)) {
@@ -488,13 +730,15 @@ ys_read_docfiledata( ys_docdb_t *db, ys_docdata_t *data, ys_filepos_t pos )
 		return -1;
 	}
 
-	ys_nexttok(buf, DELIMITER, data->logicalname, sizeof data->logicalname);
-	ys_nexttok(0, DELIMITER, data->title, sizeof data->title);
-	ys_nexttok(0, DELIMITER, data->author, sizeof data->author);
-	ys_nexttok(0, DELIMITER, data->type, sizeof data->type);
-	ys_nexttok(0, DELIMITER, data->size, sizeof data->size);
-	ys_nexttok(0, DELIMITER, data->datecreated, sizeof data->datecreated);
-	ys_nexttok(0, DELIMITER, data->keywords, sizeof data->keywords);
+	ys_nexttok(buf, DELIMITER, data->logicalname, 
+		sizeof data->logicalname, &hold);
+	ys_nexttok(0, DELIMITER, data->title, sizeof data->title, &hold);
+	ys_nexttok(0, DELIMITER, data->author, sizeof data->author, &hold);
+	ys_nexttok(0, DELIMITER, data->type, sizeof data->type, &hold);
+	ys_nexttok(0, DELIMITER, data->size, sizeof data->size, &hold);
+	ys_nexttok(0, DELIMITER, data->datecreated, 
+		sizeof data->datecreated, &hold);
+	ys_nexttok(0, DELIMITER, data->keywords, sizeof data->keywords, &hold);
 	data->offset = 0;
 	if (strlen(data->logicalname) == 0) {
 		fprintf(stderr, "Document file data is corrupt\n");
@@ -504,29 +748,37 @@ ys_read_docfiledata( ys_docdb_t *db, ys_docdata_t *data, ys_filepos_t pos )
 }
 
 /**
- * Reads details of a document reference.
+ * Reads the yase.docptrs record of a document.
  */
-int
-ys_dbgetdocumentref( ys_docdb_t *db, ys_docnum_t docnum, ys_docdata_t *docfile,
-	ys_docdata_t *doc )
+static int
+ys_dbgetdocptr( ys_docdb_t *db, ys_docnum_t docnum, char *type,
+	ys_filepos_t *pos )
 {
-	char type;
-	ys_filepos_t pos;
 	float wt;
 	ys_doccnt_t maxdtf;
+	ys_filepos_t offset;
 
-	memset(docfile, 0, sizeof(ys_docdata_t));
-	memset(doc, 0, sizeof(ys_docdata_t));
-	pos = docnum * (sizeof pos + sizeof type + sizeof wt + sizeof maxdtf);
-	ys_file_setpos(db->yasedocptrs, &pos);
-	ys_file_read(&type, 1, sizeof type, db->yasedocptrs);
-	ys_file_read(&pos, 1, sizeof pos, db->yasedocptrs);
-	ys_file_read(&wt, 1, sizeof wt, db->yasedocptrs);
-	ys_file_read(&maxdtf, 1, sizeof maxdtf, db->yasedocptrs);
+	offset = docnum * (sizeof *pos + sizeof *type + sizeof wt + sizeof maxdtf);
+	ys_file_setpos(db->yasedocptrs, &offset);
+	ys_file_read(type, 1, sizeof *type, db->yasedocptrs);
+	ys_file_read(pos, 1, sizeof *pos, db->yasedocptrs);
 	if (ys_file_error(db->yasedocptrs)) {
 		fprintf(stderr, "Unable to read from yase.docptrs\n");
 		return -1;
 	}
+	return 0;
+}
+
+/**
+ * Reads a document of an older database from yase.docs and 
+ * yase.files.
+ */
+static int
+ys_read_textref( ys_docdb_t *db, char type, ys_filepos_t pos, 
+	ys_docref_t *ref, ys_docdata_t *docfile, ys_docdata_t *doc )
+{
+	memset(docfile, 0, sizeof(ys_docdata_t));
+	memset(doc, 0, sizeof(ys_docdata_t));
 	if (type == MULTIDOC_FILE) {
 		if (ys_read_docdata( db, doc, pos ) != 0)
 			return -1;
@@ -534,9 +786,346 @@ ys_dbgetdocumentref( ys_docdb_t *db, ys_docnum_t docnum, ys_docdata_t *docfile,
 	}
 	if (ys_read_docfiledata( db, docfile, pos ) != 0)
 		return -1;
+	ref->field[YS_DOCFIELD_LOGICALNAME] = docfile->logicalname;
+	ref->field[YS_DOCFIELD_FILETITLE] = docfile->title;
+	ref->field[YS_DOCFIELD_AUTHOR] = docfile->author;
+	ref->field[YS_DOCFIELD_TYPE] = docfile->type;
+	ref->field[YS_DOCFIELD_SIZE] = docfile->size;
+	ref->field[YS_DOCFIELD_DATECREATED] = docfile->datecreated;
+	ref->field[YS_DOCFIELD_FILEKEYWORDS] = docfile->keywords;
+	ref->field[YS_DOCFIELD_TITLE] = doc->title;
+	ref->field[YS_DOCFIELD_ANCHOR] = doc->anchor;
+	ref->field[YS_DOCFIELD_KEYWORDS] = doc->keywords;
+	for (int i = 0; i < YS_DOCFIELD_COUNT; i++)
+		ref->len[i] = strlen(ref->field[i]);
 	return 0;
 }
 
+int
+ys_dbgetdocref( ys_docdb_t *db, ys_docnum_t docnum, ys_docref_t *ref )
+{
+	char type;
+	ys_filepos_t pos;
+
+	if (ys_dbgetdocptr(db, docnum, &type, &pos) != 0)
+		return -1;
+	if (type != STORED_DOC)
+		return ys_read_textref(db, type, pos, ref, &db->textfile,
+			&db->textdoc);
+	if (db->store == 0) {
+		fprintf(stderr, "Unable to open yase.store\n");
+		return -1;
+	}
+	return ys_docstore_get(db->store, pos, docnum, ref);
+}
+
+/* A request of ys_dbgetdocumentrefs() */
+typedef struct {
+	ys_docnum_t docnum;
+	size_t i;			/* where the result goes */
+	char type;
+	ys_filepos_t pos;
+	bool found;
+} ys_docreq_t;
+
+static int
+ys_docreqcmp( const void *a, const void *b )
+{
+	const ys_docreq_t *x = (const ys_docreq_t *) a;
+	const ys_docreq_t *y = (const ys_docreq_t *) b;
+
+	if (x->docnum != y->docnum)
+		return x->docnum < y->docnum ? -1 : 1;
+	return x->i < y->i ? -1 : x->i > y->i;
+}
+
+static void
+ys_emptyref( ys_docref_t *ref )
+{
+	for (int i = 0; i < YS_DOCFIELD_COUNT; i++) {
+		ref->field[i] = "";
+		ref->len[i] = 0;
+	}
+}
+
+/**
+ * Finds the stored fields of n documents. The documents are read in 
+ * document order rather than in the order given: records of 
+ * yase.docptrs that are near each other are read together, and the 
+ * blocks of yase.store are each read once (see ys_docstore_getmany()).
+ * refs receives the documents in the order given; they are valid 
+ * until the database is next read.
+ * @returns 0 on success, -1 if any document could not be read, in 
+ *          which case its fields are empty
+ */
+int
+ys_dbgetdocumentrefs(ys_docdb_t *db, const ys_docnum_t *docnums, size_t n,
+	ys_docref_t *refs)
+{
+	enum { SPAN = 256 };
+	float wt;
+	ys_doccnt_t maxdtf;
+	char type;
+	ys_filepos_t pos;
+	const size_t recsize = sizeof pos + sizeof type + sizeof wt + sizeof maxdtf;
+	ys_uchar_t buf[SPAN * (sizeof pos + sizeof type + sizeof wt + sizeof maxdtf)];
+	ys_docreq_t *req;
+	ys_filepos_t *blocks = 0;
+	ys_docnum_t *stored = 0;
+	ys_docref_t *storedrefs = 0;
+	size_t nstored = 0, ntext = 0;
+	int rc = 0;
+
+	if (n == 0)
+		return 0;
+	req = (ys_docreq_t *) calloc(n, sizeof *req);
+	if (req == 0) {
+		fprintf(stderr, "Error: ran out of memory\n");
+		return -1;
+	}
+	for (size_t i = 0; i < n; i++) {
+		req[i].docnum = docnums[i];
+		req[i].i = i;
+		ys_emptyref(&refs[i]);
+	}
+	qsort(req, n, sizeof *req, ys_docreqcmp);
+
+	/* Read the records of yase.docptrs, a span at a time */
+	for (size_t i = 0; i < n; ) {
+		ys_docnum_t first = req[i].docnum;
+		size_t j = i;
+		while (j < n && req[j].docnum - first < SPAN)
+			j++;
+		size_t count = req[j-1].docnum - first + 1;
+		pos = first * recsize;
+		ys_file_setpos(db->yasedocptrs, &pos);
+		size_t got = ys_file_read(buf, recsize, count, db->yasedocptrs);
+		if (ys_file_error(db->yasedocptrs)) {
+			fprintf(stderr, "Unable to read from yase.docptrs\n");
+			free(req);
+			return -1;
+		}
+		for (; i < j; i++) {
+			size_t k = req[i].docnum - first;
+			if (k >= got) {
+				fprintf(stderr, "Unable to read from yase.docptrs\n");
+				rc = -1;
+				continue;
+			}
+			memcpy(&req[i].type, buf + k * recsize, sizeof type);
+			memcpy(&req[i].pos, buf + k * recsize + sizeof type, 
+				sizeof pos);
+			req[i].found = true;
+			if (req[i].type == STORED_DOC)
+				nstored++;
+			else
+				ntext++;
+		}
+	}
+
+	if (nstored > 0 && db->store == 0) {
+		fprintf(stderr, "Unable to open yase.store\n");
+		rc = -1;
+	}
+	else if (nstored > 0) {
+		blocks = (ys_filepos_t *) malloc(nstored * sizeof *blocks);
+		stored = (ys_docnum_t *) malloc(nstored * sizeof *stored);
+		storedrefs = (ys_docref_t *) malloc(nstored * sizeof *storedrefs);
+		if (blocks == 0 || stored == 0 || storedrefs == 0) {
+			fprintf(stderr, "Error: ran out of memory\n");
+			rc = -1;
+		}
+		else {
+			size_t k = 0;
+			for (size_t i = 0; i < n; i++) {
+				if (req[i].found && req[i].type == STORED_DOC) {
+					blocks[k] = req[i].pos;
+					stored[k++] = req[i].docnum;
+				}
+			}
+			if (ys_docstore_getmany(db->store, nstored, blocks, 
+				stored, storedrefs) != 0)
+				rc = -1;
+			k = 0;
+			for (size_t i = 0; i < n; i++) {
+				if (req[i].found && req[i].type == STORED_DOC)
+					refs[req[i].i] = storedrefs[k++];
+			}
+		}
+		free(blocks);
+		free(stored);
+		free(storedrefs);
+	}
+
+	/* Documents of an older database each need their own buffers */
+	if (ntext > 0 && db->ntexts < 2 * ntext) {
+		ys_docdata_t *texts = (ys_docdata_t *) realloc(db->texts, 
+			2 * ntext * sizeof *texts);
+		if (texts == 0) {
+			fprintf(stderr, "Error: ran out of memory\n");
+			ntext = 0;
+			rc = -1;
+		}
+		else {
+			db->texts = texts;
+			db->ntexts = 2 * ntext;
+		}
+	}
+	for (size_t i = 0, k = 0; i < n && k < 2 * ntext; i++) {
+		if (!req[i].found || req[i].type == STORED_DOC)
+			continue;
+		ys_docref_t *ref = &refs[req[i].i];
+		if (ys_read_textref(db, req[i].type, req[i].pos, ref, 
+			&db->texts[k], &db->texts[k+1]) != 0) {
+			ys_emptyref(ref);
+			rc = -1;
+		}
+		k += 2;
+	}
+	free(req);
+	return rc;
+}
+
+static void
+ys_copyfield( char *buf, size_t size, const ys_docref_t *ref, int field )
+{
+	size_t len = ref->len[field] < size ? ref->len[field] : size - 1;
+	memcpy(buf, ref->field[field], len);
+	buf[len] = 0;
+}
+
+/**
+ * Reads details of a document reference.
+ */
+int
+ys_dbgetdocumentref( ys_docdb_t *db, ys_docnum_t docnum, ys_docdata_t *docfile,
+	ys_docdata_t *doc )
+{
+	ys_docref_t ref;
+
+	memset(docfile, 0, sizeof(ys_docdata_t));
+	memset(doc, 0, sizeof(ys_docdata_t));
+	if (ys_dbgetdocref(db, docnum, &ref) != 0)
+		return -1;
+	ys_copyfield(docfile->logicalname, sizeof docfile->logicalname, &ref,
+		YS_DOCFIELD_LOGICALNAME);
+	ys_copyfield(docfile->title, sizeof docfile->title, &ref, 
+		YS_DOCFIELD_FILETITLE);
+	ys_copyfield(docfile->author, sizeof docfile->author, &ref, 
+		YS_DOCFIELD_AUTHOR);
+	ys_copyfield(docfile->type, sizeof docfile->type, &ref, 
+		YS_DOCFIELD_TYPE);
+	ys_copyfield(docfile->size, sizeof docfile->size, &ref, 
+		YS_DOCFIELD_SIZE);
+	ys_copyfield(docfile->datecreated, sizeof docfile->datecreated, &ref,
+		YS_DOCFIELD_DATECREATED);
+	ys_copyfield(docfile->keywords, sizeof docfile->keywords, &ref, 
+		YS_DOCFIELD_FILEKEYWORDS);
+	ys_copyfield(doc->title, sizeof doc->title, &ref, YS_DOCFIELD_TITLE);
+	ys_copyfield(doc->anchor, sizeof doc->anchor, &ref, 
+		YS_DOCFIELD_ANCHOR);
+	ys_copyfield(doc->keywords, sizeof doc->keywords, &ref, 
+		YS_DOCFIELD_KEYWORDS);
+	return 0;
+}
+
+/**
+ * Moves the documents of an older database from yase.files and
+ * yase.docs to yase.store, and removes those files. The database
+ * must be open for update. The documents are added to the end of 
+ * the store before their yase.docptrs records are changed, so the 
+ * database can be read throughout, and converted again if this 
+ * fails part of the way.
+ * @returns  the number of documents moved, or -1 on error
+ */
+long
+ys_dbconvert( ys_docdb_t *db )
+{
+	ys_docnum_t numdocs, numfiles, docnum;
+	ys_doccnt_t maxdtf, maxtf;
+	ys_bool_t stemmed;
+	ys_docstore_t *store;
+	ys_filepos_t *blocks;
+	ys_docref_t ref;
+	char path[1024];
+	char type;
+	long n = 0;
+	float wt;
+
+	if (ys_dbgetinfo(db, &numdocs, &numfiles, &maxdtf, &maxtf, 
+		&stemmed) != 0)
+		return -1;
+	blocks = (ys_filepos_t *) calloc(numdocs ? numdocs : 1, sizeof *blocks);
+	if (blocks == 0) {
+		fprintf(stderr, "Run out of memory\n");
+		return -1;
+	}
+	snprintf(path, sizeof path, "%s/%s", db->dbpath, "yase.store");
+	store = ys_docstore_open(path, "a");
+	if (store == 0) {
+		free(blocks);
+		return -1;
+	}
+	for (docnum = 0; docnum < numdocs; docnum++) {
+		if (ys_dbgetdocptr(db, docnum, &type, &blocks[docnum]) != 0)
+			goto failed;
+		if (type == STORED_DOC) {
+			blocks[docnum] = -1;
+			continue;
+		}
+		if (ys_read_textref(db, type, blocks[docnum], &ref, 
+			&db->textfile, &db->textdoc) != 0 ||
+			ys_docstore_add(store, docnum, ref.field, 
+			&blocks[docnum]) != 0)
+			goto failed;
+	}
+	if (ys_docstore_close(store) != 0) {
+		store = 0;
+		goto failed;
+	}
+	store = 0;
+
+	type = STORED_DOC;
+	for (docnum = 0; docnum < numdocs; docnum++) {
+		ys_filepos_t offset;
+		if (blocks[docnum] == -1)
+			continue;
+		offset = docnum * (sizeof offset + sizeof type + sizeof wt + 
+			sizeof maxdtf);
+		ys_file_setpos(db->yasedocptrs, &offset);
+		ys_file_write(&type, 1, sizeof type, db->yasedocptrs);
+		ys_file_write(&blocks[docnum], 1, sizeof blocks[docnum], 
+			db->yasedocptrs);
+		if (ys_file_error(db->yasedocptrs)) {
+			fprintf(stderr, "Unable to write to yase.docptrs\n");
+			goto failed;
+		}
+		n++;
+	}
+	free(blocks);
+
+	if (db->yasefiles != 0)
+		ys_file_close(db->yasefiles);
+	if (db->yasedocs != 0)
+		ys_file_close(db->yasedocs);
+	db->yasefiles = db->yasedocs = 0;
+	snprintf(path, sizeof path, "%s/%s", db->dbpath, "yase.files");
+	remove(path);
+	snprintf(path, sizeof path, "%s/%s", db->dbpath, "yase.docs");
+	remove(path);
+	if (db->store == 0) {
+		snprintf(path, sizeof path, "%s/%s", db->dbpath, "yase.store");
+		db->store = ys_docstore_open(path, "r");
+	}
+	return n;
+
+failed:
+	if (store != 0)
+		ys_docstore_close(store);
+	free(blocks);
+	return -1;
+}
+
 int
 ys_dbaddinfo(ys_docdb_t *db, ys_docnum_t numdocs, ys_docnum_t numfiles,
 	ys_doccnt_t maxdoctermfreq, ys_doccnt_t maxtermfreq, ys_bool_t stemmed)
@@ -547,6 +1136,7 @@ ys_dbaddinfo(ys_docdb_t *db, ys_docnum_t numdocs, ys_docnum_t numfiles,
 	db->info.maxdoctermfreq = maxdoctermfreq;
 	db->info.maxtermfreq = maxtermfreq;
 	db->info.stemmed = stemmed;
+	db->info.generation++;
 	ys_file_setpos(db->yaseinfo, &pos);
 	ys_file_write(&db->info, 1, sizeof db->info, 
 		db->yaseinfo);
@@ -557,6 +1147,19 @@ ys_dbaddinfo(ys_docdb_t *db, ys_docnum_t numdocs, ys_docnum_t numfiles,
 	return 0;
 }
 
+int
+ys_dbsetpostingsformat(ys_docdb_t *db, ys_uint32_t format)
+{
+	db->info.postings_format = format;
+	return 0;
+}
+
+ys_uint32_t
+ys_dbgetpostingsformat(ys_docdb_t *db)
+{
+	return db->info.postings_format;
+}
+
 int
 ys_dbgetinfo(ys_docdb_t *db, ys_docnum_t *numdocs, ys_docnum_t *numfiles,
 	ys_doccnt_t *maxdoctermfreq, ys_doccnt_t *maxtermfreq, ys_bool_t *stemmed)
@@ -577,3 +1180,80 @@ ys_dbgetinfo(ys_docdb_t *db, ys_docnum_t *numdocs, ys_docnum_t *numfiles,
 	return 0;
 }
 
+ys_uint32_t
+ys_dbgetgeneration(ys_docdb_t *db)
+{
+	ys_docnum_t numdocs, numfiles;
+	ys_doccnt_t maxdtf, maxtf;
+	ys_bool_t stemmed;
+
+	if (ys_dbgetinfo(db, &numdocs, &numfiles, &maxdtf, &maxtf, 
+		&stemmed) != 0)
+		return 0;
+	return db->info.generation;
+}
+
+ys_uint32_t
+ys_dbgetopengeneration(ys_docdb_t *db)
+{
+	return db->opengeneration;
+}
+
+int
+ys_dbnewgeneration(ys_docdb_t *db)
+{
+	ys_docnum_t numdocs, numfiles;
+	ys_doccnt_t maxdtf, maxtf;
+	ys_bool_t stemmed;
+
+	if (ys_dbgetinfo(db, &numdocs, &numfiles, &maxdtf, &maxtf, 
+		&stemmed) != 0)
+		return -1;
+	return ys_dbaddinfo(db, numdocs, numfiles, maxdtf, maxtf, stemmed);
+}
+
+/**
+ * Marks a document deleted. The database must be open for update;
+ * yase.deleted is written when it is closed.
+ * @returns 1 if the document was already deleted, 0 if it has been
+ *          deleted now, -1 on error
+ */
+int
+ys_dbdeletedoc(ys_docdb_t *db, ys_docnum_t docnum)
+{
+	ys_docnum_t numdocs, numfiles;
+	ys_doccnt_t maxdtf, maxtf;
+	ys_bool_t stemmed;
+
+	if (ys_dbgetinfo(db, &numdocs, &numfiles, &maxdtf, &maxtf, 
+		&stemmed) != 0)
+		return -1;
+	if (docnum >= numdocs) {
+		fprintf(stderr, "Error: there is no document %lu\n", 
+			(unsigned long) docnum);
+		return -1;
+	}
+	if (db->deleted == 0 || db->deleted->size < numdocs) {
+		/* Grow to cover documents added since */
+		if (db->deleted != 0)
+			ys_bs_resize(db->deleted, numdocs);
+		else
+			db->deleted = ys_bs_alloc(numdocs);
+	}
+	if (ys_bs_addmember(db->deleted, docnum))
+		return 1;
+	db->deleted_changed = true;
+	return 0;
+}
+
+ys_bool_t
+ys_dbisdeleted(ys_docdb_t *db, ys_docnum_t docnum)
+{
+	return db->deleted != 0 && ys_bs_ismember(db->deleted, docnum);
+}
+
+ys_bitset_t *
+ys_dbgetdeleted(ys_docdb_t *db)
+{
+	return db->deleted;
+}
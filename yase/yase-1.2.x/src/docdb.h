@@ -24,6 +24,7 @@
 #define docdb_h
 
 #include "yase.h"
+#include "bitset.h"
 
 enum {
 	YS_FILENAME_LEN = 1024,
@@ -52,6 +53,35 @@ typedef struct {
 	ys_filepos_t offset;		/* internal use */
 } ys_docdata_t;
 
+/**
+ * The stored fields of a document. The first seven belong to the file
+ * that holds the document, the rest to the document itself when the 
+ * file holds more than one.
+ */
+enum {
+	YS_DOCFIELD_LOGICALNAME,
+	YS_DOCFIELD_FILETITLE,
+	YS_DOCFIELD_AUTHOR,
+	YS_DOCFIELD_TYPE,
+	YS_DOCFIELD_SIZE,
+	YS_DOCFIELD_DATECREATED,
+	YS_DOCFIELD_FILEKEYWORDS,
+	YS_DOCFIELD_TITLE,
+	YS_DOCFIELD_ANCHOR,
+	YS_DOCFIELD_KEYWORDS,
+	YS_DOCFIELD_COUNT
+};
+
+/**
+ * The stored fields of a document, as found by ys_dbgetdocref(). Each
+ * field is nul terminated and points into memory owned by the 
+ * database, so it is only valid until the database is next read.
+ */
+typedef struct {
+	const char *field[YS_DOCFIELD_COUNT];
+	size_t len[YS_DOCFIELD_COUNT];
+} ys_docref_t;
+
 typedef struct ys_docdb_t ys_docdb_t;
 
 extern ys_docdb_t *
@@ -74,6 +104,30 @@ extern int
 ys_dbgetdocumentref(ys_docdb_t *db, ys_docnum_t docnum, 
 	ys_docdata_t *docfile, ys_docdata_t *doc);
 
+/**
+ * Finds the stored fields of a document without copying them. Fields
+ * the document does not have are empty strings.
+ */
+extern int
+ys_dbgetdocref(ys_docdb_t *db, ys_docnum_t docnum, ys_docref_t *ref);
+
+/**
+ * Finds the stored fields of n documents, reading them in document 
+ * order so that a page of results costs few seeks. refs receives the
+ * documents in the order of docnums. Returns -1 if any document could
+ * not be read; its fields are then empty.
+ */
+extern int
+ys_dbgetdocumentrefs(ys_docdb_t *db, const ys_docnum_t *docnums, size_t n,
+	ys_docref_t *refs);
+
+/**
+ * Moves the documents of a database built before yase.store existed 
+ * into it. Returns the number of documents moved, or -1 on error.
+ */
+extern long
+ys_dbconvert(ys_docdb_t *db);
+
 extern int 
 ys_dbadddocweight(ys_docdb_t *db, ys_docnum_t docnum, float wt);
 
@@ -89,6 +143,10 @@ ys_dbgetdocmaxdtf(ys_docdb_t *db, ys_docnum_t docnum, ys_doccnt_t *maxdtf);
 extern int 
 ys_dbgetdocwtdtf(ys_docdb_t *db, ys_docnum_t docnum, float *wt, ys_doccnt_t *maxdtf);
 
+extern int 
+ys_dbgetdocwtdtfs(ys_docdb_t *db, ys_docnum_t first, ys_docnum_t n, 
+	float *wts, ys_doccnt_t *maxdtfs);
+
 extern ys_docnum_t
 ys_dbnumdocs(ys_docdb_t *db);
 
@@ -100,4 +158,59 @@ extern int
 ys_dbgetinfo(ys_docdb_t *db, ys_docnum_t *numdocs, ys_docnum_t *numfiles,
 	ys_doccnt_t *maxdoctermfreq, ys_doccnt_t *maxtermfreq, ys_bool_t *stemmed);
 
+/**
+ * The postings format is saved by ys_dbaddinfo() and is valid
+ * after ys_dbgetinfo().
+ */
+extern int
+ys_dbsetpostingsformat(ys_docdb_t *db, ys_uint32_t format);
+
+extern ys_uint32_t
+ys_dbgetpostingsformat(ys_docdb_t *db);
+
+/**
+ * yase.info holds a generation number that changes whenever the 
+ * results of a query might: ys_dbaddinfo() moves it on, and so does
+ * writing yase.deleted. A database rebuilt with ys_dbopen() mode "w"
+ * carries on from the generation of the one it replaces. 
+ * ys_dbgetgeneration() reads it afresh, so that a reader can tell 
+ * whether the database has changed since it last looked; it returns 0
+ * for a database written before it existed.
+ */
+extern ys_uint32_t
+ys_dbgetgeneration(ys_docdb_t *db);
+
+/**
+ * Returns the generation of the database when it was opened; 
+ * ys_dbopen() reads yase.info before yase.deleted, so the deleted 
+ * documents are those of this generation or a later one.
+ */
+extern ys_uint32_t
+ys_dbgetopengeneration(ys_docdb_t *db);
+
+/**
+ * Moves the generation number on, for changes made other than through
+ * ys_dbaddinfo(). The database must be open for update.
+ */
+extern int
+ys_dbnewgeneration(ys_docdb_t *db);
+
+/**
+ * Deleted documents keep their document numbers, but are no longer
+ * returned by queries. Their postings are removed when the segments 
+ * holding them are merged (see yasemerge).
+ */
+extern int
+ys_dbdeletedoc(ys_docdb_t *db, ys_docnum_t docnum);
+
+extern ys_bool_t
+ys_dbisdeleted(ys_docdb_t *db, ys_docnum_t docnum);
+
+/**
+ * Returns the set of deleted documents, or 0 if there are none. It
+ * may be smaller than the number of documents.
+ */
+extern ys_bitset_t *
+ys_dbgetdeleted(ys_docdb_t *db);
+
 #endif
@@ -0,0 +1,552 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - binary store of the stored fields of documents.
+// 17-10-26: Added ys_docstore_getmany().
+
+#include "docstore.h"
+#include "ystdio.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+/* A block that had to be expanded, or read */
+typedef struct {
+	ys_filepos_t offset;
+	ys_uchar_t *data;
+	size_t alloc;
+} ys_docstore_held_t;
+
+struct ys_docstore_t {
+	char name[1024];
+	ys_file_t *out;			/* 0 unless writing */
+	ys_filepos_t outpos;		/* where the pending block goes */
+	ys_uchar_t *pending;		/* records of the pending block */
+	size_t used;
+	size_t pendalloc;
+	ys_docnum_t firstdoc;
+	ys_uint32_t ndocs;
+	const ys_uchar_t *data;		/* the mapped store, if mapped */
+	size_t len;
+	ys_docstore_held_t *held;	/* blocks expanded, or read, for 
+					 * the last request */
+	size_t nheld;
+	size_t heldalloc;
+	ys_uchar_t *stored;		/* compressed block being read or 
+					 * written */
+	size_t storedalloc;
+};
+
+static bool
+ys_docstore_reserve( ys_uchar_t **buf, size_t *alloc, size_t n )
+{
+	if (n <= *alloc)
+		return true;
+	size_t size = *alloc ? *alloc : YS_DOCSTORE_BLOCKSIZE;
+	while (size < n)
+		size *= 2;
+	ys_uchar_t *p = (ys_uchar_t *) realloc(*buf, size);
+	if (p == NULL) {
+		fprintf(stderr, "Error: ran out of memory\n");
+		return false;
+	}
+	*buf = p;
+	*alloc = size;
+	return true;
+}
+
+static size_t
+ys_docstore_putcode( ys_uchar_t *cp, size_t value )
+{
+	size_t n = 0;
+	do {
+		cp[n++] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+		value >>= 7;
+	} while (value > 0);
+	return n;
+}
+
+static const ys_uchar_t *
+ys_docstore_getcode( const ys_uchar_t *cp, const ys_uchar_t *end, 
+	size_t *value )
+{
+	size_t v = 0;
+	int shift = 0;
+	do {
+		if (cp == end || shift >= 64)
+			return NULL;
+		v |= (size_t)(*cp & 0x7f) << shift;
+		shift += 7;
+	} while (*cp++ & 0x80);
+	*value = v;
+	return cp;
+}
+
+ys_docstore_t *
+ys_docstore_open( const char *name, const char *mode )
+{
+	ys_docstore_t *store;
+
+	store = (ys_docstore_t *) calloc(1, sizeof *store);
+	if (store == NULL) {
+		fprintf(stderr, "Error: ran out of memory\n");
+		return NULL;
+	}
+	snprintf(store->name, sizeof store->name, "%s", name);
+	if (strcmp(mode, "r") == 0) {
+		FILE *fp = fopen(name, "rb");
+		if (fp == NULL) {
+			if (errno != ENOENT)
+				perror(name);
+			free(store);
+			return NULL;
+		}
+		fclose(fp);
+		return store;
+	}
+	store->out = ys_file_open(name, mode, 0);
+	if (store->out == 0 || 
+		ys_file_seek(store->out, 0, SEEK_END) != 0 ||
+		ys_file_getpos(store->out, &store->outpos) != 0) {
+		if (store->out != 0)
+			ys_file_close(store->out);
+		free(store);
+		return NULL;
+	}
+	return store;
+}
+
+static void
+ys_docstore_unmap( ys_docstore_t *store )
+{
+#ifndef WIN32
+	if (store->data != NULL)
+		munmap((void *) store->data, store->len);
+#endif
+	store->data = NULL;
+	store->len = 0;
+}
+
+int
+ys_docstore_close( ys_docstore_t *store )
+{
+	int rc = 0;
+	if (store->out != 0) {
+		if (ys_docstore_flush(store) != 0)
+			rc = -1;
+		if (ys_file_close(store->out) != 0)
+			rc = -1;
+	}
+	ys_docstore_unmap(store);
+	free(store->pending);
+	for (size_t i = 0; i < store->heldalloc; i++)
+		free(store->held[i].data);
+	free(store->held);
+	free(store->stored);
+	free(store);
+	return rc;
+}
+
+int
+ys_docstore_flush( ys_docstore_t *store )
+{
+	ys_docstore_block_t hdr;
+	const ys_uchar_t *cp = store->pending;
+
+	if (store->ndocs == 0)
+		return 0;
+	hdr.rawlen = (ys_uint32_t) store->used;
+	hdr.storedlen = hdr.rawlen;
+	hdr.ndocs = store->ndocs;
+	hdr.firstdoc = store->firstdoc;
+#ifdef HAVE_LZ4
+	int bound = LZ4_compressBound((int) store->used);
+	if (bound > 0 && ys_docstore_reserve(&store->stored, 
+		&store->storedalloc, bound)) {
+		int n = LZ4_compress_default((const char *) store->pending, 
+			(char *) store->stored, (int) store->used, bound);
+		if (n > 0 && (size_t) n < store->used) {
+			hdr.storedlen = n;
+			cp = store->stored;
+		}
+	}
+#endif
+	ys_file_write(&hdr, 1, sizeof hdr, store->out);
+	ys_file_write(cp, 1, hdr.storedlen, store->out);
+	if (ys_file_error(store->out)) {
+		fprintf(stderr, "Unable to write to %s\n", store->name);
+		return -1;
+	}
+	store->outpos += sizeof hdr + hdr.storedlen;
+	store->used = 0;
+	store->ndocs = 0;
+	return 0;
+}
+
+int
+ys_docstore_add( ys_docstore_t *store, ys_docnum_t docnum, 
+	const char * const *fields, ys_filepos_t *block )
+{
+	size_t lens[YS_DOCFIELD_COUNT];
+	size_t reclen = 0;
+	int i;
+
+	if (store->ndocs > 0 && (docnum != store->firstdoc + store->ndocs ||
+		store->used >= YS_DOCSTORE_BLOCKSIZE)) {
+		if (ys_docstore_flush(store) != 0)
+			return -1;
+	}
+	for (i = 0; i < YS_DOCFIELD_COUNT; i++) {
+		lens[i] = strlen(fields[i]);
+		reclen += (lens[i] >> 7) + 1 + lens[i] + 1;
+	}
+	/* Over-estimates the codes, but is large enough for the record */
+	if (!ys_docstore_reserve(&store->pending, &store->pendalloc, 
+		store->used + reclen + 10))
+		return -1;
+	if (store->ndocs == 0)
+		store->firstdoc = docnum;
+	/* The fields go after one byte for the record's length, and are
+	 * moved up once the length is known if its code is longer */
+	ys_uchar_t *start = store->pending + store->used;
+	ys_uchar_t *cp = start + 1;
+	for (i = 0; i < YS_DOCFIELD_COUNT; i++) {
+		cp += ys_docstore_putcode(cp, lens[i]);
+		memcpy(cp, fields[i], lens[i] + 1);
+		cp += lens[i] + 1;
+	}
+	reclen = cp - (start + 1);
+	ys_uchar_t code[16];
+	size_t n = ys_docstore_putcode(code, reclen);
+	if (n > 1)
+		memmove(start + n, start + 1, reclen);
+	memcpy(start, code, n);
+	store->used += n + reclen;
+	store->ndocs++;
+	*block = store->outpos;
+	return 0;
+}
+
+/**
+ * Maps the store, again if it has grown since it was mapped. Leaves
+ * store->data NULL if it cannot be mapped.
+ */
+static int
+ys_docstore_map( ys_docstore_t *store, ys_filepos_t end )
+{
+	struct stat statbuf;
+
+	if (store->data != NULL && (ys_filepos_t) store->len >= end)
+		return 0;
+#ifndef WIN32
+	FILE *fp = fopen(store->name, "rb");
+	if (fp == NULL) {
+		perror(store->name);
+		return -1;
+	}
+	/* Blocks held by ys_docstore_getmany() may point into the old
+	 * mapping, so it is only replaced if the store has grown */
+	if (fstat(fileno(fp), &statbuf) == 0 && statbuf.st_size > 0 &&
+		(store->data == NULL || 
+		(size_t) statbuf.st_size > store->len)) {
+		ys_docstore_unmap(store);
+		void *map = mmap(NULL, (size_t) statbuf.st_size, PROT_READ, 
+			MAP_SHARED, fileno(fp), 0);
+		if (map != MAP_FAILED) {
+			store->data = (const ys_uchar_t *) map;
+			store->len = (size_t) statbuf.st_size;
+		}
+	}
+	fclose(fp);
+#endif
+	return 0;
+}
+
+/**
+ * Reads count bytes at offset into buf, for when the store is not
+ * mapped.
+ */
+static int
+ys_docstore_read( ys_docstore_t *store, ys_filepos_t offset, void *buf, 
+	size_t count )
+{
+	ys_file_t *fp = ys_file_open(store->name, "r", 0);
+	if (fp == 0)
+		return -1;
+	ys_file_setpos(fp, &offset);
+	size_t n = ys_file_read(buf, 1, count, fp);
+	ys_file_close(fp);
+	return n == count ? 0 : -1;
+}
+
+/**
+ * Returns a buffer for a block, which replaces those held unless keep 
+ * is set.
+ */
+static ys_docstore_held_t *
+ys_docstore_hold( ys_docstore_t *store, ys_filepos_t offset, bool keep )
+{
+	if (!keep)
+		store->nheld = 0;
+	if (store->nheld == store->heldalloc) {
+		size_t n = store->heldalloc ? store->heldalloc * 2 : 4;
+		ys_docstore_held_t *held = (ys_docstore_held_t *) 
+			realloc(store->held, n * sizeof *held);
+		if (held == NULL) {
+			fprintf(stderr, "Error: ran out of memory\n");
+			return NULL;
+		}
+		memset(held + store->heldalloc, 0, 
+			(n - store->heldalloc) * sizeof *held);
+		store->held = held;
+		store->heldalloc = n;
+	}
+	ys_docstore_held_t *h = &store->held[store->nheld++];
+	h->offset = offset;
+	return h;
+}
+
+/**
+ * Returns the records of the block at offset, reading or expanding
+ * them if need be. An expanded block is kept with those already held
+ * if keep is set, else it replaces them.
+ */
+static const ys_uchar_t *
+ys_docstore_block( ys_docstore_t *store, ys_filepos_t offset, 
+	ys_docstore_block_t *hdr, bool keep )
+{
+	const ys_uchar_t *cp = NULL;
+	ys_docstore_held_t *h;
+
+	if (offset < 0 || ys_docstore_map(store, offset + sizeof *hdr) != 0)
+		goto corrupt;
+	if (store->data != NULL) {
+		if (offset + sizeof *hdr > store->len)
+			goto corrupt;
+		memcpy(hdr, store->data + offset, sizeof *hdr);
+		if (offset + sizeof *hdr + hdr->storedlen > store->len)
+			goto corrupt;
+		cp = store->data + offset + sizeof *hdr;
+		if (hdr->storedlen == hdr->rawlen)
+			return cp;
+	}
+	else if (ys_docstore_read(store, offset, hdr, sizeof *hdr) != 0)
+		goto corrupt;
+	for (size_t i = 0; i < store->nheld; i++) {
+		if (store->held[i].offset == offset)
+			return store->held[i].data;
+	}
+	h = ys_docstore_hold(store, offset, keep);
+	if (h == NULL || !ys_docstore_reserve(&h->data, &h->alloc, 
+		hdr->rawlen)) {
+		if (h != NULL)
+			store->nheld--;
+		return NULL;
+	}
+	/* Not held until it is complete */
+	store->nheld--;
+	if (hdr->storedlen == hdr->rawlen) {
+		if (ys_docstore_read(store, offset + sizeof *hdr, h->data,
+			hdr->rawlen) != 0)
+			goto corrupt;
+	}
+	else {
+#ifdef HAVE_LZ4
+		if (cp == NULL) {
+			if (!ys_docstore_reserve(&store->stored, 
+				&store->storedalloc, hdr->storedlen))
+				return NULL;
+			if (ys_docstore_read(store, offset + sizeof *hdr, 
+				store->stored, hdr->storedlen) != 0)
+				goto corrupt;
+			cp = store->stored;
+		}
+		if (LZ4_decompress_safe((const char *) cp, (char *) h->data,
+			(int) hdr->storedlen, (int) hdr->rawlen) != 
+			(int) hdr->rawlen)
+			goto corrupt;
+#else
+		fprintf(stderr, "Error: %s is compressed, and YASE was built "
+			"without LZ4\n", store->name);
+		return NULL;
+#endif
+	}
+	store->nheld++;
+	return h->data;
+
+corrupt:
+	fprintf(stderr, "Error: %s is corrupt\n", store->name);
+	return NULL;
+}
+
+/**
+ * Finds the fields of a document; the block is kept with those already
+ * held if keep is set.
+ */
+static int
+ys_docstore_lookup( ys_docstore_t *store, ys_filepos_t block, 
+	ys_docnum_t docnum, ys_docref_t *ref, bool keep )
+{
+	ys_docstore_block_t hdr;
+	const ys_uchar_t *cp, *end;
+	size_t len;
+
+	if (store->out != 0 && store->ndocs > 0 && block == store->outpos &&
+		ys_docstore_flush(store) != 0)
+		return -1;
+	cp = ys_docstore_block(store, block, &hdr, keep);
+	if (cp == NULL)
+		return -1;
+	if (docnum < hdr.firstdoc || docnum - hdr.firstdoc >= hdr.ndocs) {
+		fprintf(stderr, "Error: document %lu is not in %s\n", 
+			(unsigned long) docnum, store->name);
+		return -1;
+	}
+	end = cp + hdr.rawlen;
+	for (ys_docnum_t i = hdr.firstdoc; ; i++) {
+		cp = ys_docstore_getcode(cp, end, &len);
+		if (cp == NULL || len > (size_t)(end - cp))
+			goto corrupt;
+		if (i == docnum)
+			break;
+		cp += len;
+	}
+	end = cp + len;
+	for (int i = 0; i < YS_DOCFIELD_COUNT; i++) {
+		cp = ys_docstore_getcode(cp, end, &len);
+		if (cp == NULL || len >= (size_t)(end - cp) || cp[len] != 0)
+			goto corrupt;
+		ref->field[i] = (const char *) cp;
+		ref->len[i] = len;
+		cp += len + 1;
+	}
+	return 0;
+
+corrupt:
+	fprintf(stderr, "Error: %s is corrupt\n", store->name);
+	return -1;
+}
+
+int
+ys_docstore_get( ys_docstore_t *store, ys_filepos_t block, 
+	ys_docnum_t docnum, ys_docref_t *ref )
+{
+	return ys_docstore_lookup(store, block, docnum, ref, false);
+}
+
+/* Orders requests by block, then document */
+typedef struct {
+	ys_filepos_t block;
+	ys_docnum_t docnum;
+	size_t i;
+} ys_docstore_req_t;
+
+static int
+ys_docstore_reqcmp( const void *a, const void *b )
+{
+	const ys_docstore_req_t *x = (const ys_docstore_req_t *) a;
+	const ys_docstore_req_t *y = (const ys_docstore_req_t *) b;
+
+	if (x->block != y->block)
+		return x->block < y->block ? -1 : 1;
+	if (x->docnum != y->docnum)
+		return x->docnum < y->docnum ? -1 : 1;
+	return 0;
+}
+
+int
+ys_docstore_getmany( ys_docstore_t *store, size_t n, 
+	const ys_filepos_t *blocks, const ys_docnum_t *docnums, 
+	ys_docref_t *refs )
+{
+	ys_docstore_req_t *req;
+	int rc = 0;
+
+	if (n == 0)
+		return 0;
+	req = (ys_docstore_req_t *) malloc(n * sizeof *req);
+	if (req == NULL) {
+		fprintf(stderr, "Error: ran out of memory\n");
+		return -1;
+	}
+	for (size_t i = 0; i < n; i++) {
+		req[i].block = blocks[i];
+		req[i].docnum = docnums[i];
+		req[i].i = i;
+	}
+	qsort(req, n, sizeof *req, ys_docstore_reqcmp);
+
+	/* Map the store as far as the last block now, so that it is not
+	 * remapped under blocks already found, and ask for the blocks to
+	 * be read ahead */
+	if (store->out != 0 && store->ndocs > 0 && 
+		req[n-1].block >= store->outpos && 
+		ys_docstore_flush(store) != 0) {
+		free(req);
+		return -1;
+	}
+	if (req[n-1].block >= 0)
+		ys_docstore_map(store, req[n-1].block + 
+			sizeof(ys_docstore_block_t));
+#if !defined(WIN32) && defined(MADV_WILLNEED)
+	if (store->data != NULL) {
+		long pagesize = sysconf(_SC_PAGESIZE);
+		for (size_t i = 0; i < n; i++) {
+			ys_docstore_block_t hdr;
+			ys_filepos_t offset = req[i].block;
+			if (i > 0 && offset == req[i-1].block)
+				continue;
+			if (offset < 0 || 
+				offset + sizeof hdr > store->len)
+				continue;
+			memcpy(&hdr, store->data + offset, sizeof hdr);
+			size_t start = (size_t) offset & ~(pagesize - 1);
+			size_t end = (size_t) offset + sizeof hdr + 
+				hdr.storedlen;
+			if (end > store->len)
+				end = store->len;
+			madvise((void *)(store->data + start), end - start,
+				MADV_WILLNEED);
+		}
+	}
+#endif
+
+	store->nheld = 0;
+	for (size_t i = 0; i < n; i++) {
+		ys_docref_t *ref = &refs[req[i].i];
+		if (ys_docstore_lookup(store, req[i].block, req[i].docnum,
+			ref, true) != 0) {
+			memset(ref, 0, sizeof *ref);
+			for (int j = 0; j < YS_DOCFIELD_COUNT; j++)
+				ref->field[j] = "";
+			rc = -1;
+		}
+	}
+	free(req);
+	return rc;
+}
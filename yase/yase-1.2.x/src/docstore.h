@@ -0,0 +1,109 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - binary store of the stored fields of documents.
+// 17-10-26: Added ys_docstore_getmany().
+
+#ifndef docstore_h
+#define docstore_h
+
+#include "yase.h"
+#include "docdb.h"
+
+/**
+ * The document store (yase.store) replaces the text records of 
+ * yase.files and yase.docs. Documents are stored in order, in blocks
+ * of about YS_DOCSTORE_BLOCKSIZE bytes. A block is a 
+ * ys_docstore_block_t followed by the records of ndocs documents 
+ * from firstdoc on. A record is its length as a variable byte code,
+ * then YS_DOCFIELD_COUNT fields, each a variable byte length, the 
+ * bytes and a nul, so that fields can be used where they lie. When
+ * YASE is built with LZ4 (make USE_LZ4=1), a block that compresses is
+ * stored compressed, and storedlen is less than rawlen. yase.docptrs 
+ * gives the offset of the block that holds each document.
+ */
+enum {
+	YS_DOCSTORE_BLOCKSIZE = 16*1024
+};
+
+typedef struct {
+	ys_uint32_t rawlen;		/* bytes of records */
+	ys_uint32_t storedlen;		/* bytes that follow the header */
+	ys_uint32_t ndocs;
+	ys_docnum_t firstdoc;
+} ys_docstore_block_t;
+
+typedef struct ys_docstore_t ys_docstore_t;
+
+/**
+ * Opens a document store. Mode is "r" to read, "w" to create a new 
+ * store, or "a" to add documents to the end of an existing one, which
+ * is created if need be. Returns NULL if it cannot be opened; for 
+ * mode "r", no message is printed if the file does not exist.
+ */
+extern ys_docstore_t *
+ys_docstore_open( const char *name, const char *mode );
+
+/**
+ * Writes any pending block and closes the store.
+ */
+extern int
+ys_docstore_close( ys_docstore_t *store );
+
+/**
+ * Adds the fields of a document. Documents are expected in order; a
+ * gap in document numbers starts a new block. block receives the 
+ * offset of the document's block.
+ */
+extern int
+ys_docstore_add( ys_docstore_t *store, ys_docnum_t docnum, 
+	const char * const *fields, ys_filepos_t *block );
+
+/**
+ * Writes the pending block, if there is one.
+ */
+extern int
+ys_docstore_flush( ys_docstore_t *store );
+
+/**
+ * Finds the fields of a document in the block at the given offset.
+ * Uncompressed blocks are read in place from the memory mapped store;
+ * a compressed block is expanded into a buffer that is kept until
+ * another block is read.
+ */
+extern int
+ys_docstore_get( ys_docstore_t *store, ys_filepos_t block, 
+	ys_docnum_t docnum, ys_docref_t *ref );
+
+/**
+ * Finds the fields of n documents, given the offsets of their blocks.
+ * The requests are taken in block order, each block is read or 
+ * expanded once, and all the fields found stay valid until the next 
+ * call to ys_docstore_get() or ys_docstore_getmany(). A document that
+ * cannot be found gets empty fields, and -1 is returned.
+ */
+extern int
+ys_docstore_getmany( ys_docstore_t *store, size_t n, 
+	const ys_filepos_t *blocks, const ys_docnum_t *docnums, 
+	ys_docref_t *refs );
+
+#endif
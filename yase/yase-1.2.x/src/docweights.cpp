@@ -20,6 +20,8 @@
 *    Email  : dibyendu@mazumdar.demon.co.uk 
 *    Website: www.mazumdar.demon.co.uk/yase_index.html 
 */ 
+// 17-10-26: Term frequencies and maxtf are taken over all segments of
+//           the collection. Added ys_build_bounds().
 
 #include "yase.h"
 #include "makedb.h"
@@ -40,14 +42,17 @@ typedef struct docwt_t {
 	ys_filepos_t position;
 	ys_doccnt_t tf;
 	ys_doccnt_t dtf;
+	double bound;
 	ys_docdb_t *docdb;
 	YASENS PostFile *postings;
+	const YASENS Collection *collection;
 } docwt_t;
 
 static docwt_t *ys_docweight_allocate( ys_docnum_t N );
 static void ys_docweight_add_tf( docwt_t *dw, ys_docnum_t docnum, 
 	ys_doccnt_t dtf, ys_doccnt_t tf, char *word );
 static int ys_docweight_calculate_and_write( docwt_t *dw, ys_docdb_t *db );
+static void ys_docweight_free( docwt_t *dw );
 
 /**
  * This function allocates an array of floats used to accumulate document 
@@ -65,8 +70,10 @@ ys_docweight_allocate( ys_docnum_t N )
 	}
 	dw->weights = (float *) calloc(N, sizeof(float));
 	dw->d_maxdtfs = (ys_doccnt_t *) calloc(N, sizeof(ys_doccnt_t));
-	if (dw->weights == 0) {
+	if (dw->weights == 0 || dw->d_maxdtfs == 0) {
 		fprintf(stderr, "Error allocating memory\n");
+		free(dw->weights);
+		free(dw->d_maxdtfs);
 		free(dw);
 		return 0;
 	}
@@ -97,7 +104,7 @@ ys_docweight_add_tf( docwt_t *dw, ys_docnum_t docnum,
 
 /**
  * This function calculates the document weight for each document and saves
- * it to the database.
+ * it to the database. The weights are left in dw->weights.
  */
 static int
 ys_docweight_calculate_and_write( docwt_t *dw, ys_docdb_t *db )
@@ -110,28 +117,25 @@ ys_docweight_calculate_and_write( docwt_t *dw, ys_docdb_t *db )
 		printf("doc(%ld) weight(%.2f)\n",
 			docnum, dwt);
 #endif
+		dw->weights[docnum] = dwt;
 		if (ys_dbadddocweight( db, docnum, dwt ) != 0)
 			return -1;
 	}
+	return 0;
+}
+
+static void
+ys_docweight_free( docwt_t *dw )
+{
 	free(dw->weights);
 	free(dw->d_maxdtfs);
 	free(dw);
-	return 0;
 }
 
 static ys_bool_t
 ys_select_document( void *arg, ys_docnum_t docnum, ys_doccnt_t dtf )
 {
 	docwt_t *dw = (docwt_t *)arg;
-	if (dw->d_maxdtfs[docnum] == 0) {
-		ys_doccnt_t maxdtf = 0;
-		ys_dbgetdocmaxdtf(dw->docdb, docnum, &maxdtf);
-		dw->d_maxdtfs[docnum] = maxdtf;
-#if _DUMP_CALCWEIGHT
-		printf("Document # %lu, Max DTF = %lu\n",
-			docnum, maxdtf);
-#endif
-	}
 	double idf = ys_idf(dw->N,dw->tf,dw->maxtf);
 	double dtw = ys_dtw(idf, dtf, dw->d_maxdtfs[docnum]);
 #if _DUMP_CALCWEIGHT
@@ -150,10 +154,84 @@ evaluate(ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t value,
 	dw->term = key2;
 	dw->position = value;
 	dw->tf = doccnt;
+	if (dw->collection->getNumSegments() > 1) {
+		/* idf depends on the term's frequency in all segments */
+		YASENS TermRef ref;
+		dw->collection->findTerm(key2, &ref);
+		dw->tf = ref.tf;
+	}
 	dw->postings->iterate(value, ys_select_document, arg);
 	return BOOL_TRUE;
 }
 
+static ys_bool_t 
+evaluate_maxtf(ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t value, 
+	ys_doccnt_t doccnt, void *arg)
+{
+	docwt_t *dw = (docwt_t *)arg;
+	YASENS TermRef ref;
+	if (dw->collection->findTerm(key2, &ref) && ref.tf > dw->maxtf)
+		dw->maxtf = ref.tf;
+	return BOOL_TRUE;
+}
+
+/**
+ * Works out maxtf over all segments, and saves it if it has changed;
+ * yasemakedb only knows the largest tf within the segment it wrote.
+ */
+static int
+ys_docweight_find_maxtf( docwt_t *dw, YASENS Collection &collection,
+	ys_uchar_t *key )
+{
+	ys_docnum_t numdocs, numfiles;
+	ys_doccnt_t maxdtf, maxtf;
+	ys_bool_t stemmed;
+
+	dw->maxtf = 0;
+	for (int s = 0; s < collection.getNumSegments(); s++)
+		ys_btree_iterate( collection.getIndex(s), key, evaluate_maxtf, 
+			(void *)dw);
+	if (dw->maxtf == collection.getMaxTf())
+		return 0;
+	if (ys_dbgetinfo(dw->docdb, &numdocs, &numfiles, &maxdtf, &maxtf, 
+		&stemmed) != 0)
+		return -1;
+	return ys_dbaddinfo(dw->docdb, numdocs, numfiles, maxdtf, dw->maxtf,
+		stemmed);
+}
+
+static ys_bool_t
+ys_bound_document( void *arg, ys_docnum_t docnum, ys_doccnt_t dtf )
+{
+	docwt_t *dw = (docwt_t *)arg;
+	double b = ys_log_dtf(dtf, dw->d_maxdtfs[docnum]) / dw->weights[docnum];
+	if (b > dw->bound)
+		dw->bound = b;
+	return BOOL_TRUE;
+}
+
+/**
+ * Works out the largest log_dtf/document weight of a term, which 
+ * multiplied by idf and qtw bounds the term's contribution to any
+ * document's score. Only terms with a skip table record a bound.
+ */
+static ys_bool_t 
+evaluate_bound(ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t value, 
+	ys_doccnt_t doccnt, void *arg)
+{
+	docwt_t *dw = (docwt_t *)arg;
+	if (!dw->postings->has_bound(doccnt))
+		return BOOL_TRUE;
+	dw->bound = 0.0;
+	dw->postings->iterate(value, ys_bound_document, arg);
+	if (dw->postings->write_bound(value, (float)dw->bound) != 0) {
+		fprintf(stderr, "Error: cannot write bound for term %.*s\n",
+			key2[0], key2+1);
+		return BOOL_FALSE;
+	}
+	return BOOL_TRUE;
+}
+
 int 
 ys_build_docweights( const char *home )
 {
@@ -166,17 +244,80 @@ ys_build_docweights( const char *home )
 	YASENS Collection collection;
 	if (collection.open( home, "r+" ) != 0)
 		return -1;
-	ys_btree_t *tree = collection.getIndex();
 	N = collection.getN();
 	docwt_t *dw = ys_docweight_allocate( N );
 	if (dw == 0) {
 		return -1;
 	}
-	dw->postings = collection.getPostFile();
+	dw->collection = &collection;
 	dw->docdb = collection.getDocDb();
 	dw->maxdtf = collection.getMaxDtf();
 	dw->maxtf = collection.getMaxTf();
-	ys_btree_iterate( tree, key, evaluate, (void *)dw);
-	ys_docweight_calculate_and_write( dw, dw->docdb );
+	if (collection.getNumSegments() > 1 &&
+		ys_docweight_find_maxtf( dw, collection, key ) != 0) {
+		ys_docweight_free( dw );
+		return -1;
+	}
+	/* The max dtfs of all documents are read in one pass; the weights
+	 * read with them are discarded as they are about to be replaced. */
+	if (collection.getDocWeights( 0, N, dw->weights, dw->d_maxdtfs ) != 0) {
+		ys_docweight_free( dw );
+		return -1;
+	}
+	memset(dw->weights, 0, N * sizeof(float));
+	for (int s = 0; s < collection.getNumSegments(); s++) {
+		dw->postings = collection.getPostFile(s);
+		ys_btree_iterate( collection.getIndex(s), key, evaluate, (void *)dw);
+	}
+	if (ys_docweight_calculate_and_write( dw, dw->docdb ) != 0) {
+		ys_docweight_free( dw );
+		return -1;
+	}
+	if (collection.getPostingsFormat() & YS_POSTINGS_BOUNDS) {
+		for (int s = 0; s < collection.getNumSegments(); s++) {
+			dw->postings = collection.getPostFile(s);
+			ys_btree_iterate( collection.getIndex(s), key, evaluate_bound, 
+				(void *)dw);
+		}
+	}
+	ys_docweight_free( dw );
+	return 0;
+}
+
+int
+ys_build_bounds( const char *home, int id )
+{
+	ys_uchar_t key[YS_MAXKEYSIZE+1];
+	int s;
+
+	strcpy((char *)key+1, "");
+	key[0] = strlen((char *)key+1);
+
+	YASENS Collection collection;
+	if (collection.open( home, "r+" ) != 0)
+		return -1;
+	if (!(collection.getPostingsFormat() & YS_POSTINGS_BOUNDS))
+		return 0;
+	for (s = 0; s < collection.getNumSegments(); s++) {
+		if (collection.getSegment(s)->id == id)
+			break;
+	}
+	if (s == collection.getNumSegments()) {
+		fprintf(stderr, "Error: there is no segment %d\n", id);
+		return -1;
+	}
+	docwt_t *dw = ys_docweight_allocate( collection.getN() );
+	if (dw == 0)
+		return -1;
+	dw->collection = &collection;
+	dw->docdb = collection.getDocDb();
+	dw->postings = collection.getPostFile(s);
+	if (collection.getDocWeights( 0, collection.getN(), dw->weights, 
+		dw->d_maxdtfs ) != 0) {
+		ys_docweight_free( dw );
+		return -1;
+	}
+	ys_btree_iterate( collection.getIndex(s), key, evaluate_bound, (void *)dw);
+	ys_docweight_free( dw );
 	return 0;
 }
@@ -26,5 +26,12 @@
 extern int
 ys_build_docweights( const char *home );
 
+/**
+ * Records score bounds in the postings of one segment, using the
+ * document weights already saved. Used when segments are merged.
+ */
+extern int
+ys_build_bounds( const char *home, int id );
+
 #endif
 
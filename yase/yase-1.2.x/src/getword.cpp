@@ -35,6 +35,11 @@
 * DM 06-05-02 moved some of the common code to functions
 * DM 03-01-03 started converting to C++, and used tokenizer classes
 * DM 04-01-03 New C++ classes to represent SaxParser, HtmlParser and XmlParser.
+*    17-10-26 Documents are passed to a DocumentSink instead of being added to
+*             the database directly, so that they can be parsed in parallel.
+*             Filter lookup, filter commands and ys_html_get_data() are
+*             serialised by Document_lock. Parser memory is now released
+*             after each HTML document.
 */
 
 #include "getword.h"
@@ -44,6 +49,7 @@
 #include "util.h"
 #include "tokenizer.h"
 #include "saxparser.h"
+#include "ysthread.h"
 
 typedef struct {
 	ys_link_t link;
@@ -68,18 +74,37 @@ static filter_t * get_filter( const char *ext );
 static void init_docfile(ys_query_document_t *doc, ys_docdata_t *docfile,
 	const char *type);
 static int text_extract_words(ys_docdata_t *docfile, ys_query_document_t *doc, 
-	ys_docdb_t *docdb, ys_pfn_index_t pfn_index, ys_mkdb_t *arg);
-static int text_processor( ys_query_document_t *doc, ys_docdb_t *docdb, 
-	ys_pfn_index_t ptrfunc, ys_mkdb_t *arg );
-static int html_processor( ys_query_document_t *doc, ys_docdb_t *docdb, 
-	ys_pfn_index_t ptrfunc, ys_mkdb_t *arg );
-static int xml_processor( ys_query_document_t *doc, ys_docdb_t *docdb, 
-	ys_pfn_index_t ptrfunc, ys_mkdb_t *arg );
-static int my_html_processor(ys_query_document_t *doc, ys_docdb_t *docdb, 
-	ys_pfn_index_t pfn_index, ys_mkdb_t *arg);
+	YASENS DocumentSink *sink);
+static int text_processor( ys_query_document_t *doc, YASENS DocumentSink *sink);
+static int html_processor( ys_query_document_t *doc, YASENS DocumentSink *sink);
+static int xml_processor( ys_query_document_t *doc, YASENS DocumentSink *sink);
+static int my_html_processor(ys_query_document_t *doc, YASENS DocumentSink *sink);
 static ys_bool_t strendswith( const char *s, const char *suffix );
 static const char *filebasename(const char *filename);
 
+/* Protects the filter cache, the environment passed to filters and the 
+ * state held by xmlparser.cpp.
+ */
+static ys_mutex_t Document_lock;
+
+int
+ys_document_init(void)
+{
+#if USE_LIBXML
+	xmlInitParser();
+#endif
+	return ys_mutex_init(&Document_lock);
+}
+
+void
+ys_document_cleanup(void)
+{
+	ys_mutex_destroy(&Document_lock);
+#if USE_LIBXML
+	xmlCleanupParser();
+#endif
+}
+
 /**
  * Determines if a filter is available to transform a file.
  * Filters are specified in the yase.config file using the following syntax:
@@ -344,7 +369,9 @@ document_open( const char *logicalname, const char *name )
 	d->logicalname = logicalname;
 	ext = strchr(filebasename(name), '.');
 	if (ext != NULL) { 
+		ys_mutex_lock(&Document_lock);
 		d->filter = ys_get_filter(ext+1);
+		ys_mutex_unlock(&Document_lock);
 	}
 	if (d->filter == 0) {
 		d->file = fopen(name, "rb");
@@ -354,7 +381,9 @@ document_open( const char *logicalname, const char *name )
 		}
 	}
 	else {
+		ys_mutex_lock(&Document_lock);
 		d->file = ys_run_cmd(d->filter->cmd, name, logicalname);
+		ys_mutex_unlock(&Document_lock);
 	}
 	if (d->file == NULL) {
 		free(d);
@@ -413,7 +442,9 @@ document_reopen( ys_query_document_t *doc )
 		rc = 0;
 	}
 	if ( rc == 0 ) {
+		ys_mutex_lock(&Document_lock);
 		doc->file = ys_run_cmd(doc->filter->cmd, name, logicalname);
+		ys_mutex_unlock(&Document_lock);
 		if (doc->file == NULL) {
 			rc = -1;
 		}
@@ -429,9 +460,7 @@ int
 ys_document_process(
 	const char *logicalnamep, 
 	const char *filename, 
-	ys_docdb_t *docdb, 
-	ys_pfn_index_t ptrfunc, 
-	ys_mkdb_t *arg) 
+	YASENS DocumentSink *sink) 
 {
 	ys_query_document_t *doc = 0;
 	int rc = 0;
@@ -446,17 +475,17 @@ ys_document_process(
 	if (doc->filter == 0) {
 		if (strendswith(filename, ".html") ||
 		    strendswith(filename, ".htm"))
-			rc = html_processor(doc, docdb, ptrfunc, arg);
+			rc = html_processor(doc, sink);
 		else 
-			rc = text_processor(doc, docdb, ptrfunc, arg);
+			rc = text_processor(doc, sink);
 	}
 	else {
 		if (doc->filter->generates_xml)
-			rc = xml_processor(doc, docdb, ptrfunc, arg);
+			rc = xml_processor(doc, sink);
 		else if (doc->filter->generates_html)
-			rc = my_html_processor(doc, docdb, ptrfunc, arg);
+			rc = my_html_processor(doc, sink);
 		else
-			rc = text_processor(doc, docdb, ptrfunc, arg);
+			rc = text_processor(doc, sink);
 	}
 	
 	document_close(doc);
@@ -484,7 +513,12 @@ init_docfile(
 		snprintf(docfile->size, sizeof docfile->size, 
 			"%ld", statbuf.st_size);
 		tt = statbuf.st_ctime;
+#ifdef WIN32
 		tm = localtime(&tt);
+#else
+		struct tm tmbuf;
+		tm = localtime_r(&tt, &tmbuf);
+#endif
 		strftime(docfile->datecreated, sizeof docfile->datecreated,
 			"%D %R", tm);
 	}
@@ -494,17 +528,16 @@ init_docfile(
  * Text file reader
  */
 static int
-text_extract_words(ys_docdata_t *docfile, ys_query_document_t *doc, ys_docdb_t *docdb, ys_pfn_index_t pfn_index, ys_mkdb_t *arg)
+text_extract_words(ys_docdata_t *docfile, ys_query_document_t *doc, YASENS DocumentSink *sink)
 {
 	ys_uchar_t word[YS_TERM_LEN];
 	const ys_uchar_t *wordp;
-	bool skippingBinaryFiles = ys_mkdb_get_skip_binary_files( arg );
+	bool skippingBinaryFiles = sink->skipBinaryFiles();
 
-	if (ys_dbaddfile(docdb, docfile) == 0) {
-		unsigned long docnum;
-		int rc = ys_dbadddocptr(docdb, docfile, 0, &docnum);
-		/** TODO: FIXME **/
-		ys_mkdb_set_curdocnum( arg, docnum );
+	if (sink->addFile(docfile) == 0) {
+		ys_docnum_t docnum;
+		if (sink->addDocument(docfile, 0, &docnum) != 0)
+			goto done;
 		FILE *file = doc->file;
 		ys_uchar_t buf[BUFSIZ];
 		YASENS StringTokenizer st;
@@ -518,7 +551,7 @@ text_extract_words(ys_docdata_t *docfile, ys_query_document_t *doc, ys_docdb_t *
 			while (cp != 0 && (!skippingBinaryFiles || st.countBinary() < 50)) {
 				strncpy((char *)word+1, (const char *)cp, sizeof word-1);
 				word[0] = strlen((const char *)word+1);
-				if (pfn_index(arg, word, docnum) != 0)
+				if (sink->addWord(word, docnum) != 0)
 					goto done;
 				cp = st.nextToken();
 			}
@@ -527,7 +560,7 @@ text_extract_words(ys_docdata_t *docfile, ys_query_document_t *doc, ys_docdb_t *
 		if (cp != 0 && (!skippingBinaryFiles || st.countBinary() < 50)) {
 			strncpy((char *)word+1, (const char *)cp, sizeof word-1);
 			word[0] = strlen((const char *)word+1);
-			if (pfn_index(arg, word, docnum) != 0)
+			if (sink->addWord(word, docnum) != 0)
 				goto done;
 		}
 	}
@@ -539,23 +572,28 @@ done:
  * Text file reader
  */
 static int
-text_processor(ys_query_document_t *doc, ys_docdb_t *docdb, ys_pfn_index_t pfn_index, ys_mkdb_t *arg)
+text_processor(ys_query_document_t *doc, YASENS DocumentSink *sink)
 {
 	ys_docdata_t docfile = {0};
 	init_docfile(doc, &docfile, "TEXT");
-	return text_extract_words(&docfile, doc, docdb, pfn_index, arg);
+	return text_extract_words(&docfile, doc, sink);
 }
 
 static int
-my_html_processor(ys_query_document_t *doc, ys_docdb_t *docdb, ys_pfn_index_t pfn_index, ys_mkdb_t *arg)
+my_html_processor(ys_query_document_t *doc, YASENS DocumentSink *sink)
 {
 	ys_docdata_t docfile = {0};
 	ys_html_data_t htdata = {0};
 
-	if ( ys_html_get_data(doc->file, &htdata) != 0 )
-		return -1;
-	if ( document_reopen(doc) != 0 )
+	/* htdata points into memory owned by xmlparser.cpp, which is
+	 * released once the fields have been copied.
+	 */
+	ys_mutex_lock(&Document_lock);
+	if ( ys_html_get_data(doc->file, &htdata) != 0 ) {
+		ys_xml_release_memory();
+		ys_mutex_unlock(&Document_lock);
 		return -1;
+	}
 	init_docfile(doc, &docfile, "HTML");
 	if (htdata.title != 0 && strlen(htdata.title) > 0) {
 		strncpy(docfile.title, htdata.title, 
@@ -569,7 +607,11 @@ my_html_processor(ys_query_document_t *doc, ys_docdb_t *docdb, ys_pfn_index_t pf
 		strncpy(docfile.keywords, htdata.keywords, 
 			sizeof docfile.keywords);
 	}
-	return text_extract_words(&docfile, doc, docdb, pfn_index, arg);
+	ys_xml_release_memory();
+	ys_mutex_unlock(&Document_lock);
+	if ( document_reopen(doc) != 0 )
+		return -1;
+	return text_extract_words(&docfile, doc, sink);
 }
 
 #if USE_LIBXML
@@ -578,19 +620,17 @@ YASE_NS_BEGIN
 
 class HtmlParser : public SaxParser {
 protected:
-	ys_docdb_t *docdb;
-	ys_pfn_index_t pfn_index;
-	ys_mkdb_t *arg;
+	YASENS DocumentSink *sink;
 	ys_docdata_t docfile;
 	ys_docdata_t doc;
-	unsigned long docnum;
+	ys_docnum_t docnum;
 	int pass;
 	int intitle;
 	ys_uchar_t word[YS_TERM_LEN];
 	YASENS UTF8ToAsciiTokenizer st;
 
 public:
-	HtmlParser(ys_docdb_t *docdb, ys_pfn_index_t pfn_index, ys_mkdb_t *arg);
+	HtmlParser(YASENS DocumentSink *sink);
 
 	virtual void 
 	startElement(const xmlChar *name, const xmlChar **atts);
@@ -619,7 +659,7 @@ protected:
 	bool indoc;
 
 public:
-	XmlParser(ys_docdb_t *docdb, ys_pfn_index_t pfn_index, ys_mkdb_t *arg);
+	XmlParser(YASENS DocumentSink *sink);
 
 	virtual void 
 	startElement(const xmlChar *name, const xmlChar **atts);
@@ -700,7 +740,7 @@ YASENS HtmlParser::scanTokens(const xmlChar *ch, int len)
 	while (cp != 0) {
 		strncpy((char *)word+1, (const char *)cp, sizeof word-1);
 		word[0] = strlen((const char *)word+1);
-		pfn_index(arg, word, docnum);
+		sink->addWord(word, docnum);
 		cp = st.nextToken();
 	}
 }
@@ -712,14 +752,12 @@ YASENS HtmlParser::trailingWord()
 	if (cp != 0) {
 		strncpy((char *)word+1, (const char *)cp, sizeof word-1);
 		word[0] = strlen((const char *)word+1);
-		pfn_index(arg, word, docnum);
+		sink->addWord(word, docnum);
 	}
 }
 
 YASENS HtmlParser::HtmlParser(
-	ys_docdb_t *docdb, 
-	ys_pfn_index_t pfn_index, 
-	ys_mkdb_t *arg)
+	YASENS DocumentSink *sink)
 {
 	memset(&docfile, 0, sizeof docfile);
 	memset(&doc, 0, sizeof doc);
@@ -727,9 +765,7 @@ YASENS HtmlParser::HtmlParser(
 	pass = 1;
 	intitle = 0;
 	word[0] = 0;
-	this->docdb = docdb;
-	this->pfn_index = pfn_index;
-	this->arg = arg;
+	this->sink = sink;
 }
 	
 /**
@@ -753,17 +789,14 @@ YASENS HtmlParser::parse(ys_query_document_t *doc)
 	if (htmldoc != NULL) {
 		xmlFreeDoc(htmldoc);
 	}
-	if (ys_dbaddfile(docdb, &docfile) == 0) {
-		int rc = ys_dbadddocptr(docdb, &docfile, 0, &docnum);
-		/** TODO: FIXME **/
-		ys_mkdb_set_curdocnum( arg, docnum );
+	if (sink->addFile(&docfile) == 0 && 
+		sink->addDocument(&docfile, 0, &docnum) == 0) {
 		pass = 2;
 		htmldoc = htmlSAXParseFile(doc->filename, NULL, 
 			ys_get_saxp_handler(), (void *)this);
 		if (htmldoc != NULL) {
 			xmlFreeDoc(htmldoc);
 		}
-		xmlCleanupParser();
 	}
 }
 
@@ -827,14 +860,10 @@ YASENS XmlParser::startElement(const xmlChar *name, const xmlChar **atts)
 			}
 		}
 		if (!docfile_added) {
-			ys_dbaddfile(docdb, &docfile);
+			sink->addFile(&docfile);
 			docfile_added = true;
 		}	
-		ys_dbadddoc(docdb, &docfile, &doc);
-		ys_dbadddocptr(docdb, &docfile, 
-			&doc, &docnum);
-		/** TODO: FIXME **/
-		ys_mkdb_set_curdocnum( arg, docnum );
+		sink->addDocument(&docfile, &doc, &docnum);
 	}
 	st.reset();
 }
@@ -860,9 +889,7 @@ YASENS XmlParser::characters(const xmlChar *ch, int len)
 }
 
 YASENS XmlParser::XmlParser(
-	ys_docdb_t *docdb, 
-	ys_pfn_index_t pfn_index, 
-	ys_mkdb_t *arg) : HtmlParser(docdb, pfn_index, arg)
+	YASENS DocumentSink *sink) : HtmlParser(sink)
 {
 	docfile_added = false;
 	infile = false;
@@ -895,21 +922,20 @@ YASENS XmlParser::parse(ys_query_document_t *doc)
 				"xmlParseChunk returned error %d\n", rc);
 		}
 	}
-	xmlCleanupParser();
 }
 
 static int
-html_processor(ys_query_document_t *doc, ys_docdb_t *docdb, ys_pfn_index_t pfn_index, ys_mkdb_t *arg)
+html_processor(ys_query_document_t *doc, YASENS DocumentSink *sink)
 {
-	YASENS HtmlParser parser(docdb, pfn_index, arg);
+	YASENS HtmlParser parser(sink);
 	parser.parse(doc);
 	return 0;
 }
 
 static int
-xml_processor(ys_query_document_t *doc, ys_docdb_t *docdb, ys_pfn_index_t pfn_index, ys_mkdb_t *arg)
+xml_processor(ys_query_document_t *doc, YASENS DocumentSink *sink)
 {
-	YASENS XmlParser parser(docdb, pfn_index, arg);
+	YASENS XmlParser parser(sink);
 	parser.parse(doc);
 	return 0;
 }
@@ -917,15 +943,15 @@ xml_processor(ys_query_document_t *doc, ys_docdb_t *docdb, ys_pfn_index_t pfn_in
 #else
 
 static int
-xml_processor(ys_query_document_t *doc, ys_docdb_t *docdb, ys_pfn_index_t pfn_index, ys_mkdb_t *arg)
+xml_processor(ys_query_document_t *doc, YASENS DocumentSink *sink)
 {
-	return text_processor(doc, docdb, pfn_index, arg);
+	return text_processor(doc, sink);
 }
 
 static int
-html_processor(ys_query_document_t *doc, ys_docdb_t *docdb, ys_pfn_index_t pfn_index, ys_mkdb_t *arg)
+html_processor(ys_query_document_t *doc, YASENS DocumentSink *sink)
 {
-	return my_html_processor(doc, docdb, pfn_index, arg); 
+	return my_html_processor(doc, sink); 
 }
 
 #endif
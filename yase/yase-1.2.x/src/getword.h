@@ -29,8 +29,39 @@
 
 typedef int ys_getword_opts_t;
 	
-typedef int (*ys_pfn_index_t)(ys_mkdb_t *arg, ys_uchar_t *word, ys_docnum_t docnum);
+YASE_NS_BEGIN
+
+/**
+ * DocumentSink receives the files, documents and words found by
+ * ys_document_process(). A file may contain several documents (XML). 
+ * The words are length prefixed (Pascal strings) and are only valid
+ * for the duration of the call.
+ */
+class DocumentSink {
+public:
+	virtual ~DocumentSink() {}
+	/** Called once per file. Returns 0 if the file is to be indexed. */
+	virtual int addFile(ys_docdata_t *docfile) = 0;
+	/**
+	 * Called once per document; doc is null for files that hold
+	 * a single document. Sets docnum for use in addWord().
+	 */
+	virtual int addDocument(ys_docdata_t *docfile, ys_docdata_t *doc,
+		ys_docnum_t *docnum) = 0;
+	virtual int addWord(ys_uchar_t *word, ys_docnum_t docnum) = 0;
+	virtual bool skipBinaryFiles() const = 0;
+};
+
+YASE_NS_END
+
+/**
+ * ys_document_init() must be called before documents are processed,
+ * and ys_document_cleanup() after. ys_document_process() may then be
+ * called from several threads at once, each with its own sink.
+ */
+extern int ys_document_init(void);
+extern void ys_document_cleanup(void);
 extern int ys_document_process(const char *logicalname, const char *physicalname, 
-	ys_docdb_t *docdb, ys_pfn_index_t ptrfunc, ys_mkdb_t *arg) ;
+	YASENS DocumentSink *sink) ;
 
 #endif
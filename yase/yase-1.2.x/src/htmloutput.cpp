@@ -30,6 +30,10 @@
 /* 16-feb-2002 Added support for html template file */
 /* 16-feb-2002 Converted text output to xml format */
 /* 18-22 Jan 2003: Converted to C++ from old C stuff */
+/* 17 Oct 2026: Summary shows when the match count is a lower bound */
+/* 17 Oct 2026: HtmlOutput can write to any stream */
+/* 17 Oct 2026: Rows are output from the stored fields in place */
+/* 17 Oct 2026: The documents of a page are read together */
 
 #include "query.h"
 #include "util.h"
@@ -188,6 +192,15 @@ YASENS HtmlOutput::HtmlOutput()
 	t = new YASENS TemplateLoader();
 }
 
+YASENS HtmlOutput::HtmlOutput(FILE *out)
+{
+	this->out = out;
+	doRowHeader = false;
+	form = 0;
+	input = 0;
+	t = new YASENS TemplateLoader();
+}
+
 YASENS HtmlOutput::~HtmlOutput()
 {
 	delete t;
@@ -227,22 +240,44 @@ YASENS HtmlOutput::doOutput(YASENS Collection *collection, QueryForm *form, Quer
 	}
 
 	ys_docdb_t *db = collection->getDocDb();
-	ys_docdata_t docfile, doc;
 
 	doHeader();
 	if (rs != 0) {
+		/* Collect the page, then read its documents in one go */
+		size_t rows = end_result >= start_result ? 
+			end_result - start_result + 1 : 0;
+		ys_docnum_t *docnums = (ys_docnum_t *) malloc(rows * sizeof *docnums + 1);
+		double *scores = (double *) malloc(rows * sizeof *scores + 1);
+		int *hits = (int *) malloc(rows * sizeof *hits + 1);
+		ys_docref_t *refs = (ys_docref_t *) malloc(rows * sizeof *refs + 1);
+		size_t n = 0;
+		if (docnums == 0 || scores == 0 || hits == 0 || refs == 0) {
+			fprintf(stderr, "Error: ran out of memory\n");
+			rows = 0;
+		}
 		YASENS SearchResultItem *item = rs->getNext();
 		cur_result = 0;
-		while (item != 0 && cur_result < end_result) {
+		while (item != 0 && cur_result < end_result && n < rows) {
 			if (++cur_result >= start_result) {
-				ys_dbgetdocumentref(db, item->getDocnum(),
-					&docfile, &doc);
-				outputRow(docfile.logicalname, "",
-					&docfile, &doc, item->getScore(), item->getHits());
+				docnums[n] = item->getDocnum();
+				scores[n] = item->getScore();
+				hits[n++] = item->getHits();
 			}
 			item = rs->getNext();
 		}
-		outputSummary(matches, curpage,	page_count, pagesize, rs->getElapsedTime());
+		bool failed = ys_dbgetdocumentrefs(db, docnums, n, refs) != 0;
+		for (size_t i = 0; i < n; i++) {
+			/* Skip documents that could not be read */
+			if (failed && refs[i].len[YS_DOCFIELD_LOGICALNAME] == 0)
+				continue;
+			outputRow(&refs[i], scores[i], hits[i]);
+		}
+		free(docnums);
+		free(scores);
+		free(hits);
+		free(refs);
+		outputSummary(matches, curpage,	page_count, pagesize, rs->getElapsedTime(),
+			rs->isCountExact());
 	}
 	doFooter();
 }
@@ -310,13 +345,13 @@ YASENS HtmlOutput::doFooter()
  */
 void 
 YASENS HtmlOutput::outputRow(
-	const char *reference,		/* HTML Link */
-	const char *anchor, 		/* Anchor */
-	ys_docdata_t *docfile,		/* Document File */
-	ys_docdata_t *doc, 		/* Document */
+	const ys_docref_t *ref,		/* Stored fields of the document */
 	double rank, 			/* Rank */
 	int matchcount) 		/* Number of hits */
 {
+	const char *reference = ref->field[YS_DOCFIELD_LOGICALNAME];
+	const char *title = ref->field[YS_DOCFIELD_TITLE];
+	const char *filetitle = ref->field[YS_DOCFIELD_FILETITLE];
 	char mytitle[BUFSIZ] = {0};
 	char myref1[BUFSIZ] = {0};
 	char myref[BUFSIZ] = {0};
@@ -346,24 +381,24 @@ YASENS HtmlOutput::outputRow(
 			input->getHttpHost(), reference);
 	}
 	ys_url_encode_string(myref1, myref, sizeof myref, YS_URLX_SPACE_TO_HEX);
-	if (doc->title[0]) {
-		if (docfile->title[0]) {
+	if (title[0]) {
+		if (filetitle[0]) {
 			snprintf(mytitle, sizeof mytitle, "<i>%s</i><br>%s",
-				doc->title, docfile->title);
+				title, filetitle);
 		}
 		else {
 			snprintf(mytitle, sizeof mytitle, "<i>%s</i><br>%s",
-				doc->title, docfile->logicalname);
+				title, reference);
 		}
 	}
 	else {
-		if (docfile->title[0]) {
+		if (filetitle[0]) {
 			snprintf(mytitle, sizeof mytitle, "%s",
-				docfile->title);
+				filetitle);
 		}
 		else {
 			snprintf(mytitle, sizeof mytitle, "%s",
-				docfile->logicalname);
+				reference);
 		}
 	}
 
@@ -389,7 +424,7 @@ YASENS HtmlOutput::outputRow(
 					cp += 2;
 					break;
 				case 's':
-					fprintf(out, "%s", docfile->size);
+					fputs(ref->field[YS_DOCFIELD_SIZE], out);
 					cp += 2;
 					break;
 				case 'h':
@@ -411,7 +446,7 @@ YASENS HtmlOutput::outputRow(
 	else {
 		fprintf(out, "<tr>\n<td valign=\"bottom\" nowrap>\n");
 		fprintf(out, "<a href=\"%s\">%s</a></td>\n", myref, mytitle);
-		fprintf(out, "<td>%s</td>\n", docfile->size);
+		fprintf(out, "<td>%s</td>\n", ref->field[YS_DOCFIELD_SIZE]);
 		fprintf(out, "<td>%.2f</td>\n", rank);
 		fprintf(out, "</tr>\n");
 	}
@@ -467,7 +502,8 @@ YASENS HtmlOutput::outputSummary(
 	int curpage,		/* Current page */
 	int pagecount, 		/* Total Page count */
 	int pagesize,		/* Size of each page */
-	double elapsed_time)		
+	double elapsed_time,
+	bool exact)		/* Is matches exact ? */
 {
 	char *td_format = "        <td>\n%s        </td>\n";
 	char default_navfmt[4096];
@@ -610,8 +646,8 @@ YASENS HtmlOutput::outputSummary(
 	}
 
 	fputs(default_navfooter, out);
-	fprintf(out, "<br>Page %d displayed, out of %d pages, containing %d items",
-		curpage, pagecount, matches);
+	fprintf(out, "<br>Page %d displayed, out of %d pages, containing %s%d items",
+		curpage, pagecount, exact ? "" : "at least ", matches);
 	fprintf(out, "<br>Query was processed in %.2g seconds",
 		elapsed_time);
 
@@ -626,12 +662,12 @@ YASENS HtmlOutput::message(const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	vfprintf(stdout, fmt, args);
+	vfprintf(out, fmt, args);
 	va_end(args);
 	const char *cp = fmt;
 	while (*cp) {
 		if (*cp == '\n')
-			fputs("<br>\n", stdout);
+			fputs("<br>\n", out);
 		cp++;
 	}
 }
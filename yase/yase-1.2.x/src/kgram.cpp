@@ -0,0 +1,394 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - bigram index of a collection's terms, for wildcard
+//           and fuzzy term expansion.
+
+#include "kgram.h"
+
+#include <algorithm>
+
+enum {
+	YS_KGRAM_PAD = 0		/* pads the ends of a term */
+};
+
+/* Orders term numbers by their keys */
+struct ys_kgram_less {
+	const ys_uchar_t *text;
+	const size_t *offsets;
+	bool operator()(unsigned a, unsigned b) const {
+		const ys_uchar_t *ka = text + offsets[a];
+		const ys_uchar_t *kb = text + offsets[b];
+		int n = ka[0] < kb[0] ? ka[0] : kb[0];
+		int rc = memcmp(ka+1, kb+1, n);
+		return rc < 0 || (rc == 0 && ka[0] < kb[0]);
+	}
+};
+
+YASENS KGramIndex::KGramIndex()
+{
+	nterms = 0;
+	nalloc = 0;
+	text = 0;
+	textlen = 0;
+	textalloc = 0;
+	offsets = 0;
+	tfs = 0;
+	gramstart = 0;
+	grams = 0;
+}
+
+YASENS KGramIndex::~KGramIndex()
+{
+	free(text);
+	free(offsets);
+	free(tfs);
+	free(gramstart);
+	free(grams);
+}
+
+int
+YASENS KGramIndex::add(const ys_uchar_t *key, ys_doccnt_t tf)
+{
+	size_t need = key[0] + 2;
+
+	if (nterms == nalloc) {
+		unsigned n = nalloc == 0 ? 1024 : nalloc * 2;
+		size_t *o = (size_t *) realloc(offsets, n * sizeof *o);
+		if (o != 0)
+			offsets = o;
+		ys_doccnt_t *t = (ys_doccnt_t *) realloc(tfs, n * sizeof *t);
+		if (t != 0)
+			tfs = t;
+		if (o == 0 || t == 0) {
+			fprintf(stderr, "Error allocating memory\n");
+			return -1;
+		}
+		nalloc = n;
+	}
+	if (textlen + need > textalloc) {
+		size_t n = textalloc == 0 ? 16384 : textalloc * 2;
+		while (n < textlen + need)
+			n *= 2;
+		ys_uchar_t *p = (ys_uchar_t *) realloc(text, n);
+		if (p == 0) {
+			fprintf(stderr, "Error allocating memory\n");
+			return -1;
+		}
+		text = p;
+		textalloc = n;
+	}
+	offsets[nterms] = textlen;
+	tfs[nterms] = tf;
+	memcpy(text + textlen, key, key[0] + 1);
+	text[textlen + key[0] + 1] = 0;
+	textlen += need;
+	nterms++;
+	return 0;
+}
+
+/**
+ * Writes the distinct bigrams of word, padded at either end, to out 
+ * in ascending order. out must have room for len+1 entries.
+ */
+unsigned
+YASENS KGramIndex::distinctGrams(const ys_uchar_t *word, int len, 
+	unsigned *out) const
+{
+	unsigned n = 0;
+	int prev = YS_KGRAM_PAD;
+	for (int i = 0; i <= len; i++) {
+		int ch = i < len ? word[i] : YS_KGRAM_PAD;
+		out[n++] = gram(prev, ch);
+		prev = ch;
+	}
+	std::sort(out, out+n);
+	return (unsigned) (std::unique(out, out+n) - out);
+}
+
+int
+YASENS KGramIndex::build()
+{
+	unsigned *order = 0, *g = 0;
+	unsigned i, n, total;
+	size_t *o = 0;
+	ys_doccnt_t *t = 0;
+	int rc = -1;
+
+	free(gramstart);
+	free(grams);
+	gramstart = 0;
+	grams = 0;
+
+	order = (unsigned *) malloc((nterms+1) * sizeof *order);
+	o = (size_t *) malloc((nterms+1) * sizeof *o);
+	t = (ys_doccnt_t *) malloc((nterms+1) * sizeof *t);
+	g = (unsigned *) malloc((YS_TERM_LEN+1) * sizeof *g);
+	gramstart = (unsigned *) calloc(NGRAMS+1, sizeof *gramstart);
+	if (order == 0 || o == 0 || t == 0 || g == 0 || gramstart == 0) {
+		fprintf(stderr, "Error allocating memory\n");
+		goto done;
+	}
+
+	/* Sort the terms, summing the tfs of duplicates */
+	for (i = 0; i < nterms; i++)
+		order[i] = i;
+	{
+		ys_kgram_less less = { text, offsets };
+		std::sort(order, order+nterms, less);
+		n = 0;
+		for (i = 0; i < nterms; i++) {
+			if (n > 0 && !less(order[i-1], order[i])) {
+				t[n-1] += tfs[order[i]];
+				continue;
+			}
+			o[n] = offsets[order[i]];
+			t[n] = tfs[order[i]];
+			n++;
+		}
+	}
+	free(offsets);
+	free(tfs);
+	offsets = o;
+	tfs = t;
+	nterms = nalloc = n;
+	o = 0;
+	t = 0;
+
+	/* Count the terms with each bigram, then fill in the lists */
+	total = 0;
+	for (i = 0; i < nterms; i++) {
+		const ys_uchar_t *k = key(i);
+		unsigned ng = distinctGrams(k+1, k[0], g);
+		for (unsigned j = 0; j < ng; j++)
+			gramstart[g[j]+1]++;
+		total += ng;
+	}
+	for (i = 0; i < NGRAMS; i++)
+		gramstart[i+1] += gramstart[i];
+	grams = (unsigned *) malloc((total+1) * sizeof *grams);
+	if (grams == 0) {
+		fprintf(stderr, "Error allocating memory\n");
+		goto done;
+	}
+	for (i = 0; i < nterms; i++) {
+		const ys_uchar_t *k = key(i);
+		unsigned ng = distinctGrams(k+1, k[0], g);
+		for (unsigned j = 0; j < ng; j++)
+			grams[gramstart[g[j]]++] = i;
+	}
+	/* Each entry now holds the end of its list, so shift them back */
+	for (i = NGRAMS; i > 0; i--)
+		gramstart[i] = gramstart[i-1];
+	gramstart[0] = 0;
+	rc = 0;
+
+done:
+	free(order);
+	free(o);
+	free(t);
+	free(g);
+	return rc;
+}
+
+size_t
+YASENS KGramIndex::memsize() const
+{
+	size_t size = textalloc + nalloc * (sizeof *offsets + sizeof *tfs);
+	if (gramstart != 0)
+		size += (NGRAMS+1) * sizeof *gramstart + 
+			gramstart[NGRAMS] * sizeof *grams;
+	return size;
+}
+
+bool
+YASENS KGramIndex::match(const ys_uchar_t *pattern, const ys_uchar_t *text,
+	int len)
+{
+	const ys_uchar_t *star = 0;	/* last * seen */
+	int i = 0, mark = 0;
+
+	while (i < len) {
+		if (*pattern == '*') {
+			star = ++pattern;
+			mark = i;
+		}
+		else if (*pattern != 0 && (*pattern == '?' || *pattern == text[i])) {
+			pattern++;
+			i++;
+		}
+		else if (star != 0) {
+			/* Let the last * take one more character */
+			pattern = star;
+			i = ++mark;
+		}
+		else
+			return false;
+	}
+	while (*pattern == '*')
+		pattern++;
+	return *pattern == 0;
+}
+
+int
+YASENS KGramIndex::distance(const ys_uchar_t *a, int alen, 
+	const ys_uchar_t *b, int blen, int maxdist)
+{
+	int row[YS_TERM_LEN+2];
+
+	if (alen - blen > maxdist || blen - alen > maxdist)
+		return maxdist+1;
+	for (int j = 0; j <= blen; j++)
+		row[j] = j;
+	for (int i = 1; i <= alen; i++) {
+		int diag = row[0];
+		int least = row[0] = i;
+		for (int j = 1; j <= blen; j++) {
+			int d = diag + (a[i-1] != b[j-1]);
+			if (row[j] + 1 < d)
+				d = row[j] + 1;
+			if (row[j-1] + 1 < d)
+				d = row[j-1] + 1;
+			diag = row[j];
+			row[j] = d;
+			if (d < least)
+				least = d;
+		}
+		if (least > maxdist)
+			return maxdist+1;
+	}
+	return row[blen] <= maxdist ? row[blen] : maxdist+1;
+}
+
+void
+YASENS KGramIndex::wildcard(const ys_uchar_t *pattern, 
+	ys_pfn_kgram_match_t *pfunc, void *arg) const
+{
+	unsigned g[YS_TERM_LEN+1];
+	unsigned ng = 0, i, j;
+	int len = strlen((const char *)pattern);
+	int prev = YS_KGRAM_PAD;
+
+	if (grams == 0 || len > YS_TERM_LEN)
+		return;
+
+	/* Bigrams of two literal characters */
+	for (i = 0; i <= (unsigned) len; i++) {
+		int ch = i < (unsigned) len ? pattern[i] : YS_KGRAM_PAD;
+		if (prev != '*' && prev != '?' && ch != '*' && ch != '?')
+			g[ng++] = gram(prev, ch);
+		prev = ch;
+	}
+	std::sort(g, g+ng);
+	ng = (unsigned) (std::unique(g, g+ng) - g);
+
+	if (ng == 0) {
+		for (i = 0; i < nterms; i++) {
+			const ys_uchar_t *k = key(i);
+			if (match(pattern, k+1, k[0]) && !pfunc(arg, k, tfs[i], 0))
+				return;
+		}
+		return;
+	}
+
+	/* Check each term of the shortest list against the others */
+	unsigned shortest = 0;
+	for (j = 1; j < ng; j++) {
+		if (gramstart[g[j]+1] - gramstart[g[j]] < 
+			gramstart[g[shortest]+1] - gramstart[g[shortest]])
+			shortest = j;
+	}
+	for (i = gramstart[g[shortest]]; i < gramstart[g[shortest]+1]; i++) {
+		unsigned t = grams[i];
+		for (j = 0; j < ng; j++) {
+			if (j != shortest && !std::binary_search(grams + gramstart[g[j]],
+				grams + gramstart[g[j]+1], t))
+				break;
+		}
+		if (j < ng)
+			continue;
+		const ys_uchar_t *k = key(t);
+		if (match(pattern, k+1, k[0]) && !pfunc(arg, k, tfs[t], 0))
+			return;
+	}
+}
+
+/**
+ * Each edit changes at most two of a word's padded bigrams, so a term 
+ * within maxdist edits shares all but 2*maxdist of its distinct bigrams.
+ * When that leaves none, terms are chosen by length alone.
+ */
+void
+YASENS KGramIndex::fuzzy(const ys_uchar_t *word, int maxdist, 
+	ys_pfn_kgram_match_t *pfunc, void *arg) const
+{
+	unsigned g[YS_TERM_LEN+1];
+	int len = strlen((const char *)word);
+	unsigned ng, i, j, ncand = 0;
+	unsigned char *counts = 0;
+	unsigned *cand = 0;
+	int need;
+
+	if (grams == 0 || len > YS_TERM_LEN)
+		return;
+	if (maxdist > YS_KGRAM_MAXDIST)
+		maxdist = YS_KGRAM_MAXDIST;
+	if (maxdist < 0)
+		maxdist = 0;
+	ng = distinctGrams(word, len, g);
+	need = (int) ng - 2 * maxdist;
+
+	cand = (unsigned *) malloc((nterms+1) * sizeof *cand);
+	if (cand == 0) {
+		fprintf(stderr, "Error allocating memory\n");
+		return;
+	}
+	if (need <= 0) {
+		for (i = 0; i < nterms; i++)
+			cand[ncand++] = i;
+	}
+	else {
+		counts = (unsigned char *) calloc(nterms+1, 1);
+		if (counts == 0) {
+			fprintf(stderr, "Error allocating memory\n");
+			free(cand);
+			return;
+		}
+		for (j = 0; j < ng; j++) {
+			for (i = gramstart[g[j]]; i < gramstart[g[j]+1]; i++) {
+				unsigned t = grams[i];
+				if (++counts[t] == need)
+					cand[ncand++] = t;
+			}
+		}
+		std::sort(cand, cand+ncand);
+	}
+
+	for (i = 0; i < ncand; i++) {
+		const ys_uchar_t *k = key(cand[i]);
+		int d = distance(word, len, k+1, k[0], maxdist);
+		if (d <= maxdist && !pfunc(arg, k, tfs[cand[i]], d))
+			break;
+	}
+	free(counts);
+	free(cand);
+}
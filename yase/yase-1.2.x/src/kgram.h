@@ -0,0 +1,122 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - bigram index of a collection's terms, for wildcard
+//           and fuzzy term expansion.
+
+#ifndef kgram_h
+#define kgram_h
+
+#include "yase.h"
+
+enum {
+	YS_KGRAM_MAXDIST = 2		/* largest edit distance for fuzzy() */
+};
+
+/**
+ * Called for each term that matches; key is length prefixed and null 
+ * terminated. Return false to stop.
+ */
+typedef ys_bool_t ys_pfn_kgram_match_t(void *arg, const ys_uchar_t *key, 
+	ys_doccnt_t tf, int distance);
+
+YASE_NS_BEGIN
+
+/**
+ * An in memory index from the bigrams of each term to the terms that
+ * contain them, for finding the terms that match a wildcard pattern 
+ * (with * and ?) or are within a small edit distance of a word. Terms
+ * are padded with a 0 byte at either end, so that the first and last
+ * characters form bigrams of their own. The bigrams of a pattern's 
+ * literal characters select candidate terms, which are then checked 
+ * against the pattern, or edit distance, itself. Terms are added in 
+ * any order, and may repeat (as when a term is in several segments, 
+ * in which case their tfs are summed); build() must be called once 
+ * all terms have been added.
+ */
+class KGramIndex {
+private:
+	enum { NGRAMS = 256*256 };
+	unsigned nterms;
+	unsigned nalloc;
+	ys_uchar_t *text;		/* the terms, length prefixed */
+	size_t textlen;
+	size_t textalloc;
+	size_t *offsets;		/* start of each term in text */
+	ys_doccnt_t *tfs;
+	unsigned *gramstart;		/* first entry of each bigram */
+	unsigned *grams;		/* term numbers, by bigram */
+
+	static unsigned gram(int a, int b) { return (a << 8) | b; }
+	const ys_uchar_t *key(unsigned t) const { return text + offsets[t]; }
+	unsigned distinctGrams(const ys_uchar_t *word, int len, 
+		unsigned *out) const;
+
+private:
+	KGramIndex(const KGramIndex&);
+	KGramIndex& operator=(const KGramIndex&);
+
+public:
+	KGramIndex();
+	~KGramIndex();
+	/**
+	 * Adds a term (a length prefixed key). Returns -1 if out of 
+	 * memory.
+	 */
+	int add(const ys_uchar_t *key, ys_doccnt_t tf);
+	/**
+	 * Sorts the terms, merging duplicates, and builds the bigram
+	 * lists. Returns -1 if out of memory.
+	 */
+	int build();
+	unsigned getCount() const { return nterms; }
+	size_t memsize() const;
+	/**
+	 * Finds the terms that match pattern, where * matches any 
+	 * characters and ? any one character. The distance passed to
+	 * pfunc is 0.
+	 */
+	void wildcard(const ys_uchar_t *pattern, ys_pfn_kgram_match_t *pfunc,
+		void *arg) const;
+	/**
+	 * Finds the terms within maxdist insertions, deletions or
+	 * substitutions of word. maxdist is at most YS_KGRAM_MAXDIST.
+	 */
+	void fuzzy(const ys_uchar_t *word, int maxdist, 
+		ys_pfn_kgram_match_t *pfunc, void *arg) const;
+
+	/**
+	 * Does text (of len characters) match pattern ?
+	 */
+	static bool match(const ys_uchar_t *pattern, const ys_uchar_t *text, 
+		int len);
+	/**
+	 * Edit distance between a and b, or maxdist+1 if it is more than
+	 * maxdist.
+	 */
+	static int distance(const ys_uchar_t *a, int alen, 
+		const ys_uchar_t *b, int blen, int maxdist);
+};
+
+YASE_NS_END
+
+#endif
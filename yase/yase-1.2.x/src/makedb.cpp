@@ -66,6 +66,40 @@
 *             ys_mkdb_set_curdocnum() defined to set cu_docnum. This gets
 *             called from getword.cpp.
 *
+*    17-10-26 Postings are gathered per term and written with
+*             PostFile::write_postings(), so that the final merge can
+*             write block postings (-B). Intermediate runs stay in v1.
+*             Fixed missing break after -x.
+*    17-10-26 Added -C to select the postings codec.
+*    17-10-26 -B also records score bounds for MaxScore.
+*    17-10-26 Documents can be parsed by several threads (-j). Each file
+*             is parsed into a ParsedFile and added to the database by the
+*             main thread in the order the files were located, so document
+*             numbers are the same as with a single thread. 
+*             ys_mkdb_set_curdocnum() removed; the sinks set cur_docnum.
+*    17-10-26 ys_merge() no longer merges the word tree with all earlier
+*             data each time memory runs out. The tree is flushed as an
+*             independent sorted run, and the runs are merged once at the
+*             end with a heap (at most YS_MERGE_FANIN runs at a time).
+*    17-10-26 Terms are kept in a hash table (word_table_t) instead of an
+*             AVL tree, and sorted with multikey quicksort when a run is
+*             written out. Reports tokens indexed per second.
+*    17-10-26 In memory postings are stored as docnum gaps and dtfs in
+*             variable byte codes, in chunks allocated by ys_allocmem(),
+*             instead of parallel arrays of docnums and dtfs.
+*    17-10-26 Added -a to add documents to an existing collection. The
+*             new documents are indexed into a new segment (see 
+*             segment.h), which is listed in yase.seg once its btree has
+*             been built.
+*    17-10-26 The btree is bulk loaded by the final merge as terms are
+*             written, instead of by reading yase.words back afterwards.
+*             ys_mkdb_create_btree() is replaced by ys_mkdb_verify_btree(),
+*             which is only run with -v. Added -F to set the fill factor.
+*    17-10-26 The final merge also writes a term dictionary (termdict.h).
+*    17-10-26 Added -P to record the positions of terms in documents
+*             (positions.h), in tmp.<id>.positions for each run and in
+*             the positions file of the segment.
+*
 * NOTE: Twice suffered from a bug in fclose() - if you do fclose() on
 * an already closed file, it screws up the memory allocation system
 * totally - and you get a segmentation fault sometime later in malloc()
@@ -74,7 +108,7 @@
 
 #include "yase.h"
 #include "makedb.h"
-#include "avl3.h"
+#include "alloc.h"
 #include "getword.h"
 #include "locator.h"
 #include "docdb.h"
@@ -87,28 +121,72 @@
 #include "version.h"
 #include "collection.h"
 #include "docweights.h"
+#include "ysthread.h"
+#include "segment.h"
+#include "termdict.h"
+#include "positions.h"
 
 #include "getopt.h"
 
 /**
- * When building the index, terms are read and stored in a binary tree.
- * I chose to use binary tree instead of hash table because it allows
- * me to skip the sorting. Each term is stored in a structure. The
- * documents it appeared in is stored in an array. A parallel array is
- * used to store the frequency of the term in each document. A count is
- * kept of the total number of documents the term has appeared in.
+ * Postings held in memory are stored as pairs of variable byte codes
+ * (docnum gap, dtf) in a list of chunks; positions, if recorded, in
+ * a second list, coded as in the positions file. Chunks start small and double
+ * in size up to YS_CHUNK_MAXSIZE, so that rare terms waste little space.
+ * They are allocated with ys_allocmem(), from the fixed size allocators,
+ * and so are counted in Maxmem.
+ */
+enum {
+	YS_CHUNK_MINSIZE = 32,
+	YS_CHUNK_MAXSIZE = 512
+};
+
+typedef struct posting_chunk_t {
+	struct posting_chunk_t *next;
+	unsigned int size;		/* including this header */
+	unsigned int used;		/* bytes of data used */
+} posting_chunk_t;
+
+/**
+ * When building the index, terms are read and stored in a hash table
+ * (see word_table_t below). Each term is stored in a structure. The
+ * documents it appeared in are stored in chunks of posting codes.
+ * The last document is kept aside until the next one is added, as its
+ * dtf may still change. A count is kept of the total number of
+ * documents the term has appeared in.
  */
 typedef struct {
 	ys_uchar_t *word;			/* term */
-	ys_docnum_t *doclist;		/* document array */
-	ys_doccnt_t *dtflist;		/* document term frequency (dtf) array */
+	unsigned int hash;			/* of word */
+	posting_chunk_t *first;		/* encoded postings */
+	posting_chunk_t *last;
+	ys_docnum_t prevdoc;		/* last document encoded */
 	ys_docnum_t lastdoc;		/* last document this term appeared
 					 */
+	ys_doccnt_t lastdtf;		/* dtf in lastdoc */
 	ys_doccnt_t tf;			/* total number of documents this
 					 * term appears in.
 					 */
+	posting_chunk_t *pfirst;	/* encoded positions */
+	posting_chunk_t *plast;
+	ys_docpos_t lastpos;		/* last position in lastdoc */
 } word_t;
 
+/**
+ * Open addressing (linear probing) hash table of terms. Terms are
+ * stored in String_allocator, and word_t structures in their own
+ * allocator. A binary tree kept the terms in order, but cost a string
+ * comparison per level for every token; the table is only sorted when
+ * the terms are written out, after which it must be reset before use.
+ */
+typedef struct {
+	word_t **slots;
+	size_t nslots;			/* power of 2 */
+	size_t count;
+	ys_allocator_t *allocator;	/* word_t structures */
+	bool sorted;			/* slots[0..count) hold sorted terms */
+} word_table_t;
+
 typedef struct {
 	ys_doccnt_t maxtf;		
 	ys_doccnt_t maxdtf;		/* Max dtf amongst all documents */
@@ -120,16 +198,51 @@ typedef struct {
 	ys_uchar_t maxword[256];	/* most popular word */
 	unsigned long maxmem;		/* maximum memory used */
 	unsigned long totaldocs;	/* total number of documents */
+	unsigned long ntokens;		/* tokens indexed */
 } statistics_t;
 
+enum {
+	YS_MERGE_FANIN = 64,		/* runs merged at a time */
+	YS_MERGE_READBUF = 128*1024,	/* stdio buffer of each run read */
+	YS_MERGE_WRITEBUF = 1024*1024	/* stdio buffer of merge output */
+};
+
+/**
+ * A sorted run flushed from the word table, in tmp.<id>.words and
+ * tmp.<id>.postings, and tmp.<id>.positions with -P. Each run covers
+ * the documents indexed since the previous one, so the runs are in
+ * document number order.
+ */
+typedef struct {
+	int id;
+	unsigned long nterms;
+	unsigned long npostings;
+	unsigned long nbytes;		/* size of the files */
+} merge_run_t;
+
 typedef struct {
-	ys_file_t *prev_words_file;	
-	YASENS PostFile *prev_postings_file;
 	ys_file_t *current_words_file;
 	YASENS PostFile *current_postings_file;
+	ys_file_t *current_positions_file;	/* 0 without -P */
+	ys_filepos_t positions_offset;	/* its size so far */
 	ys_uchar_t prev_word[256];
 	char dbpath[1024];
 	size_t memlimit;
+	merge_run_t *runs;		/* runs not yet merged, oldest first */
+	int nruns;
+	int runsalloc;
+	int nextid;			/* id of the next run */
+	unsigned long runswritten;	/* including intermediate merges */
+	/* Postings for the current term are gathered here. These are
+	 * not counted in Maxmem as they are reused across merge runs. 
+	 */
+	ys_docnum_t *docnums;
+	ys_doccnt_t *dtfs;
+	size_t nalloc;
+	ys_docpos_t *positions;		/* and its positions */
+	size_t posalloc;
+	ys_btree_loader_t *loader;	/* btree of the final merge */
+	ys_termdict_writer_t *dict;	/* and its term dictionary */
 } mergedata_t;
 
 typedef struct {
@@ -140,26 +253,50 @@ typedef struct {
 	ys_filepos_t posting_offset;
 } rec_t;
 
+/**
+ * One of the inputs to a merge: a run, or the word table.
+ */
+typedef struct {
+	merge_run_t *run;		/* null for the word table */
+	ys_file_t *words_file;
+	YASENS PostFile *postings_file;
+	ys_file_t *positions_file;	/* 0 without -P */
+	rec_t rec;			/* current term of a run */
+	word_t *w;			/* current term of the word table */
+	size_t next;			/* index of the next term in the table */
+	const ys_uchar_t *word;		/* current term, null at the end */
+} merge_input_t;
+
+typedef struct ys_parse_pipeline_t ys_parse_pipeline_t;
+
 struct ys_mkdb_t {
 	char *rootpath;
 	const char *dbpath;
 	ys_bool_t stem;
 	mergedata_t mergedata;
 	statistics_t statistics;
-	AVLTree *wordtree;
+	word_table_t words;
 	ys_docdb_t *docfile;
 	ys_list_t *wget_opts;
 	bool skipBinaryFiles;
+	int postings_format;
+	int segment;			/* id of the segment being written */
+	int btree_fill;			/* fill factor of btree blocks */
+	ys_parse_pipeline_t *pipeline;	/* null if parsing in main thread */
+	ys_docpos_t nextpos;		/* position of the next word */
 };
 
-static void ys_add_to_doclist(word_t *w, ys_docnum_t docnum);
-static int ys_compare_word(void *key, void *object);
-static void ys_create_word(void *object, void *key);
-static int ys_comp( rec_t *r, word_t *w );
-static int ys_calc_prefixlen(ys_uchar_t *s1, ys_uchar_t *s2);
-static int ys_write_rec( ys_mkdb_t *, rec_t *r, word_t *w );
-static int ys_write_word( ys_mkdb_t *, word_t *w );
-static rec_t * ys_get_record(ys_file_t *fp);
+static void ys_add_to_doclist(word_t *w, ys_docnum_t docnum, ys_doccnt_t dtf,
+	const ys_docpos_t *positions);
+static void ys_get_doclist(word_t *w, ys_docnum_t *docnums, ys_doccnt_t *dtfs);
+static void ys_get_positions(word_t *w, ys_docpos_t *positions, 
+	const ys_doccnt_t *dtfs);
+static int ys_calc_prefixlen(const ys_uchar_t *s1, const ys_uchar_t *s2);
+static int ys_reserve_postings( ys_mkdb_t *, size_t n );
+static int ys_write_term( ys_mkdb_t *, const ys_uchar_t *word, 
+	const ys_docnum_t *docnums, const ys_doccnt_t *dtfs, ys_doccnt_t tf,
+	const ys_docpos_t *positions, int final );
+static int ys_get_record(ys_file_t *fp, rec_t *r);
 static int ys_merge(ys_mkdb_t *, int final);
 static int ys_extract_words(ys_mkdb_t *arg, const char *logicalname, const char *name);
 static void ys_add_wget_option( ys_list_t * list, const char *option, 
@@ -169,68 +306,318 @@ static void ys_print_yase_help(void);
 static void ys_print_yase_version(void);
 static void ys_print_wget_help (void);
 static int ys_index_word(ys_mkdb_t *mkdb, ys_uchar_t *word, ys_docnum_t docnum);
+static int ys_index_term(ys_mkdb_t *mkdb, const ys_uchar_t *term, 
+	ys_docnum_t docnum, ys_doccnt_t dtf, const ys_docpos_t *positions);
+static void ys_end_file(ys_mkdb_t *mkdb);
 
 
-static AVL_vtbl vtab = { ys_compare_word, ys_create_word, 0, 0 };
 static ys_allocator_t *String_allocator;
 
+/**
+ * Appends a variable byte code to a list of chunks, adding a chunk
+ * when the last one is full.
+ */
+static void
+ys_put_code(posting_chunk_t **first, posting_chunk_t **last, 
+	ys_uintmax_t value)
+{
+	do {
+		posting_chunk_t *c = *last;
+		if (c == 0 || sizeof *c + c->used == c->size) {
+			unsigned int size = c == 0 ? YS_CHUNK_MINSIZE : c->size*2;
+			if (size > YS_CHUNK_MAXSIZE)
+				size = YS_CHUNK_MAXSIZE;
+			c = (posting_chunk_t *) ys_allocmem(size);
+			c->next = 0;
+			c->size = size;
+			c->used = 0;
+			if (*last == 0)
+				*first = c;
+			else
+				(*last)->next = c;
+			*last = c;
+		}
+		ys_uchar_t *data = (ys_uchar_t *)(c+1);
+		data[c->used++] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+		value >>= 7;
+	} while (value > 0);
+}
+
 /**
  * For each term a list of documents (the term appears in) is maintained.
- * This function adds a new document to the list, or increments the
- * document-term frequency if the document has already been added.
+ * This function adds a new document to the list, or increases the
+ * document-term frequency by dtf if the document has already been added.
+ * positions, if not null, holds the dtf new positions of the term.
  */
 static void 
-ys_add_to_doclist(word_t *w, ys_docnum_t docnum)
+ys_add_to_doclist(word_t *w, ys_docnum_t docnum, ys_doccnt_t dtf,
+	const ys_docpos_t *positions)
 {
-	if (w->lastdoc == docnum) {
+	if (w->tf > 0 && w->lastdoc == docnum) {
 		/* Document already added, so increment document term frequency. */
-		w->dtflist[w->tf-1]++;
-		return;
+		w->lastdtf += dtf;
+	}
+	else {
+		/* New document - the previous one can now be encoded */
+		if (w->tf > 0) {
+			ys_put_code(&w->first, &w->last, w->lastdoc - w->prevdoc);
+			ys_put_code(&w->first, &w->last, w->lastdtf);
+			w->prevdoc = w->lastdoc;
+		}
+		w->lastdoc = docnum;
+		w->lastdtf = dtf;
+		w->lastpos = 0;
+		w->tf++;				/* Increment TF */
+	}
+	if (positions != 0) {
+		for (ys_doccnt_t i = 0; i < dtf; i++) {
+			ys_put_code(&w->pfirst, &w->plast, positions[i] - w->lastpos);
+			w->lastpos = positions[i];
+		}
 	}
-	/* New document - add it */
-	w->doclist = (ys_docnum_t *) ys_reallocmem(w->doclist, w->tf*sizeof docnum, 
-		(w->tf+1)*sizeof docnum);
-	w->dtflist = (ys_doccnt_t *) ys_reallocmem(w->dtflist, w->tf*sizeof docnum, 
-		(w->tf+1)*sizeof docnum);
-	w->dtflist[w->tf] = 1;		/* Set DTF to 1 */
-	w->lastdoc = docnum;
-	w->doclist[w->tf] = docnum;
-	w->tf++;				/* Increment TF */
 }
 
-static int 
-ys_compare_word(void *key, void *object)
+/**
+ * Decodes the term's postings into docnums and dtfs, which must have
+ * room for tf entries. The chunks are not freed, as they are released
+ * together by ys_destroyallmem().
+ */
+static void
+ys_get_doclist(word_t *w, ys_docnum_t *docnums, ys_doccnt_t *dtfs)
 {
-	word_t *w = (word_t*) object;
-	return strcmp((const char *)key, (const char *)w->word);
+	posting_chunk_t *c;
+	ys_docnum_t docnum = 0;
+	ys_uintmax_t value = 0;
+	int shift = 0;
+	bool isdtf = false;
+	size_t n = 0, i;
+
+	for (c = w->first; c != 0; c = c->next) {
+		const ys_uchar_t *data = (const ys_uchar_t *)(c+1);
+		for (i = 0; i < c->used; i++) {
+			value |= (ys_uintmax_t)(data[i] & 0x7f) << shift;
+			if (data[i] & 0x80) {
+				shift += 7;
+				continue;
+			}
+			if (isdtf)
+				dtfs[n++] = value;
+			else
+				docnums[n] = docnum += value;
+			isdtf = !isdtf;
+			value = 0;
+			shift = 0;
+		}
+	}
+	assert(n == w->tf-1);
+	docnums[n] = w->lastdoc;
+	dtfs[n] = w->lastdtf;
 }
 
 /**
- * Initializes a new term that has just been added to the binary tree.
+ * Decodes the term's positions, given the dtfs from ys_get_doclist().
  */
-static 
-void ys_create_word(void *object, void *key)
+static void
+ys_get_positions(word_t *w, ys_docpos_t *positions, const ys_doccnt_t *dtfs)
+{
+	posting_chunk_t *c;
+	ys_uintmax_t value = 0;
+	ys_docpos_t pos = 0;
+	ys_doccnt_t left = dtfs[0];	/* positions left in the document */
+	int shift = 0;
+	size_t n = 0, doc = 0, i;
+
+	for (c = w->pfirst; c != 0; c = c->next) {
+		const ys_uchar_t *data = (const ys_uchar_t *)(c+1);
+		for (i = 0; i < c->used; i++) {
+			value |= (ys_uintmax_t)(data[i] & 0x7f) << shift;
+			if (data[i] & 0x80) {
+				shift += 7;
+				continue;
+			}
+			if (left == 0) {
+				left = dtfs[++doc];
+				pos = 0;
+			}
+			positions[n++] = pos += value;
+			left--;
+			value = 0;
+			shift = 0;
+		}
+	}
+	assert(doc == w->tf-1 && left == 0);
+}
+
+enum {
+	YS_WORD_TABLE_SIZE = 16*1024	/* initial number of slots */
+};
+
+/**
+ * FNV-1a hash.
+ */
+static inline unsigned int
+ys_hash_word(const ys_uchar_t *word)
+{
+	unsigned int h = 2166136261U;
+	while (*word) {
+		h ^= *word++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void
+ys_wordtable_init(word_table_t *t)
 {
-	word_t *w = (word_t*) object;
-	w->word = (ys_uchar_t *) ys_allocate(String_allocator, strlen((const char *)key)+1); 
-	strcpy((char *)w->word, (const char *)key);
-	w->doclist = 0;
-	w->dtflist = 0;
-	w->lastdoc = ~0;
+	t->nslots = YS_WORD_TABLE_SIZE;
+	t->slots = (word_t **) ys_allocmem(t->nslots * sizeof *t->slots);
+	memset(t->slots, 0, t->nslots * sizeof *t->slots);
+	t->count = 0;
+	t->allocator = ys_new_allocator(sizeof(word_t), 100);
+	t->sorted = false;
+}
+
+/**
+ * Frees the table. The terms and their postings must be freed
+ * separately.
+ */
+static void
+ys_wordtable_destroy(word_table_t *t)
+{
+	ys_freemem(t->slots, t->nslots * sizeof *t->slots);
+	ys_destroy_allocator(t->allocator);
+	t->slots = 0;
+	t->count = 0;
+}
+
+static void
+ys_wordtable_grow(word_table_t *t)
+{
+	size_t nslots = t->nslots * 2;
+	word_t **slots = (word_t **) ys_allocmem(nslots * sizeof *slots);
+	size_t i;
+
+	memset(slots, 0, nslots * sizeof *slots);
+	for (i = 0; i < t->nslots; i++) {
+		word_t *w = t->slots[i];
+		if (w != 0) {
+			size_t j = w->hash & (nslots-1);
+			while (slots[j] != 0)
+				j = (j+1) & (nslots-1);
+			slots[j] = w;
+		}
+	}
+	ys_freemem(t->slots, t->nslots * sizeof *t->slots);
+	t->slots = slots;
+	t->nslots = nslots;
+}
+
+/**
+ * Finds a term, adding it if it is not in the table.
+ */
+static word_t *
+ys_wordtable_insert(word_table_t *t, const ys_uchar_t *word)
+{
+	unsigned int h = ys_hash_word(word);
+	size_t i = h & (t->nslots-1);
+	word_t *w;
+
+	assert(!t->sorted);
+	while ((w = t->slots[i]) != 0) {
+		if (w->hash == h && strcmp((const char *)w->word, 
+			(const char *)word) == 0)
+			return w;
+		i = (i+1) & (t->nslots-1);
+	}
+	w = (word_t *) ys_allocate(t->allocator, 0);
+	w->word = (ys_uchar_t *) ys_allocate(String_allocator, 
+		strlen((const char *)word)+1); 
+	strcpy((char *)w->word, (const char *)word);
+	w->hash = h;
+	w->first = 0;
+	w->last = 0;
+	w->prevdoc = 0;
+	w->lastdoc = 0;
+	w->lastdtf = 0;
 	w->tf = 0;
+	w->pfirst = 0;
+	w->plast = 0;
+	w->lastpos = 0;
+	t->slots[i] = w;
+	if (++t->count * 2 > t->nslots)
+		ys_wordtable_grow(t);
+	return w;
 }
 
-static int 
-ys_comp( rec_t *r, word_t *w )
+static inline void
+ys_swap_words(word_t **a, size_t i, size_t j)
 {
-	return strcmp( (const char *)r->word, (const char *)w->word );
+	word_t *t = a[i];
+	a[i] = a[j];
+	a[j] = t;
+}
+
+/**
+ * Multikey quicksort (Bentley and Sedgewick). The terms in a[0..n)
+ * are known to share their first d characters.
+ */
+static void
+ys_sort_words(word_t **a, size_t n, size_t d)
+{
+	while (n > 1) {
+		if (n < 16) {
+			size_t i, j;
+			for (i = 1; i < n; i++) {
+				for (j = i; j > 0 && strcmp(
+					(const char *)a[j-1]->word+d, 
+					(const char *)a[j]->word+d) > 0; j--)
+					ys_swap_words(a, j-1, j);
+			}
+			return;
+		}
+		int v = a[n/2]->word[d];
+		size_t lt = 0, i = 0, gt = n;
+		while (i < gt) {
+			int c = a[i]->word[d];
+			if (c < v)
+				ys_swap_words(a, lt++, i++);
+			else if (c > v)
+				ys_swap_words(a, i, --gt);
+			else
+				i++;
+		}
+		ys_sort_words(a, lt, d);
+		if (v != 0)
+			ys_sort_words(a+lt, gt-lt, d+1);
+		a += gt;
+		n -= gt;
+	}
+}
+
+/**
+ * Moves the terms to the front of the table and sorts them.
+ */
+static void
+ys_wordtable_sort(word_table_t *t)
+{
+	size_t i, n = 0;
+
+	if (t->sorted)
+		return;
+	for (i = 0; i < t->nslots; i++) {
+		if (t->slots[i] != 0)
+			t->slots[n++] = t->slots[i];
+	}
+	assert(n == t->count);
+	ys_sort_words(t->slots, n, 0);
+	t->sorted = true;
 }
 
 /**
  * Calculates the size of the common prefix in two strings.
  */
 static int 
-ys_calc_prefixlen(ys_uchar_t *s1, ys_uchar_t *s2)
+ys_calc_prefixlen(const ys_uchar_t *s1, const ys_uchar_t *s2)
 {
 	size_t n = 0;
 	while (*s1 && *s1++ == *s2++)
@@ -239,129 +626,126 @@ ys_calc_prefixlen(ys_uchar_t *s1, ys_uchar_t *s2)
 }
 
 /**
- * During a merge run, the data from temporary files is merged with
- * data in the binary tree. When a term appears in both the temporary files
- * and in the tree, this function is called to write out a merged version.
- * It is also called in case the term only appears in the temporary files.
- * The term, and its document list is written out.
+ * Makes sure the merge buffers can hold n postings.
  */
-static int 
-ys_write_rec( ys_mkdb_t *mkdb, rec_t *r, word_t *w )
+static int
+ys_reserve_postings( ys_mkdb_t *mkdb, size_t n )
 {
-	int prefixlen, wordlen;
-	ys_doccnt_t tf, prev_tf;
-	ys_docnum_t docnum;
-	ys_doccnt_t dtf;
-	int i;
-	ys_docnum_t n, d;
-	ys_filepos_t pos;
-
-	/* First write out the term */
-	prefixlen = ys_calc_prefixlen(r->word, mkdb->mergedata.prev_word);
-	wordlen = strlen((const char *)r->word)-prefixlen;
-	ys_file_putc(prefixlen, mkdb->mergedata.current_words_file);
-	ys_file_putc(wordlen, mkdb->mergedata.current_words_file);
-	ys_file_write(r->word+prefixlen, 1, wordlen, mkdb->mergedata.current_words_file);
-
-	/* Now write the document list to the postings file */
-	tf = r->tf;
-	if ( w )
-		tf += w->tf;
-	pos = mkdb->mergedata.current_postings_file->get_ppos();
-	ys_file_write( &pos, 1, sizeof pos, mkdb->mergedata.current_words_file );
-	ys_file_write( &tf, 1, sizeof tf, mkdb->mergedata.current_words_file );
-#if _DUMP_MERGE
-	printf("%s:tf(%lu):pos(%lu):", r->word, tf, pos);
-#endif
-	if (tf > mkdb->statistics.maxtf) {
-		mkdb->statistics.maxtf = tf;
-		memcpy(mkdb->statistics.maxword, r->word, sizeof mkdb->statistics.maxword);
-	}
-	mkdb->mergedata.prev_postings_file->set_gpos(r->posting_offset);
-	prev_tf = mkdb->mergedata.prev_postings_file->read_doccnt();
-	assert(prev_tf == r->tf);
-	mkdb->mergedata.current_postings_file->write_doccnt(tf);
-
-	for (i = 0, n = 0; i < r->tf; i++) {
-		docnum = mkdb->mergedata.prev_postings_file->read_docnum();
-		dtf = mkdb->mergedata.prev_postings_file->read_doccnt();
-		d = docnum;
-		n += docnum;
-#if _DUMP_MERGE
-		printf("<%lu,%lu>:", n, dtf);
-#endif
-		mkdb->mergedata.current_postings_file->write_docnum(d);
-		mkdb->mergedata.current_postings_file->write_doccnt(dtf);
-		if (dtf > mkdb->statistics.maxdtf) {
-			mkdb->statistics.maxdtf = dtf;
-		}
-	}	
-	if ( w ) {
-		for (i = 0; i < w->tf; i++) {
-#if _DUMP_MERGE
-			printf("<%lu,%lu>:", w->doclist[i], w->dtflist[i]);
-#endif
-			d = w->doclist[i]-n;
-			n = w->doclist[i];
-			mkdb->mergedata.current_postings_file->write_docnum(d);
-			mkdb->mergedata.current_postings_file->write_doccnt(w->dtflist[i]);
-			if (w->dtflist[i] > mkdb->statistics.maxdtf) {
-				mkdb->statistics.maxdtf = w->dtflist[i];
-			}
-		}
+	mergedata_t *md = &mkdb->mergedata;
+	if (n <= md->nalloc)
+		return 0;
+	size_t nalloc = md->nalloc == 0 ? 1024 : md->nalloc;
+	while (nalloc < n)
+		nalloc *= 2;
+	ys_docnum_t *docnums = (ys_docnum_t *) realloc(md->docnums, 
+		nalloc * sizeof *docnums);
+	if (docnums == 0) {
+		perror("realloc");
+		return -1;
 	}
-	mkdb->mergedata.current_postings_file->flush();
-	memcpy(mkdb->mergedata.prev_word, r->word, sizeof mkdb->mergedata.prev_word);
-#if _DUMP_MERGE
-	printf("\n");
-#endif
+	md->docnums = docnums;
+	ys_doccnt_t *dtfs = (ys_doccnt_t *) realloc(md->dtfs, 
+		nalloc * sizeof *dtfs);
+	if (dtfs == 0) {
+		perror("realloc");
+		return -1;
+	}
+	md->dtfs = dtfs;
+	md->nalloc = nalloc;
 	return 0;
 }
 
+static size_t
+ys_sum_dtfs( const ys_doccnt_t *dtfs, ys_doccnt_t n )
+{
+	size_t sum = 0;
+	for (ys_doccnt_t i = 0; i < n; i++)
+		sum += dtfs[i];
+	return sum;
+}
+
 /**
- * This function writes out a term and its asociated document list to the
- * files used during merging.
+ * Makes sure the merge buffers can hold n positions.
+ */
+static int
+ys_reserve_positions( ys_mkdb_t *mkdb, size_t n )
+{
+	mergedata_t *md = &mkdb->mergedata;
+	if (n <= md->posalloc)
+		return 0;
+	size_t posalloc = md->posalloc == 0 ? 4096 : md->posalloc;
+	while (posalloc < n)
+		posalloc *= 2;
+	ys_docpos_t *positions = (ys_docpos_t *) realloc(md->positions, 
+		posalloc * sizeof *positions);
+	if (positions == 0) {
+		perror("realloc");
+		return -1;
+	}
+	md->positions = positions;
+	md->posalloc = posalloc;
+	return 0;
+}
+
+/**
+ * Writes out a term and its document list to the current output files.
+ * positions holds the term's positions in each document in turn, if 
+ * they are recorded. Collection statistics are only gathered in the 
+ * final merge, when the document list is complete; the term is then 
+ * also added to the btree and the term dictionary.
  */
 static int 
-ys_write_word( ys_mkdb_t *mkdb, word_t *w )
+ys_write_term( ys_mkdb_t *mkdb, const ys_uchar_t *word, 
+	const ys_docnum_t *docnums, const ys_doccnt_t *dtfs, ys_doccnt_t tf,
+	const ys_docpos_t *positions, int final )
 {
+	mergedata_t *md = &mkdb->mergedata;
 	int prefixlen, wordlen;
-	ys_doccnt_t tf;
-	int i;
-	ys_docnum_t n, d;
-	ys_filepos_t pos;
-
-	prefixlen = ys_calc_prefixlen(w->word, mkdb->mergedata.prev_word);
-	wordlen = strlen((const char *)w->word)-prefixlen;
-	ys_file_putc(prefixlen, mkdb->mergedata.current_words_file);
-	ys_file_putc(wordlen, mkdb->mergedata.current_words_file);
-	ys_file_write(w->word+prefixlen, 1, wordlen, mkdb->mergedata.current_words_file);
-	tf = w->tf;
-	pos = mkdb->mergedata.current_postings_file->get_ppos();
-	ys_file_write( &pos, 1, sizeof pos, mkdb->mergedata.current_words_file );
-	ys_file_write( &tf, 1, sizeof tf, mkdb->mergedata.current_words_file );
+	ys_doccnt_t i;
+	ys_filepos_t pos, posoffset = md->positions_offset;
+
+	prefixlen = ys_calc_prefixlen(word, md->prev_word);
+	wordlen = strlen((const char *)word)-prefixlen;
+	ys_file_putc(prefixlen, md->current_words_file);
+	ys_file_putc(wordlen, md->current_words_file);
+	ys_file_write(word+prefixlen, 1, wordlen, md->current_words_file);
+	pos = md->current_postings_file->get_ppos();
+	ys_file_write( &pos, 1, sizeof pos, md->current_words_file );
+	ys_file_write( &tf, 1, sizeof tf, md->current_words_file );
 #if _DUMP_MERGE
-	printf("%s:tf(%lu):pos(%lu):", w->word, tf, pos);
+	printf("%s:tf(%lu):pos(%lu):", word, tf, pos);
 #endif
-	if (tf > mkdb->statistics.maxtf) {
-		mkdb->statistics.maxtf = tf;
-		memcpy(mkdb->statistics.maxword, w->word, sizeof mkdb->statistics.maxword);
-	}
-	mkdb->mergedata.current_postings_file->write_doccnt(tf);
-	for (n = 0, i = 0; i < w->tf; i++) {
+	if (final) {
+		if (tf > mkdb->statistics.maxtf) {
+			mkdb->statistics.maxtf = tf;
+			strncpy((char *)mkdb->statistics.maxword, 
+				(const char *)word, 
+				sizeof mkdb->statistics.maxword);
+		}
+		for (i = 0; i < tf; i++) {
 #if _DUMP_MERGE
-		printf("<%lu,%lu>:", w->doclist[i], w->dtflist[i]);
+			printf("<%lu,%lu>:", docnums[i], dtfs[i]);
 #endif
-		d = w->doclist[i]-n;
-		n = w->doclist[i];
-		mkdb->mergedata.current_postings_file->write_docnum(d);
-		mkdb->mergedata.current_postings_file->write_doccnt(w->dtflist[i]);
-		if (w->dtflist[i] > mkdb->statistics.maxdtf) {
-			mkdb->statistics.maxdtf = w->dtflist[i];
+			if (dtfs[i] > mkdb->statistics.maxdtf) {
+				mkdb->statistics.maxdtf = dtfs[i];
+			}
 		}
 	}
-	mkdb->mergedata.current_postings_file->flush();
-	memcpy(mkdb->mergedata.prev_word, w->word, sizeof mkdb->mergedata.prev_word);
+	if (md->current_positions_file != 0) {
+		for (i = 0; i < tf; positions += dtfs[i++])
+			md->positions_offset += ys_positions_write(
+				md->current_positions_file, positions, dtfs[i]);
+	}
+	md->current_postings_file->write_postings(docnums, dtfs, tf, posoffset);
+	strncpy((char *)md->prev_word, (const char *)word, sizeof md->prev_word);
+	if (final) {
+		ys_uchar_t key[YS_TERM_LEN+1];
+		key[0] = (ys_uchar_t) strlen((const char *)word);
+		memcpy(key+1, word, key[0]);
+		if (ys_btree_load_add(md->loader, key, pos, tf) != 0 ||
+			ys_termdict_add(md->dict, key, pos, tf) != 0)
+			return -1;
+	}
 #if _DUMP_MERGE
 	printf("\n");
 #endif
@@ -370,175 +754,510 @@ ys_write_word( ys_mkdb_t *mkdb, word_t *w )
 	 
 /**
  * During merging temporary files are used to store terms and
- * postings. This function reads a term from the terms file.
+ * postings. This function reads the next term from a terms file.
+ * The previous term must still be in r, as terms are prefix
+ * compressed. Returns -1 at the end of the file.
  */
-static rec_t *
-ys_get_record(ys_file_t *fp)
+static int
+ys_get_record(ys_file_t *fp, rec_t *r)
 {
-	static rec_t record;
 	if (fp == NULL || ys_file_eof(fp))
-		return NULL;
-	record.prefix_len = ys_file_getc(fp);
+		return -1;
+	r->prefix_len = ys_file_getc(fp);
 	if (ys_file_eof(fp))
-		return NULL;
-	record.word_len = ys_file_getc(fp);
-	ys_file_read(record.word+record.prefix_len, 1, record.word_len, fp);
-	record.word[record.prefix_len+record.word_len] = 0;
-	ys_file_read(&record.posting_offset, 1, sizeof record.posting_offset, fp);
-	ys_file_read(&record.tf, 1, sizeof record.tf, fp);
-	return &record;
+		return -1;
+	r->word_len = ys_file_getc(fp);
+	ys_file_read(r->word+r->prefix_len, 1, r->word_len, fp);
+	r->word[r->prefix_len+r->word_len] = 0;
+	ys_file_read(&r->posting_offset, 1, sizeof r->posting_offset, fp);
+	ys_file_read(&r->tf, 1, sizeof r->tf, fp);
+	return 0;
 }
 
-/*
-* Merge algorithm.
-* 7 Jan 2000
-* a and b are sorted lists
-* merge(a, b)
-* {
-*	get a;
-*	get b;
-*	while ( a || b ) {
-*		while ( a && (!b || a <= b) ) {
-*			output a;
-*			if ( b && a == b ) {
-*				output b;
-*				get b;
-*			}
-*			get a;
-*		}
-*		if (b) {
-*			output b;
-*			get b;
-*		}
-*	}
-* }
-*/
+static void
+ys_run_filename( ys_mkdb_t *mkdb, int id, const char *type, char *name,
+	size_t size )
+{
+	snprintf(name, size, "%s/tmp.%d.%s", mkdb->mergedata.dbpath, id, type);
+}
+
+static unsigned long
+ys_file_size( const char *name )
+{
+	struct stat statbuf;
+	if (stat(name, &statbuf) != 0)
+		return 0;
+	return (unsigned long) statbuf.st_size;
+}
 
 /**
- * This function implements the high level merging algorithm
- * shown above. The contents of the binary tree is merged with the
- * contents of temporary files (from previous merge run) and 
- * new set of temporary files are created. In the final merge run,
- * the temporary files are renamed, and become the final yase files.
+ * Creates the output files of a flush or merge. Runs are always
+ * written in the v1 format.
  */
-static int 
-ys_merge(ys_mkdb_t *mkdb, int final)
+static int
+ys_open_output( ys_mkdb_t *mkdb, int id, int format )
 {
-	word_t *w;
-	rec_t *r;
-	static int tmp = 1;
+	mergedata_t *md = &mkdb->mergedata;
 	char name[1024];
 
-	extern void ys_xml_release_memory(void); /* TODO: */
+	ys_run_filename(mkdb, id, "words", name, sizeof name);
+	md->current_words_file = ys_file_open(name, "w", YS_FILE_ABORT_ON_ERROR);
+	ys_file_setbuf(md->current_words_file, YS_MERGE_WRITEBUF);
+	ys_run_filename(mkdb, id, "postings", name, sizeof name);
+	md->current_postings_file = new YASENS PostFile();
+	if (md->current_postings_file->open(name, "wb") != 0)
+		return -1;
+	md->current_postings_file->set_buffer_size(YS_MERGE_WRITEBUF);
+	md->current_postings_file->set_format(format);
+	if (mkdb->postings_format & YS_POSTINGS_POSITIONS) {
+		ys_run_filename(mkdb, id, "positions", name, sizeof name);
+		md->current_positions_file = ys_file_open(name, "w", 
+			YS_FILE_ABORT_ON_ERROR);
+		ys_file_setbuf(md->current_positions_file, YS_MERGE_WRITEBUF);
+	}
+	md->positions_offset = 0;
+	md->prev_word[0] = 0;
+	return 0;
+}
 
-	if (Maxmem > mkdb->statistics.maxmem)
-		mkdb->statistics.maxmem = Maxmem;
+/**
+ * Closes the output files, and returns their size.
+ */
+static unsigned long
+ys_close_output( ys_mkdb_t *mkdb, int id )
+{
+	mergedata_t *md = &mkdb->mergedata;
+	char name[1024];
+	unsigned long nbytes;
+
+	delete md->current_postings_file;
+	md->current_postings_file = 0;
+	ys_file_close(md->current_words_file);
+	md->current_words_file = 0;
+	if (md->current_positions_file != 0) {
+		ys_file_close(md->current_positions_file);
+		md->current_positions_file = 0;
+	}
+	ys_run_filename(mkdb, id, "words", name, sizeof name);
+	nbytes = ys_file_size(name);
+	ys_run_filename(mkdb, id, "postings", name, sizeof name);
+	nbytes += ys_file_size(name);
+	ys_run_filename(mkdb, id, "positions", name, sizeof name);
+	nbytes += ys_file_size(name);
+	return nbytes;
+}
 
-	printf("Merge run# %d\n", tmp);
+/**
+ * Frees the word table and all the memory allocated for it, including
+ * the posting chunks.
+ */
+static void
+ys_reset_words( ys_mkdb_t *mkdb )
+{
+	ys_destroy_allocator(String_allocator);
+	ys_wordtable_destroy(&mkdb->words);
+	ys_destroyallmem();
+	/* Parser threads may be holding memory for the HTML parser */
+	assert(Maxmem == 0 || mkdb->pipeline != 0);
+	String_allocator = ys_new_allocator(0, 10);
+	ys_wordtable_init(&mkdb->words);
+}
 
-	snprintf(name, sizeof name, "%s/tmp.%d.words", mkdb->mergedata.dbpath, tmp);
-	mkdb->mergedata.current_words_file = ys_file_open(name, "w+", YS_FILE_ABORT_ON_ERROR);
-	snprintf(name, sizeof name, "%s/tmp.%d.postings", 
-		mkdb->mergedata.dbpath, tmp);
-	mkdb->mergedata.current_postings_file = new YASENS PostFile();
-	mkdb->mergedata.current_postings_file->open(name, "wb+");
+static merge_run_t *
+ys_add_run( ys_mkdb_t *mkdb, int pos, int id )
+{
+	mergedata_t *md = &mkdb->mergedata;
+
+	if (md->nruns == md->runsalloc) {
+		int n = md->runsalloc == 0 ? 16 : md->runsalloc * 2;
+		merge_run_t *runs = (merge_run_t *) realloc(md->runs, 
+			n * sizeof *runs);
+		if (runs == 0) {
+			perror("realloc");
+			return 0;
+		}
+		md->runs = runs;
+		md->runsalloc = n;
+	}
+	memmove(md->runs+pos+1, md->runs+pos, 
+		(md->nruns-pos) * sizeof *md->runs);
+	md->nruns++;
+	memset(&md->runs[pos], 0, sizeof md->runs[pos]);
+	md->runs[pos].id = id;
+	return &md->runs[pos];
+}
 
-	assert(mkdb->mergedata.current_words_file != 0);
-	assert(mkdb->mergedata.current_postings_file != 0);
+/**
+ * Writes the word table out as a new sorted run.
+ */
+static int
+ys_flush_run( ys_mkdb_t *mkdb )
+{
+	word_table_t *t = &mkdb->words;
+	mergedata_t *md = &mkdb->mergedata;
+	merge_run_t *run;
+	size_t i;
+
+	run = ys_add_run(mkdb, mkdb->mergedata.nruns, 
+		mkdb->mergedata.nextid++);
+	if (run == 0 || ys_open_output(mkdb, run->id, YS_POSTINGS_V1) != 0)
+		return -1;
+	ys_wordtable_sort(t);
+	for (i = 0; i < t->count; i++) {
+		word_t *w = t->slots[i];
+		if (ys_reserve_postings(mkdb, w->tf) != 0)
+			return -1;
+		ys_get_doclist(w, md->docnums, md->dtfs);
+		if (w->pfirst != 0) {
+			if (ys_reserve_positions(mkdb, ys_sum_dtfs(md->dtfs, 
+				w->tf)) != 0)
+				return -1;
+			ys_get_positions(w, md->positions, md->dtfs);
+		}
+		ys_write_term(mkdb, w->word, md->docnums, md->dtfs, w->tf, 
+			md->positions, 0);
+		run->nterms++;
+		run->npostings += w->tf;
+	}
+	run->nbytes = ys_close_output(mkdb, run->id);
+	mkdb->mergedata.runswritten++;
+	printf("Run %d: %lu terms, %lu postings, %luK written\n", run->id,
+		run->nterms, run->npostings, run->nbytes/1024);
+	ys_reset_words(mkdb);
+	return 0;
+}
 
-	if (mkdb->mergedata.prev_words_file != 0) {
-		ys_file_rewind(mkdb->mergedata.prev_words_file);
+/**
+ * Moves the input on to its next term.
+ */
+static void
+ys_next_input( ys_mkdb_t *mkdb, merge_input_t *in )
+{
+	if (in->run != 0) {
+		if (ys_get_record(in->words_file, &in->rec) == 0)
+			in->word = in->rec.word;
+		else
+			in->word = 0;
+	}
+	else {
+		word_table_t *t = &mkdb->words;
+		in->w = in->next < t->count ? t->slots[in->next++] : 0;
+		in->word = in->w != 0 ? in->w->word : 0;
 	}
+}
 
-	mkdb->mergedata.prev_word[0] = 0;
-	r = ys_get_record(mkdb->mergedata.prev_words_file);	
-	w = (word_t *) AVLTree_FindFirst(mkdb->wordtree); 
+/**
+ * Heap order: by term, then by input so that document lists are
+ * joined in document number order.
+ */
+static inline bool
+ys_input_before( merge_input_t *a, merge_input_t *b )
+{
+	int rc = strcmp((const char *)a->word, (const char *)b->word);
+	return rc < 0 || (rc == 0 && a < b);
+}
+
+static void
+ys_sift_down( merge_input_t **heap, int n, int i )
+{
+	for (;;) {
+		int least = i, l = 2*i+1, r = 2*i+2;
+		if (l < n && ys_input_before(heap[l], heap[least]))
+			least = l;
+		if (r < n && ys_input_before(heap[r], heap[least]))
+			least = r;
+		if (least == i)
+			break;
+		merge_input_t *t = heap[i];
+		heap[i] = heap[least];
+		heap[least] = t;
+		i = least;
+	}
+}
 
-	while ( r || w ) {
-		while ( r && ( !w || ys_comp(r, w) <= 0 ) ) {
-			if ( w && ys_comp(r, w) == 0 ) {
-				ys_write_rec(mkdb, r, w);
-				ys_freemem(w->doclist, 
-					w->tf * sizeof w->doclist[0]);
-				ys_freemem(w->dtflist, 
-					w->tf * sizeof w->dtflist[0]);
-				w = (word_t *) AVLTree_FindNext(mkdb->wordtree,w);
+/**
+ * Merges n inputs, oldest first, into the current output files. Terms
+ * are taken from a heap of the inputs; the document lists of all the
+ * inputs holding the smallest term are joined and written out.
+ */
+static int
+ys_merge_inputs( ys_mkdb_t *mkdb, merge_input_t *inputs, int n, int final,
+	unsigned long *nterms, unsigned long *npostings )
+{
+	mergedata_t *md = &mkdb->mergedata;
+	merge_input_t **heap;
+	ys_uchar_t word[256];
+	int i, nheap = 0;
+
+	heap = (merge_input_t **) calloc(n, sizeof *heap);
+	if (heap == 0) {
+		perror("calloc");
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		ys_next_input(mkdb, &inputs[i]);
+		if (inputs[i].word != 0)
+			heap[nheap++] = &inputs[i];
+	}
+	for (i = nheap/2 - 1; i >= 0; i--)
+		ys_sift_down(heap, nheap, i);
+
+	while (nheap > 0) {
+		ys_doccnt_t tf = 0;
+		size_t npos = 0;
+		strncpy((char *)word, (const char *)heap[0]->word, sizeof word);
+		do {
+			merge_input_t *in = heap[0];
+			ys_doccnt_t in_tf = in->run != 0 ? in->rec.tf : in->w->tf;
+			if (ys_reserve_postings(mkdb, tf + in_tf) != 0) {
+				free(heap);
+				return -1;
 			}
-			else {
-				ys_write_rec(mkdb, r, 0);
+			if (in->run != 0) {
+				in->postings_file->set_gpos(in->rec.posting_offset);
+				ys_doccnt_t run_tf = in->postings_file->read_doccnt();
+				assert(run_tf == in->rec.tf);
+				in->postings_file->read_postings(md->docnums+tf, 
+					md->dtfs+tf, run_tf, 0);
 			}
-			r = ys_get_record(mkdb->mergedata.prev_words_file);
-		}
-		if ( w ) {
-			ys_write_word(mkdb, w);
-			ys_freemem(w->doclist, 
-				w->tf * sizeof w->doclist[0]);
-			ys_freemem(w->dtflist, 
-				w->tf * sizeof w->dtflist[0]);
-			w = (word_t *) AVLTree_FindNext(mkdb->wordtree,w);
+			else
+				ys_get_doclist(in->w, md->docnums+tf, md->dtfs+tf);
+			if (md->current_positions_file != 0) {
+				/* Positions are read in the order they were written */
+				size_t n = ys_sum_dtfs(md->dtfs+tf, in_tf);
+				if (ys_reserve_positions(mkdb, npos + n) != 0) {
+					free(heap);
+					return -1;
+				}
+				if (in->run == 0)
+					ys_get_positions(in->w, md->positions+npos, 
+						md->dtfs+tf);
+				else {
+					ys_docpos_t *p = md->positions+npos;
+					for (ys_doccnt_t i = tf; i < tf + in_tf; 
+						p += md->dtfs[i++]) {
+						if (ys_positions_read(in->positions_file, p, 
+							md->dtfs[i]) != 0) {
+							fprintf(stderr, "Error: positions of run %d "
+								"are incomplete\n", in->run->id);
+							free(heap);
+							return -1;
+						}
+					}
+				}
+				npos += n;
+			}
+			tf += in_tf;
+			ys_next_input(mkdb, in);
+			if (in->word == 0)
+				heap[0] = heap[--nheap];
+			ys_sift_down(heap, nheap, 0);
+		} while (nheap > 0 && strcmp((const char *)heap[0]->word, 
+			(const char *)word) == 0);
+		if (ys_write_term(mkdb, word, md->docnums, md->dtfs, tf, 
+			md->positions, final) != 0) {
+			free(heap);
+			return -1;
 		}
+		(*nterms)++;
+		*npostings += tf;
 	}
+	free(heap);
+	return 0;
+}
+
+/**
+ * Merges runs[first] to runs[first+n-1], and the word table if final,
+ * into the output files given by id. The runs are removed.
+ */
+static int
+ys_merge_runs( ys_mkdb_t *mkdb, int first, int n, int id, int final )
+{
+	mergedata_t *md = &mkdb->mergedata;
+	merge_input_t *inputs;
+	char name[1024];
+	int i, ninputs = n + (final ? 1 : 0);
+	unsigned long nterms = 0, npostings = 0, nread = 0, nwritten;
+	int rc = 0;
 
-	if (mkdb->mergedata.prev_postings_file != 0) {
-		delete mkdb->mergedata.prev_postings_file;
-		mkdb->mergedata.prev_postings_file = 0;
-		ys_file_close(mkdb->mergedata.prev_words_file);
-		snprintf(name, sizeof name, "%s/tmp.%d.words", mkdb->mergedata.dbpath, tmp-1);
+	inputs = (merge_input_t *) calloc(ninputs, sizeof *inputs);
+	if (inputs == 0) {
+		perror("calloc");
+		return -1;
+	}
+	for (i = 0; i < n && rc == 0; i++) {
+		merge_input_t *in = &inputs[i];
+		in->run = &md->runs[first+i];
+		ys_run_filename(mkdb, in->run->id, "words", name, sizeof name);
+		in->words_file = ys_file_open(name, "r", YS_FILE_ABORT_ON_ERROR);
+		ys_file_setbuf(in->words_file, YS_MERGE_READBUF);
+		ys_run_filename(mkdb, in->run->id, "postings", name, sizeof name);
+		in->postings_file = new YASENS PostFile();
+		if (in->postings_file->open(name, "rb") != 0)
+			rc = -1;
+		else
+			in->postings_file->set_buffer_size(YS_MERGE_READBUF);
+		if (mkdb->postings_format & YS_POSTINGS_POSITIONS) {
+			ys_run_filename(mkdb, in->run->id, "positions", name, 
+				sizeof name);
+			in->positions_file = ys_file_open(name, "r", 
+				YS_FILE_ABORT_ON_ERROR);
+			ys_file_setbuf(in->positions_file, YS_MERGE_READBUF);
+		}
+		nread += in->run->nbytes;
+	}
+	if (rc == 0)
+		rc = ys_open_output(mkdb, id, 
+			final ? mkdb->postings_format : YS_POSTINGS_V1);
+	if (rc == 0 && final) {
+		ys_seg_filename(md->dbpath, mkdb->segment, "btree", name,
+			sizeof name);
+		md->loader = ys_btree_load_begin(name, mkdb->btree_fill);
+		ys_seg_filename(md->dbpath, mkdb->segment, "dict", name,
+			sizeof name);
+		md->dict = ys_termdict_create(name, 0);
+		if (md->loader == 0 || md->dict == 0)
+			rc = -1;
+	}
+	if (rc == 0)
+		rc = ys_merge_inputs(mkdb, inputs, ninputs, final, 
+			&nterms, &npostings);
+	if (md->loader != 0) {
+		if (ys_btree_load_end(md->loader) != 0)
+			rc = -1;
+		md->loader = 0;
+	}
+	if (md->dict != 0) {
+		if (ys_termdict_finish(md->dict) != 0)
+			rc = -1;
+		md->dict = 0;
+	}
+	nwritten = ys_close_output(mkdb, id);
+
+	for (i = 0; i < n; i++) {
+		merge_input_t *in = &inputs[i];
+		if (in->words_file != 0)
+			ys_file_close(in->words_file);
+		delete in->postings_file;
+		if (in->positions_file != 0)
+			ys_file_close(in->positions_file);
+		ys_run_filename(mkdb, in->run->id, "words", name, sizeof name);
 		remove(name);
-		snprintf(name, sizeof name, "%s/tmp.%d.postings", mkdb->mergedata.dbpath, tmp-1);
+		ys_run_filename(mkdb, in->run->id, "postings", name, sizeof name);
 		remove(name);
+		ys_run_filename(mkdb, in->run->id, "positions", name, sizeof name);
+		remove(name);
+	}
+	free(inputs);
+	printf("Merged %d runs%s: %lu terms, %lu postings, "
+		"%luK read, %luK written\n", n, final ? " and memory" : "",
+		nterms, npostings, nread/1024, nwritten/1024);
+
+	memmove(md->runs+first, md->runs+first+n, 
+		(md->nruns-first-n) * sizeof *md->runs);
+	md->nruns -= n;
+	if (!final) {
+		merge_run_t *run = ys_add_run(mkdb, first, id);
+		if (run == 0)
+			return -1;
+		run->nterms = nterms;
+		run->npostings = npostings;
+		run->nbytes = nwritten;
+		md->runswritten++;
 	}
+	return rc;
+}
 
-	ys_destroy_allocator(String_allocator);
-	AVLTree_Destroy(mkdb->wordtree);
-	ys_destroyallmem();
-	ys_xml_release_memory(); /* TODO: */
-	assert(Maxmem == 0);
-	String_allocator = ys_new_allocator(0, 10);
-	mkdb->wordtree = AVLTree_New(&vtab, sizeof(word_t), 100);
+/**
+ * Called when the word table has used up the memory allowed, and once
+ * at the end. Until the end, the table is written out as a new sorted
+ * run. At the end, all runs and the table are merged in one pass into
+ * the words, postings, btree and dictionary files of the segment. If there are YS_MERGE_FANIN runs or
+ * more, groups of consecutive runs are merged first so that not too many
+ * files are open at once; document lists stay in order.
+ */
+static int 
+ys_merge(ys_mkdb_t *mkdb, int final)
+{
+	mergedata_t *md = &mkdb->mergedata;
+	char name[1024];
+	char newname[1024];
+	int id, first;
 
-	if (final) {
-		char newname[sizeof name];
-		delete mkdb->mergedata.current_postings_file;
-		mkdb->mergedata.current_postings_file = 0;
-		ys_file_close(mkdb->mergedata.current_words_file);
-		snprintf(name, sizeof name, "%s/tmp.%d.words", 
-			mkdb->mergedata.dbpath, tmp);
-		snprintf(newname, sizeof newname, "%s/yase.words", 
-			mkdb->mergedata.dbpath);
-		remove(newname);
-		rename(name, newname);
-		snprintf(name, sizeof name, "%s/tmp.%d.postings", 
-			mkdb->mergedata.dbpath, tmp);
-		snprintf(newname, sizeof newname, "%s/yase.postings",
-			mkdb->mergedata.dbpath);
-		remove(newname);
+	if (Maxmem > mkdb->statistics.maxmem)
+		mkdb->statistics.maxmem = Maxmem;
+
+	if (!final)
+		return ys_flush_run(mkdb);
+
+	while (md->nruns >= YS_MERGE_FANIN) {
+		/* Each group of consecutive runs becomes one run */
+		for (first = 0; first < md->nruns - 1; first++) {
+			int n = md->nruns - first;
+			if (n > YS_MERGE_FANIN)
+				n = YS_MERGE_FANIN;
+			id = md->nextid++;
+			if (ys_merge_runs(mkdb, first, n, id, 0) != 0)
+				return -1;
+		}
+	}
+	id = md->nextid++;
+	ys_wordtable_sort(&mkdb->words);
+	if (ys_merge_runs(mkdb, 0, md->nruns, id, 1) != 0)
+		return -1;
+	ys_reset_words(mkdb);
+
+	ys_run_filename(mkdb, id, "words", name, sizeof name);
+	ys_seg_filename(md->dbpath, mkdb->segment, "words", newname, 
+		sizeof newname);
+	remove(newname);
+	rename(name, newname);
+	ys_run_filename(mkdb, id, "postings", name, sizeof name);
+	ys_seg_filename(md->dbpath, mkdb->segment, "postings", newname,
+		sizeof newname);
+	remove(newname);
+	rename(name, newname);
+	ys_seg_filename(md->dbpath, mkdb->segment, "positions", newname,
+		sizeof newname);
+	remove(newname);
+	if (mkdb->postings_format & YS_POSTINGS_POSITIONS) {
+		ys_run_filename(mkdb, id, "positions", name, sizeof name);
 		rename(name, newname);
-	} 
-	else {
-		mkdb->mergedata.prev_postings_file = mkdb->mergedata.current_postings_file;
-		mkdb->mergedata.prev_words_file = mkdb->mergedata.current_words_file;
 	}
-	tmp += 1;
-
 	return 0;
 }
 
-void
-ys_mkdb_set_curdocnum( ys_mkdb_t *mkdb, ys_docnum_t docnum )
+/**
+ * This function adds a term to the word table. The associated document
+ * number is recorded in the list attached to the term, with the term's
+ * dtf positions in the document if they are given.
+ */
+static int
+ys_index_term(ys_mkdb_t *mkdb, const ys_uchar_t *term, ys_docnum_t docnum,
+	ys_doccnt_t dtf, const ys_docpos_t *positions) 
 {
+	word_t *w;
+		
+	w = ys_wordtable_insert(&mkdb->words, term);
+	ys_add_to_doclist(w, docnum, dtf, positions);
+	mkdb->statistics.ntokens += dtf;			
+	if (mkdb->statistics.cur_maxdtf == 0) {
+		mkdb->statistics.cur_maxdtf = w->lastdtf;
 		mkdb->statistics.cur_docnum = docnum;
+	}
+	else if (w->lastdtf > mkdb->statistics.cur_maxdtf)
+		mkdb->statistics.cur_maxdtf = w->lastdtf;
+	return 0;
 }
 
 /**
- * This function adds a term to the binary tree. The associated document
- * number is recorded in the list attached to the term.
+ * Indexes a word found by the document processor. The word is a
+ * Pascal string. Words are numbered from 0 in each document.
  */
 static int
 ys_index_word(ys_mkdb_t *mkdb, ys_uchar_t *word, ys_docnum_t docnum) 
 {
-	word_t *w;
-		
+	ys_docpos_t pos = mkdb->nextpos++;
 #if _DUMP_TOKENIZER
 	printf("[%*s]\n", word[0], word+1);
 #endif
@@ -546,33 +1265,453 @@ ys_index_word(ys_mkdb_t *mkdb, ys_uchar_t *word, ys_docnum_t docnum)
 		word[0] = strlen((const char *)word+1);
 		stem(word);
 	}
-	w = (word_t *) AVLTree_Insert(mkdb->wordtree, word+1);
-	assert(w != 0);
-	ys_add_to_doclist(w, docnum);			
-	if (mkdb->statistics.cur_maxdtf == 0) {
-		mkdb->statistics.cur_maxdtf = w->dtflist[w->tf-1];
+	return ys_index_term(mkdb, word+1, docnum, 1, 
+		(mkdb->postings_format & YS_POSTINGS_POSITIONS) ? &pos : 0);
+}
+
+/**
+ * DirectSink adds files, documents and words to the database as the
+ * document processor finds them. It is used when there are no parser
+ * threads.
+ */
+class DirectSink : public YASENS DocumentSink {
+	ys_mkdb_t *mkdb;
+public:
+	DirectSink(ys_mkdb_t *mkdb) {
+		this->mkdb = mkdb;
+	}
+	int addFile(ys_docdata_t *docfile) {
+		return ys_dbaddfile(mkdb->docfile, docfile);
+	}
+	int addDocument(ys_docdata_t *docfile, ys_docdata_t *doc,
+		ys_docnum_t *docnum) {
+		if (doc != 0)
+			ys_dbadddoc(mkdb->docfile, docfile, doc);
+		int rc = ys_dbadddocptr(mkdb->docfile, docfile, doc, docnum);
+		mkdb->statistics.cur_docnum = *docnum;
+		mkdb->nextpos = 0;
+		return rc;
+	}
+	int addWord(ys_uchar_t *word, ys_docnum_t docnum) {
+		return ys_index_word(mkdb, word, docnum);
+	}
+	bool skipBinaryFiles() const {
+		return mkdb->skipBinaryFiles;
+	}
+};
+
+enum {
+	YS_TERM_BLOCKSIZE = 64*1024	/* size of ParsedFile term blocks */
+};
+
+typedef struct ys_term_block_t {
+	struct ys_term_block_t *next;
+	size_t used;
+	ys_uchar_t data[YS_TERM_BLOCKSIZE];
+} ys_term_block_t;
+
+typedef struct {
+	const ys_uchar_t *term;
+	ys_doccnt_t dtf;
+	ys_docpos_t pos;		/* once counted, index of the first of
+					 * the term's positions in 
+					 * ParsedFile::positions */
+} parsed_term_t;
+
+typedef struct {
+	ys_docdata_t doc;
+	bool hasdoc;			/* false if the file is the document */
+	size_t firstterm;		/* index into ParsedFile::terms */
+	size_t nterms;
+} parsed_doc_t;
+
+/**
+ * ParsedFile records what a parser thread finds in a file, so that the
+ * main thread can add it to the database later. Document numbers are 
+ * local to the file until then. Words are stemmed here, and once a 
+ * document is complete its terms are sorted and counted, leaving one
+ * entry per term with its dtf. This is the file's private inverted run.
+ * With -P the positions of each term are kept, in order, in positions.
+ */
+class ParsedFile : public YASENS DocumentSink {
+	ys_bool_t stemming;
+	bool skipBinary;
+	bool positional;
+	bool hasfile;
+	ys_docdata_t docfile;
+	parsed_doc_t *docs;
+	size_t ndocs, docsalloc;
+	parsed_term_t *terms;
+	size_t nterms, termsalloc;
+	ys_term_block_t *blocks;
+	size_t sorted;			/* documents whose terms are counted */
+	ys_docpos_t *positions;
+	size_t npositions, posalloc;
+
+	const ys_uchar_t *saveTerm(const ys_uchar_t *term);
+	void countTerms(parsed_doc_t *d);
+	ParsedFile(const ParsedFile&);
+	ParsedFile& operator=(const ParsedFile&);
+public:
+	ParsedFile(ys_bool_t stemming, bool skipBinary, bool positional);
+	~ParsedFile();
+	int addFile(ys_docdata_t *docfile);
+	int addDocument(ys_docdata_t *docfile, ys_docdata_t *doc,
+		ys_docnum_t *docnum);
+	int addWord(ys_uchar_t *word, ys_docnum_t docnum);
+	bool skipBinaryFiles() const {
+		return skipBinary;
+	}
+	void finish();
+	int commit(ys_mkdb_t *mkdb);
+};
+
+ParsedFile::ParsedFile(ys_bool_t stemming, bool skipBinary, bool positional)
+{
+	this->stemming = stemming;
+	this->skipBinary = skipBinary;
+	this->positional = positional;
+	hasfile = false;
+	docs = 0;
+	ndocs = docsalloc = 0;
+	terms = 0;
+	nterms = termsalloc = 0;
+	blocks = 0;
+	sorted = 0;
+	positions = 0;
+	npositions = posalloc = 0;
+}
+
+ParsedFile::~ParsedFile()
+{
+	while (blocks != 0) {
+		ys_term_block_t *next = blocks->next;
+		free(blocks);
+		blocks = next;
+	}
+	free(terms);
+	free(docs);
+	free(positions);
+}
+
+static void *
+ys_grow_array(void *array, size_t *nalloc, size_t size)
+{
+	size_t n = *nalloc == 0 ? 16 : *nalloc * 2;
+	array = realloc(array, n * size);
+	if (array == 0) {
+		perror("realloc");
+		fprintf(stderr, "Error: ran out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	*nalloc = n;
+	return array;
+}
+
+const ys_uchar_t *
+ParsedFile::saveTerm(const ys_uchar_t *term)
+{
+	size_t len = strlen((const char *)term) + 1;
+	if (blocks == 0 || blocks->used + len > sizeof blocks->data) {
+		ys_term_block_t *b = (ys_term_block_t *) malloc(sizeof *b);
+		if (b == 0) {
+			perror("malloc");
+			fprintf(stderr, "Error: ran out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		b->used = 0;
+		b->next = blocks;
+		blocks = b;
+	}
+	ys_uchar_t *copy = blocks->data + blocks->used;
+	memcpy(copy, term, len);
+	blocks->used += len;
+	return copy;
+}
+
+static int
+ys_compare_parsed_term(const void *p1, const void *p2)
+{
+	const parsed_term_t *t1 = (const parsed_term_t *)p1;
+	const parsed_term_t *t2 = (const parsed_term_t *)p2;
+	int rc = strcmp((const char *)t1->term, (const char *)t2->term);
+	if (rc != 0)
+		return rc;
+	return t1->pos < t2->pos ? -1 : t1->pos > t2->pos;
+}
+
+void
+ParsedFile::countTerms(parsed_doc_t *d)
+{
+	parsed_term_t *t = terms + d->firstterm;
+	size_t i, n = 0;
+
+	qsort(t, d->nterms, sizeof *t, ys_compare_parsed_term);
+	for (i = 0; i < d->nterms; i++) {
+		ys_docpos_t pos = t[i].pos;
+		if (n > 0 && strcmp((const char *)t[n-1].term, 
+			(const char *)t[i].term) == 0)
+			t[n-1].dtf++;
+		else {
+			t[n] = t[i];
+			t[n++].pos = npositions;
+		}
+		if (positional) {
+			if (npositions == posalloc)
+				positions = (ys_docpos_t *) ys_grow_array(positions,
+					&posalloc, sizeof *positions);
+			positions[npositions++] = pos;
+		}
+	}
+	nterms = d->firstterm + n;
+	d->nterms = n;
+}
+
+int
+ParsedFile::addFile(ys_docdata_t *docfile)
+{
+	this->docfile = *docfile;
+	hasfile = true;
+	return 0;
+}
+
+/**
+ * The docfile passed here is always the one given to addFile() by the 
+ * document processor, so only the copy taken there is kept.
+ */
+int
+ParsedFile::addDocument(ys_docdata_t *docfile, ys_docdata_t *doc,
+	ys_docnum_t *docnum)
+{
+	if (sorted < ndocs)
+		countTerms(&docs[sorted++]);
+	if (ndocs == docsalloc)
+		docs = (parsed_doc_t *) ys_grow_array(docs, &docsalloc, 
+			sizeof *docs);
+	parsed_doc_t *d = &docs[ndocs];
+	d->hasdoc = doc != 0;
+	if (doc != 0)
+		d->doc = *doc;
+	d->firstterm = nterms;
+	d->nterms = 0;
+	*docnum = ndocs++;
+	return 0;
+}
+
+int
+ParsedFile::addWord(ys_uchar_t *word, ys_docnum_t docnum)
+{
+	/* Words always belong to the last document added */
+	if (ndocs == 0 || docnum != ndocs-1)
+		return 0;
+	if (stemming) {
+		word[0] = strlen((const char *)word+1);
+		stem(word);
+	}
+	if (nterms == termsalloc)
+		terms = (parsed_term_t *) ys_grow_array(terms, &termsalloc, 
+			sizeof *terms);
+	terms[nterms].term = saveTerm(word+1);
+	terms[nterms].dtf = 1;
+	terms[nterms].pos = docs[ndocs-1].nterms;
+	nterms++;
+	docs[ndocs-1].nterms++;
+	return 0;
+}
+
+/**
+ * Counts the terms of the last document. Called once the document
+ * processor is done with the file.
+ */
+void
+ParsedFile::finish()
+{
+	if (sorted < ndocs)
+		countTerms(&docs[sorted++]);
+}
+
+/**
+ * Adds the file, its documents and their terms to the database, as
+ * DirectSink would have done.
+ */
+int
+ParsedFile::commit(ys_mkdb_t *mkdb)
+{
+	size_t i, j;
+
+	if (!hasfile)
+		return 0;
+	if (ys_dbaddfile(mkdb->docfile, &docfile) != 0)
+		return -1;
+	for (i = 0; i < ndocs; i++) {
+		parsed_doc_t *d = &docs[i];
+		ys_docdata_t *doc = d->hasdoc ? &d->doc : 0;
+		ys_docnum_t docnum;
+
+		if (doc != 0)
+			ys_dbadddoc(mkdb->docfile, &docfile, doc);
+		if (ys_dbadddocptr(mkdb->docfile, &docfile, doc, &docnum) != 0)
+			return -1;
 		mkdb->statistics.cur_docnum = docnum;
+		for (j = 0; j < d->nterms; j++) {
+			parsed_term_t *t = &terms[d->firstterm+j];
+			ys_index_term(mkdb, t->term, docnum, t->dtf, 
+				positional ? positions + t->pos : 0);
+		}
 	}
-	else if (w->dtflist[w->tf-1] > mkdb->statistics.cur_maxdtf)
-		mkdb->statistics.cur_maxdtf = w->dtflist[w->tf-1];
 	return 0;
 }
 
+typedef struct {
+	char logicalname[YS_FILENAME_LEN];
+	char physicalname[YS_FILENAME_LEN];
+	ParsedFile *parsed;
+	bool done;
+} parse_job_t;
+
 /**
- * This function processes a document file. It runs the document
- * processor routines which in turn index all terms occuring in the
- * file.
+ * Files waiting to be parsed, being parsed, or parsed and waiting to be
+ * committed are kept in a circular buffer of jobs. The main thread adds
+ * jobs at the tail and commits them from the head; parser threads take
+ * the next job. The window limits how far parsing may run ahead.
  */
-static int 
-ys_extract_words(ys_mkdb_t *mkdb, const char *logicalname, 
-	const char *physicalname)
+struct ys_parse_pipeline_t {
+	ys_mutex_t mutex;
+	ys_cond_t cond;
+	parse_job_t *jobs;
+	unsigned long window;
+	unsigned long head;		/* oldest job not committed */
+	unsigned long next;		/* next job to be parsed */
+	unsigned long tail;		/* next free slot */
+	bool stopping;
+	int nthreads;
+	ys_thread_t *threads;
+	ys_mkdb_t *mkdb;
+};
+
+static void *
+ys_parse_thread(void *arg)
 {
-	int rc;
+	ys_parse_pipeline_t *pp = (ys_parse_pipeline_t *)arg;
+
+	ys_mutex_lock(&pp->mutex);
+	for (;;) {
+		while (pp->next == pp->tail && !pp->stopping)
+			ys_cond_wait(&pp->cond, &pp->mutex);
+		if (pp->next == pp->tail)
+			break;
+		parse_job_t *job = &pp->jobs[pp->next++ % pp->window];
+		ys_mutex_unlock(&pp->mutex);
+
+		ParsedFile *parsed = new ParsedFile(pp->mkdb->stem, 
+			pp->mkdb->skipBinaryFiles, 
+			(pp->mkdb->postings_format & YS_POSTINGS_POSITIONS) != 0);
+		ys_document_process(job->logicalname, job->physicalname, 
+			parsed);
+		parsed->finish();
+
+		ys_mutex_lock(&pp->mutex);
+		job->parsed = parsed;
+		job->done = true;
+		ys_cond_broadcast(&pp->cond);
+	}
+	ys_mutex_unlock(&pp->mutex);
+	return 0;
+}
+
+/**
+ * Commits jobs in order until upto is reached, waiting for
+ * each to be parsed.
+ */
+static void
+ys_commit_parsed(ys_mkdb_t *mkdb, unsigned long upto)
+{
+	ys_parse_pipeline_t *pp = mkdb->pipeline;
+
+	while (pp->head < upto) {
+		parse_job_t *job = &pp->jobs[pp->head % pp->window];
+		ys_mutex_lock(&pp->mutex);
+		while (!job->done)
+			ys_cond_wait(&pp->cond, &pp->mutex);
+		ys_mutex_unlock(&pp->mutex);
+
+		mkdb->statistics.cur_maxdtf = 0;
+		mkdb->statistics.cur_docnum = 0;
+		job->parsed->commit(mkdb);
+		delete job->parsed;
+		job->parsed = 0;
+		ys_end_file(mkdb);
+		pp->head++;
+	}
+}
+
+static ys_parse_pipeline_t *
+ys_start_pipeline(ys_mkdb_t *mkdb, int nthreads)
+{
+	ys_parse_pipeline_t *pp = (ys_parse_pipeline_t *) calloc(1, sizeof *pp);
+	if (pp == 0) {
+		perror("calloc");
+		return 0;
+	}
+	pp->window = 4 * nthreads;
+	pp->jobs = (parse_job_t *) calloc(pp->window, sizeof *pp->jobs);
+	pp->threads = (ys_thread_t *) calloc(nthreads, sizeof *pp->threads);
+	if (pp->jobs == 0 || pp->threads == 0) {
+		perror("calloc");
+		free(pp->jobs);
+		free(pp->threads);
+		free(pp);
+		return 0;
+	}
+	pp->mkdb = mkdb;
+	ys_mutex_init(&pp->mutex);
+	ys_cond_init(&pp->cond);
+	for (pp->nthreads = 0; pp->nthreads < nthreads; pp->nthreads++) {
+		if (ys_thread_create(&pp->threads[pp->nthreads], 
+			ys_parse_thread, pp) != 0) 
+			break;
+	}
+	if (pp->nthreads == 0) {
+		ys_cond_destroy(&pp->cond);
+		ys_mutex_destroy(&pp->mutex);
+		free(pp->jobs);
+		free(pp->threads);
+		free(pp);
+		return 0;
+	}
+	return pp;
+}
+
+/**
+ * Commits outstanding jobs, then waits for the parser threads to exit.
+ */
+static void
+ys_stop_pipeline(ys_mkdb_t *mkdb)
+{
+	ys_parse_pipeline_t *pp = mkdb->pipeline;
+	int i;
 
-	mkdb->statistics.cur_maxdtf = 0;
-	mkdb->statistics.cur_docnum = 0;
-	rc = ys_document_process(logicalname, physicalname, 
-		mkdb->docfile, ys_index_word, mkdb);
+	ys_commit_parsed(mkdb, pp->tail);
+	ys_mutex_lock(&pp->mutex);
+	pp->stopping = true;
+	ys_cond_broadcast(&pp->cond);
+	ys_mutex_unlock(&pp->mutex);
+	for (i = 0; i < pp->nthreads; i++)
+		ys_thread_join(&pp->threads[i]);
+	ys_cond_destroy(&pp->cond);
+	ys_mutex_destroy(&pp->mutex);
+	free(pp->jobs);
+	free(pp->threads);
+	free(pp);
+	mkdb->pipeline = 0;
+}
+
+/**
+ * Called after all documents in a file have been indexed.
+ */
+static void
+ys_end_file(ys_mkdb_t *mkdb)
+{
 	ys_dbadddocmaxdtf(mkdb->docfile, mkdb->statistics.cur_docnum,
 		mkdb->statistics.cur_maxdtf);
 #if _DUMP_CALCWEIGHT
@@ -584,6 +1723,44 @@ ys_extract_words(ys_mkdb_t *mkdb, const char *logicalname,
 		ys_merge(mkdb, 0);
 	}
 	mkdb->statistics.totaldocs++;
+}
+
+/**
+ * This function processes a document file. It runs the document
+ * processor routines which in turn index all terms occuring in the
+ * file. With parser threads, the file is queued instead, and files
+ * that have been parsed are committed in the order they were queued.
+ */
+static int 
+ys_extract_words(ys_mkdb_t *mkdb, const char *logicalname, 
+	const char *physicalname)
+{
+	ys_parse_pipeline_t *pp = mkdb->pipeline;
+
+	if (pp == 0) {
+		DirectSink sink(mkdb);
+		mkdb->statistics.cur_maxdtf = 0;
+		mkdb->statistics.cur_docnum = 0;
+		ys_document_process(logicalname, physicalname, &sink);
+		ys_end_file(mkdb);
+		return 0;
+	}
+
+	if (pp->tail - pp->head == pp->window)
+		ys_commit_parsed(mkdb, pp->head + 1);
+	parse_job_t *job = &pp->jobs[pp->tail % pp->window];
+	strncpy(job->logicalname, logicalname, sizeof job->logicalname-1);
+	strncpy(job->physicalname, physicalname, sizeof job->physicalname-1);
+	job->parsed = 0;
+	job->done = false;
+	ys_mutex_lock(&pp->mutex);
+	pp->tail++;
+	ys_cond_broadcast(&pp->cond);
+	ys_mutex_unlock(&pp->mutex);
+
+	/* wget removes the file once we return */
+	if (strncmp(logicalname, "http://", 7) == 0)
+		ys_commit_parsed(mkdb, pp->tail);
 	return 0;
 }
 
@@ -599,10 +1776,65 @@ ys_mkdb_get_skip_binary_files( ys_mkdb_t *mkdb )
 	return mkdb->skipBinaryFiles;
 }
 
+/**
+ * Opens an existing database to add documents to it. The new segment
+ * takes the stemming and postings format of the database.
+ */
+static ys_docdb_t *
+ys_mkdb_open_append(ys_mkdb_t *mkdb, ys_mkdb_userargs_t *args,
+	ys_docnum_t *numfiles, ys_doccnt_t *maxdtf, ys_doccnt_t *maxtf)
+{
+	ys_docdb_t *docfile;
+	ys_seglist_t list;
+	ys_docnum_t numdocs;
+	ys_bool_t stemmed;
+
+	docfile = ys_dbopen(args->dbpath, "a", args->rootpath);
+	if (docfile == 0)
+		return 0;
+	if (ys_dbgetinfo(docfile, &numdocs, numfiles, maxdtf, maxtf, 
+		&stemmed) != 0 ||
+		ys_seg_read(args->dbpath, numdocs, &list) != 0) {
+		ys_dbclose(docfile);
+		return 0;
+	}
+	if (list.nsegs == YS_MAXSEGMENTS) {
+		fprintf(stderr, "Error: the database has %d segments; "
+			"run yasemerge first\n", list.nsegs);
+		ys_dbclose(docfile);
+		return 0;
+	}
+	mkdb->stem = stemmed;
+	mkdb->postings_format = ys_dbgetpostingsformat(docfile);
+	if ((mkdb->postings_format & YS_POSTINGS_VERSION_MASK) == 0)
+		mkdb->postings_format |= YS_POSTINGS_V1;
+	mkdb->segment = list.nextid;
+	args->segment = list.nextid;
+	args->firstdoc = numdocs;
+	return docfile;
+}
+
+/**
+ * Removes any segments left by an earlier database in the same place.
+ */
+static void
+ys_mkdb_remove_segments(const char *dbpath)
+{
+	ys_seglist_t list;
+	if (ys_seg_read(dbpath, 0, &list) != 0)
+		return;
+	for (int i = 0; i < list.nsegs; i++) {
+		if (list.segs[i].id != 0)
+			ys_seg_remove(dbpath, list.segs[i].id);
+	}
+	ys_seg_clear(dbpath);
+}
+
 /**
  * This is the main driving function that scans the user supplied list of 
- * directories or urls and creates the YASE database files. Only the index 
- * file is created separately.
+ * directories or urls and creates the YASE database files, including the
+ * index of the segment written. With args->append, the documents are added
+ * to an existing database and their terms written to a new segment.
  */
 int 
 ys_mkdb_create_database(char *pathname[], ys_mkdb_userargs_t *args)
@@ -610,6 +1842,9 @@ ys_mkdb_create_database(char *pathname[], ys_mkdb_userargs_t *args)
 	int rc = -1;
 	ys_docdb_t *docfile;
 	ys_mkdb_t mkdb = {0};
+	clock_t start = clock();
+	ys_docnum_t oldfiles = 0;
+	ys_doccnt_t oldmaxdtf = 0, oldmaxtf = 0;
 
 	if (args->dbpath == 0) 
 		args->dbpath = ".";
@@ -618,40 +1853,83 @@ ys_mkdb_create_database(char *pathname[], ys_mkdb_userargs_t *args)
 	strncpy(mkdb.mergedata.dbpath, args->dbpath, sizeof mkdb.mergedata.dbpath);
 	mkdb.mergedata.memlimit = args->memlimit;
 	mkdb.skipBinaryFiles = args->skipBinaryFiles;
+	mkdb.postings_format = args->postings_format;
+	mkdb.btree_fill = args->btree_fill;
+	if ((mkdb.postings_format & YS_POSTINGS_VERSION_MASK) == 0)
+		mkdb.postings_format |= YS_POSTINGS_V1;
+	mkdb.stem = args->stem;
+	args->segment = 0;
+	args->firstdoc = 0;
+	args->ndocs = 0;
 
-	docfile = ys_dbopen(args->dbpath, "w", args->rootpath);
+	if (args->append)
+		docfile = ys_mkdb_open_append(&mkdb, args, &oldfiles, 
+			&oldmaxdtf, &oldmaxtf);
+	else {
+		ys_mkdb_remove_segments(args->dbpath);
+		docfile = ys_dbopen(args->dbpath, "w", args->rootpath);
+	}
 	if ( docfile == 0 ) {
 		return -1;
 	}
 
 	String_allocator = ys_new_allocator(0, 10);
-	mkdb.wordtree = AVLTree_New(&vtab, sizeof(word_t), 100);
+	ys_wordtable_init(&mkdb.words);
 	mkdb.rootpath = args->rootpath;
 	mkdb.dbpath = args->dbpath;
-	mkdb.stem = args->stem;
 	mkdb.wget_opts = args->wget_opts;
 	mkdb.docfile = docfile;
 
+	ys_document_init();
+	if (args->nthreads > 1)
+		mkdb.pipeline = ys_start_pipeline(&mkdb, args->nthreads);
+
 	while ( *pathname && (rc = ys_locate_documents(*pathname, ys_extract_words, 
 		&mkdb)) == 0)
 		pathname++;
 
-	if (rc == 0) {
+	if (mkdb.pipeline != 0)
+		ys_stop_pipeline(&mkdb);
+	ys_document_cleanup();
+
+	if (rc == 0 && args->append && 
+		ys_dbnumdocs(docfile) == args->firstdoc) {
+		printf("no documents to add\n");
+	}
+	else if (rc == 0) {
 		if (ys_merge(&mkdb, 1) == 0) {
+			args->ndocs = ys_dbnumdocs(docfile) - args->firstdoc;
+			if (args->append)
+				printf("new segment = %d\n", mkdb.segment);
 			printf("maximum memory used = %lu\n", 
 				mkdb.statistics.maxmem);
+			printf("sorted runs written = %lu\n", 
+				mkdb.mergedata.runswritten);
 			printf("total files processed = %lu\n", 
 				mkdb.statistics.totaldocs);
 			printf("total documents processed = %lu\n", 
-				ys_dbnumdocs(docfile));
+				args->ndocs);
 			printf("most popular term = %s\n", 
 				mkdb.statistics.maxword);
 			printf("maximum collection term frequency = %lu\n", 
 				mkdb.statistics.maxtf);
 			printf("maximum document term frequency = %lu\n", 
 				mkdb.statistics.maxdtf);
+			double elapsed = (double)(clock()-start)/CLOCKS_PER_SEC;
+			printf("tokens indexed = %lu (%.0f per cpu second)\n",
+				mkdb.statistics.ntokens, 
+				elapsed > 0 ? mkdb.statistics.ntokens/elapsed : 0.0);
+			/* 
+			 * After an append maxtf is only a lower bound; 
+			 * ys_build_docweights() works out the true value.
+			 */
+			if (mkdb.statistics.maxdtf < oldmaxdtf)
+				mkdb.statistics.maxdtf = oldmaxdtf;
+			if (mkdb.statistics.maxtf < oldmaxtf)
+				mkdb.statistics.maxtf = oldmaxtf;
+			ys_dbsetpostingsformat(docfile, mkdb.postings_format);
 			rc = ys_dbaddinfo(docfile, ys_dbnumdocs(docfile),
-				mkdb.statistics.totaldocs,
+				oldfiles + mkdb.statistics.totaldocs,
 				mkdb.statistics.maxdtf,
 				mkdb.statistics.maxtf,
 				mkdb.stem);
@@ -661,31 +1939,60 @@ ys_mkdb_create_database(char *pathname[], ys_mkdb_userargs_t *args)
 	}
 
 	ys_destroy_allocator(String_allocator);
-	AVLTree_Destroy(mkdb.wordtree);
+	ys_wordtable_destroy(&mkdb.words);
 	ys_destroyallmem();
 	assert(Maxmem == 0);
 	ys_dbclose(docfile);
+	free(mkdb.mergedata.docnums);
+	free(mkdb.mergedata.dtfs);
+	free(mkdb.mergedata.runs);
 
 	return rc;
 }
 
 /**
- * This function creates the YASE index file.
+ * This function checks the YASE index file of the segment written by
+ * ys_mkdb_create_database() against its words file.
  */
 int
-ys_mkdb_create_btree(ys_mkdb_userargs_t *args)
+ys_mkdb_verify_btree(ys_mkdb_userargs_t *args)
 {
 	char wordfile[1024];
 	char treefile[1024];
 
 	if (args->dbpath == 0) args->dbpath = ".";
-	snprintf(wordfile, sizeof wordfile, "%s/%s", args->dbpath, "yase.words");
-	snprintf(treefile, sizeof treefile, "%s/%s", args->dbpath, "yase.btree");
-	if (ys_btree_create( treefile, wordfile ) == 0 
-		&& ys_btree_verify( treefile, wordfile ) == 0
-		)
+	ys_seg_filename(args->dbpath, args->segment, "words", wordfile, 
+		sizeof wordfile);
+	ys_seg_filename(args->dbpath, args->segment, "btree", treefile, 
+		sizeof treefile);
+	return ys_btree_verify( treefile, wordfile );
+}
+
+/**
+ * Adds the segment written by ys_mkdb_create_database() to yase.seg,
+ * once its index is complete. A new database has just segment 0 and
+ * needs no list.
+ */
+int
+ys_mkdb_add_segment(ys_mkdb_userargs_t *args)
+{
+	ys_seglist_t list;
+
+	if (!args->append)
 		return 0;
-	return -1;
+	if (ys_seg_read(args->dbpath, args->firstdoc, &list) != 0)
+		return -1;
+	if (list.nsegs == YS_MAXSEGMENTS || list.nextid != args->segment) {
+		fprintf(stderr, "Error: yase.seg was changed while adding "
+			"documents\n");
+		return -1;
+	}
+	list.segs[list.nsegs].id = args->segment;
+	list.segs[list.nsegs].firstdoc = args->firstdoc;
+	list.segs[list.nsegs].ndocs = args->ndocs;
+	list.nsegs++;
+	list.nextid = args->segment + 1;
+	return ys_seg_write(args->dbpath, &list);
 }
 	
 
@@ -752,6 +2059,16 @@ ys_print_yase_help(void)
   -m, --max-memory=N           use upto N megabytes of memory (approx).\n\
   -r, --root-directory=DIR     store document paths relative to DIR.\n\
   -x, --skip-binary-files      enables detection of binary files.\n\
+  -B, --block-postings         write postings in blocks with skip entries\n\
+                               and score bounds.\n\
+  -C, --codec=NAME             postings codec, gamma (default) or svbyte.\n\
+  -P, --positions              record the positions of terms, for phrase\n\
+                               and NEAR queries.\n\
+  -j, --jobs=N                 parse documents with N threads.\n\
+  -a, --append                 add the documents to an existing database,\n\
+                               in a new index segment.\n\
+  -F, --btree-fill=PERCENT     fill btree blocks to PERCENT (default 100).\n\
+  -v, --verify                 check the btree against the terms indexed.\n\
   -w, --show-wget-options-available      display supported wget options and exit.\n\
   -W, --show-wget-options      display wget options being used and exit.\n\n\
 Mail bug reports and suggestions to <dibyendu@mazumdar.demon.co.uk>.\n");
@@ -764,7 +2081,17 @@ Mail bug reports and suggestions to <dibyendu@mazumdar.demon.co.uk>.\n");
   -s, --enable-stemming        extract the stem of a word before indexing.\n\
   -m, --max-memory=N           use upto N megabytes of memory (approx).\n\
   -r, --root-directory=DIR     store document paths relative to DIR.\n\
-  -x, --skip-binary-files      enables detection of binary files.\n\n\
+  -x, --skip-binary-files      enables detection of binary files.\n\
+  -B, --block-postings         write postings in blocks with skip entries\n\
+                               and score bounds.\n\
+  -C, --codec=NAME             postings codec, gamma (default) or svbyte.\n\
+  -P, --positions              record the positions of terms, for phrase\n\
+                               and NEAR queries.\n\
+  -j, --jobs=N                 parse documents with N threads.\n\
+  -a, --append                 add the documents to an existing database,\n\
+                               in a new index segment.\n\
+  -F, --btree-fill=PERCENT     fill btree blocks to PERCENT (default 100).\n\
+  -v, --verify                 check the btree against the terms indexed.\n\n\
 Mail bug reports and suggestions to <dibyendu@mazumdar.demon.co.uk>.\n");
 #endif
 }
@@ -875,22 +2202,54 @@ main(int argc, char *argv[])
 		{ "yase-home", required_argument, NULL, 'H' },
 		{ "max-memory", required_argument, NULL, 'm' },
 		{ "skip-binary-files", no_argument, NULL, 'x' },
+		{ "block-postings", no_argument, NULL, 'B' },
+		{ "codec", required_argument, NULL, 'C' },
+		{ "positions", no_argument, NULL, 'P' },
+		{ "jobs", required_argument, NULL, 'j' },
+		{ "append", no_argument, NULL, 'a' },
+		{ "btree-fill", required_argument, NULL, 'F' },
+		{ "verify", no_argument, NULL, 'v' },
 
 		{ 0, 0, 0, 0 }
 	};
 
 	opterr = 0;
 	ys_list_init(&wget_opts);
-	while ((c = getopt_long (argc, argv, "r:H:m:swWhV",
+	while ((c = getopt_long (argc, argv, "r:H:m:C:j:F:swWhVxBPav",
 			   long_options, (int *)0)) != EOF) {
 		switch (c) {
 		case 'r': args.rootpath = optarg; break;
 		case 'H': args.dbpath = optarg; break;
 		case 'h': ys_print_yase_help(); return EXIT_SUCCESS;
 		case 'm': args.memlimit = atoi(optarg); break;
+		case 'j': args.nthreads = atoi(optarg); break;
+		case 'a': args.append = true; break;
+		case 'F': 
+			args.btree_fill = atoi(optarg);
+			if (args.btree_fill < 10 || args.btree_fill > 100) {
+				fprintf(stderr, "Fill factor must be between 10 "
+					"and 100\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'v': args.verify = true; break;
 		case 's': args.stem = BOOL_TRUE; break;
 		case 'V': ys_print_yase_version(); return EXIT_SUCCESS;
-		case 'x': args.skipBinaryFiles = true;
+		case 'x': args.skipBinaryFiles = true; break;
+		case 'B': 
+			args.postings_format |= YS_POSTINGS_V2|YS_POSTINGS_BOUNDS; 
+			break;
+		case 'P': 
+			args.postings_format |= YS_POSTINGS_POSITIONS; 
+			break;
+		case 'C': 
+			if (strcmp(optarg, "svbyte") == 0)
+				args.postings_format |= YS_POSTINGS_SVBYTE;
+			else if (strcmp(optarg, "gamma") != 0) {
+				fprintf(stderr, "Unknown codec %s; try --help\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
 
 #ifdef USE_WGET
 		case 'w': ys_print_wget_help(); return EXIT_SUCCESS;
@@ -964,8 +2323,14 @@ main(int argc, char *argv[])
 	snprintf(yasehome, sizeof yasehome, "YASE_DBPATH=%s", args.dbpath);
 	putenv(yasehome);	
 	if (ys_mkdb_create_database(argv+optind, &args) == 0) {
-		printf("Creating BTree index\n");
-		if (ys_mkdb_create_btree(&args) == 0) {
+		if (args.append && args.ndocs == 0)
+			return EXIT_SUCCESS;
+		if (args.verify) {
+			printf("Verifying BTree index\n");
+			if (ys_mkdb_verify_btree(&args) != 0)
+				return EXIT_FAILURE;
+		}
+		if (ys_mkdb_add_segment(&args) == 0) {
 			printf("Building document weights\n");
 			if (ys_build_docweights(args.dbpath) == 0) 
 				return EXIT_SUCCESS;
@@ -44,6 +44,15 @@ typedef struct {
 	ys_bool_t stem;
 	ys_list_t *wget_opts;
 	bool skipBinaryFiles;
+	int postings_format;		/* version and codec, see postfile.h */
+	int nthreads;			/* parser threads, 0 or 1 for none */
+	bool append;			/* add to an existing database */
+	int btree_fill;			/* percentage of btree blocks to fill */
+	bool verify;			/* check the btree when built */
+	/* set by ys_mkdb_create_database() */
+	int segment;			/* segment written */
+	ys_docnum_t firstdoc;		/* first document added */
+	ys_docnum_t ndocs;		/* number of documents added */
 } ys_mkdb_userargs_t;
 
 extern int 
@@ -53,7 +62,10 @@ extern float
 ys_mkdb_calculate_document_weight( ys_mkdb_t *arg, ys_docnum_t docnum );
 
 extern int 
-ys_mkdb_create_btree( ys_mkdb_userargs_t *args );
+ys_mkdb_verify_btree( ys_mkdb_userargs_t *args );
+
+extern int
+ys_mkdb_add_segment( ys_mkdb_userargs_t *args );
 
 extern ys_list_t * 
 ys_mkdb_get_wgetargs( ys_mkdb_t *mkdb );
@@ -61,9 +73,6 @@ ys_mkdb_get_wgetargs( ys_mkdb_t *mkdb );
 extern bool
 ys_mkdb_get_skip_binary_files( ys_mkdb_t *mkdb );
 
-extern void
-ys_mkdb_set_curdocnum( ys_mkdb_t *mkdb, ys_docnum_t docnum );
-
 /* #define CALC_LOGDTF(dtf)		dtf */
 #define CALC_LOGDTF(dtf)		(1.0 + log(dtf)) /* MG */
 /* #define CALC_LOGDTF(dtf)		log(1.0 + dtf)  */
@@ -0,0 +1,268 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - positions of terms within documents.
+
+#include "positions.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+struct ys_positions_t {
+	const ys_uchar_t *data;
+	size_t len;
+	bool mapped;			/* else data was read into memory */
+};
+
+size_t
+ys_positions_write( ys_file_t *fp, const ys_docpos_t *pos, ys_doccnt_t n )
+{
+	ys_docpos_t prev = 0;
+	size_t nbytes = 0;
+
+	for (ys_doccnt_t i = 0; i < n; i++) {
+		ys_docpos_t value = pos[i] - prev;
+		prev = pos[i];
+		do {
+			ys_file_putc((value & 0x7f) | (value > 0x7f ? 0x80 : 0), fp);
+			value >>= 7;
+			nbytes++;
+		} while (value > 0);
+	}
+	return nbytes;
+}
+
+int
+ys_positions_read( ys_file_t *fp, ys_docpos_t *pos, ys_doccnt_t n )
+{
+	ys_docpos_t prev = 0;
+
+	for (ys_doccnt_t i = 0; i < n; i++) {
+		ys_docpos_t value = 0;
+		int shift = 0, ch;
+		do {
+			ch = ys_file_getc(fp);
+			if (ch == EOF)
+				return -1;
+			value |= (ys_docpos_t)(ch & 0x7f) << shift;
+			shift += 7;
+		} while (ch & 0x80);
+		pos[i] = prev += value;
+	}
+	return 0;
+}
+
+ys_positions_t *
+ys_positions_open( const char *name )
+{
+	struct stat statbuf;
+	ys_positions_t *file;
+
+	FILE *fp = fopen(name, "rb");
+	if (fp == NULL) {
+		if (errno != ENOENT)
+			perror(name);
+		return NULL;
+	}
+	file = (ys_positions_t *) calloc(1, sizeof *file);
+	if (file == NULL || fstat(fileno(fp), &statbuf) != 0) {
+		fprintf(stderr, "Error: cannot open %s\n", name);
+		free(file);
+		fclose(fp);
+		return NULL;
+	}
+	file->len = (size_t) statbuf.st_size;
+	if (file->len == 0) {
+		fclose(fp);
+		return file;
+	}
+#ifndef WIN32
+	void *map = mmap(NULL, file->len, PROT_READ, MAP_SHARED, fileno(fp), 0);
+	if (map != MAP_FAILED) {
+		file->data = (const ys_uchar_t *) map;
+		file->mapped = true;
+		fclose(fp);
+		return file;
+	}
+#endif
+	ys_uchar_t *data = (ys_uchar_t *) malloc(file->len);
+	if (data == NULL || fread(data, 1, file->len, fp) != file->len) {
+		fprintf(stderr, "Error: cannot read %s\n", name);
+		free(data);
+		free(file);
+		fclose(fp);
+		return NULL;
+	}
+	file->data = data;
+	fclose(fp);
+	return file;
+}
+
+void
+ys_positions_close( ys_positions_t *file )
+{
+#ifndef WIN32
+	if (file->mapped)
+		munmap((void *) file->data, file->len);
+	else
+#endif
+	free((void *) file->data);
+	free(file);
+}
+
+const ys_uchar_t *
+ys_positions_at( const ys_positions_t *file, ys_filepos_t offset )
+{
+	if (offset < 0 || (size_t) offset >= file->len)
+		return NULL;
+	return file->data + offset;
+}
+
+const ys_uchar_t *
+ys_positions_skip( const ys_positions_t *file, const ys_uchar_t *cp, 
+	ys_doccnt_t n )
+{
+	const ys_uchar_t *end = file->data + file->len;
+
+	while (n > 0) {
+		if (cp == end)
+			return NULL;
+		if ((*cp++ & 0x80) == 0)
+			n--;
+	}
+	return cp;
+}
+
+const ys_uchar_t *
+ys_positions_decode( const ys_positions_t *file, const ys_uchar_t *cp, 
+	ys_docpos_t *pos, ys_doccnt_t n )
+{
+	const ys_uchar_t *end = file->data + file->len;
+	ys_docpos_t prev = 0;
+
+	for (ys_doccnt_t i = 0; i < n; i++) {
+		ys_docpos_t value = 0;
+		int shift = 0;
+		do {
+			if (cp == end)
+				return NULL;
+			value |= (ys_docpos_t)(*cp & 0x7f) << shift;
+			shift += 7;
+		} while (*cp++ & 0x80);
+		pos[i] = prev += value;
+	}
+	return cp;
+}
+
+size_t
+ys_positions_gallop( const ys_docpos_t *pos, size_t lo, size_t n, 
+	ys_docpos_t target )
+{
+	size_t step = 1, hi;
+
+	if (lo >= n || pos[lo] >= target)
+		return lo;
+	/* pos[lo] < target; double the step until pos[hi] >= target */
+	for (hi = lo + 1; hi < n && pos[hi] < target; hi = lo + step) {
+		lo = hi;
+		step *= 2;
+	}
+	if (hi > n)
+		hi = n;
+	/* The answer is in (lo, hi] */
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (pos[mid] < target)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return hi;
+}
+
+size_t
+ys_positions_phrase( const ys_docpos_t * const *lists, 
+	const ys_doccnt_t *counts, const ys_docpos_t *offsets, int k,
+	ys_docpos_t *out )
+{
+	size_t next[YS_POSITIONS_MAXTERMS];
+	size_t nout = 0;
+	int i, rarest = 0;
+
+	assert(k > 0 && k <= YS_POSITIONS_MAXTERMS);
+	for (i = 0; i < k; i++) {
+		next[i] = 0;
+		if (counts[i] < counts[rarest])
+			rarest = i;
+	}
+	for (ys_doccnt_t j = 0; j < counts[rarest]; j++) {
+		if (lists[rarest][j] < offsets[rarest])
+			continue;
+		ys_docpos_t start = lists[rarest][j] - offsets[rarest];
+		for (i = 0; i < k; i++) {
+			if (i == rarest)
+				continue;
+			next[i] = ys_positions_gallop(lists[i], next[i], counts[i],
+				start + offsets[i]);
+			if (next[i] == counts[i])
+				return nout;
+			if (lists[i][next[i]] != start + offsets[i])
+				break;
+		}
+		if (i == k)
+			out[nout++] = start;
+	}
+	return nout;
+}
+
+bool
+ys_positions_near( const ys_docpos_t * const *lists, 
+	const ys_doccnt_t *counts, int k, ys_docpos_t distance )
+{
+	size_t next[YS_POSITIONS_MAXTERMS];
+	int i;
+
+	assert(k > 0 && k <= YS_POSITIONS_MAXTERMS);
+	for (i = 0; i < k; i++) {
+		if (counts[i] == 0)
+			return false;
+		next[i] = 0;
+	}
+	for (;;) {
+		int least = 0;
+		ys_docpos_t high = lists[0][next[0]];
+		for (i = 1; i < k; i++) {
+			ys_docpos_t p = lists[i][next[i]];
+			if (p < lists[least][next[least]])
+				least = i;
+			if (p > high)
+				high = p;
+		}
+		if (high - lists[least][next[least]] <= distance)
+			return true;
+		if (++next[least] == counts[least])
+			return false;
+	}
+}
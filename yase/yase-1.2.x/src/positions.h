@@ -0,0 +1,125 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - positions of terms within documents, for phrase
+//           and proximity queries.
+
+#ifndef positions_h
+#define positions_h
+
+#include "yase.h"
+#include "ystdio.h"
+
+/**
+ * A collection built with yasemakedb -P has a positions file per
+ * segment (yase.positions, or yase.N.positions for segment N) giving 
+ * the word offsets of each term in each document, counted from 0. A 
+ * term's positions follow the order of its postings: for each 
+ * document, dtf variable byte codes, the first offset and then the 
+ * gaps between offsets. The postings give the offset of the term's 
+ * positions (see YS_POSTINGS_POSITIONS), so queries that do not need
+ * positions never read the file.
+ */
+enum {
+	YS_POSITIONS_MAXTERMS = 16	/* terms in a phrase or NEAR */
+};
+
+typedef struct ys_positions_t ys_positions_t;
+
+/**
+ * Writes the positions of a term in one document, which must be in 
+ * ascending order. Returns the number of bytes written.
+ */
+extern size_t
+ys_positions_write( ys_file_t *fp, const ys_docpos_t *pos, ys_doccnt_t n );
+
+/**
+ * Reads the positions of a term in one document, as written by 
+ * ys_positions_write(). Returns -1 at the end of the file.
+ */
+extern int
+ys_positions_read( ys_file_t *fp, ys_docpos_t *pos, ys_doccnt_t n );
+
+/**
+ * Opens a positions file for reading. Returns NULL if it cannot be
+ * opened; no message is printed if the file does not exist.
+ */
+extern ys_positions_t *
+ys_positions_open( const char *name );
+
+extern void
+ys_positions_close( ys_positions_t *file );
+
+/**
+ * Returns the positions at offset, or NULL if the offset is not in the
+ * file.
+ */
+extern const ys_uchar_t *
+ys_positions_at( const ys_positions_t *file, ys_filepos_t offset );
+
+/**
+ * Steps over n positions. Returns NULL if the file ends first.
+ */
+extern const ys_uchar_t *
+ys_positions_skip( const ys_positions_t *file, const ys_uchar_t *cp, 
+	ys_doccnt_t n );
+
+/**
+ * Decodes the n positions of one document. Returns the positions of
+ * the next document, or NULL if the file ends first.
+ */
+extern const ys_uchar_t *
+ys_positions_decode( const ys_positions_t *file, const ys_uchar_t *cp, 
+	ys_docpos_t *pos, ys_doccnt_t n );
+
+/**
+ * Returns the index of the first of pos[lo..n) that is >= target, or
+ * n. The search gallops forward from lo, so a run of searches for
+ * ascending targets costs O(log gap) each.
+ */
+extern size_t
+ys_positions_gallop( const ys_docpos_t *pos, size_t lo, size_t n, 
+	ys_docpos_t target );
+
+/**
+ * Finds the occurrences of a phrase of k terms in a document. lists[i]
+ * holds the counts[i] positions of term i, which must occur at 
+ * offsets[i] from the start of the phrase. The term with the fewest
+ * positions proposes starts, and the others are searched with 
+ * ys_positions_gallop(). Writes the starts to out, which must have 
+ * room for the smallest count, and returns how many there are.
+ */
+extern size_t
+ys_positions_phrase( const ys_docpos_t * const *lists, 
+	const ys_doccnt_t *counts, const ys_docpos_t *offsets, int k,
+	ys_docpos_t *out );
+
+/**
+ * Do k lists of positions each have one within distance words of 
+ * each other ? The lists are merged, moving past the smallest 
+ * position each time, until the window they span is small enough.
+ */
+extern bool
+ys_positions_near( const ys_docpos_t * const *lists, 
+	const ys_doccnt_t *counts, int k, ys_docpos_t distance );
+
+#endif
@@ -0,0 +1,362 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - codecs used by PostFile to encode postings.
+
+#include "postfile.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+/* 
+ * Decoding tables for Stream VByte, indexed by control byte: total
+ * data length of the four values, and the shuffle that moves each value
+ * into its own 32 bit lane.
+ */
+static struct ys_svb_tables_t {
+	ys_uchar_t length[256];
+	ys_uchar_t shuffle[256][16];
+	ys_svb_tables_t() {
+		for (int c = 0; c < 256; c++) {
+			int pos = 0;
+			for (int i = 0; i < 4; i++) {
+				int len = ((c >> (2*i)) & 3) + 1;
+				for (int j = 0; j < 4; j++)
+					shuffle[c][4*i+j] = j < len ? pos+j : 0xff;
+				pos += len;
+			}
+			length[c] = pos;
+		}
+	}
+} Svb_tables;
+
+enum {
+	SVB_MAXSTREAM = YS_POSTINGS_BLOCKSIZE/4 + YS_POSTINGS_BLOCKSIZE*4,
+	SVB_PADDING = 16	/* SSSE3 decoder reads 16 bytes at a time */
+};
+
+YASENS PostingsCodec *
+YASENS PostingsCodec::create(int format)
+{
+	switch (format & YS_POSTINGS_CODEC_MASK) {
+	case YS_POSTINGS_GAMMA:
+		return new YASENS GammaCodec();
+	case YS_POSTINGS_SVBYTE:
+		return new YASENS StreamVByteCodec();
+	}
+	return 0;
+}
+
+void
+YASENS GammaCodec::endWrite(YASENS BitFile &bf)
+{
+	bf.flush();
+}
+
+void
+YASENS GammaCodec::encode(YASENS BitFile &bf, const ys_docnum_t *docnums,
+	const ys_doccnt_t *dtfs, size_t n, ys_docnum_t base)
+{
+	for (size_t i = 0; i < n; i++) {
+		bf.gammaEncode((ys_uint32_t)(docnums[i]-base)+1);
+		bf.gammaEncode((ys_uint32_t)dtfs[i]+1);
+		base = docnums[i];
+	}
+}
+
+void
+YASENS GammaCodec::decode(YASENS BitFile &bf, ys_docnum_t *docnums,
+	ys_doccnt_t *dtfs, size_t n, ys_docnum_t base)
+{
+	for (size_t i = 0; i < n; i++) {
+		base += (ys_docnum_t) bf.gammaDecode()-1;
+		docnums[i] = base;
+		dtfs[i] = (ys_doccnt_t) bf.gammaDecode()-1;
+	}
+}
+
+ys_uint32_t
+YASENS GammaCodec::encodedLength(const ys_docnum_t *docnums,
+	const ys_doccnt_t *dtfs, size_t n, ys_docnum_t base)
+{
+	ys_uint32_t bits = 0;
+	for (size_t i = 0; i < n; i++) {
+		bits += YASENS BitFile::gammaLength((ys_uint32_t)(docnums[i]-base)+1);
+		bits += YASENS BitFile::gammaLength((ys_uint32_t)dtfs[i]+1);
+		base = docnums[i];
+	}
+	return bits;
+}
+
+size_t
+YASENS StreamVByteCodec::streamLength(const unsigned int *values, size_t n)
+{
+	size_t len = (n+3)/4;
+	for (size_t i = 0; i < n; i++) {
+		unsigned int v = values[i];
+		len += v < (1U<<8) ? 1 : v < (1U<<16) ? 2 : v < (1U<<24) ? 3 : 4;
+	}
+	return len;
+}
+
+size_t
+YASENS StreamVByteCodec::encodeStream(ys_uchar_t *out, 
+	const unsigned int *values, size_t n)
+{
+	ys_uchar_t *ctrl = out;
+	ys_uchar_t *data = out + (n+3)/4;
+	memset(ctrl, 0, (n+3)/4);
+	for (size_t i = 0; i < n; i++) {
+		unsigned int v = values[i];
+		int code = v < (1U<<8) ? 0 : v < (1U<<16) ? 1 : v < (1U<<24) ? 2 : 3;
+		ctrl[i >> 2] |= code << ((i & 3) * 2);
+		for (int j = 0; j <= code; j++) {
+			*data++ = (ys_uchar_t) v;
+			v >>= 8;
+		}
+	}
+	return data - out;
+}
+
+void
+YASENS StreamVByteCodec::decodeStream(YASENS BitFile &bf, 
+	unsigned int *values, size_t n)
+{
+	ys_uchar_t ctrl[YS_POSTINGS_BLOCKSIZE/4];
+	ys_uchar_t data[YS_POSTINGS_BLOCKSIZE*4 + SVB_PADDING];
+	size_t nctrl = (n+3)/4;
+	size_t datalen = 0;
+	size_t i;
+
+	assert(n <= YS_POSTINGS_BLOCKSIZE);
+	bf.getBytes(ctrl, nctrl);
+	for (i = 0; i < nctrl; i++)
+		datalen += Svb_tables.length[ctrl[i]];
+	/* unused slots in the last control byte are zero, ie one byte each */
+	datalen -= nctrl*4 - n;
+	bf.getBytes(data, datalen);
+
+	const ys_uchar_t *p = data;
+	i = 0;
+#if defined(__SSSE3__)
+	memset(data + datalen, 0, SVB_PADDING);
+	for (; i+4 <= n; i += 4) {
+		int c = ctrl[i >> 2];
+		__m128i in = _mm_loadu_si128((const __m128i *) p);
+		__m128i shuf = _mm_loadu_si128((const __m128i *) Svb_tables.shuffle[c]);
+		_mm_storeu_si128((__m128i *)(values+i), _mm_shuffle_epi8(in, shuf));
+		p += Svb_tables.length[c];
+	}
+#endif
+	for (; i < n; i++) {
+		int code = (ctrl[i >> 2] >> ((i & 3) * 2)) & 3;
+		unsigned int v = p[0];
+		switch (code) {
+		case 3: v |= (unsigned int) p[3] << 24;
+		case 2: v |= (unsigned int) p[2] << 16;
+		case 1: v |= (unsigned int) p[1] << 8;
+		}
+		values[i] = v;
+		p += code+1;
+	}
+}
+
+void
+YASENS StreamVByteCodec::startWrite(YASENS BitFile &bf)
+{
+	bf.flush();
+}
+
+void
+YASENS StreamVByteCodec::endWrite(YASENS BitFile &bf)
+{
+	bf.alignPut();
+}
+
+void
+YASENS StreamVByteCodec::startRead(YASENS BitFile &bf)
+{
+	bf.alignGet();
+}
+
+void
+YASENS StreamVByteCodec::encode(YASENS BitFile &bf, 
+	const ys_docnum_t *docnums, const ys_doccnt_t *dtfs, size_t n, 
+	ys_docnum_t base)
+{
+	unsigned int values[YS_POSTINGS_BLOCKSIZE] = { 0 };
+	ys_uchar_t out[2*SVB_MAXSTREAM];
+	size_t i, len;
+
+	assert(n <= YS_POSTINGS_BLOCKSIZE);
+	for (i = 0; i < n; i++) {
+		values[i] = (unsigned int)(docnums[i]-base);
+		base = docnums[i];
+	}
+	len = encodeStream(out, values, n);
+	for (i = 0; i < n; i++)
+		values[i] = (unsigned int) dtfs[i];
+	len += encodeStream(out+len, values, n);
+	bf.putBytes(out, len);
+}
+
+void
+YASENS StreamVByteCodec::decode(YASENS BitFile &bf, ys_docnum_t *docnums,
+	ys_doccnt_t *dtfs, size_t n, ys_docnum_t base)
+{
+	unsigned int values[YS_POSTINGS_BLOCKSIZE];
+	size_t i;
+
+	decodeStream(bf, values, n);
+	for (i = 0; i < n; i++) {
+		base += values[i];
+		docnums[i] = base;
+	}
+	decodeStream(bf, values, n);
+	for (i = 0; i < n; i++)
+		dtfs[i] = values[i];
+}
+
+ys_uint32_t
+YASENS StreamVByteCodec::encodedLength(const ys_docnum_t *docnums,
+	const ys_doccnt_t *dtfs, size_t n, ys_docnum_t base)
+{
+	unsigned int values[YS_POSTINGS_BLOCKSIZE];
+	size_t i, len;
+
+	assert(n <= YS_POSTINGS_BLOCKSIZE);
+	for (i = 0; i < n; i++) {
+		values[i] = (unsigned int)(docnums[i]-base);
+		base = docnums[i];
+	}
+	len = streamLength(values, n);
+	for (i = 0; i < n; i++)
+		values[i] = (unsigned int) dtfs[i];
+	len += streamLength(values, n);
+	return (ys_uint32_t) len * 8;
+}
+
+#ifdef TEST_POSTCODEC
+
+/*
+ * Decode benchmark. Usage: postcodec <yase home> [passes]
+ * Decodes every postings list in a collection and reports the size of
+ * yase.postings and the decode rate. The checksum allows the output of
+ * two collections built from the same documents to be compared.
+ */
+
+#include "collection.h"
+#include <time.h>
+
+typedef struct {
+	ys_postoff_t *offsets;
+	size_t noffsets;
+	size_t nalloc;
+	unsigned long npostings;
+	unsigned long checksum;
+} ys_codec_bench_t;
+
+static ys_bool_t
+ys_bench_add_term(ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t value,
+	ys_doccnt_t doccnt, void *arg)
+{
+	ys_codec_bench_t *b = (ys_codec_bench_t *)arg;
+	if (b->noffsets == b->nalloc) {
+		b->nalloc = b->nalloc == 0 ? 1024 : b->nalloc * 2;
+		b->offsets = (ys_postoff_t *) realloc(b->offsets, 
+			b->nalloc * sizeof *b->offsets);
+		if (b->offsets == 0) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	b->offsets[b->noffsets++] = (ys_postoff_t) value;
+	return BOOL_TRUE;
+}
+
+static ys_bool_t
+ys_bench_posting(void *arg, ys_docnum_t docnum, ys_doccnt_t dtf)
+{
+	ys_codec_bench_t *b = (ys_codec_bench_t *)arg;
+	b->npostings++;
+	b->checksum = b->checksum * 31 + docnum * 7 + dtf;
+	return BOOL_TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+	ys_uchar_t key[YS_MAXKEYSIZE+1];
+	ys_codec_bench_t b = {0};
+	char path[1024];
+	int passes = 10;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: postcodec <yase home> [passes]\n");
+		exit(1);
+	}
+	if (argc > 2)
+		passes = atoi(argv[2]);
+
+	YASENS Collection collection;
+	if (collection.open(argv[1], "r") != 0) {
+		fprintf(stderr, "%s", collection.getError());
+		exit(1);
+	}
+	key[0] = 0;
+	key[1] = 0;
+	ys_btree_iterate(collection.getIndex(), key, ys_bench_add_term, &b);
+
+	YASENS PostFile *pf = collection.getPostFile();
+	clock_t start = clock();
+	for (int p = 0; p < passes; p++) {
+		b.npostings = 0;
+		b.checksum = 0;
+		for (size_t i = 0; i < b.noffsets; i++)
+			pf->iterate(b.offsets[i], ys_bench_posting, &b);
+	}
+	double elapsed = (double)(clock()-start)/CLOCKS_PER_SEC;
+
+	long size = 0;
+	snprintf(path, sizeof path, "%s/yase.postings", argv[1]);
+	FILE *fp = fopen(path, "rb");
+	if (fp != 0) {
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp);
+		fclose(fp);
+	}
+	int format = collection.getPostingsFormat();
+	printf("%s: v%d %s, %lu terms, %lu postings, %ld bytes (%.2f bits/posting)\n",
+		argv[1], format & YS_POSTINGS_VERSION_MASK,
+		(format & YS_POSTINGS_CODEC_MASK) == YS_POSTINGS_SVBYTE ? 
+			"svbyte" : "gamma",
+		(unsigned long) b.noffsets, b.npostings, size, 
+		b.npostings ? size * 8.0 / b.npostings : 0.0);
+	printf("decoded %d passes in %.3fs, %.1f M postings/sec, checksum %lx\n",
+		passes, elapsed, 
+		elapsed > 0 ? b.npostings * (double) passes / elapsed / 1e6 : 0.0,
+		b.checksum);
+	free(b.offsets);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - codecs used by PostFile to encode postings.
+
+#ifndef postcodec_h
+#define postcodec_h
+
+#include "cbitfile.h"
+
+/**
+ * Codec identifiers, stored in bits 8-15 of the postings format.
+ */
+#define YS_POSTINGS_CODEC_MASK		0xff00
+#define YS_POSTINGS_GAMMA		0x0000
+#define YS_POSTINGS_SVBYTE		0x0100
+
+YASE_NS_BEGIN
+
+/**
+ * A PostingsCodec encodes runs of postings for PostFile. Postings are
+ * passed as absolute docnums; the first gap is taken relative to base.
+ * A term's postings are written as: term frequency and skip table
+ * (always gamma coded), startWrite(), one or more calls to encode(),
+ * and finally endWrite(). Readers call startRead() after the skip table
+ * and may then decode from the start of any block.
+ */
+class PostingsCodec {
+public:
+	virtual ~PostingsCodec() {}
+	virtual void startWrite(YASENS BitFile &bf) {}
+	virtual void endWrite(YASENS BitFile &bf) = 0;
+	virtual void startRead(YASENS BitFile &bf) {}
+	virtual void encode(YASENS BitFile &bf, const ys_docnum_t *docnums,
+		const ys_doccnt_t *dtfs, size_t n, ys_docnum_t base) = 0;
+	virtual void decode(YASENS BitFile &bf, ys_docnum_t *docnums,
+		ys_doccnt_t *dtfs, size_t n, ys_docnum_t base) = 0;
+	/**
+	 * Size in bits of encode() output for the same arguments.
+	 */
+	virtual ys_uint32_t encodedLength(const ys_docnum_t *docnums,
+		const ys_doccnt_t *dtfs, size_t n, ys_docnum_t base) = 0;
+
+	/**
+	 * Returns a codec for the given postings format, or 0 if the
+	 * codec is unknown.
+	 */
+	static PostingsCodec *create(int format);
+};
+
+/**
+ * The original Elias gamma coding: gamma(gap+1), gamma(dtf+1).
+ */
+class GammaCodec : public PostingsCodec {
+public:
+	virtual void endWrite(YASENS BitFile &bf);
+	virtual void encode(YASENS BitFile &bf, const ys_docnum_t *docnums,
+		const ys_doccnt_t *dtfs, size_t n, ys_docnum_t base);
+	virtual void decode(YASENS BitFile &bf, ys_docnum_t *docnums,
+		ys_doccnt_t *dtfs, size_t n, ys_docnum_t base);
+	virtual ys_uint32_t encodedLength(const ys_docnum_t *docnums,
+		const ys_doccnt_t *dtfs, size_t n, ys_docnum_t base);
+};
+
+/**
+ * Stream VByte. Each group of up to YS_POSTINGS_BLOCKSIZE postings is
+ * stored as two streams, gaps then dtfs. A stream is a control byte per
+ * four values, giving the byte length (1-4) of each, followed by the
+ * values in little endian order. All data is byte aligned; when compiled
+ * with SSSE3 the four values of a control byte are decoded with a single
+ * shuffle.
+ */
+class StreamVByteCodec : public PostingsCodec {
+private:
+	static size_t encodeStream(ys_uchar_t *out, const unsigned int *values,
+		size_t n);
+	static void decodeStream(YASENS BitFile &bf, unsigned int *values,
+		size_t n);
+	static size_t streamLength(const unsigned int *values, size_t n);
+public:
+	virtual void startWrite(YASENS BitFile &bf);
+	virtual void endWrite(YASENS BitFile &bf);
+	virtual void startRead(YASENS BitFile &bf);
+	virtual void encode(YASENS BitFile &bf, const ys_docnum_t *docnums,
+		const ys_doccnt_t *dtfs, size_t n, ys_docnum_t base);
+	virtual void decode(YASENS BitFile &bf, ys_docnum_t *docnums,
+		ys_doccnt_t *dtfs, size_t n, ys_docnum_t base);
+	virtual ys_uint32_t encodedLength(const ys_docnum_t *docnums,
+		const ys_doccnt_t *dtfs, size_t n, ys_docnum_t base);
+};
+
+YASE_NS_END
+
+#endif
@@ -21,6 +21,10 @@
 *    Website: www.mazumdar.demon.co.uk/yase_index.html 
 */ 
 // 04-12-02: Created - represents the postings file.
+// 17-10-26: Block postings (v2) and PostingsCursor.
+// 17-10-26: Postings are encoded by a PostingsCodec.
+// 17-10-26: Score upper bounds for MaxScore.
+// 17-10-26: Offsets of positions.
 
 #include "postfile.h"
 
@@ -31,31 +35,403 @@ YASENS PostFile::get_term_frequency(ys_postoff_t offset)
 	return read_doccnt();
 }
 
+ys_doccnt_t
+YASENS PostFile::start_postings(ys_postoff_t offset)
+{
+	ys_doccnt_t tf = get_term_frequency(offset);
+	if (has_bound(tf))
+		read_bound();
+	if (has_positions())
+		read_positions_offset();
+	if (get_version() == YS_POSTINGS_V2 && tf > YS_POSTINGS_BLOCKSIZE) {
+		ys_doccnt_t nblocks = (tf+YS_POSTINGS_BLOCKSIZE-1)/YS_POSTINGS_BLOCKSIZE;
+		for (ys_doccnt_t b = 0; b < nblocks; b++) {
+			bf.gammaDecode();
+			bf.gammaDecode();
+			bf.gammaDecode();
+		}
+	}
+	start_blocks();
+	return tf;
+}
+
+void
+YASENS PostFile::read_postings(ys_docnum_t *docnums, ys_doccnt_t *dtfs, 
+	size_t n, ys_docnum_t base)
+{
+	/* Codecs work on at most one block at a time */
+	for (size_t i = 0; i < n; i += YS_POSTINGS_BLOCKSIZE) {
+		size_t count = n-i < YS_POSTINGS_BLOCKSIZE ? 
+			n-i : YS_POSTINGS_BLOCKSIZE;
+		codec->decode(bf, docnums+i, dtfs+i, count, base);
+		base = docnums[i+count-1];
+	}
+}
+
+void
+YASENS PostFile::write_postings(const ys_docnum_t *docnums, 
+	const ys_doccnt_t *dtfs, ys_doccnt_t tf, ys_filepos_t positions)
+{
+	ys_doccnt_t i, n;
+	ys_docnum_t prev;
+
+	write_doccnt(tf);
+	if (has_bound(tf)) {
+		/* Filled in later by write_bound() */
+		float bound = 0.0;
+		bf.alignPut();
+		bf.putBytes(&bound, sizeof bound);
+	}
+	if (has_positions()) {
+		bf.alignPut();
+		bf.putBytes(&positions, sizeof positions);
+	}
+	if (get_version() == YS_POSTINGS_V2 && tf > YS_POSTINGS_BLOCKSIZE) {
+		/* 
+		 * Skip table. The length of each block is worked out
+		 * by the codec, so that the table can be written ahead of
+		 * the blocks in a single pass.
+		 */
+		ys_docnum_t lastdoc = 0;
+		for (i = 0; i < tf; i += YS_POSTINGS_BLOCKSIZE) {
+			ys_doccnt_t maxdtf = 0;
+			n = tf-i < YS_POSTINGS_BLOCKSIZE ? 
+				tf-i : YS_POSTINGS_BLOCKSIZE;
+			prev = i == 0 ? 0 : docnums[i-1];
+			for (ys_doccnt_t j = i; j < i+n; j++) {
+				if (dtfs[j] > maxdtf)
+					maxdtf = dtfs[j];
+			}
+			write_docnum(docnums[i+n-1]-lastdoc);
+			bf.gammaEncode(codec->encodedLength(docnums+i, dtfs+i, 
+				n, prev)+1);
+			write_doccnt(maxdtf);
+			lastdoc = docnums[i+n-1];
+		}
+	}
+	codec->startWrite(bf);
+	for (i = 0, prev = 0; i < tf; i += n) {
+		n = tf-i < YS_POSTINGS_BLOCKSIZE ? tf-i : YS_POSTINGS_BLOCKSIZE;
+		codec->encode(bf, docnums+i, dtfs+i, n, prev);
+		prev = docnums[i+n-1];
+	}
+	codec->endWrite(bf);
+}
+
+int
+YASENS PostFile::write_bound(ys_postoff_t offset, float bound)
+{
+	ys_doccnt_t tf = get_term_frequency(offset);
+	if (!has_bound(tf))
+		return -1;
+	bf.alignGet();
+	bf.patchBytes((ys_filepos_t)(bf.getgbitpos() / 8), &bound, sizeof bound);
+	return 0;
+}
+
 void 
 YASENS PostFile::iterate(ys_postoff_t offset,
 		ys_pfn_postings_iterator_t *pfunc, void *arg )
 {
+	enum { BATCH = 128 };
+	ys_docnum_t docnums[BATCH];
+	ys_doccnt_t dtfs[BATCH];
 	ys_doccnt_t tf;
-	ys_docnum_t docnum, n;	
-	ys_doccnt_t dtf;
+	ys_docnum_t n;	
 	ys_doccnt_t i;
 
-	tf = get_term_frequency(offset);
+	tf = start_postings(offset);
 #if _DUMP_POSTINGS
 	printf("(%lu ", tf);
 #endif
-	for ( n = 0, i = 0; i < tf; i++ ) {
-		docnum = read_docnum();
-		dtf = read_doccnt();
+	for ( n = 0, i = 0; i < tf; ) {
+		size_t count = tf-i < BATCH ? tf-i : BATCH;
+		read_postings(docnums, dtfs, count, n);
+		n = docnums[count-1];
+		for (size_t j = 0; j < count; j++, i++) {
 #if _DUMP_POSTINGS
-		printf("<%lu,%lu>", docnum, dtf); 
+			printf("<%lu,%lu>", docnums[j], dtfs[j]); 
 #endif
-		n += docnum;
-		if (! pfunc( arg, n, dtf ) )
-			break;
+			if (! pfunc( arg, docnums[j], dtfs[j] ) )
+				goto done;
+		}
 	}	
+done:
 #if _DUMP_POSTINGS
 	printf(")\n"); 
 #endif
+	return;
+}
+
+YASENS PostingsCursor::PostingsCursor()
+{
+	pf = 0;
+	skipdoc = 0;
+	skippos = 0;
+	skipmaxdtf = 0;
+	clear();
+}
+
+YASENS PostingsCursor::~PostingsCursor()
+{
+	clear();
+}
+
+void
+YASENS PostingsCursor::clear()
+{
+	free(skipdoc);
+	free(skippos);
+	free(skipmaxdtf);
+	skipdoc = 0;
+	skippos = 0;
+	skipmaxdtf = 0;
+	bound = 0.0;
+	positions = 0;
+	nblocks = 0;
+	block = 0;
+	tf = 0;
+	ndecoded = 0;
+	count = 0;
+	cur = 0;
+	base = 0;
+	bitpos = 0;
+	datapos = 0;
+}
+
+int
+YASENS PostingsCursor::open(YASENS PostFile *postfile, ys_postoff_t offset)
+{
+	clear();
+	pf = postfile;
+	tf = pf->get_term_frequency(offset);
+	if (pf->has_bound(tf))
+		bound = pf->read_bound();
+	if (pf->has_positions())
+		positions = pf->read_positions_offset();
+	if (pf->get_version() == YS_POSTINGS_V2 && tf > BLOCKSIZE) {
+		nblocks = (tf+BLOCKSIZE-1)/BLOCKSIZE;
+		skipdoc = (ys_docnum_t *) calloc(nblocks, sizeof *skipdoc);
+		skippos = (ys_uint64_t *) calloc(nblocks, sizeof *skippos);
+		skipmaxdtf = (ys_doccnt_t *) calloc(nblocks, sizeof *skipmaxdtf);
+		if (skipdoc == 0 || skippos == 0 || skipmaxdtf == 0) {
+			perror("calloc");
+			clear();
+			return -1;
+		}
+		ys_docnum_t lastdoc = 0;
+		ys_uint64_t pos = 0;
+		for (ys_doccnt_t b = 0; b < nblocks; b++) {
+			lastdoc += pf->read_docnum();
+			skipdoc[b] = lastdoc;
+			skippos[b] = pos;
+			pos += pf->read_doccnt();
+			skipmaxdtf[b] = pf->read_doccnt();
+		}
+	}
+	pf->start_blocks();
+	datapos = bitpos = pf->get_gbitpos();
+	readBlock();
+	return 0;
+}
+
+/**
+ * Decodes the next block. The PostFile may have been used by another
+ * cursor in the meantime, so the position is always restored first.
+ */
+void
+YASENS PostingsCursor::readBlock()
+{
+	if (count > 0)
+		base = docnums[count-1];
+	cur = 0;
+	count = 0;
+	if (ndecoded >= tf)
+		return;
+	block = ndecoded / BLOCKSIZE;
+	count = tf-ndecoded < BLOCKSIZE ? tf-ndecoded : BLOCKSIZE;
+	pf->set_gbitpos(bitpos);
+	pf->read_postings(docnums, dtfs, count, base);
+	bitpos = pf->get_gbitpos();
+	ndecoded += count;
+}
+
+ys_doccnt_t
+YASENS PostingsCursor::blockMaxDtf() const
+{
+	if (nblocks == 0)
+		return 0;
+	return skipmaxdtf[block];
+}
+
+void
+YASENS PostingsCursor::skipTo(ys_docnum_t target)
+{
+	while (cur < count) {
+		if (docnums[count-1] < target) {
+			/* not in this block */
+			if (ndecoded >= tf) {
+				cur = count;
+				return;
+			}
+			if (nblocks > 0) {
+				ys_doccnt_t b = block+1;
+				while (b < nblocks-1 && skipdoc[b] < target)
+					b++;
+				if (b > block+1) {
+					/* jump straight to block b */
+					base = skipdoc[b-1];
+					bitpos = datapos + skippos[b];
+					ndecoded = b * BLOCKSIZE;
+					count = 0;
+					readBlock();
+					continue;
+				}
+			}
+			readBlock();
+			continue;
+		}
+		while (docnums[cur] < target)
+			cur++;
+		return;
+	}
 }
 
+#ifdef TEST_POSTFILE
+
+/*
+ * Writes the same postings lists in v1 and v2 format, in v2 with
+ * Stream VByte and in v2 with score bounds, and checks that iterate(), 
+ * next() and skipTo() see identical postings in all, and that bounds
+ * can be filled in. Also compares the time taken by skipTo() 
+ * for a sparse set of targets.
+ */
+
+#include <time.h>
+
+static ys_docnum_t *Check;
+static int Ncheck;
+
+static ys_bool_t
+ys_check_posting(void *arg, ys_docnum_t docnum, ys_doccnt_t dtf)
+{
+	if (Check[Ncheck++] != docnum) {
+		fprintf(stderr, "iterate() returned wrong docnum !\n");
+		exit(1);
+	}
+	return BOOL_TRUE;
+}
+
+int main()
+{
+	enum { NTERMS = 50, MAXTF = 20000, NPROBES = 10 };
+	static ys_docnum_t docnums[NTERMS][MAXTF];
+	static ys_doccnt_t dtfs[NTERMS][MAXTF];
+	ys_doccnt_t tfs[NTERMS];
+	enum { NFORMATS = 4 };
+	ys_postoff_t offsets[NFORMATS][NTERMS];
+	const char *names[NFORMATS] = { "test.v1", "test.v2", "test.svb", 
+		"test.bnd" };
+	const int formats[NFORMATS] = { YS_POSTINGS_V1, YS_POSTINGS_V2,
+		YS_POSTINGS_V2|YS_POSTINGS_SVBYTE, 
+		YS_POSTINGS_V2|YS_POSTINGS_BOUNDS };
+	double elapsed[NFORMATS] = { 0, 0, 0, 0 };
+	int t, f;
+
+	srand(1);
+	for (t = 0; t < NTERMS; t++) {
+		ys_docnum_t d = 0;
+		tfs[t] = t == 0 ? 1 : (ys_doccnt_t)(rand() % MAXTF) + 1;
+		for (ys_doccnt_t i = 0; i < tfs[t]; i++) {
+			d += (i == 0 ? 0 : 1) + rand() % 50;
+			docnums[t][i] = d;
+			dtfs[t][i] = 1 + rand() % 10;
+		}
+	}
+	for (f = 0; f < NFORMATS; f++) {
+		YASENS PostFile pf;
+		pf.open(names[f], "wb+");
+		pf.set_format(formats[f]);
+		for (t = 0; t < NTERMS; t++) {
+			offsets[f][t] = pf.get_ppos();
+			pf.write_postings(docnums[t], dtfs[t], tfs[t]);
+		}
+		pf.close();
+	}
+	{
+		YASENS PostFile pf;
+		pf.open(names[3], "rb+");
+		pf.set_format(formats[3]);
+		for (t = 0; t < NTERMS; t++) {
+			if (pf.write_bound(offsets[3][t], (float)t) != 
+				(pf.has_bound(tfs[t]) ? 0 : -1)) {
+				fprintf(stderr, "write_bound() failed !\n");
+				exit(1);
+			}
+		}
+		pf.close();
+	}
+	for (f = 0; f < NFORMATS; f++) {
+		YASENS PostFile pf;
+		pf.open(names[f], "rb");
+		pf.set_format(formats[f]);
+		for (t = 0; t < NTERMS; t++) {
+			Check = docnums[t];
+			Ncheck = 0;
+			pf.iterate(offsets[f][t], ys_check_posting, 0);
+			if (Ncheck != (int)tfs[t]) {
+				fprintf(stderr, "iterate() returned %d postings, expected %lu !\n",
+					Ncheck, (unsigned long)tfs[t]);
+				exit(1);
+			}
+			YASENS PostingsCursor cursor;
+			cursor.open(&pf, offsets[f][t]);
+			if (cursor.getBound() != (pf.has_bound(tfs[t]) ? t : 0)) {
+				fprintf(stderr, "getBound() returned %g !\n", 
+					cursor.getBound());
+				exit(1);
+			}
+			for (ys_doccnt_t i = 0; i < tfs[t]; i++, cursor.next()) {
+				if (cursor.atEnd() || cursor.docnum() != docnums[t][i] ||
+					cursor.dtf() != dtfs[t][i]) {
+					fprintf(stderr, "next() failed !\n");
+					exit(1);
+				}
+			}
+			if (!cursor.atEnd()) {
+				fprintf(stderr, "next() did not reach end !\n");
+				exit(1);
+			}
+		}
+		/* Interleave cursors on one PostFile as a query would */
+		YASENS PostingsCursor cursors[NTERMS];
+		for (t = 0; t < NTERMS; t++)
+			cursors[t].open(&pf, offsets[f][t]);
+		clock_t start = clock();
+		for (int p = 1; p <= NPROBES; p++) {
+			for (t = 0; t < NTERMS; t++) {
+				ys_docnum_t target = (ys_docnum_t) p * 
+					(docnums[t][tfs[t]-1] / NPROBES + 1);
+				cursors[t].skipTo(target);
+				ys_doccnt_t i = 0;
+				while (i < tfs[t] && docnums[t][i] < target)
+					i++;
+				if (i == tfs[t] ? !cursors[t].atEnd() : 
+					(cursors[t].atEnd() || 
+					 cursors[t].docnum() != docnums[t][i])) {
+					fprintf(stderr, "skipTo() failed !\n");
+					exit(1);
+				}
+			}
+		}
+		elapsed[f] = (double)(clock()-start)/CLOCKS_PER_SEC;
+		pf.close();
+		remove(names[f]);
+	}
+	printf("skipTo over %d terms: v1 %.3fs, v2 %.3fs, v2+svbyte %.3fs, "
+		"v2+bounds %.3fs\n", 
+		NTERMS, elapsed[0], elapsed[1], elapsed[2], elapsed[3]);
+	return 0;
+}
+
+#endif
@@ -21,33 +21,141 @@
 *    Website: www.mazumdar.demon.co.uk/yase_index.html 
 */ 
 // 04-12-02: Created - represents the postings file.
+// 17-10-26: Added block postings format (v2) with skip entries, and 
+//           PostingsCursor.
+// 17-10-26: Postings are encoded by a PostingsCodec.
+// 17-10-26: Score upper bounds for MaxScore.
+// 17-10-26: Added set_buffer_size().
+// 17-10-26: Postings may give the offset of the term's positions.
+// 18-10-26: PostFile cannot be copied, as it owns its codec.
 
 #ifndef postfile_h
 #define postfile_h
 
 #include "cbitfile.h"
+#include "postcodec.h"
 
 typedef ys_filepos_t ys_postoff_t;
 typedef ys_bool_t ys_pfn_postings_iterator_t(void *arg1, ys_docnum_t docnum, ys_doccnt_t dtf );
 
+/**
+ * Postings formats. In v1 a term's postings are gamma(tf+1) followed
+ * by gamma(gap+1), gamma(dtf+1) for each document. v2 groups the
+ * postings into blocks of YS_POSTINGS_BLOCKSIZE entries; when a term
+ * has more than one block, a skip table follows tf with one entry per
+ * block: gamma(lastdoc delta+1), gamma(bit length+1), gamma(maxdtf+1).
+ * The blocks themselves are encoded exactly as in v1, so a sequential 
+ * reader only needs to step over the skip table.
+ * Old collections do not record a format; 0 is treated as v1.
+ * The codec (see postcodec.h) occupies bits 8-15 of the format, and 
+ * replaces the gamma coding of gaps and dtfs. tf and the skip table 
+ * are always gamma coded; with a byte oriented codec the skip table
+ * gives block lengths in bits of whole bytes.
+ * With YS_POSTINGS_BOUNDS, v2 terms that have a skip table also record 
+ * an upper bound on log_dtf/document weight (see formulas.h) over all 
+ * of their documents, which RankedSearch uses to skip documents that 
+ * cannot make the top k. It is stored as a 32 bit float, word aligned 
+ * after tf, so that ys_build_docweights() can fill it in once document 
+ * weights are known.
+ * With YS_POSTINGS_POSITIONS every term records the offset of its 
+ * positions in the positions file (see positions.h) as a word aligned
+ * ys_filepos_t, after tf and any bound.
+ */
+#define YS_POSTINGS_V1			1
+#define YS_POSTINGS_V2			2
+#define YS_POSTINGS_VERSION_MASK	0xff
+#define YS_POSTINGS_BOUNDS		0x10000
+#define YS_POSTINGS_POSITIONS		0x20000
+#define YS_POSTINGS_BLOCKSIZE		128
+
 YASE_NS_BEGIN
 
 class PostFile {
 private:
 	YASENS BitFile bf;
+	int format;
+	YASENS PostingsCodec *codec;
+
+private:
+	PostFile(const PostFile&);
+	PostFile& operator=(const PostFile&);
+
 public:
 	PostFile();
 	~PostFile();
 	int open(const char *filename, const char *mode = 0);
 	void close();
+	/** Sets the size of the stdio buffer; call right after open() */
+	int set_buffer_size(size_t size);
 	ys_postoff_t get_gpos();
 	void set_gpos(ys_postoff_t pos);
 	ys_postoff_t get_ppos();
 	void set_ppos(ys_postoff_t pos);
+	ys_uint64_t get_gbitpos();
+	void set_gbitpos(ys_uint64_t bitpos);
+	/**
+	 * Sets the version and codec. Returns -1 if the codec is not 
+	 * known.
+	 */
+	int set_format(int fmt);
+	int get_format() const;
+	int get_version() const;
+	/**
+	 * Does a term with the given tf record a score bound ?
+	 */
+	bool has_bound(ys_doccnt_t tf) const;
+	/**
+	 * Reads the bound, which must follow the term frequency.
+	 */
+	float read_bound();
+	/**
+	 * Replaces the bound of the term at offset. Returns -1 if the
+	 * term does not record one.
+	 */
+	int write_bound(ys_postoff_t offset, float bound);
+	/**
+	 * Do terms record the offset of their positions ?
+	 */
+	bool has_positions() const;
+	/**
+	 * Reads the positions offset, which must follow the term 
+	 * frequency and bound.
+	 */
+	ys_filepos_t read_positions_offset();
 	void write_docnum(ys_docnum_t docnum);
 	ys_docnum_t read_docnum();
 	void write_doccnt(ys_doccnt_t doccnt);
 	ys_doccnt_t read_doccnt();
+
+	/**
+	 * Reads up to n postings from the current position. Docnum
+	 * gaps are added to base to give absolute docnums.
+	 */
+	void read_postings(ys_docnum_t *docnums, ys_doccnt_t *dtfs, size_t n,
+		ys_docnum_t base);
+
+	/**
+	 * Writes a complete postings list for a term at the current
+	 * put position, in the format set by set_format(). docnums
+	 * must be in ascending order. positions is the offset of the 
+	 * term's positions, and is only written if has_positions().
+	 */
+	void write_postings(const ys_docnum_t *docnums, const ys_doccnt_t *dtfs,
+		ys_doccnt_t tf, ys_filepos_t positions = 0);
+
+	/**
+	 * Positions the get pointer at the first posting of the term
+	 * at offset, stepping over the bound, positions offset and skip
+	 * table if there are any.
+	 * Returns the term frequency.
+	 */
+	ys_doccnt_t start_postings(ys_postoff_t offset);
+
+	/**
+	 * Must be called after reading the skip table, before the
+	 * first block is read.
+	 */
+	void start_blocks();
 	
 	/**
 	 * Evaluate a user supplied function for each posting starting
@@ -66,13 +174,80 @@ public:
 	void flush();
 };
 
+/**
+ * A PostingsCursor walks one term's postings in docnum order, a block
+ * at a time. skipTo() uses the skip table of v2 postings to avoid
+ * decoding blocks that cannot contain the target. Several cursors may
+ * share a PostFile as each cursor remembers its own bit position.
+ */
+class PostingsCursor {
+private:
+	enum { BLOCKSIZE = YS_POSTINGS_BLOCKSIZE };
+	YASENS PostFile *pf;
+	ys_doccnt_t tf;
+	ys_doccnt_t ndecoded;		/* postings decoded so far */
+	ys_uint64_t bitpos;		/* position of next undecoded block */
+	ys_uint64_t datapos;		/* position of first block */
+	ys_docnum_t base;		/* last docnum of previous block */
+	ys_docnum_t docnums[BLOCKSIZE];
+	ys_doccnt_t dtfs[BLOCKSIZE];
+	int count;
+	int cur;
+	ys_doccnt_t nblocks;		/* number of skip entries */
+	ys_doccnt_t block;		/* current block */
+	ys_docnum_t *skipdoc;		/* last docnum in each block */
+	ys_uint64_t *skippos;		/* block offset relative to datapos */
+	ys_doccnt_t *skipmaxdtf;	/* largest dtf in each block */
+	float bound;			/* see YS_POSTINGS_BOUNDS */
+	ys_filepos_t positions;		/* see YS_POSTINGS_POSITIONS */
+
+	void readBlock();
+	void clear();
+public:
+	PostingsCursor();
+	~PostingsCursor();
+	/**
+	 * Positions the cursor at the first posting of the term at
+	 * offset. Returns -1 on error.
+	 */
+	int open(YASENS PostFile *pf, ys_postoff_t offset);
+	ys_bool_t atEnd() const { return cur >= count; }
+	ys_docnum_t docnum() const { return docnums[cur]; }
+	ys_doccnt_t dtf() const { return dtfs[cur]; }
+	ys_doccnt_t getTf() const { return tf; }
+	/**
+	 * Upper bound on log_dtf/document weight for the term, or 0 if
+	 * the postings do not record one.
+	 */
+	float getBound() const { return bound; }
+	/**
+	 * Offset of the term's positions, or 0 if the postings do not
+	 * record it.
+	 */
+	ys_filepos_t getPositionsOffset() const { return positions; }
+	/**
+	 * Largest dtf in the current block, or 0 if the postings
+	 * have no skip table.
+	 */
+	ys_doccnt_t blockMaxDtf() const;
+	void next();
+	/**
+	 * Advances to the first posting with docnum >= target.
+	 */
+	void skipTo(ys_docnum_t target);
+};
+
 YASE_NS_END
 
 inline 
-YASENS PostFile::PostFile() {}
+YASENS PostFile::PostFile() : format(YS_POSTINGS_V1), 
+	codec(new YASENS GammaCodec()) {}
 
 inline
-YASENS PostFile::~PostFile() {}
+YASENS PostFile::~PostFile() 
+{
+	delete codec;
+}
 
 inline int
 YASENS PostFile::open(const char *filename, const char *mode)
@@ -86,6 +261,12 @@ YASENS PostFile::close()
 	bf.close();
 }
 
+inline int
+YASENS PostFile::set_buffer_size(size_t size)
+{
+	return bf.setBufferSize(size);
+}
+
 inline ys_postoff_t 
 YASENS PostFile::get_gpos()
 {
@@ -98,6 +279,83 @@ YASENS PostFile::set_gpos(ys_postoff_t pos)
 	bf.setgpos((ys_filepos_t) pos);
 }
 
+inline ys_uint64_t
+YASENS PostFile::get_gbitpos()
+{
+	return bf.getgbitpos();
+}
+
+inline void
+YASENS PostFile::set_gbitpos(ys_uint64_t bitpos)
+{
+	bf.setgbitpos(bitpos);
+}
+
+inline int
+YASENS PostFile::set_format(int fmt)
+{
+	YASENS PostingsCodec *c = YASENS PostingsCodec::create(fmt);
+	if (c == 0) {
+		fprintf(stderr, "Error: unknown postings codec %x\n", 
+			fmt & YS_POSTINGS_CODEC_MASK);
+		return -1;
+	}
+	delete codec;
+	codec = c;
+	format = (fmt & YS_POSTINGS_VERSION_MASK) == 0 ? 
+		(fmt | YS_POSTINGS_V1) : fmt;
+	return 0;
+}
+
+inline void
+YASENS PostFile::start_blocks()
+{
+	codec->startRead(bf);
+}
+
+inline int
+YASENS PostFile::get_format() const
+{
+	return format;
+}
+
+inline int
+YASENS PostFile::get_version() const
+{
+	return format & YS_POSTINGS_VERSION_MASK;
+}
+
+inline bool
+YASENS PostFile::has_bound(ys_doccnt_t tf) const
+{
+	return (format & YS_POSTINGS_BOUNDS) != 0 && 
+		get_version() == YS_POSTINGS_V2 && tf > YS_POSTINGS_BLOCKSIZE;
+}
+
+inline float
+YASENS PostFile::read_bound()
+{
+	float bound;
+	bf.alignGet();
+	bf.getBytes(&bound, sizeof bound);
+	return bound;
+}
+
+inline bool
+YASENS PostFile::has_positions() const
+{
+	return (format & YS_POSTINGS_POSITIONS) != 0;
+}
+
+inline ys_filepos_t
+YASENS PostFile::read_positions_offset()
+{
+	ys_filepos_t offset;
+	bf.alignGet();
+	bf.getBytes(&offset, sizeof offset);
+	return offset;
+}
+
 inline ys_postoff_t 
 YASENS PostFile::get_ppos()
 {
@@ -140,4 +398,11 @@ YASENS PostFile::flush()
 	bf.flush();
 }
 
+inline void
+YASENS PostingsCursor::next()
+{
+	if (++cur >= count && ndecoded < tf)
+		readBlock();
+}
+
 #endif
@@ -22,6 +22,13 @@
 */
 
 /* 12-22 Jan 2003: Converted to C++ from old C stuff */
+/* 17 Oct 2026: WebInput can take its variables from a connection. */
+/* 17 Oct 2026: <collection>.maxexpansion limits query pattern expansion. */
+/* 17 Oct 2026: ConsoleOutput uses ys_dbgetdocref(). */
+/* 17 Oct 2026: Results may come from a QueryCache. */
+/* 17 Oct 2026: Cached results are kept under the generation the 
+ * collection was opened at. */
+/* 18 Oct 2026: No more results are asked for than the collection holds. */
 
 #include "query.h"
 #include "util.h"
@@ -51,20 +58,46 @@ safe_getenv(const char *name)
 }
 
 YASENS WebInput::WebInput()
+{
+	env = 0;
+	init(stdin);
+}
+
+YASENS WebInput::WebInput(const char * const *env, FILE *in)
+{
+	this->env = env;
+	init(in);
+}
+
+const char *
+YASENS WebInput::getVariable(const char *name) const
+{
+	if (env == 0)
+		return safe_getenv(name);
+	size_t len = strlen(name);
+	for (int i = 0; env[i] != 0; i++) {
+		if (strncmp(env[i], name, len) == 0 && env[i][len] == '=')
+			return env[i] + len + 1;
+	}
+	return "";
+}
+
+void
+YASENS WebInput::init(FILE *in)
 {
 	buf = bufp = 0;
-	referrer = safe_getenv("HTTP_REFERER");
-	host = safe_getenv("HTTP_HOST");
-	documentroot = safe_getenv("DOCUMENT_ROOT");
-	requestmethod = safe_getenv("REQUEST_METHOD");
-	scriptname = safe_getenv("SCRIPT_NAME");
-	const char *cl = safe_getenv("CONTENT_LENGTH");
+	referrer = getVariable("HTTP_REFERER");
+	host = getVariable("HTTP_HOST");
+	documentroot = getVariable("DOCUMENT_ROOT");
+	requestmethod = getVariable("REQUEST_METHOD");
+	scriptname = getVariable("SCRIPT_NAME");
+	const char *cl = getVariable("CONTENT_LENGTH");
 	contentlength = atol(cl);
 	if (strcasecmp(requestmethod, "get") == 0)
-		querystring = (ys_uchar_t *) strdup(safe_getenv("QUERY_STRING"));
+		querystring = (ys_uchar_t *) strdup(getVariable("QUERY_STRING"));
 	else {
-		querystring = (ys_uchar_t *) malloc(contentlength);
-		size_t n = fread(querystring, 1, contentlength, stdin);
+		querystring = (ys_uchar_t *) calloc(1, contentlength+1);
+		size_t n = fread(querystring, 1, contentlength, in);
 		// if (n != (size_t)contentlength)
 		//	ERROR
 	}
@@ -232,8 +265,9 @@ YASENS TestInput::getInput(QueryForm *form)
 	return true;
 }
 
-YASENS QueryAction::QueryAction()
+YASENS QueryAction::QueryAction(YASENS QueryCache *cache)
 {
+	this->cache = cache;
 }
 
 YASENS QueryAction::~QueryAction()
@@ -247,27 +281,127 @@ YASENS QueryAction::doSearch(YASENS Collection *collection, YASENS QueryForm *fo
 	if (search == 0)
 		return 0;
 	search->addInput(form->getQueryExpr());
+	/* Only the pages up to the one being displayed are needed, and
+	 * never more than the collection holds; the page size and page
+	 * come from the request, so their product may also overflow */
+	int need = 0;
+	int pagesize = form->getPageSize();
+	int curpage = form->getCurrentPage();
+	if (pagesize > 0 && curpage > 0) {
+		ys_doccnt_t n = collection->getN();
+		if (n > INT_MAX)
+			n = INT_MAX;
+		if ((ys_doccnt_t) curpage > n / pagesize)
+			need = (int) n;
+		else
+			need = pagesize * curpage;
+	}
+	search->setMaxResults(need);
 	YASENS SearchResultSet *rs = 0;
-	if (search->parseQuery()) {
+	if (!search->parseQuery()) {
+		delete search;
+		return 0;
+	}
+
+	char key[YS_QUERYCACHE_KEYLEN];
+	char query[YS_QUERYCACHE_KEYLEN];
+	if (cache == 0 || !search->getCacheKey(query, sizeof query) ||
+		snprintf(key, sizeof key, "%s\n%d\n%d\n%d\n%s", 
+		cache->getPath(), form->getMethod(), 
+		collection->getWeightBits(), collection->getMaxExpansion(), 
+		query) >= (int) sizeof key) {
 		rs = search->executeQuery();
+		delete search;
+		return rs;
+	}
+
+	struct timeval start, stop;
+	gettimeofday(&start, (struct timezone *)0);
+	/* Not the generation in yase.info now, which may be newer than
+	 * the documents the collection holds */
+	ys_uint32_t generation = collection->getGeneration();
+	YASENS CachedResultSet *cs = cache->get(key, generation, need);
+	if (cs != 0) {
+		gettimeofday(&stop, (struct timezone *)0);
+		cs->setElapsedTime(ys_calculate_elapsed_time(&start, &stop));
+		delete search;
+		return cs;
 	}
+	/* Find enough results for the next pages as well */
+	if (need > 0 && need < cache->getDepth())
+		search->setMaxResults(cache->getDepth());
+	rs = search->executeQuery();
 	delete search;
-	return rs;
+	if (rs == 0)
+		return 0;
+	cs = YASENS CachedResultSet::copy(rs, 
+		need > 0 && need < cache->getDepth() ? cache->getDepth() : need);
+	delete rs;
+	cache->put(key, generation, cs);
+	return cs;
+}
+
+int
+YASENS QueryAction::openCollection(YASENS Collection *collection, 
+	YASENS Properties *prop, const char *name, const char *path)
+{
+	char key[1024];
+	snprintf(key, sizeof key, "%s.blockcache", name);
+	const char *blockcache = prop->get(key);
+	if (blockcache != 0)
+		collection->setCacheSize(strtoul(blockcache, 0, 10));
+	snprintf(key, sizeof key, "%s.docweights", name);
+	const char *docweights = prop->get(key);
+	if (docweights != 0)
+		collection->setWeightBits(atoi(docweights));
+	snprintf(key, sizeof key, "%s.maxexpansion", name);
+	const char *maxexpansion = prop->get(key);
+	if (maxexpansion != 0)
+		collection->setMaxExpansion(atoi(maxexpansion));
+	return collection->open(path, "r");
+}
+
+YASENS QueryCache *
+YASENS QueryAction::openCache(YASENS Properties *prop, const char *name,
+	const char *path, bool shared)
+{
+	char key[1024];
+	snprintf(key, sizeof key, "%s.querycache", name);
+	const char *entries = prop->get(key);
+	if (entries == 0 || atoi(entries) <= 0)
+		return 0;
+	int depth = YS_QUERYCACHE_DEPTH;
+	snprintf(key, sizeof key, "%s.querycachedepth", name);
+	const char *value = prop->get(key);
+	if (value != 0 && atoi(value) > 0)
+		depth = atoi(value);
+	if (!shared)
+		return new YASENS MemoryQueryCache(path, atoi(entries), depth);
+	snprintf(key, sizeof key, "%s.querycachefile", name);
+	const char *file = prop->get(key);
+	if (file == 0)
+		return 0;
+	YASENS FileQueryCache *cache = new YASENS FileQueryCache(path, depth);
+	if (cache->open(file, atoi(entries)) != 0) {
+		delete cache;
+		return 0;
+	}
+	return cache;
 }
 
 void
 YASENS ConsoleOutput::doOutput(YASENS Collection *collection, YASENS QueryForm *form, YASENS QueryInput *input, YASENS SearchResultSet *rs)
 {
 	ys_docdb_t *db = collection->getDocDb();
-	ys_docdata_t docfile, doc;
+	ys_docref_t ref;
 	if (rs != 0) {
 		YASENS SearchResultItem *item = rs->getNext();
 		while (item != 0) {
-			ys_dbgetdocumentref(db, item->getDocnum(),
-				&docfile, &doc);
 			item->dump(stdout);
-			fprintf(stdout, "Filename %s, Title %s\n",
-				docfile.filename, docfile.title);
+			if (ys_dbgetdocref(db, item->getDocnum(), &ref) == 0)
+				fprintf(stdout, "Filename %s, Title %s\n",
+					ref.field[YS_DOCFIELD_LOGICALNAME], 
+					ref.field[YS_DOCFIELD_FILETITLE]);
 			item = rs->getNext();
 		}
 	}
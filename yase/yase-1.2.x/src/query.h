@@ -22,6 +22,10 @@
 */
 
 /* 12-22 Jan 2003: Converted to C++ from old C stuff */
+/* 17 Oct 2026: WebInput and HtmlOutput can work on a connection
+ * instead of the process environment and stdio. */
+/* 17 Oct 2026: HtmlOutput::outputRow() takes a ys_docref_t. */
+/* 17 Oct 2026: QueryAction can use a QueryCache. */
 
 #ifndef query_h
 #define query_h
@@ -32,9 +36,12 @@
 #include "postfile.h"
 #include "docdb.h"
 #include "search.h"
+#include "querycache.h"
 
 YASE_NS_BEGIN
 
+class Properties;
+
 /**
  * QueryForm holds the data captured from the browser.
  */
@@ -90,11 +97,21 @@ private:
 private:
 	ys_uchar_t *buf;
 	ys_uchar_t *bufp;
+	const char * const *env;
 private:
+	void init(FILE *in);
+	const char *getVariable(const char *name) const;
 	bool getNextField(const ys_uchar_t *line, ys_uchar_t *name, size_t namelen, ys_uchar_t *value, size_t valuelen);
 	bool processParameter(QueryForm *form, const ys_uchar_t *name, const ys_uchar_t *value);
 public:
 	WebInput();
+	/**
+	 * Takes the CGI variables from env, a null terminated array of
+	 * NAME=value strings, instead of the environment, and reads a 
+	 * POST request from in. env must remain valid while the WebInput
+	 * is in use.
+	 */
+	WebInput(const char * const *env, FILE *in);
 	virtual ~WebInput();
 
 	const char *getHttpReferrer() const { return referrer; }
@@ -148,6 +165,10 @@ private:
 	WebInput *input;
 public:
 	HtmlOutput();
+	/**
+	 * Writes to the given stream instead of stdout.
+	 */
+	HtmlOutput(FILE *out);
 	virtual ~HtmlOutput();
 	virtual void doOutput(YASENS Collection *collection, QueryForm *form, QueryInput *input, YASENS SearchResultSet *rs);
 	virtual void start();
@@ -157,10 +178,7 @@ private:
 	void doHeader();
 	void doFooter();
 	void outputRow(
-		const char *reference,		/* HTML Link */
-		const char *anchor, 		/* Anchor */
-		ys_docdata_t *docfile,		/* Document File */
-		ys_docdata_t *doc, 		/* Document */
+		const ys_docref_t *ref,		/* Stored fields of the document */
 		double rank, 			/* Rank */
 		int matchcount); 		/* Number of hits */
 	const char * substLink(
@@ -173,7 +191,8 @@ private:
 		int curpage,		/* Current page */
 		int pagecount, 		/* Total Page count */
 		int pagesize,		/* Size of each page */
-		double elapsed_time);
+		double elapsed_time,
+		bool exact);		/* Is matches exact ? */
 };
 
 
@@ -195,10 +214,32 @@ public:
 
 class QueryAction
 {
+private:
+	YASENS QueryCache *cache;
 public:
-	QueryAction();
+	/**
+	 * Results are looked for in, and added to, cache, if it is not 0.
+	 */
+	QueryAction(YASENS QueryCache *cache = 0);
 	~QueryAction();
 	YASENS SearchResultSet *doSearch(YASENS Collection *collection, QueryForm *form);
+	/**
+	 * Opens the collection at path for searching, applying the
+	 * settings for the named collection in prop. Returns -1 on error.
+	 */
+	static int openCollection(YASENS Collection *collection, 
+		YASENS Properties *prop, const char *name, const char *path);
+	/**
+	 * Creates the query cache set up for the named collection in 
+	 * prop, or returns 0 if it has none. <name>.querycache is the 
+	 * number of queries to keep, and <name>.querycachedepth the 
+	 * number of results of each (default YS_QUERYCACHE_DEPTH).
+	 * The cache is kept in memory, unless shared is set, when it is 
+	 * the file given by <name>.querycachefile, and there is no cache
+	 * if that is not given.
+	 */
+	static YASENS QueryCache *openCache(YASENS Properties *prop, 
+		const char *name, const char *path, bool shared);
 };	
 
 YASE_NS_END
@@ -0,0 +1,492 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+/* 17 Oct 2026: Created - cache of query results */
+/* 17 Oct 2026: Added purge() */
+
+#include "querycache.h"
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+YASENS CachedResultSet::CachedResultSet(int n)
+{
+	items = new YASENS CachedResult[n > 0 ? n : 1];
+	nitems = 0;
+	current = 0;
+}
+
+YASENS CachedResultSet *
+YASENS CachedResultSet::copy(YASENS SearchResultSet *rs, int max)
+{
+	int n = rs->getCount();
+	if (max > 0 && n > max)
+		n = max;
+	YASENS CachedResultSet *cs = new YASENS CachedResultSet(n);
+	YASENS SearchResultItem *item;
+	while ((max == 0 || cs->nitems < max) && (item = rs->getNext()) != 0) {
+		if (cs->nitems == n) {
+			/* The count was low */
+			YASENS CachedResult *items = new YASENS CachedResult[2*n+1];
+			for (int i = 0; i < n; i++)
+				items[i] = cs->items[i];
+			delete [] cs->items;
+			cs->items = items;
+			n = 2*n+1;
+		}
+		YASENS CachedResult *r = &cs->items[cs->nitems++];
+		r->docnum = item->getDocnum();
+		r->rank = item->getScore();
+		r->hits = item->getHits();
+	}
+	cs->count = rs->getCount();
+	cs->countExact = rs->isCountExact();
+	cs->elapsed = rs->getElapsedTime();
+	return cs;
+}
+
+bool
+YASENS CachedResultSet::contains(ys_docnum_t docnum)
+{
+	for (int i = 0; i < nitems; i++)
+		if (items[i].docnum == docnum)
+			return true;
+	return false;
+}
+
+YASENS QueryCache::QueryCache(const char *path, int depth)
+{
+	snprintf(this->path, sizeof this->path, "%s", path);
+	this->depth = depth > 0 ? depth : YS_QUERYCACHE_DEPTH;
+}
+
+/**
+ * FNV-1a
+ */
+ys_uint32_t
+YASENS QueryCache::hash(const char *key)
+{
+	ys_uint32_t h = 2166136261U;
+	for (const ys_uchar_t *cp = (const ys_uchar_t *) key; *cp; cp++) {
+		h ^= *cp;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+struct YASENS MemoryQueryCache::Entry {
+	char *key;
+	ys_uint32_t hash;
+	ys_uint32_t generation;
+	YASENS CachedResultSet *rs;
+	Entry *chain;			/* next in bucket */
+	Entry *prev;			/* more recently used */
+	Entry *next;			/* less recently used */
+};
+
+YASENS MemoryQueryCache::MemoryQueryCache(const char *path, int capacity,
+	int depth) : YASENS QueryCache(path, depth)
+{
+	this->capacity = capacity > 0 ? capacity : 1;
+	nbuckets = this->capacity;
+	buckets = new Entry *[nbuckets];
+	for (int i = 0; i < nbuckets; i++)
+		buckets[i] = 0;
+	head = tail = 0;
+	nentries = 0;
+	ys_mutex_init(&mutex);
+}
+
+YASENS MemoryQueryCache::~MemoryQueryCache()
+{
+	while (head != 0)
+		remove(head);
+	delete [] buckets;
+	ys_mutex_destroy(&mutex);
+}
+
+YASENS MemoryQueryCache::Entry *
+YASENS MemoryQueryCache::find(const char *key, ys_uint32_t h)
+{
+	for (Entry *e = buckets[h % nbuckets]; e != 0; e = e->chain) {
+		if (e->hash == h && strcmp(e->key, key) == 0)
+			return e;
+	}
+	return 0;
+}
+
+/**
+ * Takes an entry off the list of recently used entries.
+ */
+void
+YASENS MemoryQueryCache::unlink(Entry *e)
+{
+	if (e->prev != 0)
+		e->prev->next = e->next;
+	else
+		head = e->next;
+	if (e->next != 0)
+		e->next->prev = e->prev;
+	else
+		tail = e->prev;
+	e->prev = e->next = 0;
+}
+
+void
+YASENS MemoryQueryCache::remove(Entry *e)
+{
+	Entry **ep = &buckets[e->hash % nbuckets];
+	while (*ep != e)
+		ep = &(*ep)->chain;
+	*ep = e->chain;
+	unlink(e);
+	nentries--;
+	free(e->key);
+	delete e->rs;
+	delete e;
+}
+
+YASENS CachedResultSet *
+YASENS MemoryQueryCache::get(const char *key, ys_uint32_t generation, 
+	int need)
+{
+	YASENS CachedResultSet *cs = 0;
+	ys_uint32_t h = hash(key);
+
+	ys_mutex_lock(&mutex);
+	Entry *e = find(key, h);
+	if (e != 0 && e->generation != generation) {
+		remove(e);
+		e = 0;
+	}
+	if (e != 0 && e->rs->covers(need)) {
+		unlink(e);
+		e->next = head;
+		if (head != 0)
+			head->prev = e;
+		else
+			tail = e;
+		head = e;
+		YASENS CachedResultSet *rs = e->rs;
+		cs = new YASENS CachedResultSet(rs->nitems);
+		for (int i = 0; i < rs->nitems; i++)
+			cs->items[i] = rs->items[i];
+		cs->nitems = rs->nitems;
+		cs->count = rs->count;
+		cs->countExact = rs->countExact;
+	}
+	ys_mutex_unlock(&mutex);
+	return cs;
+}
+
+void
+YASENS MemoryQueryCache::put(const char *key, ys_uint32_t generation, 
+	const YASENS CachedResultSet *rs)
+{
+	ys_uint32_t h = hash(key);
+	int n = rs->nitems < depth ? rs->nitems : depth;
+
+	Entry *e = new Entry;
+	e->key = strdup(key);
+	e->hash = h;
+	e->generation = generation;
+	e->rs = new YASENS CachedResultSet(n);
+	for (int i = 0; i < n; i++)
+		e->rs->items[i] = rs->items[i];
+	e->rs->nitems = n;
+	e->rs->count = rs->count;
+	e->rs->countExact = rs->countExact;
+
+	ys_mutex_lock(&mutex);
+	Entry *old = find(key, h);
+	if (old != 0)
+		remove(old);
+	e->chain = buckets[h % nbuckets];
+	buckets[h % nbuckets] = e;
+	e->prev = 0;
+	e->next = head;
+	if (head != 0)
+		head->prev = e;
+	else
+		tail = e;
+	head = e;
+	if (++nentries > capacity)
+		remove(tail);
+	ys_mutex_unlock(&mutex);
+}
+
+void
+YASENS MemoryQueryCache::purge(ys_uint32_t generation)
+{
+	ys_mutex_lock(&mutex);
+	Entry *e = head;
+	while (e != 0) {
+		Entry *next = e->next;
+		if (e->generation != generation)
+			remove(e);
+		e = next;
+	}
+	ys_mutex_unlock(&mutex);
+}
+
+/*
+ * The cache file is a header followed by nslots slots. A slot is a 
+ * ys_qcache_slot_t followed by depth ys_qcache_item_t. A slot whose
+ * keylen is 0 is empty.
+ */
+enum {
+	YS_QCACHE_MAGIC = 0x43515359,	/* "YSQC" */
+	YS_QCACHE_VERSION = 1
+};
+
+typedef struct {
+	ys_uint32_t magic;
+	ys_uint32_t version;
+	ys_uint32_t nslots;
+	ys_uint32_t depth;
+} ys_qcache_header_t;
+
+typedef struct {
+	ys_uint32_t hash;
+	ys_uint32_t generation;
+	ys_uint32_t keylen;
+	ys_uint32_t nitems;
+	ys_int32_t count;
+	ys_uint32_t exact;
+	char key[YS_QUERYCACHE_KEYLEN];
+} ys_qcache_slot_t;
+
+typedef struct {
+	ys_docnum_t docnum;
+	float rank;
+	ys_int32_t hits;
+} ys_qcache_item_t;
+
+YASENS FileQueryCache::FileQueryCache(const char *path, int depth)
+	: YASENS QueryCache(path, depth)
+{
+	name[0] = 0;
+	fd = -1;
+	map = 0;
+	len = 0;
+	nslots = 0;
+	slotsize = sizeof(ys_qcache_slot_t) + this->depth * sizeof(ys_qcache_item_t);
+}
+
+#ifdef WIN32
+
+YASENS FileQueryCache::~FileQueryCache()
+{
+}
+
+int
+YASENS FileQueryCache::open(const char *name, int nslots)
+{
+	fprintf(stderr, "Error: a query cache file is not supported on this platform\n");
+	return -1;
+}
+
+YASENS CachedResultSet *
+YASENS FileQueryCache::get(const char *key, ys_uint32_t generation, int need)
+{
+	return 0;
+}
+
+void
+YASENS FileQueryCache::put(const char *key, ys_uint32_t generation, 
+	const YASENS CachedResultSet *rs)
+{
+}
+
+#else
+
+YASENS FileQueryCache::~FileQueryCache()
+{
+	if (map != 0)
+		munmap(map, len);
+	if (fd >= 0)
+		::close(fd);
+}
+
+/**
+ * Makes a new, empty, cache file, which is renamed over the old one so
+ * that processes using that are not disturbed.
+ */
+int
+YASENS FileQueryCache::create()
+{
+	char tmpname[1100];
+	ys_qcache_header_t hdr;
+
+	snprintf(tmpname, sizeof tmpname, "%s.%ld", name, (long) getpid());
+	fd = ::open(tmpname, O_RDWR|O_CREAT|O_TRUNC, 0666);
+	if (fd < 0) {
+		perror(tmpname);
+		return -1;
+	}
+	hdr.magic = YS_QCACHE_MAGIC;
+	hdr.version = YS_QCACHE_VERSION;
+	hdr.nslots = nslots;
+	hdr.depth = depth;
+	if (ftruncate(fd, (off_t) len) != 0 || 
+		pwrite(fd, &hdr, sizeof hdr, 0) != (ssize_t) sizeof hdr ||
+		rename(tmpname, name) != 0) {
+		perror(tmpname);
+		::close(fd);
+		fd = -1;
+		unlink(tmpname);
+		return -1;
+	}
+	return 0;
+}
+
+int
+YASENS FileQueryCache::open(const char *name, int nslots)
+{
+	struct stat statbuf;
+	ys_qcache_header_t hdr;
+
+	snprintf(this->name, sizeof this->name, "%s", name);
+	this->nslots = nslots > 0 ? nslots : 1;
+	len = sizeof hdr + this->nslots * slotsize;
+	fd = ::open(name, O_RDWR);
+	if (fd >= 0 && (fstat(fd, &statbuf) != 0 || 
+		(size_t) statbuf.st_size != len || 
+		pread(fd, &hdr, sizeof hdr, 0) != (ssize_t) sizeof hdr ||
+		hdr.magic != YS_QCACHE_MAGIC || 
+		hdr.version != YS_QCACHE_VERSION ||
+		hdr.nslots != (ys_uint32_t) this->nslots || 
+		hdr.depth != (ys_uint32_t) depth)) {
+		::close(fd);
+		fd = -1;
+	}
+	if (fd < 0 && create() != 0)
+		return -1;
+	void *p = mmap(0, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		perror(name);
+		::close(fd);
+		fd = -1;
+		return -1;
+	}
+	map = (ys_uchar_t *) p;
+	return 0;
+}
+
+bool
+YASENS FileQueryCache::lock(int slot, bool write)
+{
+	struct flock fl;
+
+	memset(&fl, 0, sizeof fl);
+	fl.l_type = write ? F_WRLCK : F_RDLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = sizeof(ys_qcache_header_t) + slot * slotsize;
+	fl.l_len = slotsize;
+	while (fcntl(fd, F_SETLKW, &fl) != 0) {
+		if (errno != EINTR)
+			return false;
+	}
+	return true;
+}
+
+void
+YASENS FileQueryCache::unlock(int slot)
+{
+	struct flock fl;
+
+	memset(&fl, 0, sizeof fl);
+	fl.l_type = F_UNLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = sizeof(ys_qcache_header_t) + slot * slotsize;
+	fl.l_len = slotsize;
+	fcntl(fd, F_SETLK, &fl);
+}
+
+YASENS CachedResultSet *
+YASENS FileQueryCache::get(const char *key, ys_uint32_t generation, int need)
+{
+	YASENS CachedResultSet *cs = 0;
+	ys_uint32_t h = hash(key);
+	size_t keylen = strlen(key);
+	int slot = h % nslots;
+
+	if (map == 0 || keylen >= YS_QUERYCACHE_KEYLEN || !lock(slot, false))
+		return 0;
+	ys_qcache_slot_t *s = (ys_qcache_slot_t *)
+		(map + sizeof(ys_qcache_header_t) + slot * slotsize);
+	const ys_qcache_item_t *items = (const ys_qcache_item_t *) (s + 1);
+	if (s->keylen == keylen && s->hash == h && 
+		s->generation == generation && s->nitems <= (ys_uint32_t) depth &&
+		memcmp(s->key, key, keylen) == 0 &&
+		((need > 0 && s->nitems >= (ys_uint32_t) need) ||
+		(s->exact && s->nitems >= (ys_uint32_t) s->count))) {
+		cs = new YASENS CachedResultSet(s->nitems);
+		for (ys_uint32_t i = 0; i < s->nitems; i++) {
+			YASENS CachedResult *r = &cs->items[i];
+			r->docnum = items[i].docnum;
+			r->rank = items[i].rank;
+			r->hits = items[i].hits;
+		}
+		cs->nitems = s->nitems;
+		cs->count = s->count;
+		cs->countExact = s->exact != 0;
+	}
+	unlock(slot);
+	return cs;
+}
+
+void
+YASENS FileQueryCache::put(const char *key, ys_uint32_t generation, 
+	const YASENS CachedResultSet *rs)
+{
+	ys_uint32_t h = hash(key);
+	size_t keylen = strlen(key);
+	int slot = h % nslots;
+	int n = rs->nitems < depth ? rs->nitems : depth;
+
+	if (map == 0 || keylen >= YS_QUERYCACHE_KEYLEN || !lock(slot, true))
+		return;
+	ys_qcache_slot_t *s = (ys_qcache_slot_t *)
+		(map + sizeof(ys_qcache_header_t) + slot * slotsize);
+	ys_qcache_item_t *items = (ys_qcache_item_t *) (s + 1);
+	for (int i = 0; i < n; i++) {
+		items[i].docnum = rs->items[i].docnum;
+		items[i].rank = rs->items[i].rank;
+		items[i].hits = rs->items[i].hits;
+	}
+	s->hash = h;
+	s->generation = generation;
+	s->nitems = n;
+	s->count = rs->count;
+	s->exact = rs->countExact;
+	memcpy(s->key, key, keylen+1);
+	s->keylen = keylen;
+	unlock(slot);
+}
+
+#endif
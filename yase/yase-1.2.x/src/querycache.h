@@ -0,0 +1,193 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+/* 17 Oct 2026: Created - cache of query results */
+
+#ifndef querycache_h
+#define querycache_h
+
+#include "yase.h"
+#include "ysthread.h"
+#include "search.h"
+
+enum {
+	YS_QUERYCACHE_KEYLEN = 1024,	/* longest key, with its nul */
+	YS_QUERYCACHE_DEPTH = 200	/* default results kept per query */
+};
+
+YASE_NS_BEGIN
+
+class CachedResult : public SearchResultItem {
+	friend class CachedResultSet;
+	friend class MemoryQueryCache;
+	friend class FileQueryCache;
+};
+
+/**
+ * The first results of a query, in order, as kept by a QueryCache.
+ * If not all the results are held, only the pages they cover can be 
+ * shown from it.
+ */
+class CachedResultSet : public SearchResultSet {
+	friend class MemoryQueryCache;
+	friend class FileQueryCache;
+private:
+	CachedResult *items;
+	int nitems;
+	int current;
+
+	CachedResultSet(int n);
+	CachedResultSet(const CachedResultSet&);
+	CachedResultSet& operator=(const CachedResultSet&);
+public:
+	~CachedResultSet() { delete [] items; }
+	/**
+	 * Takes the first max results of rs, or all of them if max is 0.
+	 * rs is left at the end of its results.
+	 */
+	static CachedResultSet *copy(SearchResultSet *rs, int max);
+	/**
+	 * Does the set hold the first need results, or all results if 
+	 * need is 0 ?
+	 */
+	bool covers(int need) const {
+		return (need > 0 && nitems >= need) || 
+			(countExact && nitems >= count);
+	}
+	void setElapsedTime(double e) { elapsed = e; }
+	SearchResultItem *getNext() {
+		return current < nitems ? &items[current++] : 0;
+	}
+	bool contains(ys_docnum_t docnum);
+};
+
+/**
+ * A QueryCache keeps the results of queries on one collection, so that
+ * a query that is repeated, or the next page of its results, need not
+ * be evaluated again. Results are looked up by a key made from the 
+ * collection's path, the search method and the normalized query (see 
+ * Search::getCacheKey()), and are only returned while the collection's
+ * generation (see ys_dbgetgeneration()) is the one they were found at.
+ * At most getDepth() results of each query are kept.
+ */
+class QueryCache {
+protected:
+	char path[1024];
+	int depth;
+
+	QueryCache(const char *path, int depth);
+	static ys_uint32_t hash(const char *key);
+private:
+	QueryCache(const QueryCache&);
+	QueryCache& operator=(const QueryCache&);
+public:
+	virtual ~QueryCache() {}
+	const char *getPath() const { return path; }
+	int getDepth() const { return depth; }
+	/**
+	 * Returns the results kept for key at the given generation, if 
+	 * they cover need results (see CachedResultSet::covers()); else 0.
+	 * The caller owns the result set.
+	 */
+	virtual CachedResultSet *get(const char *key, ys_uint32_t generation,
+		int need) = 0;
+	/**
+	 * Keeps the first getDepth() results of rs for key, replacing 
+	 * whatever was kept for it before.
+	 */
+	virtual void put(const char *key, ys_uint32_t generation, 
+		const CachedResultSet *rs) = 0;
+	/**
+	 * Drops the results found at generations other than the given 
+	 * one, which get() would not return.
+	 */
+	virtual void purge(ys_uint32_t generation) = 0;
+};
+
+/**
+ * Keeps the results of the most recently used queries in memory, for
+ * a server process. It may be shared by threads.
+ */
+class MemoryQueryCache : public QueryCache {
+private:
+	struct Entry;
+	Entry **buckets;
+	int nbuckets;
+	Entry *head;			/* most recently used */
+	Entry *tail;
+	int nentries;
+	int capacity;
+	ys_mutex_t mutex;
+
+	Entry *find(const char *key, ys_uint32_t h);
+	void unlink(Entry *e);
+	void remove(Entry *e);
+public:
+	MemoryQueryCache(const char *path, int capacity, 
+		int depth = YS_QUERYCACHE_DEPTH);
+	~MemoryQueryCache();
+	CachedResultSet *get(const char *key, ys_uint32_t generation, 
+		int need);
+	void put(const char *key, ys_uint32_t generation, 
+		const CachedResultSet *rs);
+	void purge(ys_uint32_t generation);
+};
+
+/**
+ * Keeps results in a file that is memory mapped by every process that
+ * uses it, for yasequery as a CGI program. The file has a fixed 
+ * number of slots, and a query is kept in the slot its key hashes to,
+ * replacing the query that was there. Slots are locked with fcntl() 
+ * while they are read or written. If the file was made for another 
+ * number of slots or depth, a new one replaces it.
+ */
+class FileQueryCache : public QueryCache {
+private:
+	char name[1024];
+	int fd;
+	ys_uchar_t *map;
+	size_t len;
+	int nslots;
+	size_t slotsize;
+
+	int create();
+	bool lock(int slot, bool write);
+	void unlock(int slot);
+public:
+	FileQueryCache(const char *path, int depth = YS_QUERYCACHE_DEPTH);
+	~FileQueryCache();
+	/**
+	 * Opens the cache file, creating it if need be. Returns -1 on
+	 * error, when the cache cannot be used.
+	 */
+	int open(const char *name, int nslots);
+	CachedResultSet *get(const char *key, ys_uint32_t generation, 
+		int need);
+	void put(const char *key, ys_uint32_t generation, 
+		const CachedResultSet *rs);
+	/** Does nothing; slots of other generations are replaced in turn */
+	void purge(ys_uint32_t generation) {}
+};
+
+YASE_NS_END
+
+#endif
@@ -0,0 +1,389 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+/* 17 Oct 2026: Created - yasequery server mode */
+/* 17 Oct 2026: Workers share a query cache for each collection */
+/* 17 Oct 2026: A worker's collection is opened again when it changes */
+/* 17 Oct 2026: Results of older generations are purged from the query 
+ * cache when a collection is opened again */
+
+#include "queryserver.h"
+#include "query.h"
+
+#ifndef WIN32
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#endif
+
+enum {
+	YS_SERVER_MAXVARS = 64,		/* CGI variables per request */
+	YS_SERVER_TIMEOUT = 30		/* seconds to wait for a request */
+};
+
+struct OpenCollection {
+	char name[1024];
+	YASENS Collection *collection;
+	OpenCollection *next;
+};
+
+struct YASENS QueryServer::OpenCache {
+	char name[1024];
+	YASENS QueryCache *cache;	/* 0 if the collection has none */
+	OpenCache *next;
+};
+
+struct YASENS QueryServer::Worker {
+	YASENS QueryServer *server;
+	ys_thread_t thread;
+	OpenCollection *collections;
+};
+
+YASENS QueryServer::QueryServer(YASENS Properties *prop, int nworkers)
+{
+	this->prop = prop;
+	this->nworkers = nworkers > 0 ? nworkers : 1;
+	workers = 0;
+	listenfd = -1;
+	sockpath[0] = 0;
+	qsize = 4 * this->nworkers;
+	queue = new int[qsize];
+	qhead = 0;
+	qcount = 0;
+	stopping = false;
+	caches = 0;
+	ys_mutex_init(&mutex);
+	ys_cond_init(&cond);
+	ys_mutex_init(&cachemutex);
+}
+
+YASENS QueryServer::~QueryServer()
+{
+#ifndef WIN32
+	if (listenfd >= 0) {
+		::close(listenfd);
+		unlink(sockpath);
+	}
+#endif
+	delete [] queue;
+	while (caches != 0) {
+		OpenCache *next = caches->next;
+		delete caches->cache;
+		delete caches;
+		caches = next;
+	}
+	ys_cond_destroy(&cond);
+	ys_mutex_destroy(&mutex);
+	ys_mutex_destroy(&cachemutex);
+}
+
+#ifdef WIN32
+
+int
+YASENS QueryServer::listen(const char *path)
+{
+	fprintf(stderr, "Error: server mode is not supported on this platform\n");
+	return -1;
+}
+
+int
+YASENS QueryServer::run()
+{
+	return -1;
+}
+
+#else
+
+static volatile sig_atomic_t Stop_requested = 0;
+
+static void
+ys_server_stop(int sig)
+{
+	Stop_requested = 1;
+}
+
+int
+YASENS QueryServer::listen(const char *path)
+{
+	struct sockaddr_un addr;
+
+	if (strlen(path) >= sizeof addr.sun_path) {
+		fprintf(stderr, "Error: socket path %s is too long\n", path);
+		return -1;
+	}
+	listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenfd < 0) {
+		perror("socket");
+		return -1;
+	}
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(listenfd, (struct sockaddr *)&addr, sizeof addr) != 0 ||
+		::listen(listenfd, SOMAXCONN) != 0) {
+		perror(path);
+		::close(listenfd);
+		listenfd = -1;
+		return -1;
+	}
+	strcpy(sockpath, path);
+	return 0;
+}
+
+int
+YASENS QueryServer::run()
+{
+	struct sigaction sa;
+	sigset_t stopsigs, oldmask;
+	int i, rc = 0;
+
+	if (listenfd < 0)
+		return -1;
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, 0);
+	/* No SA_RESTART, so that accept() is interrupted */
+	sa.sa_handler = ys_server_stop;
+	sigaction(SIGINT, &sa, 0);
+	sigaction(SIGTERM, &sa, 0);
+
+	/* Only this thread should see SIGINT and SIGTERM */
+	sigemptyset(&stopsigs);
+	sigaddset(&stopsigs, SIGINT);
+	sigaddset(&stopsigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stopsigs, &oldmask);
+	workers = new Worker[nworkers];
+	for (i = 0; i < nworkers; i++) {
+		workers[i].server = this;
+		workers[i].collections = 0;
+		if (ys_thread_create(&workers[i].thread, workerMain, &workers[i]) != 0)
+			break;
+	}
+	pthread_sigmask(SIG_SETMASK, &oldmask, 0);
+	if (i < nworkers) {
+		nworkers = i;
+		Stop_requested = 1;
+		rc = -1;
+	}
+
+	while (!Stop_requested) {
+		int fd = accept(listenfd, 0, 0);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			perror("accept");
+			rc = -1;
+			break;
+		}
+		ys_mutex_lock(&mutex);
+		while (qcount == qsize && !Stop_requested)
+			ys_cond_wait(&cond, &mutex);
+		queue[(qhead + qcount++) % qsize] = fd;
+		ys_cond_broadcast(&cond);
+		ys_mutex_unlock(&mutex);
+	}
+
+	ys_mutex_lock(&mutex);
+	stopping = true;
+	ys_cond_broadcast(&cond);
+	ys_mutex_unlock(&mutex);
+	for (i = 0; i < nworkers; i++)
+		ys_thread_join(&workers[i].thread);
+	delete [] workers;
+	workers = 0;
+	return rc;
+}
+
+/**
+ * Waits for a connection. Returns -1 when the server is stopping and
+ * no connections are left.
+ */
+int
+YASENS QueryServer::take()
+{
+	int fd = -1;
+	ys_mutex_lock(&mutex);
+	while (qcount == 0 && !stopping)
+		ys_cond_wait(&cond, &mutex);
+	if (qcount > 0) {
+		fd = queue[qhead];
+		qhead = (qhead + 1) % qsize;
+		qcount--;
+		ys_cond_broadcast(&cond);
+	}
+	ys_mutex_unlock(&mutex);
+	return fd;
+}
+
+void *
+YASENS QueryServer::workerMain(void *arg)
+{
+	Worker *worker = (Worker *) arg;
+	int fd;
+
+	while ((fd = worker->server->take()) >= 0)
+		worker->server->serve(worker, fd);
+
+	OpenCollection *oc = worker->collections;
+	while (oc != 0) {
+		OpenCollection *next = oc->next;
+		delete oc->collection;
+		delete oc;
+		oc = next;
+	}
+	worker->collections = 0;
+	return 0;
+}
+
+/**
+ * Returns the worker's copy of the named collection, opening it on
+ * first use, and again when documents have been added or deleted 
+ * since (see Collection::hasChanged()); the results of the old 
+ * collection are then dropped from the query cache.
+ */
+YASENS Collection *
+YASENS QueryServer::getCollection(Worker *worker, const char *name, 
+	const char *path)
+{
+	OpenCollection *oc;
+	for (oc = worker->collections; oc != 0; oc = oc->next) {
+		if (strcmp(oc->name, name) == 0)
+			break;
+	}
+	if (oc != 0 && !oc->collection->hasChanged())
+		return oc->collection;
+	YASENS Collection *collection = new YASENS Collection();
+	if (YASENS QueryAction::openCollection(collection, prop, name, path) != 0) {
+		delete collection;
+		return 0;
+	}
+	if (oc == 0) {
+		oc = new OpenCollection;
+		strncpy(oc->name, name, sizeof oc->name);
+		oc->name[sizeof oc->name - 1] = 0;
+		oc->next = worker->collections;
+		worker->collections = oc;
+	}
+	else {
+		delete oc->collection;
+		YASENS QueryCache *cache = getCache(name, path);
+		if (cache != 0)
+			cache->purge(collection->getGeneration());
+	}
+	oc->collection = collection;
+	return collection;
+}
+
+/**
+ * Returns the query cache of the named collection, creating it on 
+ * first use, or 0 if it has none.
+ */
+YASENS QueryCache *
+YASENS QueryServer::getCache(const char *name, const char *path)
+{
+	OpenCache *oc;
+	ys_mutex_lock(&cachemutex);
+	for (oc = caches; oc != 0; oc = oc->next) {
+		if (strcmp(oc->name, name) == 0)
+			break;
+	}
+	if (oc == 0) {
+		oc = new OpenCache;
+		strncpy(oc->name, name, sizeof oc->name);
+		oc->name[sizeof oc->name - 1] = 0;
+		oc->cache = YASENS QueryAction::openCache(prop, name, path, false);
+		oc->next = caches;
+		caches = oc;
+	}
+	ys_mutex_unlock(&cachemutex);
+	return oc->cache;
+}
+
+void
+YASENS QueryServer::serve(Worker *worker, int fd)
+{
+	char vars[YS_SERVER_MAXVARS][4096];
+	const char *env[YS_SERVER_MAXVARS+1];
+	struct timeval tv;
+	int nvars = 0;
+
+	tv.tv_sec = YS_SERVER_TIMEOUT;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+	FILE *in = fdopen(fd, "r");
+	int outfd = dup(fd);
+	FILE *out = outfd >= 0 ? fdopen(outfd, "w") : 0;
+	if (in == 0 || out == 0) {
+		perror("fdopen");
+		if (in != 0) fclose(in); else ::close(fd);
+		if (out != 0) fclose(out); else if (outfd >= 0) ::close(outfd);
+		return;
+	}
+
+	while (nvars < YS_SERVER_MAXVARS && 
+		fgets(vars[nvars], sizeof vars[nvars], in) != 0) {
+		char *cp = strchr(vars[nvars], '\n');
+		if (cp != 0)
+			*cp = 0;
+		cp = strchr(vars[nvars], '\r');
+		if (cp != 0)
+			*cp = 0;
+		if (vars[nvars][0] == 0)
+			break;
+		env[nvars] = vars[nvars];
+		nvars++;
+	}
+	env[nvars] = 0;
+
+	YASENS WebInput input(env, in);
+	YASENS QueryForm form;
+	YASENS HtmlOutput output(out);
+	output.start();
+	input.getInput(&form);
+	const char *path = prop->get(form.getCollectionPath());
+	YASENS Collection *collection = 0;
+	if (path == 0) 
+		output.message("Unrecognised Collection %s\n", form.getCollectionPath());
+	else if ((collection = getCollection(worker, form.getCollectionPath(), path)) == 0)
+		output.message("Failed to open database\n");
+	else {
+		YASENS QueryAction action(getCache(form.getCollectionPath(), path));
+		YASENS SearchResultSet *rs = action.doSearch(collection, &form);
+		if (rs != 0) {
+			output.doOutput(collection, &form, &input, rs);
+			delete rs;
+		}
+		else 
+			output.message("Failed to process query\n");
+	}
+	output.end();
+	fclose(out);
+	fclose(in);
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+/* 17 Oct 2026: Created - yasequery server mode */
+/* 17 Oct 2026: Workers share a query cache for each collection */
+
+#ifndef queryserver_h
+#define queryserver_h
+
+#include "yase.h"
+#include "ysthread.h"
+#include "collection.h"
+#include "properties.h"
+#include "querycache.h"
+
+YASE_NS_BEGIN
+
+/**
+ * QueryServer answers queries over a Unix domain socket, so that 
+ * collections are opened once rather than for every request. Each 
+ * connection carries one request, in the manner of a CGI invocation:
+ * the client sends the CGI variables as NAME=value lines ended by an 
+ * empty line, followed by the body of a POST request; the server 
+ * replies with exactly what yasequery would write to stdout and closes 
+ * the connection.
+ * Connections are accepted by the thread that calls run() and handed 
+ * to a pool of workers. Searching is not safe across threads on one 
+ * Collection, so each worker keeps its own open Collections, which it
+ * opens again when documents are added or deleted; the query cache of
+ * a collection (see QueryAction::openCache()) is kept in memory and 
+ * shared by the workers.
+ */
+class QueryServer {
+private:
+	struct Worker;
+	struct OpenCache;
+	YASENS Properties *prop;
+	int nworkers;
+	Worker *workers;
+	int listenfd;
+	char sockpath[108];
+	ys_mutex_t mutex;
+	ys_cond_t cond;
+	int *queue;			/* accepted connections */
+	int qsize;
+	int qhead;
+	int qcount;
+	bool stopping;
+	OpenCache *caches;		/* query caches, by collection */
+	ys_mutex_t cachemutex;
+
+	static void *workerMain(void *arg);
+	int take();
+	void serve(Worker *worker, int fd);
+	YASENS Collection *getCollection(Worker *worker, const char *name, 
+		const char *path);
+	YASENS QueryCache *getCache(const char *name, const char *path);
+
+private:
+	QueryServer(const QueryServer&);
+	QueryServer& operator=(const QueryServer&);
+
+public:
+	QueryServer(YASENS Properties *prop, int nworkers);
+	~QueryServer();
+	/**
+	 * Creates the socket, replacing any left behind by an earlier 
+	 * server. Returns -1 on error.
+	 */
+	int listen(const char *path);
+	/**
+	 * Serves requests until SIGINT or SIGTERM is received. Returns
+	 * -1 on error.
+	 */
+	int run();
+};
+
+YASE_NS_END
+
+#endif
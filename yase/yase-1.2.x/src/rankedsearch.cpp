@@ -25,12 +25,30 @@
 // 09-01-03: The result tree must be deleted in RankedSearchResultSet
 // 08-02-03: Ignore and, or and not as terms so that we can combine boolean
 //           queries with ranking.
+// 17-10-26: Added document at a time evaluation with a top-k heap, used
+//           when the number of results is limited.
+// 17-10-26: MaxScore pruning in evaluateTopK(), for collections that
+//           record score bounds.
+// 17-10-26: Added evaluateAccumulated() for broad queries.
+// 17-10-26: Document weights come from the Collection.
+// 17-10-26: Terms are looked up in every segment of the collection, and
+//           their postings read through TermRefs and TermCursors.
+// 17-10-26: Query terms may be prefix, wildcard or fuzzy patterns; the
+//           terms they expand to are merged by a TermUnion.
+// 17-10-26: Added getCacheKey().
+// 18-10-26: The number of results kept is limited to the number of 
+//           documents.
 
 #include "rankedsearch.h"
 #include "formulas.h"
 #include "stem.h"
+#include "bitset.h"
 
 #include <new>
+#include <algorithm>
+
+/* Relative margin added to score bounds, see evaluateTopK() */
+#define YS_MAXSCORE_SLACK	1e-4
 
 static int ys_compare_document(void *key, void *object);
 static void ys_create_document(void *object, void *key);
@@ -133,8 +151,158 @@ public:
 	}	
 };
 
+/**
+ * Holds the best k documents of a ranked search. While the search runs
+ * the items form a min-heap, so that the worst document is at the top 
+ * and can be replaced cheaply. finish() sorts the items by rank, in the 
+ * same order as the AVL result set.
+ */
+class ScoredDocument : public SearchResultItem {
+	friend class TopKResultSet;
+	friend class RankedSearch;
+};
+
+class TopKResultSet : public SearchResultSet {
+	ScoredDocument *items;
+	int k;
+	int nitems;
+	int current;
+
+	/* Is a ranked below b ? */
+	static bool worse(const ScoredDocument *a, const ScoredDocument *b) {
+		if (a->rank != b->rank)
+			return a->rank < b->rank;
+		return a->docnum > b->docnum;
+	}
+	static bool better(const ScoredDocument &a, const ScoredDocument &b) {
+		return worse(&b, &a);
+	}
+	void siftDown(int i, int n);
+public:
+	TopKResultSet(int k) {
+		this->k = k;
+		items = new ScoredDocument[k];
+		nitems = 0;
+		current = 0;
+	}
+	~TopKResultSet() {
+		delete [] items;
+	}
+	/**
+	 * Offers a scored document; it is kept if it is amongst the
+	 * best k seen so far. Every call counts as a match.
+	 */
+	void offer(ys_docnum_t docnum, float rank, int hits);
+	/**
+	 * Takes all n matches at once, and keeps the best k, or all of
+	 * them if k is 0. The result set takes over docs, which must
+	 * have been allocated with new[].
+	 */
+	void select(ScoredDocument *docs, int n);
+	/**
+	 * Counts a match that was not scored as it could not make the
+	 * best k.
+	 */
+	void skip() { count++; }
+	bool isFull() const { return nitems == k; }
+	/**
+	 * Rank of the worst document kept; only valid when isFull().
+	 * As documents are offered in docnum order, a later document
+	 * must rank strictly higher to be kept.
+	 */
+	float threshold() const { return items[0].rank; }
+	/**
+	 * Marks the count as a lower bound, and raises it to n.
+	 */
+	void setCountAtLeast(int n) {
+		countExact = false;
+		if (count < n)
+			count = n;
+	}
+	void finish();
+	SearchResultItem *getNext() {
+		return current < nitems ? &items[current++] : 0;
+	}
+	void setElapsedTime(double e) { elapsed = e; }
+	bool contains(ys_docnum_t docnum) {
+		for (int i = 0; i < nitems; i++)
+			if (items[i].docnum == docnum)
+				return true;
+		return false;
+	}
+};
+
 YASE_NS_END
 
+void
+YASENS TopKResultSet::siftDown(int i, int n)
+{
+	for (;;) {
+		int child = 2*i+1;
+		if (child >= n)
+			break;
+		if (child+1 < n && worse(&items[child+1], &items[child]))
+			child++;
+		if (!worse(&items[child], &items[i]))
+			break;
+		ScoredDocument tmp = items[i];
+		items[i] = items[child];
+		items[child] = tmp;
+		i = child;
+	}
+}
+
+void
+YASENS TopKResultSet::offer(ys_docnum_t docnum, float rank, int hits)
+{
+	ScoredDocument d;
+	d.docnum = docnum;
+	d.rank = rank;
+	d.hits = hits;
+	count++;
+	if (nitems < k) {
+		/* sift up */
+		int i = nitems++;
+		while (i > 0 && worse(&d, &items[(i-1)/2])) {
+			items[i] = items[(i-1)/2];
+			i = (i-1)/2;
+		}
+		items[i] = d;
+	}
+	else if (worse(&items[0], &d)) {
+		items[0] = d;
+		siftDown(0, nitems);
+	}
+}
+
+void
+YASENS TopKResultSet::select(YASENS ScoredDocument *docs, int n)
+{
+	int m = (k == 0 || k > n) ? n : k;
+
+	if (m < n)
+		std::nth_element(docs, docs+m, docs+n, better);
+	std::sort(docs, docs+m, better);
+	delete [] items;
+	items = docs;
+	nitems = m;
+	count = n;
+	current = 0;
+}
+
+void
+YASENS TopKResultSet::finish()
+{
+	/* Heap sort; the worst document moves to the end each time */
+	for (int n = nitems-1; n > 0; n--) {
+		ScoredDocument tmp = items[0];
+		items[0] = items[n];
+		items[n] = tmp;
+		siftDown(0, n);
+	}
+	current = 0;
+}
+
 /**
  * Utility functions for the trees
  */
@@ -236,8 +404,8 @@ YASENS RankedSearch::selectDocument(ys_docnum_t docnum, ys_doccnt_t dtf)
 
 		if (!document->weighted) {
 			/* Retrieve document weight */
-			if (ys_dbgetdocwtdtf(collection->getDocDb(),
-				document->docnum, &document->dwt, &document->maxdtf) != 0 ) {
+			if (collection->getDocWeight(document->docnum, 
+				&document->dwt, &document->maxdtf) != 0 ) {
 				// snprintf(message, sizeof message, "Error: cannot retrieve document weight\n");
 				return false;
 			}
@@ -299,94 +467,392 @@ YASENS RankedSearch::calculateWeight(ys_doccnt_t tf, ys_docnum_t N)
 }
 
 /**
- * Called for each term found in the index. Retrieves all documents
- * for the term and saves them in the result tree.
- * Note that this function may be called to process exact as well as partial
- * matches. It is called for all terms after the first term that is found
- * - until it returns BOOL_FALSE.
+ * Evaluate a query. Locate all documents containing the terms found
+ * by findTerms().
  */
 bool
-YASENS RankedSearch::findDocs(ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t position,
-					   ys_doccnt_t tf)
+YASENS RankedSearch::evaluateQuery(YASENS TermPostings *found, int nfound)
 {
-	/* If the keys are not of equal length, then we return false */
-	if (key1[0] != key2[0])
-		return false;
+	matches = 0;
 
-	if (strncmp( (const char *)key1+1, (const char *)key2+1, key1[0] ) == 0) {
-#if _TEST_FREQ_IN_TREE
-		ys_doccnt_t fq = 0;
-		fq = collection->postings_file->get_term_frequency( position );
-		assert(tf == fq);
-#endif
-		calculateWeight(tf, collection->getN());
-		//snprintf(query->message+strlen(query->message),
-		//	sizeof query->message-strlen(query->message),
-		//	 "%.*s (%ld) ",
-		//	key1[0], key1+1, tf);
-		collection->getPostFile()->iterate( position, ys_select_document, this );
-		return true;
+	/* Process each term in sequence */
+	for (int f = 0; f < nfound; f++) {
+		curterm = found[f].term+1;
+		collection->iterate( found[f].refs(), found[f].nrefs(), 
+			ys_select_document, this );
+	}
+	return true;
+}
+
+int
+YASENS RankedSearch::findTerms(YASENS TermPostings *found)
+{
+	int nfound = 0;
+
+	curterm = 0;
+	for (int i = 0; i < termcount; i++) {
+	 	ys_uchar_t key[YS_MAXKEYSIZE+1];
+		ys_uchar_t *cp = terms[i].text;
+		YASENS TermPostings *t = &found[nfound];
+
+		curterm++;
+		t->nexpanded = 0;
+		if (YASENS Collection::isPattern(cp)) {
+			if (t->expanded == 0)
+				t->expanded = new YASENS TermRef[collection->getMaxExpansion()];
+			t->nexpanded = collection->expandTerm(cp, t->expanded);
+			if (t->nexpanded <= 0) {
+				t->nexpanded = 0;
+				continue;
+			}
+			t->ref.nparts = 0;
+			t->ref.tf = 0;
+			for (int j = 0; j < t->nexpanded; j++)
+				t->ref.tf += t->expanded[j].tf;
+			if (t->ref.tf > collection->getN())
+				t->ref.tf = collection->getN();
+		}
+		else {
+			memset(key, 0, sizeof key);
+			key[0] = strlen((const char *)cp);
+			memcpy(key+1, cp, key[0]+1);
+			if (collection->isStemmed())
+				stem(key);
+			if (!collection->findTerm( key, &t->ref ))
+				continue;
+		}
+		calculateWeight(t->ref.tf, collection->getN());
+		found[nfound++].term = i;
+	}
+	return nfound;
+}
+
+bool
+YASENS RankedSearch::evaluateTopK(YASENS TopKResultSet *rs, 
+	YASENS TermPostings *found, int nfound)
+{
+	YASENS TermUnion *cursors[YS_SEARCH_MAXTERMS];
+	int termnum[YS_SEARCH_MAXTERMS];	/* query term of each cursor */
+	double ub[YS_SEARCH_MAXTERMS];		/* score bound of each cursor */
+	int order[YS_SEARCH_MAXTERMS];		/* cursors by increasing bound */
+	double below[YS_SEARCH_MAXTERMS+1];	/* sum of bounds before order[j] */
+	float contrib[YS_SEARCH_MAXTERMS];
+	bool hit[YS_SEARCH_MAXTERMS];
+	int essential = 0;			/* first essential cursor in order */
+	double threshold = -1.0;
+	ys_doccnt_t maxtf = 0;
+	bool prune = (collection->getPostingsFormat() & YS_POSTINGS_BOUNDS) != 0;
+	int ncursors = 0;
+	bool ok = true;
+	int i, j;
+
+	matches = 0;
+
+	/* Open a cursor on the postings of each term */
+	for (int f = 0; f < nfound; f++) {
+		ys_doccnt_t tf = found[f].ref.tf;
+
+		i = found[f].term;
+		cursors[ncursors] = new YASENS TermUnion();
+		if (cursors[ncursors]->open(collection, found[f].refs(), 
+			found[f].nrefs()) != 0) {
+			delete cursors[ncursors];
+			ok = false;
+			break;
+		}
+		if (tf > maxtf)
+			maxtf = tf;
+
+		/*
+		 * The most a term can add to a document's score. The
+		 * document weight includes the term's own weight, 
+		 * calculated with the collection's maxtf, so dtw/dwt is
+		 * never more than idf/ys_idf(N,tf,maxtf). For a pattern it
+		 * is the weight of the term with the largest tf that is
+		 * included. The bound stored with longer postings is 
+		 * usually much tighter.
+		 * YS_MAXSCORE_SLACK allows for rounding, as scores are 
+		 * summed in single precision.
+		 */
+		double idf = terms[i].idf;
+		ub[ncursors] = idf / ys_idf(collection->getN(), 
+			cursors[ncursors]->getMaxTermTf(), collection->getMaxTf());
+		float bound = cursors[ncursors]->getBound();
+		if (bound > 0.0 && idf * bound < ub[ncursors])
+			ub[ncursors] = idf * bound;
+		ub[ncursors] *= terms[i].qtw * (1.0 + YS_MAXSCORE_SLACK);
+		termnum[ncursors++] = i;
+	}
+
+	/* Sort the cursors by bound, for MaxScore */
+	for (i = 0; i < ncursors; i++) {
+		for (j = i; j > 0 && ub[order[j-1]] > ub[i]; j--)
+			order[j] = order[j-1];
+		order[j] = i;
+	}
+	below[0] = 0.0;
+	for (j = 0; j < ncursors; j++)
+		below[j+1] = below[j] + ub[order[j]];
+
+	while (ok) {
+		ys_docnum_t docnum = 0;
+		bool found = false;
+		bool pruned = false;
+		float dwt, rank = 0.0;
+		double score;
+		ys_doccnt_t maxdtf;
+		int hits = 0;
+
+		/* 
+		 * The next document is the smallest docnum of the essential
+		 * cursors. A document that appears only in the others 
+		 * cannot score more than threshold.
+		 */
+		for (j = essential; j < ncursors; j++) {
+			i = order[j];
+			if (cursors[i]->atEnd())
+				continue;
+			if (!found || cursors[i]->docnum() < docnum) {
+				docnum = cursors[i]->docnum();
+				found = true;
+			}
+		}
+		if (!found)
+			break;
+
+		if (essential > 0) {
+			/* Check the bounds before fetching the document */
+			score = below[essential];
+			for (j = essential; j < ncursors; j++) {
+				i = order[j];
+				if (!cursors[i]->atEnd() && cursors[i]->docnum() == docnum)
+					score += ub[i];
+			}
+			if (score <= threshold) {
+				for (j = essential; j < ncursors; j++) {
+					i = order[j];
+					if (!cursors[i]->atEnd() && 
+						cursors[i]->docnum() == docnum)
+						cursors[i]->next();
+				}
+				rs->skip();
+				continue;
+			}
+		}
+
+		if (collection->getDocWeight(docnum, &dwt, &maxdtf) != 0) {
+			ok = false;
+			break;
+		}
+		matches++;
+
+		score = 0.0;
+		for (i = 0; i < ncursors; i++)
+			hit[i] = false;
+		for (j = essential; j < ncursors; j++) {
+			i = order[j];
+			if (cursors[i]->atEnd() || cursors[i]->docnum() != docnum)
+				continue;
+			contrib[i] = (float)ys_inner_product(
+				ys_dtw(terms[termnum[i]].idf, cursors[i]->dtf(), maxdtf), 
+				terms[termnum[i]].qtw);
+			score += contrib[i] / dwt;
+			hit[i] = true;
+			cursors[i]->next();
+		}
+		/* Add in the other terms, while the document can still make it */
+		for (j = essential-1; j >= 0; j--) {
+			if (score + below[j+1] <= threshold) {
+				pruned = true;
+				break;
+			}
+			i = order[j];
+			cursors[i]->skipTo(docnum);
+			if (cursors[i]->atEnd() || cursors[i]->docnum() != docnum)
+				continue;
+			contrib[i] = (float)ys_inner_product(
+				ys_dtw(terms[termnum[i]].idf, cursors[i]->dtf(), maxdtf), 
+				terms[termnum[i]].qtw);
+			score += contrib[i] / dwt;
+			hit[i] = true;
+		}
+		if (pruned) {
+			rs->skip();
+			continue;
+		}
+
+		/* Sum in query term order, as evaluateQuery() does */
+		for (i = 0; i < ncursors; i++) {
+			if (!hit[i])
+				continue;
+			rank = rank + contrib[i];
+			hits++;
+		}
+		rs->offer(docnum, rank / dwt, hits);
+
+		if (prune && rs->isFull()) {
+			threshold = rs->threshold();
+			while (essential < ncursors && below[essential+1] <= threshold)
+				essential++;
+		}
 	}
 
-	return false;
+	/* Documents found only in non essential cursors were not counted */
+	if (essential > 0)
+		rs->setCountAtLeast(maxtf);
+	for (i = 0; i < ncursors; i++)
+		delete cursors[i];
+	rs->finish();
+	return ok;
 }
 
 /**
- * Called for each term found in the index. Retrieves all documents
- * for the term and saves them in the result tree.
- * Note that this function may be called to process exact as well as partial
- * matches. It is called for all terms after the first term that is found
- * - until it returns BOOL_FALSE.
+ * State shared with the postings iterator of evaluateAccumulated().
  */
+struct ys_accumulator_t {
+	ys_bitset_t *touched;		/* documents seen */
+	float *acc;			/* sum of term weights */
+	ys_doccnt_t *maxdtfs;		/* max dtf within document */
+	unsigned char *hits;		/* number of terms matched */
+	float idf;
+	float qtw;
+};
+
 static ys_bool_t
-ys_find_docs( ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t position, ys_doccnt_t tf,
-	void *arg )
+ys_accumulate_document( void *arg, ys_docnum_t docnum, ys_doccnt_t dtf )
 {
-	YASENS RankedSearch *search = (YASENS RankedSearch *)arg;
-	return search->findDocs(key1, key2, position, tf);
+	ys_accumulator_t *a = (ys_accumulator_t *)arg;
+	if (a->hits[docnum]++ == 0)
+		ys_bs_addmember(a->touched, (unsigned) docnum);
+	a->acc[docnum] = a->acc[docnum] +
+		(float)ys_inner_product(ys_dtw(a->idf, dtf, a->maxdtfs[docnum]), 
+			a->qtw);
+	return BOOL_TRUE;
 }
 
 /**
- * Evaluate a query. Search the terms and locate all documents
- * containing those terms.
+ * Document weights are read for the whole collection up front, in 
+ * docnum order. Term weights are summed in the same order as 
+ * selectDocument() does, so that the ranks are the same.
  */
 bool
-YASENS RankedSearch::evaluateQuery()
+YASENS RankedSearch::evaluateAccumulated(YASENS TopKResultSet *rs, 
+	YASENS TermPostings *found, int nfound)
 {
-	matches = 0;
-	curterm = 0;
+	ys_docnum_t N = collection->getN();
+	ys_accumulator_t a;
+	float *dwts;
+	YASENS ScoredDocument *docs = 0;
+	bool ok = false;
+	int f, n;
 
-	/* Process each term in sequence */
-	for (int i = 0; i < termcount; i++) {
-	 	ys_uchar_t key[YS_MAXKEYSIZE+1];
-		ys_uchar_t *cp = terms[i].text;
+	matches = 0;
+	memset(&a, 0, sizeof a);
+	a.touched = ys_bs_alloc((unsigned) N);
+	a.acc = (float *) calloc(N, sizeof(float));
+	a.maxdtfs = (ys_doccnt_t *) calloc(N, sizeof(ys_doccnt_t));
+	a.hits = (unsigned char *) calloc(N, sizeof(unsigned char));
+	dwts = (float *) calloc(N, sizeof(float));
+	if (a.touched == 0 || a.acc == 0 || a.maxdtfs == 0 || a.hits == 0 || 
+		dwts == 0) {
+		fprintf(stderr, "Error allocating memory\n");
+		goto done;
+	}
+	if (collection->getDocWeights(0, N, dwts, a.maxdtfs) != 0)
+		goto done;
+
+	for (f = 0; f < nfound; f++) {
+		a.idf = terms[found[f].term].idf;
+		a.qtw = terms[found[f].term].qtw;
+		collection->iterate(found[f].refs(), found[f].nrefs(), 
+			ys_accumulate_document, &a);
+	}
 
-		key[0] = strlen((const char *)cp);
-		memcpy(key+1, cp, key[0]+1);
-		if (collection->isStemmed())
-			stem(key);
-		curterm++;
-		ys_btree_iterate( collection->getIndex(), key, ys_find_docs, this );
+	matches = ys_bs_count(a.touched);
+	docs = new YASENS ScoredDocument[matches > 0 ? matches : 1];
+	{
+		YASENS BitSetIterator iter(a.touched);
+		int docnum;
+		n = 0;
+		while ((docnum = iter.getNext()) >= 0) {
+			docs[n].docnum = docnum;
+			docs[n].rank = a.acc[docnum] / dwts[docnum];
+			docs[n].hits = a.hits[docnum];
+			n++;
+		}
 	}
-	return true;
+	rs->select(docs, n);
+	ok = true;
+
+done:
+	if (a.touched != 0)
+		ys_bs_destroy(a.touched);
+	free(a.acc);
+	free(a.maxdtfs);
+	free(a.hits);
+	free(dwts);
+	return ok;
 }
 
 /**
  * Output results of the query. If all_terms was specified, ignore matches
  * that didnot contain all the terms. If ranked query was requested,
  * sort results by rank before sending them to the user.
+ * When the number of results is limited, documents are evaluated one
+ * at a time and only the best are kept; otherwise all matches are
+ * collected in a tree and sorted.
  */
 YASENS SearchResultSet *
 YASENS RankedSearch::executeQuery()
 {
+	YASENS TermPostings found[YS_SEARCH_MAXTERMS];
+	ys_doccnt_t broad = collection->getN() / YS_SEARCH_ACCUMULATE_RATIO;
+	ys_doccnt_t total = 0, mintf = 0;
+	int nfound;
+
+	/* The top-k heap is allocated whole, so k must not exceed the
+	 * number of documents, whatever was asked for */
+	if (maxResults > 0 && collection->getN() > 0 && 
+		(ys_doccnt_t) maxResults > collection->getN())
+		maxResults = (int) collection->getN();
+
+	startTimer();
+	nfound = findTerms(found);
+	for (int i = 0; i < nfound; i++) {
+		total += found[i].ref.tf;
+		if (i == 0 || found[i].ref.tf < mintf)
+			mintf = found[i].ref.tf;
+	}
+
+	/*
+	 * Broad queries are evaluated into arrays. If only the top k are
+	 * wanted and there are score bounds, MaxScore does better as long
+	 * as one of the terms is selective, since the broad terms then
+	 * drop out once k documents have been found.
+	 */
+	bool accumulate = total > broad;
+	if (accumulate && maxResults > 0 && 
+		(collection->getPostingsFormat() & YS_POSTINGS_BOUNDS) != 0)
+		accumulate = mintf > broad;
+	if (accumulate || maxResults > 0) {
+		YASENS TopKResultSet *rs = new YASENS TopKResultSet(maxResults);
+		bool ok = accumulate ? evaluateAccumulated(rs, found, nfound) :
+			evaluateTopK(rs, found, nfound);
+		if (!ok)
+			snprintf(message, sizeof message,
+				"Error: cannot evaluate query\n");
+		stopTimer();
+		rs->setElapsedTime(elapsed);
+		return rs;
+	}
+
 	resultSet = new YASENS RankedSearchResultSet();
 	if ( resultSet == 0 ) {
 		snprintf(message, sizeof message,
 			"Error: cannot create result tree\n");
 	}
 	else {
-		startTimer();
-		if (evaluateQuery() && matches > 0)
+		if (evaluateQuery(found, nfound) && matches > 0)
 			resultSet->sortByRank();
 		stopTimer();
 		resultSet->setElapsedTime(elapsed);
@@ -431,7 +897,7 @@ YASENS RankedSearch::saveTerm(const ys_uchar_t *word)
 bool
 YASENS RankedSearch::parseQuery()
 {
-	YASENS StringTokenizer st;
+	YASENS PatternStringTokenizer st;
 	st.setInput(input);
 	const ys_uchar_t *term = st.nextToken();
 	while (term != 0) {
@@ -444,3 +910,20 @@ YASENS RankedSearch::parseQuery()
 	return true;
 }
 
+bool
+YASENS RankedSearch::getCacheKey(char *key, size_t size)
+{
+	char qtf[32];
+
+	key[0] = 0;
+	for (int i = 0; i < termcount; i++) {
+		if (!addKeyWord(key, size, terms[i].text))
+			return false;
+		if (terms[i].qtf > 1) {
+			snprintf(qtf, sizeof qtf, "^%d", terms[i].qtf);
+			if (!addKeyText(key, size, qtf))
+				return false;
+		}
+	}
+	return true;
+}
@@ -38,7 +38,33 @@ struct SearchTerm {
 	float idf;               /* term weight in the collection */
 };
 
+/**
+ * A query term found in the index. A pattern is found as the terms it
+ * expands to, whose postings are merged by a TermUnion; ref.tf is then
+ * the sum of their tfs.
+ */
+struct TermPostings {
+	int term;                /* index into RankedSearch::terms */
+	YASENS TermRef ref;      /* postings in each segment */
+	YASENS TermRef *expanded; /* terms a pattern expanded to */
+	int nexpanded;           /* 0 if not a pattern */
+	TermPostings() : expanded(0), nexpanded(0) {}
+	~TermPostings() { delete [] expanded; }
+	const YASENS TermRef *refs() const { 
+		return nexpanded > 0 ? expanded : &ref; 
+	}
+	int nrefs() const { return nexpanded > 0 ? nexpanded : 1; }
+};
+
+enum {
+	/* Use the accumulator when the query terms have more than
+	 * N/YS_SEARCH_ACCUMULATE_RATIO postings between them.
+	 */
+	YS_SEARCH_ACCUMULATE_RATIO = 8
+};
+
 class RankedSearchResultSet;
+class TopKResultSet;
 
 class RankedSearch : public Search {
 private:
@@ -53,12 +79,33 @@ public:
 	~RankedSearch();
 	bool selectDocument(ys_docnum_t docnum, ys_doccnt_t dtf);
 	void calculateWeight(ys_doccnt_t tf, ys_docnum_t N);
-	bool findDocs(ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t position, 
-		ys_doccnt_t tf);
-	bool evaluateQuery();
+	bool evaluateQuery(TermPostings *found, int nfound);
+	/**
+	 * Looks up each query term, calculating its weight. Patterns
+	 * are expanded (see Collection::expandTerm()). Returns the 
+	 * number of terms found.
+	 */
+	int findTerms(TermPostings *found);
+	/**
+	 * Document at a time evaluation. The postings of all terms
+	 * are merged in docnum order, so each document is scored
+	 * completely before moving on, and only the best k are kept.
+	 */
+	bool evaluateTopK(TopKResultSet *rs, TermPostings *found, int nfound);
+	/**
+	 * Term at a time evaluation into arrays indexed by docnum,
+	 * for queries that match a large part of the collection.
+	 */
+	bool evaluateAccumulated(TopKResultSet *rs, TermPostings *found, 
+		int nfound);
 	void saveTerm(const ys_uchar_t *word);
 public:
 	bool parseQuery();
+	/**
+	 * The key is the query terms in order, each followed by ^qtf if
+	 * it was repeated; the order is kept as scores are summed in it.
+	 */
+	bool getCacheKey(char *key, size_t size);
 	SearchResultSet *executeQuery();
 };
 
@@ -22,16 +22,19 @@
 */ 
 
 // 09-01-03: Modified so that Collection can be specified as parameter
+// 17-10-26: Added addKeyWord() and addKeyText()
 
 #include "search.h"
 #include "rankedsearch.h"
 #include "boolsearch.h"
+#include "stem.h"
 
 YASENS Search::Search(YASENS Collection *collection)
 {
 	this->collection = collection;
 	input = 0;
 	elapsed = 0.0;
+	maxResults = 0;
 }
 
 YASENS Search::~Search()
@@ -62,6 +65,36 @@ YASENS Search::addInput(const ys_uchar_t *text)
 	}
 }
 
+bool
+YASENS Search::addKeyText(char *key, size_t size, const char *text)
+{
+	size_t len = strlen(key);
+	size_t n = strlen(text);
+	if (len + n >= size)
+		return false;
+	memcpy(key+len, text, n+1);
+	return true;
+}
+
+bool
+YASENS Search::addKeyWord(char *key, size_t size, const ys_uchar_t *word) const
+{
+	ys_uchar_t buf[YS_TERM_LEN+2];
+	size_t len = strlen((const char *)word);
+
+	if (len > YS_TERM_LEN)
+		len = YS_TERM_LEN;
+	memset(buf, 0, sizeof buf);
+	buf[0] = len;
+	memcpy(buf+1, word, len);
+	if (!YASENS Collection::isPattern(word) && collection->isStemmed())
+		stem(buf);
+	buf[buf[0]+1] = 0;
+	if (key[0] != 0 && !addKeyText(key, size, " "))
+		return false;
+	return addKeyText(key, size, (const char *)buf+1);
+}
+
 YASENS Search*
 YASENS Search::createSearch(YASENS Collection *collection, int method)
 {
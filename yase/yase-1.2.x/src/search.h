@@ -21,6 +21,9 @@
 *    Website: www.mazumdar.demon.co.uk/yase_index.html
 */
 // 10 Dec 2002: Created
+// 17 Oct 2026: Added setMaxResults()
+// 17 Oct 2026: Added SearchResultSet::isCountExact()
+// 17 Oct 2026: Added getCacheKey()
 
 #ifndef search_h
 #define search_h
@@ -55,12 +58,18 @@ public:
 class SearchResultSet {
 protected:
 	int count;
+	bool countExact;
 	double elapsed;
-	SearchResultSet() { count = 0; elapsed = 0.0; }
+	SearchResultSet() { count = 0; countExact = true; elapsed = 0.0; }
 public:
 	virtual ~SearchResultSet() {}
 	virtual SearchResultItem *getNext() = 0;
 	int getCount() const { return count; }
+	/**
+	 * False if the search skipped documents that could not make the 
+	 * result set, in which case getCount() is a lower bound.
+	 */
+	bool isCountExact() const { return countExact; }
 	double getElapsedTime() const { return elapsed; }
 	virtual bool contains(ys_docnum_t docnum) { return false; }
 };
@@ -73,6 +82,7 @@ protected:
 	struct timeval start;
 	struct timeval stop;
 	double elapsed;
+	int maxResults;
 protected:
 	Search(YASENS Collection *collection);
 	void startTimer() { gettimeofday(&start, (struct timezone *)0); }
@@ -80,6 +90,15 @@ protected:
 		gettimeofday(&stop, (struct timezone *)0); 
 		elapsed = ys_calculate_elapsed_time(&start, &stop);
 	}
+	/**
+	 * Appends a word to a cache key, stemmed as it would be looked 
+	 * up unless it is a pattern. Returns false if it does not fit.
+	 */
+	bool addKeyWord(char *key, size_t size, const ys_uchar_t *word) const;
+	/**
+	 * Appends text to a cache key; returns false if it does not fit.
+	 */
+	static bool addKeyText(char *key, size_t size, const char *text);
 private:
 	Search(const Search&);
 	Search& operator=(const Search&);
@@ -91,8 +110,22 @@ public:
 	virtual ~Search();
 	virtual void reset();
 	void addInput(const ys_uchar_t *text);
+	/**
+	 * Limits the result set to the best k documents, where the 
+	 * search method can make use of it. The count of matches may
+	 * then be a lower bound (see SearchResultSet::isCountExact()).
+	 * 0 (the default) returns all matches.
+	 */
+	void setMaxResults(int k) { maxResults = k > 0 ? k : 0; }
 	virtual SearchResultSet* executeQuery() = 0;
 	virtual bool parseQuery() = 0;
+	/**
+	 * Writes a normalized form of the parsed query to key: the words
+	 * as they are looked up, and the operators, so that queries that
+	 * must give the same results have the same key. Returns false if
+	 * the query cannot be cached, or its key does not fit.
+	 */
+	virtual bool getCacheKey(char *key, size_t size) { return false; }
 	double getElapsedTime() const { return elapsed; }
 	static Search* createSearch(YASENS Collection *collection, int method);
 };
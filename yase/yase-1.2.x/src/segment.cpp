@@ -0,0 +1,150 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - index segments.
+
+#include "segment.h"
+
+#include <errno.h>
+
+/*
+ * yase.seg is a text file. The first line holds the id of the next
+ * segment; each following line describes a segment, in docnum order,
+ * as "id firstdoc ndocs".
+ */
+
+void
+ys_seg_filename(const char *home, int id, const char *type, char *name,
+	size_t size)
+{
+	if (id == 0)
+		snprintf(name, size, "%s/yase.%s", home, type);
+	else
+		snprintf(name, size, "%s/yase.%d.%s", home, id, type);
+}
+
+int
+ys_seg_read(const char *home, ys_docnum_t numdocs, ys_seglist_t *list)
+{
+	char path[1024];
+	char line[256];
+	FILE *fp;
+	ys_docnum_t nextdoc = 0;
+
+	memset(list, 0, sizeof *list);
+	snprintf(path, sizeof path, "%s/yase.seg", home);
+	fp = fopen(path, "r");
+	if (fp == 0) {
+		if (errno != ENOENT) {
+			perror(path);
+			return -1;
+		}
+		list->nsegs = 1;
+		list->nextid = 1;
+		list->segs[0].id = 0;
+		list->segs[0].firstdoc = 0;
+		list->segs[0].ndocs = numdocs;
+		return 0;
+	}
+	if (fgets(line, sizeof line, fp) == 0 || 
+		sscanf(line, "%d", &list->nextid) != 1)
+		goto damaged;
+	while (fgets(line, sizeof line, fp) != 0) {
+		unsigned long id, firstdoc, ndocs;
+		if (sscanf(line, "%lu %lu %lu", &id, &firstdoc, &ndocs) != 3 ||
+			list->nsegs == YS_MAXSEGMENTS || firstdoc != nextdoc ||
+			(int)id >= list->nextid)
+			goto damaged;
+		list->segs[list->nsegs].id = (int) id;
+		list->segs[list->nsegs].firstdoc = firstdoc;
+		list->segs[list->nsegs].ndocs = ndocs;
+		list->nsegs++;
+		nextdoc = firstdoc + ndocs;
+	}
+	fclose(fp);
+	if (list->nsegs > 0)
+		return 0;
+	fp = 0;
+
+damaged:
+	if (fp != 0)
+		fclose(fp);
+	fprintf(stderr, "Error: %s is damaged\n", path);
+	return -1;
+}
+
+int
+ys_seg_write(const char *home, const ys_seglist_t *list)
+{
+	char path[1024];
+	char tmppath[1024];
+	FILE *fp;
+	int i;
+
+	snprintf(path, sizeof path, "%s/yase.seg", home);
+	snprintf(tmppath, sizeof tmppath, "%s/tmp.seg", home);
+	fp = fopen(tmppath, "w");
+	if (fp == 0) {
+		perror(tmppath);
+		return -1;
+	}
+	fprintf(fp, "%d\n", list->nextid);
+	for (i = 0; i < list->nsegs; i++) {
+		fprintf(fp, "%d %lu %lu\n", list->segs[i].id,
+			(unsigned long) list->segs[i].firstdoc,
+			(unsigned long) list->segs[i].ndocs);
+	}
+	if (ferror(fp) || fclose(fp) != 0) {
+		fprintf(stderr, "Unable to write to %s\n", tmppath);
+		remove(tmppath);
+		return -1;
+	}
+#ifdef WIN32
+	/* rename() fails if the target exists */
+	remove(path);
+#endif
+	if (rename(tmppath, path) != 0) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+void
+ys_seg_clear(const char *home)
+{
+	char path[1024];
+	snprintf(path, sizeof path, "%s/yase.seg", home);
+	remove(path);
+}
+
+void
+ys_seg_remove(const char *home, int id)
+{
+	static const char *types[] = { "words", "postings", "btree", "dict", 
+		"positions" };
+	char name[1024];
+	for (size_t i = 0; i < sizeof types / sizeof types[0]; i++) {
+		ys_seg_filename(home, id, types[i], name, sizeof name);
+		remove(name);
+	}
+}
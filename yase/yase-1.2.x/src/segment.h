@@ -0,0 +1,96 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - index segments.
+
+#ifndef segment_h
+#define segment_h
+
+#include "yase.h"
+
+/**
+ * A collection's inverted index may be split into segments. Each 
+ * segment has its own words, postings, btree and term dictionary
+ * (termdict.h) files, and positions file (positions.h) if positions 
+ * are recorded, and covers a range of document numbers; the 
+ * ranges are consecutive, so a term's postings are those of each 
+ * segment in turn. The document database 
+ * (yase.store, yase.docptrs, ...) is shared. 
+ * Segment 0 uses the original names (yase.words, yase.postings and
+ * yase.btree); segment N uses yase.N.words and so on. The segments are
+ * listed in yase.seg, which is written whenever a segment is added or
+ * segments are merged; a collection without yase.seg has one segment,
+ * segment 0, holding all documents.
+ */
+enum {
+	YS_MAXSEGMENTS = 32
+};
+
+typedef struct {
+	int id;
+	ys_docnum_t firstdoc;
+	ys_docnum_t ndocs;
+} ys_segment_t;
+
+typedef struct {
+	int nsegs;
+	int nextid;			/* id of the next new segment */
+	ys_segment_t segs[YS_MAXSEGMENTS];	/* in docnum order */
+} ys_seglist_t;
+
+/**
+ * Builds the name of a segment file; type is "words", "postings",
+ * "btree", "dict" or "positions".
+ */
+extern void
+ys_seg_filename(const char *home, int id, const char *type, char *name,
+	size_t size);
+
+/**
+ * Reads the list of segments. numdocs is the number of documents in
+ * the collection, used when there is no yase.seg.
+ * @returns 0 on success, -1 if yase.seg is damaged
+ */
+extern int
+ys_seg_read(const char *home, ys_docnum_t numdocs, ys_seglist_t *list);
+
+/**
+ * Replaces yase.seg. The new list is written to a temporary file 
+ * which is then renamed, so readers see either the old list or the
+ * new one.
+ */
+extern int
+ys_seg_write(const char *home, const ys_seglist_t *list);
+
+/**
+ * Removes yase.seg, so that the collection has one segment again.
+ */
+extern void
+ys_seg_clear(const char *home);
+
+/**
+ * Removes the files of a segment.
+ */
+extern void
+ys_seg_remove(const char *home, int id);
+
+#endif
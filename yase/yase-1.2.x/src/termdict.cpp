@@ -0,0 +1,694 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - front coded term dictionary.
+
+#include "termdict.h"
+
+#include <errno.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+enum {
+	YS_TERMDICT_MAGIC = 0x59534431,	/* "YSD1" */
+	/* prefix, length, suffix and two variable byte codes */
+	YS_TERMDICT_MAXENTRY = 2 + YS_MAXKEYSIZE + 2*10
+};
+
+typedef struct {
+	ys_uint32_t magic;
+	ys_uint32_t blockterms;
+	ys_uint32_t nterms;
+	ys_uint32_t nblocks;
+	ys_uint32_t maxblocklen;	/* longest block in bytes */
+	ys_uint32_t keyslen;		/* bytes of first terms in the index */
+	ys_filepos_t indexpos;
+} ys_termdict_header_t;
+
+struct ys_termdict_writer_t {
+	FILE *fp;
+	ys_termdict_header_t header;
+	ys_uchar_t *block;		/* block being filled */
+	size_t blocklen;
+	ys_uint32_t count;		/* terms in the block */
+	ys_uchar_t prevkey[YS_MAXKEYSIZE+1];
+	ys_filepos_t prevvalue;
+	ys_filepos_t pos;		/* file position of the block */
+	ys_filepos_t *offsets;		/* of each block */
+	ys_uchar_t *keys;		/* first term of each block */
+	size_t nalloc;
+	size_t keysalloc;
+	int rc;
+};
+
+struct ys_termdict_t {
+	ys_termdict_header_t header;
+	ys_filepos_t *offsets;		/* nblocks+1 */
+	ys_uchar_t **firstkeys;
+	ys_uchar_t *keys;
+	FILE *fp;			/* only if not mapped */
+	const ys_uchar_t *map;
+	size_t maplen;
+	ys_uchar_t *buf;
+};
+
+/**
+ * Decodes the entries of a block in turn.
+ */
+typedef struct {
+	const ys_uchar_t *cp;
+	const ys_uchar_t *end;
+	ys_uchar_t key[YS_MAXKEYSIZE+1];
+	ys_filepos_t value;
+	ys_doccnt_t doccnt;
+} ys_termdict_cursor_t;
+
+static inline int
+ys_termdict_compare( const ys_uchar_t *key1, const ys_uchar_t *key2 )
+{
+	int n = key1[0] < key2[0] ? key1[0] : key2[0];
+	int rc = memcmp(key1+1, key2+1, n);
+	return rc != 0 ? rc : key1[0] - key2[0];
+}
+
+static inline ys_uchar_t *
+ys_termdict_put_vbyte( ys_uchar_t *cp, ys_uint64_t n )
+{
+	while (n >= 0x80) {
+		*cp++ = (ys_uchar_t) (n | 0x80);
+		n >>= 7;
+	}
+	*cp++ = (ys_uchar_t) n;
+	return cp;
+}
+
+static inline const ys_uchar_t *
+ys_termdict_get_vbyte( const ys_uchar_t *cp, ys_uint64_t *n )
+{
+	ys_uint64_t v = 0;
+	int shift = 0;
+	while (*cp & 0x80) {
+		v |= (ys_uint64_t) (*cp++ & 0x7f) << shift;
+		shift += 7;
+	}
+	*n = v | ((ys_uint64_t) *cp++ << shift);
+	return cp;
+}
+
+static inline bool
+ys_termdict_next( ys_termdict_cursor_t *c )
+{
+	ys_uint64_t n;
+	int prefix, len;
+
+	if (c->cp >= c->end)
+		return false;
+	prefix = *c->cp++;
+	len = *c->cp++;
+	memcpy(c->key+1+prefix, c->cp, len);
+	c->key[0] = (ys_uchar_t) (prefix + len);
+	c->cp += len;
+	c->cp = ys_termdict_get_vbyte(c->cp, &n);
+	c->value += (ys_filepos_t) n;
+	c->cp = ys_termdict_get_vbyte(c->cp, &n);
+	c->doccnt = (ys_doccnt_t) n;
+	return true;
+}
+
+static int
+ys_termdict_flush( ys_termdict_writer_t *writer )
+{
+	ys_termdict_header_t *h = &writer->header;
+
+	if (writer->count == 0)
+		return 0;
+	if (fwrite(writer->block, 1, writer->blocklen, writer->fp) != 
+		writer->blocklen) {
+		perror("fwrite");
+		return -1;
+	}
+	writer->pos += writer->blocklen;
+	if (writer->blocklen > h->maxblocklen)
+		h->maxblocklen = writer->blocklen;
+	writer->blocklen = 0;
+	writer->count = 0;
+	return 0;
+}
+
+ys_termdict_writer_t *
+ys_termdict_create( const char *name, int blockterms )
+{
+	ys_termdict_writer_t *writer;
+
+	if (blockterms == 0)
+		blockterms = YS_TERMDICT_BLOCKTERMS;
+	else if (blockterms < YS_TERMDICT_MINTERMS)
+		blockterms = YS_TERMDICT_MINTERMS;
+	else if (blockterms > YS_TERMDICT_MAXTERMS)
+		blockterms = YS_TERMDICT_MAXTERMS;
+	writer = (ys_termdict_writer_t *) calloc(1, sizeof *writer);
+	if (writer != NULL)
+		writer->block = (ys_uchar_t *) malloc(blockterms * 
+			YS_TERMDICT_MAXENTRY);
+	if (writer == NULL || writer->block == NULL) {
+		fprintf(stderr, "Error: ran out of memory\n");
+		free(writer);
+		return NULL;
+	}
+	writer->fp = fopen(name, "wb");
+	if (writer->fp == NULL) {
+		perror(name);
+		free(writer->block);
+		free(writer);
+		return NULL;
+	}
+	writer->header.magic = YS_TERMDICT_MAGIC;
+	writer->header.blockterms = blockterms;
+	/* the header is written again at the end */
+	fwrite(&writer->header, sizeof writer->header, 1, writer->fp);
+	writer->pos = sizeof writer->header;
+	return writer;
+}
+
+int
+ys_termdict_add( ys_termdict_writer_t *writer, const ys_uchar_t *key,
+	ys_filepos_t value, ys_doccnt_t doccnt )
+{
+	ys_termdict_header_t *h = &writer->header;
+	ys_uchar_t *cp;
+	int prefix = 0;
+
+	if (writer->rc != 0)
+		return -1;
+	if (key[0] > YS_MAXKEYSIZE || (h->nterms > 0 && 
+		(ys_termdict_compare(key, writer->prevkey) <= 0 || 
+		 value < writer->prevvalue))) {
+		fprintf(stderr, "Error: cannot add key %.*s to the term "
+			"dictionary\n", key[0], key+1);
+		writer->rc = -1;
+		return -1;
+	}
+	if (writer->count == h->blockterms && ys_termdict_flush(writer) != 0) {
+		writer->rc = -1;
+		return -1;
+	}
+	if (writer->count == 0) {
+		/* a new block, listed in the index */
+		if (h->nblocks == writer->nalloc) {
+			size_t n = writer->nalloc == 0 ? 256 : writer->nalloc*2;
+			ys_filepos_t *offsets = (ys_filepos_t *) 
+				realloc(writer->offsets, n * sizeof *offsets);
+			if (offsets == NULL) {
+				fprintf(stderr, "Error: ran out of memory\n");
+				writer->rc = -1;
+				return -1;
+			}
+			writer->offsets = offsets;
+			writer->nalloc = n;
+		}
+		if (h->keyslen + key[0] + 1 > writer->keysalloc) {
+			size_t n = writer->keysalloc == 0 ? 4096 : 
+				writer->keysalloc*2;
+			ys_uchar_t *keys = (ys_uchar_t *) realloc(writer->keys, n);
+			if (keys == NULL) {
+				fprintf(stderr, "Error: ran out of memory\n");
+				writer->rc = -1;
+				return -1;
+			}
+			writer->keys = keys;
+			writer->keysalloc = n;
+		}
+		writer->offsets[h->nblocks++] = writer->pos;
+		memcpy(writer->keys + h->keyslen, key, key[0]+1);
+		h->keyslen += key[0]+1;
+		writer->prevvalue = 0;
+	}
+	else {
+		while (prefix < key[0] && prefix < writer->prevkey[0] &&
+			key[prefix+1] == writer->prevkey[prefix+1])
+			prefix++;
+	}
+	cp = writer->block + writer->blocklen;
+	*cp++ = (ys_uchar_t) prefix;
+	*cp++ = (ys_uchar_t) (key[0] - prefix);
+	memcpy(cp, key+1+prefix, key[0] - prefix);
+	cp += key[0] - prefix;
+	cp = ys_termdict_put_vbyte(cp, value - writer->prevvalue);
+	cp = ys_termdict_put_vbyte(cp, doccnt);
+	writer->blocklen = cp - writer->block;
+	writer->count++;
+	h->nterms++;
+	memcpy(writer->prevkey, key, key[0]+1);
+	writer->prevvalue = value;
+	return 0;
+}
+
+int
+ys_termdict_finish( ys_termdict_writer_t *writer )
+{
+	ys_termdict_header_t *h = &writer->header;
+	int rc = writer->rc;
+
+	if (rc == 0 && ys_termdict_flush(writer) != 0)
+		rc = -1;
+	if (rc == 0) {
+		h->indexpos = writer->pos;
+		if (fwrite(writer->offsets, sizeof *writer->offsets, h->nblocks, 
+			writer->fp) != h->nblocks ||
+			fwrite(writer->keys, 1, h->keyslen, writer->fp) != 
+			h->keyslen ||
+			fseek(writer->fp, 0, SEEK_SET) != 0 ||
+			fwrite(h, sizeof *h, 1, writer->fp) != 1) {
+			perror("fwrite");
+			rc = -1;
+		}
+	}
+	if (fclose(writer->fp) != 0) {
+		perror("fclose");
+		rc = -1;
+	}
+	free(writer->block);
+	free(writer->offsets);
+	free(writer->keys);
+	free(writer);
+	return rc;
+}
+
+ys_termdict_t *
+ys_termdict_open( const char *name )
+{
+	ys_termdict_t *dict;
+	ys_termdict_header_t *h;
+	ys_uint32_t i;
+	size_t pos;
+
+	FILE *fp = fopen(name, "rb");
+	if (fp == NULL) {
+		if (errno != ENOENT)
+			perror(name);
+		return NULL;
+	}
+	dict = (ys_termdict_t *) calloc(1, sizeof *dict);
+	if (dict == NULL) {
+		fprintf(stderr, "Error: ran out of memory\n");
+		fclose(fp);
+		return NULL;
+	}
+	dict->fp = fp;
+	h = &dict->header;
+	if (fread(h, sizeof *h, 1, fp) != 1 || h->magic != YS_TERMDICT_MAGIC)
+		goto damaged;
+	dict->offsets = (ys_filepos_t *) malloc((h->nblocks+1) * 
+		sizeof *dict->offsets);
+	dict->firstkeys = (ys_uchar_t **) malloc((h->nblocks+1) * 
+		sizeof *dict->firstkeys);
+	dict->keys = (ys_uchar_t *) malloc(h->keyslen+1);
+	dict->buf = (ys_uchar_t *) malloc(h->maxblocklen+1);
+	if (dict->offsets == NULL || dict->firstkeys == NULL || 
+		dict->keys == NULL || dict->buf == NULL) {
+		fprintf(stderr, "Error: ran out of memory\n");
+		ys_termdict_close(dict);
+		return NULL;
+	}
+	if (fseek(fp, h->indexpos, SEEK_SET) != 0 ||
+		fread(dict->offsets, sizeof *dict->offsets, h->nblocks, fp) != 
+		h->nblocks ||
+		fread(dict->keys, 1, h->keyslen, fp) != h->keyslen)
+		goto damaged;
+	dict->offsets[h->nblocks] = h->indexpos;
+	for (i = 0, pos = 0; i < h->nblocks; i++) {
+		if (pos >= h->keyslen)
+			goto damaged;
+		dict->firstkeys[i] = dict->keys + pos;
+		pos += dict->keys[pos] + 1;
+	}
+
+#ifndef WIN32
+	if (h->indexpos > 0) {
+		void *map = mmap(NULL, h->indexpos, PROT_READ, MAP_SHARED, 
+			fileno(fp), 0);
+		if (map != MAP_FAILED) {
+			madvise(map, h->indexpos, MADV_RANDOM);
+			dict->map = (const ys_uchar_t *) map;
+			dict->maplen = h->indexpos;
+			fclose(dict->fp);
+			dict->fp = NULL;
+		}
+	}
+#endif
+	return dict;
+
+damaged:
+	fprintf(stderr, "Error: %s is damaged\n", name);
+	ys_termdict_close(dict);
+	return NULL;
+}
+
+void
+ys_termdict_close( ys_termdict_t *dict )
+{
+#ifndef WIN32
+	if (dict->map != NULL)
+		munmap((void *) dict->map, dict->maplen);
+#endif
+	if (dict->fp != NULL)
+		fclose(dict->fp);
+	free(dict->offsets);
+	free(dict->firstkeys);
+	free(dict->keys);
+	free(dict->buf);
+	free(dict);
+}
+
+/**
+ * Finds the last block whose first term is <= key. Returns -1 if key
+ * comes before every term.
+ */
+static long
+ys_termdict_locate( ys_termdict_t *dict, const ys_uchar_t *key )
+{
+	long lo = 0, hi = (long) dict->header.nblocks - 1;
+
+	while (lo <= hi) {
+		long mid = (lo + hi) / 2;
+		if (ys_termdict_compare(dict->firstkeys[mid], key) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return hi;
+}
+
+/**
+ * Positions a cursor at the start of block b. buf must have room for
+ * the longest block.
+ */
+static int
+ys_termdict_start( ys_termdict_t *dict, long b, ys_uchar_t *buf,
+	ys_termdict_cursor_t *c )
+{
+	size_t len = dict->offsets[b+1] - dict->offsets[b];
+
+	if (dict->map != NULL)
+		c->cp = dict->map + dict->offsets[b];
+	else {
+		if (fseek(dict->fp, dict->offsets[b], SEEK_SET) != 0 ||
+			fread(buf, 1, len, dict->fp) != len) {
+			fprintf(stderr, "Error: failed to read term dictionary\n");
+			return -1;
+		}
+		c->cp = buf;
+	}
+	c->end = c->cp + len;
+	c->value = 0;
+	return 0;
+}
+
+bool
+ys_termdict_find( ys_termdict_t *dict, const ys_uchar_t *key, 
+	ys_filepos_t *value, ys_doccnt_t *doccnt )
+{
+	ys_termdict_cursor_t c;
+	long b = ys_termdict_locate(dict, key);
+
+	if (b < 0 || ys_termdict_start(dict, b, dict->buf, &c) != 0)
+		return false;
+	while (ys_termdict_next(&c)) {
+		int rc = ys_termdict_compare(c.key, key);
+		if (rc == 0) {
+			*value = c.value;
+			*doccnt = c.doccnt;
+			return true;
+		}
+		if (rc > 0)
+			break;
+	}
+	return false;
+}
+
+int
+ys_termdict_iterate( ys_termdict_t *dict, ys_uchar_t *key, 
+	ys_pfn_btree_iterator_t *pfunc, void *arg )
+{
+	ys_termdict_cursor_t c;
+	ys_uchar_t *buf = NULL;
+	long b = ys_termdict_locate(dict, key);
+	int rc = 0;
+
+	/* pfunc may look up other terms, so the block is not read into 
+	 * dict->buf */
+	if (dict->map == NULL) {
+		buf = (ys_uchar_t *) malloc(dict->header.maxblocklen+1);
+		if (buf == NULL) {
+			fprintf(stderr, "Error: ran out of memory\n");
+			return -1;
+		}
+	}
+	if (b < 0)
+		b = 0;
+	for (; b < (long) dict->header.nblocks; b++) {
+		if (ys_termdict_start(dict, b, buf, &c) != 0) {
+			rc = -1;
+			break;
+		}
+		while (ys_termdict_next(&c)) {
+			if (ys_termdict_compare(c.key, key) < 0)
+				continue;
+			if (!pfunc(key, c.key, c.value, c.doccnt, arg))
+				goto done;
+		}
+	}
+done:
+	free(buf);
+	return rc;
+}
+
+size_t
+ys_termdict_memsize( ys_termdict_t *dict )
+{
+	return sizeof *dict + dict->header.keyslen + 
+		(dict->header.nblocks+1) * (sizeof *dict->offsets + 
+		sizeof *dict->firstkeys) + dict->header.maxblocklen;
+}
+
+#ifdef TEST_TERMDICT
+
+/*
+ * Compares lookups in the btree and in term dictionaries with 16, 32
+ * and 64 terms per block, built from the terms of a collection's first
+ * segment: exact lookups of every term in random order, and prefix 
+ * lookups that list the terms starting with the first three letters
+ * of a sample of terms. Also reports the size of each.
+ */
+
+#include <time.h>
+
+typedef struct {
+	ys_uchar_t (*keys)[YS_MAXKEYSIZE+1];
+	ys_filepos_t *values;
+	ys_doccnt_t *doccnts;
+	size_t n;
+	size_t nalloc;
+	unsigned long count;
+} ys_dict_bench_t;
+
+static ys_bool_t
+ys_bench_add_term(ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t value,
+	ys_doccnt_t doccnt, void *arg)
+{
+	ys_dict_bench_t *b = (ys_dict_bench_t *) arg;
+	if (b->n == b->nalloc) {
+		b->nalloc = b->nalloc == 0 ? 1024 : b->nalloc * 2;
+		b->keys = (ys_uchar_t (*)[YS_MAXKEYSIZE+1]) realloc(b->keys,
+			b->nalloc * sizeof *b->keys);
+		b->values = (ys_filepos_t *) realloc(b->values, 
+			b->nalloc * sizeof *b->values);
+		b->doccnts = (ys_doccnt_t *) realloc(b->doccnts,
+			b->nalloc * sizeof *b->doccnts);
+		if (b->keys == 0 || b->values == 0 || b->doccnts == 0) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	memcpy(b->keys[b->n], key2, key2[0]+1);
+	b->values[b->n] = value;
+	b->doccnts[b->n] = doccnt;
+	b->n++;
+	return BOOL_TRUE;
+}
+
+static ys_bool_t
+ys_bench_count_prefix(ys_uchar_t *key1, ys_uchar_t *key2, ys_filepos_t value,
+	ys_doccnt_t doccnt, void *arg)
+{
+	ys_dict_bench_t *b = (ys_dict_bench_t *) arg;
+	if (key2[0] < key1[0] || memcmp(key1+1, key2+1, key1[0]) != 0)
+		return BOOL_FALSE;
+	b->count++;
+	return BOOL_TRUE;
+}
+
+static long
+ys_bench_file_size(const char *name)
+{
+	long size = 0;
+	FILE *fp = fopen(name, "rb");
+	if (fp != 0) {
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp);
+		fclose(fp);
+	}
+	return size;
+}
+
+static void
+ys_bench_report(const char *what, long size, size_t memsize, 
+	double exact, double prefix, unsigned long nprefix,
+	unsigned long nexact, unsigned long count)
+{
+	printf("%-10s %9ld bytes, %7lu resident, exact %6.0f ns, "
+		"prefix %7.0f ns (%lu terms)\n", what, size, 
+		(unsigned long) memsize, 
+		nexact ? exact * 1e9 / nexact : 0.0, 
+		nprefix ? prefix * 1e9 / nprefix : 0.0, count);
+}
+
+int Ys_debug = 0;
+
+int main(int argc, char *argv[])
+{
+	ys_dict_bench_t b = {0};
+	ys_uchar_t key[YS_MAXKEYSIZE+1];
+	ys_uchar_t prefixes[1000][4];
+	size_t *order, i, nprefix = 0;
+	char path[1024];
+	int passes = 5, p;
+	ys_filepos_t value;
+	ys_doccnt_t doccnt;
+	clock_t start;
+	double exact, prefix;
+	static const int sizes[] = { 16, 32, 64 };
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: termdict <yase home> [passes]\n");
+		exit(1);
+	}
+	if (argc > 2)
+		passes = atoi(argv[2]);
+
+	snprintf(path, sizeof path, "%s/yase.btree", argv[1]);
+	ys_btree_t *tree = ys_btree_open_mapped(path, 0);
+	if (tree == 0)
+		exit(1);
+	key[0] = 0;
+	ys_btree_iterate(tree, key, ys_bench_add_term, &b);
+	if (b.n == 0) {
+		fprintf(stderr, "no terms in %s\n", path);
+		exit(1);
+	}
+	srand(1);
+	order = (size_t *) malloc(b.n * sizeof *order);
+	for (i = 0; i < b.n; i++)
+		order[i] = i;
+	for (i = b.n-1; i > 0; i--) {
+		size_t j = rand() % (i+1), t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+	for (i = 0; i < b.n && nprefix < 1000; i++) {
+		ys_uchar_t *k = b.keys[order[i]];
+		if (k[0] < 3)
+			continue;
+		prefixes[nprefix][0] = 3;
+		memcpy(prefixes[nprefix]+1, k+1, 3);
+		nprefix++;
+	}
+	printf("%s: %lu terms, %d passes\n", argv[1], (unsigned long) b.n, 
+		passes);
+
+	start = clock();
+	for (p = 0; p < passes; p++)
+		for (i = 0; i < b.n; i++)
+			ys_btree_find(tree, b.keys[order[i]], &value, &doccnt);
+	exact = (double)(clock()-start)/CLOCKS_PER_SEC;
+	b.count = 0;
+	start = clock();
+	for (p = 0; p < passes; p++)
+		for (i = 0; i < nprefix; i++)
+			ys_btree_iterate(tree, prefixes[i], 
+				ys_bench_count_prefix, &b);
+	prefix = (double)(clock()-start)/CLOCKS_PER_SEC;
+	ys_bench_report("btree", ys_bench_file_size(path), 0, exact, prefix,
+		nprefix * passes, b.n * passes, b.count / passes);
+	ys_btree_close(tree);
+
+	for (size_t s = 0; s < sizeof sizes / sizeof sizes[0]; s++) {
+		char name[32];
+		snprintf(path, sizeof path, "tmp.termdict.%d", sizes[s]);
+		ys_termdict_writer_t *writer = ys_termdict_create(path, sizes[s]);
+		if (writer == 0)
+			exit(1);
+		for (i = 0; i < b.n; i++)
+			ys_termdict_add(writer, b.keys[i], b.values[i], 
+				b.doccnts[i]);
+		if (ys_termdict_finish(writer) != 0)
+			exit(1);
+		ys_termdict_t *dict = ys_termdict_open(path);
+		if (dict == 0)
+			exit(1);
+		for (i = 0; i < b.n; i++) {
+			if (!ys_termdict_find(dict, b.keys[i], &value, &doccnt) ||
+				value != b.values[i] || doccnt != b.doccnts[i]) {
+				printf("Lookup of %.*s failed\n", b.keys[i][0],
+					b.keys[i]+1);
+				exit(1);
+			}
+		}
+		start = clock();
+		for (p = 0; p < passes; p++)
+			for (i = 0; i < b.n; i++)
+				ys_termdict_find(dict, b.keys[order[i]], &value, 
+					&doccnt);
+		exact = (double)(clock()-start)/CLOCKS_PER_SEC;
+		b.count = 0;
+		start = clock();
+		for (p = 0; p < passes; p++)
+			for (i = 0; i < nprefix; i++)
+				ys_termdict_iterate(dict, prefixes[i], 
+					ys_bench_count_prefix, &b);
+		prefix = (double)(clock()-start)/CLOCKS_PER_SEC;
+		snprintf(name, sizeof name, "dict/%d", sizes[s]);
+		ys_bench_report(name, ys_bench_file_size(path), 
+			ys_termdict_memsize(dict), exact, prefix, 
+			nprefix * passes, b.n * passes, b.count / passes);
+		ys_termdict_close(dict);
+		remove(path);
+	}
+	free(order);
+	free(b.keys);
+	free(b.values);
+	free(b.doccnts);
+	return 0;
+}
+
+#endif
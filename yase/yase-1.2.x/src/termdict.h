@@ -0,0 +1,104 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - front coded term dictionary.
+
+#ifndef termdict_h
+#define termdict_h
+
+#include "yase.h"
+#include "btree.h"
+
+/**
+ * A term dictionary (yase.dict, or yase.N.dict for segment N) maps each
+ * term of a segment to its postings offset and term frequency, like
+ * the btree, but is laid out for lookups rather than updates. Terms are
+ * stored in sorted order in blocks of up to blockterms entries. Within
+ * a block each term is front coded against the previous one (shared
+ * prefix length, suffix length, suffix), followed by the postings 
+ * offset as a variable byte delta and the term frequency as a variable
+ * byte code; the first term of a block is stored whole. A sparse index
+ * holding the offset and first term of every block follows the blocks,
+ * and is loaded into memory by ys_termdict_open(), so an exact or 
+ * prefix lookup decodes a single block. Keys are length prefixed, as 
+ * in the btree.
+ */
+enum {
+	YS_TERMDICT_MINTERMS = 16,
+	YS_TERMDICT_BLOCKTERMS = 32,	/* default terms per block */
+	YS_TERMDICT_MAXTERMS = 64
+};
+
+typedef struct ys_termdict_writer_t ys_termdict_writer_t;
+typedef struct ys_termdict_t ys_termdict_t;
+
+/**
+ * Starts writing a dictionary. blockterms is clamped to 
+ * YS_TERMDICT_MINTERMS..YS_TERMDICT_MAXTERMS; 0 selects the default.
+ */
+extern ys_termdict_writer_t *
+ys_termdict_create( const char *name, int blockterms );
+
+/**
+ * Adds the next term. Terms must be added in ascending order, with
+ * ascending postings offsets.
+ */
+extern int
+ys_termdict_add( ys_termdict_writer_t *writer, const ys_uchar_t *key,
+	ys_filepos_t value, ys_doccnt_t doccnt );
+
+/**
+ * Writes the index and closes the file. The writer is freed.
+ */
+extern int
+ys_termdict_finish( ys_termdict_writer_t *writer );
+
+/**
+ * Opens a dictionary for reading. Returns NULL if it cannot be 
+ * opened; no message is printed if the file does not exist.
+ */
+extern ys_termdict_t *
+ys_termdict_open( const char *name );
+
+extern void
+ys_termdict_close( ys_termdict_t *dict );
+
+extern bool
+ys_termdict_find( ys_termdict_t *dict, const ys_uchar_t *key, 
+	ys_filepos_t *value, ys_doccnt_t *doccnt );
+
+/**
+ * Evaluates a function for each term >= key, in order, until the 
+ * function returns BOOL_FALSE. The arguments are those passed by
+ * ys_btree_iterate().
+ */
+extern int
+ys_termdict_iterate( ys_termdict_t *dict, ys_uchar_t *key, 
+	ys_pfn_btree_iterator_t *pfunc, void *arg );
+
+/**
+ * Memory used by the index of an open dictionary, in bytes.
+ */
+extern size_t
+ys_termdict_memsize( ys_termdict_t *dict );
+
+#endif
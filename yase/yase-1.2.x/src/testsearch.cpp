@@ -1,28 +1,32 @@
 // 09-01-03: Moved out of boolsearch.cpp and rankedsearch.cpp
+// 17-10-26: Optional limit on the number of results. Names qualified
+//           with YASENS.
 #include "search.h"
 
 int Ys_debug = 0;
 int main(int argc, const char *argv[])
 {
 	if (argc < 4) {
-		fprintf(stderr, "usage: testsearch <path> <mode> <query>\n");
+		fprintf(stderr, "usage: testsearch <path> <mode> <query> [k]\n");
 		exit(1);
 	}
 
-	Collection collection;
+	YASENS Collection collection;
 	if (collection.open(argv[1], "r") != 0)
 		exit(1);
 
-	Search *search = 0;
+	YASENS Search *search = 0;
 	if (argv[2][0] == 'b')
-		search = Search::createSearch(&collection, Search::SM_BOOLEAN);
+		search = YASENS Search::createSearch(&collection, YASENS Search::SM_BOOLEAN);
 	else
-		search = Search::createSearch(&collection, Search::SM_RANKED);
-	search->addInput(argv[3]);
+		search = YASENS Search::createSearch(&collection, YASENS Search::SM_RANKED);
+	if (argc > 4)
+		search->setMaxResults(atoi(argv[4]));
+	search->addInput((const ys_uchar_t *)argv[3]);
 	search->parseQuery();
-	SearchResultSet *rs = search->executeQuery();
+	YASENS SearchResultSet *rs = search->executeQuery();
 	if (rs != 0) {
-		SearchResultItem *item = rs->getNext();
+		YASENS SearchResultItem *item = rs->getNext();
 		while (item != 0) {
 			item->dump(stdout);
 			item = rs->getNext();
@@ -170,6 +170,19 @@ class CIdentTokenizer : public LowerCaseTokenizer {
 	}
 };
 
+/**
+ * Also accepts the wildcard (* and ?) and fuzzy match (~) operators
+ * of query terms as part of a word. See Collection::expandTerm().
+ */
+template <typename T = LowerCaseTokenizer>
+class TPatternTokenizer : public T {
+public:
+	virtual bool isWordChar(int ch) const
+	{ 
+		return T::isWordChar(ch) || ch == '*' || ch == '?' || ch == '~'; 
+	}
+};
+
 template <typename T = LowerCaseTokenizer>
 class TStringTokenizer {
 public:
@@ -254,6 +267,7 @@ public:
 
 typedef TStringTokenizer<LowerCaseTokenizer> StringTokenizer;
 typedef TUTF8ToAsciiTokenizer<LowerCaseTokenizer> UTF8ToAsciiTokenizer;
+typedef TStringTokenizer<TPatternTokenizer<LowerCaseTokenizer> > PatternStringTokenizer;
 
 template <typename T>
 void
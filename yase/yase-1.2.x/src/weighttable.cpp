@@ -0,0 +1,171 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - document weights held in memory.
+// 18-10-26: Quantised weights are never below the exact ones, and max 
+//           dtfs are kept in 32 bits if any does not fit in 16.
+
+#include "weighttable.h"
+
+#include <math.h>
+
+YASENS WeightTable::WeightTable()
+{
+	weights = 0;
+	maxdtfs = 0;
+	codes16 = 0;
+	codes8 = 0;
+	maxdtfs16 = 0;
+	values = 0;
+	clear();
+}
+
+YASENS WeightTable::~WeightTable()
+{
+	clear();
+}
+
+void
+YASENS WeightTable::clear()
+{
+	free(weights);
+	free(maxdtfs);
+	free(codes16);
+	free(codes8);
+	free(maxdtfs16);
+	free(values);
+	weights = 0;
+	maxdtfs = 0;
+	codes16 = 0;
+	codes8 = 0;
+	maxdtfs16 = 0;
+	values = 0;
+	bits = 0;
+	n = 0;
+}
+
+int
+YASENS WeightTable::load(ys_docdb_t *db, ys_docnum_t n, int bits)
+{
+	clear();
+	if (bits != 8 && bits != 16 && bits != 32) {
+		fprintf(stderr, "Error: weights must be 8, 16 or 32 bits\n");
+		return -1;
+	}
+	weights = (float *) calloc(n > 0 ? n : 1, sizeof(float));
+	maxdtfs = (ys_doccnt_t *) calloc(n > 0 ? n : 1, sizeof(ys_doccnt_t));
+	if (weights == 0 || maxdtfs == 0) {
+		fprintf(stderr, "Error allocating memory\n");
+		clear();
+		return -1;
+	}
+	if (ys_dbgetdocwtdtfs(db, 0, n, weights, maxdtfs) != 0) {
+		clear();
+		return -1;
+	}
+	this->n = n;
+	this->bits = bits;
+	if (bits < 32) {
+		if (quantise(weights, maxdtfs) != 0) {
+			clear();
+			return -1;
+		}
+		free(weights);
+		weights = 0;
+		if (maxdtfs16 != 0) {
+			free(maxdtfs);
+			maxdtfs = 0;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Code 0 is kept for documents without a weight; the rest are spread
+ * evenly over log(weight). Weights are rounded up, so that a document 
+ * never scores more than it would with its exact weight and the score
+ * bounds used by MaxScore still hold. For the same reason max dtfs are
+ * not saturated: if any is too large for 16 bits they stay in 32.
+ */
+int
+YASENS WeightTable::quantise(const float *wts, const ys_doccnt_t *dtfs)
+{
+	unsigned ncodes = 1U << bits;
+	float wmin = 0.0, wmax = 0.0;
+	ys_doccnt_t dtfmax = 0;
+	ys_docnum_t i;
+
+	for (i = 0; i < n; i++) {
+		if (dtfs[i] > dtfmax)
+			dtfmax = dtfs[i];
+		if (wts[i] <= 0.0)
+			continue;
+		if (wmin == 0.0 || wts[i] < wmin)
+			wmin = wts[i];
+		if (wts[i] > wmax)
+			wmax = wts[i];
+	}
+	values = (float *) calloc(ncodes, sizeof(float));
+	if (dtfmax <= 0xffff)
+		maxdtfs16 = (ys_uint16_t *) calloc(n > 0 ? n : 1, 
+			sizeof(ys_uint16_t));
+	if (bits == 16)
+		codes16 = (ys_uint16_t *) calloc(n > 0 ? n : 1, sizeof(ys_uint16_t));
+	else
+		codes8 = (ys_uchar_t *) calloc(n > 0 ? n : 1, sizeof(ys_uchar_t));
+	if (values == 0 || (maxdtfs16 == 0 && dtfmax <= 0xffff) || 
+		(codes16 == 0 && codes8 == 0)) {
+		fprintf(stderr, "Error allocating memory\n");
+		return -1;
+	}
+
+	double lmin = wmin > 0.0 ? log(wmin) : 0.0;
+	double step = wmax > wmin ? (log(wmax) - lmin) / (ncodes - 2) : 0.0;
+	for (unsigned c = 1; c < ncodes; c++)
+		values[c] = (float) exp(lmin + step * (c - 1));
+	/* Exact at the ends, so that every weight has a code above it */
+	values[1] = wmin;
+	values[ncodes-1] = wmax;
+
+	for (i = 0; i < n; i++) {
+		unsigned c = 0;
+		if (wts[i] > 0.0) {
+			c = 1;
+			if (step > 0.0)
+				c += (unsigned) ceil((log(wts[i]) - lmin) / step);
+			if (c >= ncodes)
+				c = ncodes - 1;
+			/* log() and exp() may round either way */
+			while (c > 1 && values[c-1] >= wts[i])
+				c--;
+			while (values[c] < wts[i])
+				c++;
+		}
+		if (codes16 != 0)
+			codes16[i] = (ys_uint16_t) c;
+		else
+			codes8[i] = (ys_uchar_t) c;
+		if (maxdtfs16 != 0)
+			maxdtfs16[i] = (ys_uint16_t) dtfs[i];
+	}
+	return 0;
+}
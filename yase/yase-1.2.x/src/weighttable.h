@@ -0,0 +1,91 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+// 17-10-26: Created - document weights held in memory.
+// 18-10-26: Max dtfs too large for 16 bits are kept in 32.
+
+#ifndef weighttable_h
+#define weighttable_h
+
+#include "yase.h"
+#include "docdb.h"
+
+YASE_NS_BEGIN
+
+/**
+ * Holds the weight and max dtf of every document in a collection, so
+ * that ranking does not have to read yase.docptrs. The table is held
+ * column by column. With 32 bits, weights and max dtfs are kept
+ * exactly. With 16 or 8 bits, each weight is stored as a code on a
+ * logarithmic scale between the smallest and largest weights, rounding
+ * up, and max dtfs are stored in 16 bits unless one of them needs 32. 
+ * This makes the table 4 or 3 bytes per document instead of 8, at the
+ * cost of slightly lower scores; no document scores more than with its
+ * exact weight, so the score bounds used by MaxScore still hold.
+ */
+class WeightTable {
+private:
+	int bits;
+	ys_docnum_t n;
+	float *weights;			/* 32 bits */
+	ys_doccnt_t *maxdtfs;		/* 32 bits, or any too large for 16 */
+	ys_uint16_t *codes16;		/* 16 bits */
+	ys_uchar_t *codes8;		/* 8 bits */
+	ys_uint16_t *maxdtfs16;		/* 16 or 8 bits */
+	float *values;			/* weight of each code */
+
+	void clear();
+	int quantise(const float *wts, const ys_doccnt_t *dtfs);
+
+private:
+	WeightTable(const WeightTable&);
+	WeightTable& operator=(const WeightTable&);
+
+public:
+	WeightTable();
+	~WeightTable();
+	/**
+	 * Loads n documents from the database, keeping weights in the
+	 * given number of bits (8, 16 or 32). Returns -1 on error.
+	 */
+	int load(ys_docdb_t *db, ys_docnum_t n, int bits = 32);
+	int getBits() const { return bits; }
+	ys_docnum_t getCount() const { return n; }
+	void get(ys_docnum_t docnum, float *wt, ys_doccnt_t *maxdtf) const;
+};
+
+YASE_NS_END
+
+inline void
+YASENS WeightTable::get(ys_docnum_t docnum, float *wt, ys_doccnt_t *maxdtf) const
+{
+	if (weights != 0) {
+		*wt = weights[docnum];
+		*maxdtf = maxdtfs[docnum];
+	}
+	else {
+		*wt = values[codes16 != 0 ? codes16[docnum] : codes8[docnum]];
+		*maxdtf = maxdtfs16 != 0 ? maxdtfs16[docnum] : maxdtfs[docnum];
+	}
+}
+
+#endif
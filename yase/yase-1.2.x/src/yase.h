@@ -21,6 +21,7 @@
 *    Website: www.mazumdar.demon.co.uk/yase_index.html 
 */ 
 // 27-01-03: Added namespace yase
+// 17-10-26: Added ys_docpos_t.
 
 #ifndef yase_h
 #define yase_h
@@ -106,6 +107,7 @@ typedef ys_uintmax_t ys_docnum_t;
 typedef ys_intmax_t ys_filepos_t;
 typedef ys_uintmax_t ys_blocknum_t;
 typedef ys_uintmax_t ys_doccnt_t;
+typedef ys_uintmax_t ys_docpos_t;	/* offset of a word in a document */
 
 enum { YS_TERM_LEN = 255 };	/* Maximum length of a word that can
 				 * indexed by YASE. 
@@ -0,0 +1,94 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+/* 17 Oct 2026: Created - converts a collection to the document store */
+
+/**
+ * yaseconvert moves the documents of a collection built before the 
+ * document store (yase.store) was introduced out of yase.files and 
+ * yase.docs, which it then removes. Such collections can still be
+ * queried, and have documents added, without being converted; the
+ * text records are just slower to read. A converted collection cannot
+ * be read by earlier versions of YASE.
+ */
+
+#include "yase.h"
+#include "docdb.h"
+#include "version.h"
+#include "getopt.h"
+
+static void
+ys_print_convert_help(void)
+{
+	fprintf(stdout, 
+"usage: yaseconvert [options]\n"
+"  -H, --yase-home <path>  YASE home directory\n"
+"  -h, --help              show this help\n"
+"  -V, --version           show the version of YASE\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *home = ".";
+	ys_docdb_t *db;
+	long nconverted;
+	int c;
+
+	static struct option long_options[] =
+	{
+		{ "yase-home", required_argument, NULL, 'H' },
+		{ "help", no_argument, NULL, 'h' },
+		{ "version", no_argument, NULL, 'V' },
+		{ 0, 0, 0, 0 }
+	};
+
+	opterr = 0;
+	while ((c = getopt_long (argc, argv, "H:hV",
+			   long_options, (int *)0)) != EOF) {
+		switch (c) {
+		case 'H': home = optarg; break;
+		case 'h': ys_print_convert_help(); return EXIT_SUCCESS;
+		case 'V': 
+			printf("YASE %s collection conversion utility\n", 
+				Yase_version);
+			return EXIT_SUCCESS;
+		default:
+			fprintf(stderr, "Unrecognised option %c; try --help\n", optopt);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc) {
+		ys_print_convert_help();
+		return EXIT_FAILURE;
+	}
+
+	db = ys_dbopen(home, "r+", 0);
+	if (db == 0)
+		return EXIT_FAILURE;
+	nconverted = ys_dbconvert(db);
+	if (ys_dbclose(db) != 0 || nconverted < 0)
+		return EXIT_FAILURE;
+	printf("%ld document%s converted\n", nconverted, 
+		nconverted == 1 ? "" : "s");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+/* 17 Oct 2026: Created - deletes documents from a collection */
+/* 17 Oct 2026: Reads names with ys_dbgetdocref() */
+
+/**
+ * yasedelete marks documents deleted, so that queries no longer return
+ * them. Documents are given by the name stored for their file (the name
+ * shown in query results), which deletes every document in the file, or
+ * with -n by document number. The postings of deleted documents are 
+ * removed when yasemerge merges the segments that hold them.
+ * To update a file, delete it and add it again with yasemakedb -a.
+ */
+
+#include "yase.h"
+#include "docdb.h"
+#include "version.h"
+#include "getopt.h"
+
+/**
+ * Deletes the documents of the named files. Returns the number of 
+ * documents deleted, or -1 on error.
+ */
+static long
+ys_delete_by_name(ys_docdb_t *db, ys_docnum_t numdocs, char *names[], 
+	int nnames, bool *found)
+{
+	ys_docref_t ref;
+	ys_docnum_t docnum;
+	long ndeleted = 0;
+	int i;
+
+	for (docnum = 0; docnum < numdocs; docnum++) {
+		if (ys_dbisdeleted(db, docnum))
+			continue;
+		if (ys_dbgetdocref(db, docnum, &ref) != 0)
+			return -1;
+		for (i = 0; i < nnames; i++) {
+			if (strcmp(ref.field[YS_DOCFIELD_LOGICALNAME], names[i]) == 0)
+				break;
+		}
+		if (i == nnames)
+			continue;
+		found[i] = true;
+		if (ys_dbdeletedoc(db, docnum) < 0)
+			return -1;
+		ndeleted++;
+	}
+	return ndeleted;
+}
+
+static void
+ys_print_delete_help(void)
+{
+	fprintf(stdout, 
+"usage: yasedelete [options] <name>...\n"
+"  -H, --yase-home <path>  YASE home directory\n"
+"  -n, --docnum            the arguments are document numbers\n"
+"  -h, --help              show this help\n"
+"  -V, --version           show the version of YASE\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *home = ".";
+	bool bynumber = false;
+	ys_docdb_t *db;
+	ys_docnum_t numdocs, numfiles;
+	ys_doccnt_t maxdtf, maxtf;
+	ys_bool_t stemmed;
+	long ndeleted = 0;
+	int c, i, rc = EXIT_SUCCESS;
+
+	static struct option long_options[] =
+	{
+		{ "yase-home", required_argument, NULL, 'H' },
+		{ "docnum", no_argument, NULL, 'n' },
+		{ "help", no_argument, NULL, 'h' },
+		{ "version", no_argument, NULL, 'V' },
+		{ 0, 0, 0, 0 }
+	};
+
+	opterr = 0;
+	while ((c = getopt_long (argc, argv, "H:nhV",
+			   long_options, (int *)0)) != EOF) {
+		switch (c) {
+		case 'H': home = optarg; break;
+		case 'n': bynumber = true; break;
+		case 'h': ys_print_delete_help(); return EXIT_SUCCESS;
+		case 'V': 
+			printf("YASE %s document deletion utility\n", Yase_version);
+			return EXIT_SUCCESS;
+		default:
+			fprintf(stderr, "Unrecognised option %c; try --help\n", optopt);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind == argc) {
+		ys_print_delete_help();
+		return EXIT_FAILURE;
+	}
+
+	db = ys_dbopen(home, "r+", 0);
+	if (db == 0)
+		return EXIT_FAILURE;
+	if (ys_dbgetinfo(db, &numdocs, &numfiles, &maxdtf, &maxtf, 
+		&stemmed) != 0) {
+		ys_dbclose(db);
+		return EXIT_FAILURE;
+	}
+	if (bynumber) {
+		for (i = optind; i < argc; i++) {
+			char *end;
+			unsigned long docnum = strtoul(argv[i], &end, 10);
+			if (*end != 0 || end == argv[i]) {
+				fprintf(stderr, "Error: %s is not a document number\n", 
+					argv[i]);
+				rc = EXIT_FAILURE;
+				continue;
+			}
+			int deleted = ys_dbdeletedoc(db, docnum);
+			if (deleted < 0)
+				rc = EXIT_FAILURE;
+			else if (deleted == 0)
+				ndeleted++;
+		}
+	}
+	else {
+		bool *found = (bool *) calloc(argc - optind, sizeof(bool));
+		if (found == 0) {
+			fprintf(stderr, "Error: ran out of memory\n");
+			ys_dbclose(db);
+			return EXIT_FAILURE;
+		}
+		ndeleted = ys_delete_by_name(db, numdocs, argv+optind, 
+			argc-optind, found);
+		if (ndeleted < 0) {
+			ndeleted = 0;
+			rc = EXIT_FAILURE;
+		}
+		for (i = optind; i < argc; i++) {
+			if (!found[i-optind]) {
+				fprintf(stderr, "Error: %s is not in the collection\n", 
+					argv[i]);
+				rc = EXIT_FAILURE;
+			}
+		}
+		free(found);
+	}
+	if (ys_dbclose(db) != 0)
+		return EXIT_FAILURE;
+	printf("%ld document%s deleted\n", ndeleted, ndeleted == 1 ? "" : "s");
+	return rc;
+}
@@ -0,0 +1,332 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+/* 17 Oct 2026: Created - load generator for yasequery */
+
+/**
+ * yaseload sends queries to a yasequery server (yasequery -s) from a 
+ * number of concurrent clients, and reports throughput and latency. 
+ * With -x it runs the given yasequery as a CGI program for each 
+ * request instead, for comparison.
+ * Queries are read from a file, one CGI query string per line, such as
+ *	q=alice+cheshire&sm=ranked&ps=10
+ * and are sent in turn until the requested number have been made.
+ */
+
+#include "yase.h"
+#include "ysthread.h"
+#include "getopt.h"
+
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+typedef struct {
+	const char *sockpath;		/* server socket */
+	const char *cgi;		/* or CGI program */
+	const char *collection;		/* yp= if not in the query */
+	char **queries;
+	int nqueries;
+	int nrequests;
+	bool print;
+	ys_mutex_t mutex;
+	int next;			/* next request to make */
+	int errors;
+	double *latency;		/* milliseconds, by request */
+} ys_load_t;
+
+static double
+ys_load_now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/**
+ * Reads the whole response from fd, copying it to stdout if wanted.
+ * Returns the number of bytes read, or -1 on error.
+ */
+static long
+ys_load_response(ys_load_t *load, int fd)
+{
+	char buf[8192];
+	long total = 0;
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof buf)) > 0) {
+		if (load->print)
+			fwrite(buf, 1, n, stdout);
+		total += n;
+	}
+	return n < 0 ? -1 : total;
+}
+
+static int
+ys_load_socket(ys_load_t *load, const char *query)
+{
+	struct sockaddr_un addr;
+	char request[8192];
+	int fd, len;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, load->sockpath, sizeof addr.sun_path - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof addr) != 0) {
+		perror(load->sockpath);
+		close(fd);
+		return -1;
+	}
+	len = snprintf(request, sizeof request, 
+		"REQUEST_METHOD=GET\nSCRIPT_NAME=/cgi-bin/yasequery\n"
+		"HTTP_HOST=localhost\nQUERY_STRING=%s\n\n", query);
+	if (write(fd, request, len) != len) {
+		perror("write");
+		close(fd);
+		return -1;
+	}
+	long n = ys_load_response(load, fd);
+	close(fd);
+	return n > 0 ? 0 : -1;
+}
+
+static int
+ys_load_cgi(ys_load_t *load, const char *query)
+{
+	char qs[8192];
+	int fds[2];
+	int status;
+	pid_t pid;
+
+	snprintf(qs, sizeof qs, "QUERY_STRING=%s", query);
+	if (pipe(fds) != 0) {
+		perror("pipe");
+		return -1;
+	}
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		const char *env[] = { "REQUEST_METHOD=GET", 
+			"SCRIPT_NAME=/cgi-bin/yasequery", "HTTP_HOST=localhost", 
+			qs, 0 };
+		dup2(fds[1], 1);
+		close(fds[0]);
+		close(fds[1]);
+		execle(load->cgi, load->cgi, (char *) 0, env);
+		_exit(127);
+	}
+	close(fds[1]);
+	long n = ys_load_response(load, fds[0]);
+	close(fds[0]);
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || 
+		WEXITSTATUS(status) != 0)
+		return -1;
+	return n > 0 ? 0 : -1;
+}
+
+static void *
+ys_load_client(void *arg)
+{
+	ys_load_t *load = (ys_load_t *) arg;
+	char query[4096];
+
+	for (;;) {
+		ys_mutex_lock(&load->mutex);
+		int i = load->next++;
+		ys_mutex_unlock(&load->mutex);
+		if (i >= load->nrequests)
+			break;
+		const char *q = load->queries[i % load->nqueries];
+		if (load->collection != 0 && strstr(q, "yp=") == 0)
+			snprintf(query, sizeof query, "yp=%s&%s", load->collection, q);
+		else
+			snprintf(query, sizeof query, "%s", q);
+		double start = ys_load_now();
+		int rc = load->sockpath != 0 ? 
+			ys_load_socket(load, query) : ys_load_cgi(load, query);
+		load->latency[i] = ys_load_now() - start;
+		if (rc != 0) {
+			ys_mutex_lock(&load->mutex);
+			load->errors++;
+			ys_mutex_unlock(&load->mutex);
+		}
+	}
+	return 0;
+}
+
+static int
+ys_load_queries(ys_load_t *load, const char *filename)
+{
+	char line[4096];
+	FILE *file = fopen(filename, "r");
+	if (file == 0) {
+		perror(filename);
+		return -1;
+	}
+	while (fgets(line, sizeof line, file) != 0) {
+		char *cp = strchr(line, '\n');
+		if (cp != 0)
+			*cp = 0;
+		if (line[0] == 0 || line[0] == '#')
+			continue;
+		load->queries = (char **) realloc(load->queries, 
+			(load->nqueries+1) * sizeof(char *));
+		load->queries[load->nqueries++] = strdup(line);
+	}
+	fclose(file);
+	if (load->nqueries == 0) {
+		fprintf(stderr, "Error: no queries in %s\n", filename);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+ys_compare_latency(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void
+ys_print_load_help(void)
+{
+	fprintf(stdout, 
+"usage: yaseload (-s <socket> | -x <yasequery>) -f <queries> [options]\n"
+"  -s, --server <socket>   send requests to a yasequery server\n"
+"  -x, --cgi <program>     run the program as a CGI for each request\n"
+"  -f, --queries <file>    query strings, one per line\n"
+"  -y, --collection <name> collection to query, unless given by yp=\n"
+"  -c, --clients <n>       concurrent clients (default 1)\n"
+"  -n, --requests <n>      number of requests (default 100)\n"
+"  -p, --print             write responses to stdout\n"
+"  -h, --help              show this help\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	ys_load_t load;
+	const char *queryfile = 0;
+	int nclients = 1;
+	int c, i;
+
+	static struct option long_options[] =
+	{
+		{ "server", required_argument, NULL, 's' },
+		{ "cgi", required_argument, NULL, 'x' },
+		{ "queries", required_argument, NULL, 'f' },
+		{ "collection", required_argument, NULL, 'y' },
+		{ "clients", required_argument, NULL, 'c' },
+		{ "requests", required_argument, NULL, 'n' },
+		{ "print", no_argument, NULL, 'p' },
+		{ "help", no_argument, NULL, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+
+	memset(&load, 0, sizeof load);
+	load.nrequests = 100;
+	opterr = 0;
+	while ((c = getopt_long (argc, argv, "s:x:f:y:c:n:ph",
+			   long_options, (int *)0)) != EOF) {
+		switch (c) {
+		case 's': load.sockpath = optarg; break;
+		case 'x': load.cgi = optarg; break;
+		case 'f': queryfile = optarg; break;
+		case 'y': load.collection = optarg; break;
+		case 'c': nclients = atoi(optarg); break;
+		case 'n': load.nrequests = atoi(optarg); break;
+		case 'p': load.print = true; break;
+		case 'h': ys_print_load_help(); return EXIT_SUCCESS;
+		default:
+			fprintf(stderr, "Unrecognised option %c; try --help\n", optopt);
+			return EXIT_FAILURE;
+		}
+	}
+	if ((load.sockpath == 0) == (load.cgi == 0) || queryfile == 0 || 
+		load.nrequests <= 0) {
+		ys_print_load_help();
+		return EXIT_FAILURE;
+	}
+	if (ys_load_queries(&load, queryfile) != 0)
+		return EXIT_FAILURE;
+	/* Responses would be interleaved */
+	if (load.print || nclients < 1)
+		nclients = 1;
+
+	load.latency = (double *) calloc(load.nrequests, sizeof(double));
+	ys_thread_t *clients = (ys_thread_t *) calloc(nclients, sizeof(ys_thread_t));
+	if (load.latency == 0 || clients == 0) {
+		fprintf(stderr, "Error allocating memory\n");
+		return EXIT_FAILURE;
+	}
+	ys_mutex_init(&load.mutex);
+
+	double start = ys_load_now();
+	for (i = 0; i < nclients; i++) {
+		if (ys_thread_create(&clients[i], ys_load_client, &load) != 0)
+			break;
+	}
+	nclients = i;
+	for (i = 0; i < nclients; i++)
+		ys_thread_join(&clients[i]);
+	double elapsed = ys_load_now() - start;
+
+	if (!load.print) {
+		double total = 0.0;
+		qsort(load.latency, load.nrequests, sizeof(double), ys_compare_latency);
+		for (i = 0; i < load.nrequests; i++)
+			total += load.latency[i];
+		printf("requests %d, errors %d, clients %d, %.0f ms\n",
+			load.nrequests, load.errors, nclients, elapsed);
+		printf("throughput %.1f requests/s\n", 
+			load.nrequests * 1000.0 / elapsed);
+		printf("latency ms: mean %.2f, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f\n",
+			total / load.nrequests,
+			load.latency[load.nrequests / 2],
+			load.latency[(int)(load.nrequests * 0.95)],
+			load.latency[(int)(load.nrequests * 0.99)],
+			load.latency[load.nrequests - 1]);
+	}
+
+	ys_mutex_destroy(&load.mutex);
+	for (i = 0; i < load.nqueries; i++)
+		free(load.queries[i]);
+	free(load.queries);
+	free(load.latency);
+	free(clients);
+	return load.errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
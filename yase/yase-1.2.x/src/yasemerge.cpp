@@ -0,0 +1,550 @@
+/*** 
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.  
+* 
+*    This program is free software; you can redistribute it and/or modify 
+*    it under the terms of the GNU General Public License as published by 
+*    the Free Software Foundation; either version 2 of the License, or 
+*    (at your option) any later version.  
+* 
+*    This program is distributed in the hope that it will be useful, 
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+*    GNU General Public License for more details.  
+* 
+*    You should have received a copy of the GNU General Public License 
+*    along with this program; if not, write to the Free Software 
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  
+* 
+*    Author : Dibyendu Majumdar 
+*    Email  : dibyendu@mazumdar.demon.co.uk 
+*    Website: www.mazumdar.demon.co.uk/yase_index.html 
+*/ 
+/* 17 Oct 2026: Created - merges index segments */
+/* 17 Oct 2026: Merges positions */
+/* 17 Oct 2026: Moves the generation on after merging */
+
+/**
+ * yasemerge merges the index segments of a collection (see segment.h).
+ * Each run of adjacent segments is merged into one new segment, whose
+ * words and postings are written in the collection's postings format,
+ * with its positions if the collection records them;
+ * then yase.seg is replaced and the old segments are removed.
+ * By default segments are merged in tiers: a segment of n documents is
+ * at level floor(log_F(n)), and F adjacent segments at the same level 
+ * are merged, repeatedly, so each document is merged about log_F(N) 
+ * times. With -a all segments are merged into one.
+ * Postings of deleted documents are dropped from the new segment.
+ * Document weights do not change when segments are merged, so only the
+ * score bounds of the new segment need to be recorded, unless postings
+ * were dropped; then the weights are calculated again.
+ * The generation (see ys_dbgetgeneration()) is moved on, so that
+ * readers that keep the collection open, such as the yasequery server,
+ * open the new segments.
+ */
+
+#include "yase.h"
+#include "segment.h"
+#include "docdb.h"
+#include "ystdio.h"
+#include "btree.h"
+#include "termdict.h"
+#include "postfile.h"
+#include "docweights.h"
+#include "positions.h"
+#include "version.h"
+#include "getopt.h"
+
+enum {
+	YS_SEGMERGE_BUFSIZE = 128*1024,	/* stdio buffer of each file */
+	YS_SEGMERGE_FACTOR = 4		/* default tier factor */
+};
+
+/**
+ * One of the segments being merged. The words file holds prefix
+ * compressed records in term order, as written by yasemakedb.
+ */
+typedef struct {
+	ys_file_t *words_file;
+	YASENS PostFile *postings_file;
+	ys_file_t *positions_file;	/* read in term order */
+	ys_uchar_t word[256];		/* current term */
+	ys_filepos_t offset;		/* its postings */
+	ys_doccnt_t tf;
+	bool done;
+} ys_seginput_t;
+
+typedef struct {
+	const char *home;
+	int format;			/* postings format of the collection */
+	ys_docnum_t *docnums;		/* postings of the current term */
+	ys_doccnt_t *dtfs;
+	size_t nalloc;
+	ys_docpos_t *positions;		/* and their positions */
+	size_t posalloc;
+	ys_bitset_t *deleted;		/* 0 if no document is deleted */
+	unsigned long nterms;
+	unsigned long npurged;		/* postings of deleted documents */
+	int fill;			/* fill factor of btree blocks */
+	bool verify;			/* check the new btree */
+} ys_segmerge_t;
+
+/**
+ * Reads the next record of a words file. Returns -1 at the end of the
+ * file.
+ */
+static int
+ys_seg_next_term(ys_seginput_t *in)
+{
+	int prefixlen, wordlen;
+
+	prefixlen = ys_file_getc(in->words_file);
+	if (ys_file_eof(in->words_file)) {
+		in->done = true;
+		return -1;
+	}
+	wordlen = ys_file_getc(in->words_file);
+	ys_file_read(in->word+prefixlen, 1, wordlen, in->words_file);
+	in->word[prefixlen+wordlen] = 0;
+	ys_file_read(&in->offset, 1, sizeof in->offset, in->words_file);
+	ys_file_read(&in->tf, 1, sizeof in->tf, in->words_file);
+	return 0;
+}
+
+static int
+ys_seg_reserve(ys_segmerge_t *sm, size_t n)
+{
+	if (n <= sm->nalloc)
+		return 0;
+	size_t nalloc = sm->nalloc == 0 ? 1024 : sm->nalloc;
+	while (nalloc < n)
+		nalloc *= 2;
+	ys_docnum_t *docnums = (ys_docnum_t *) realloc(sm->docnums, 
+		nalloc * sizeof *docnums);
+	if (docnums != 0)
+		sm->docnums = docnums;
+	ys_doccnt_t *dtfs = (ys_doccnt_t *) realloc(sm->dtfs, 
+		nalloc * sizeof *dtfs);
+	if (dtfs != 0)
+		sm->dtfs = dtfs;
+	if (docnums == 0 || dtfs == 0) {
+		fprintf(stderr, "Error: ran out of memory\n");
+		return -1;
+	}
+	sm->nalloc = nalloc;
+	return 0;
+}
+
+static int
+ys_seg_reserve_positions(ys_segmerge_t *sm, size_t n)
+{
+	if (n <= sm->posalloc)
+		return 0;
+	size_t posalloc = sm->posalloc == 0 ? 4096 : sm->posalloc;
+	while (posalloc < n)
+		posalloc *= 2;
+	ys_docpos_t *positions = (ys_docpos_t *) realloc(sm->positions, 
+		posalloc * sizeof *positions);
+	if (positions == 0) {
+		fprintf(stderr, "Error: ran out of memory\n");
+		return -1;
+	}
+	sm->positions = positions;
+	sm->posalloc = posalloc;
+	return 0;
+}
+
+/**
+ * Reads the positions of the postings count.. of the current term from
+ * an input, after those of the postings before. Returns the new number
+ * of positions, or -1 on error.
+ */
+static long
+ys_seg_read_positions(ys_segmerge_t *sm, ys_seginput_t *in, 
+	ys_doccnt_t count, size_t npos)
+{
+	size_t n = 0;
+	ys_doccnt_t j;
+
+	for (j = count; j < count + in->tf; j++)
+		n += sm->dtfs[j];
+	if (ys_seg_reserve_positions(sm, npos + n) != 0)
+		return -1;
+	for (j = count; j < count + in->tf; j++) {
+		if (ys_positions_read(in->positions_file, sm->positions+npos,
+			sm->dtfs[j]) != 0) {
+			fprintf(stderr, "Error: positions of %s are incomplete\n",
+				in->word);
+			return -1;
+		}
+		npos += sm->dtfs[j];
+	}
+	return (long) npos;
+}
+
+/**
+ * Merges the words and postings of n segments into segment id, and 
+ * loads its btree and term dictionary. The inputs are in docnum order, so each term's 
+ * postings are those of the inputs in turn.
+ */
+static int
+ys_seg_merge_files(ys_segmerge_t *sm, const ys_segment_t *segs, int n, 
+	int id)
+{
+	ys_seginput_t in[YS_MAXSEGMENTS];
+	char name[1024];
+	ys_uchar_t word[256], prev_word[256];
+	ys_file_t *words_file;
+	YASENS PostFile postings_file;
+	ys_file_t *positions_file = 0;
+	ys_filepos_t posoffset = 0;
+	bool positional = (sm->format & YS_POSTINGS_POSITIONS) != 0;
+	ys_btree_loader_t *loader;
+	ys_termdict_writer_t *dict;
+	int i, rc = 0;
+
+	memset(in, 0, sizeof in);
+	for (i = 0; i < n; i++) {
+		ys_seg_filename(sm->home, segs[i].id, "words", name, sizeof name);
+		in[i].words_file = ys_file_open(name, "r", YS_FILE_ABORT_ON_ERROR);
+		ys_file_setbuf(in[i].words_file, YS_SEGMERGE_BUFSIZE);
+		ys_seg_filename(sm->home, segs[i].id, "postings", name, 
+			sizeof name);
+		in[i].postings_file = new YASENS PostFile();
+		if (in[i].postings_file->open(name, "rb") != 0)
+			return -1;
+		in[i].postings_file->set_buffer_size(YS_SEGMERGE_BUFSIZE);
+		in[i].postings_file->set_format(sm->format);
+		if (positional) {
+			ys_seg_filename(sm->home, segs[i].id, "positions", name, 
+				sizeof name);
+			in[i].positions_file = ys_file_open(name, "r", 
+				YS_FILE_ABORT_ON_ERROR);
+			ys_file_setbuf(in[i].positions_file, YS_SEGMERGE_BUFSIZE);
+		}
+		ys_seg_next_term(&in[i]);
+	}
+	ys_seg_filename(sm->home, id, "words", name, sizeof name);
+	words_file = ys_file_open(name, "w", YS_FILE_ABORT_ON_ERROR);
+	ys_file_setbuf(words_file, YS_SEGMERGE_BUFSIZE);
+	ys_seg_filename(sm->home, id, "postings", name, sizeof name);
+	if (postings_file.open(name, "wb") != 0)
+		return -1;
+	postings_file.set_buffer_size(YS_SEGMERGE_BUFSIZE);
+	postings_file.set_format(sm->format);
+	if (positional) {
+		ys_seg_filename(sm->home, id, "positions", name, sizeof name);
+		positions_file = ys_file_open(name, "w", YS_FILE_ABORT_ON_ERROR);
+		ys_file_setbuf(positions_file, YS_SEGMERGE_BUFSIZE);
+	}
+	ys_seg_filename(sm->home, id, "btree", name, sizeof name);
+	loader = ys_btree_load_begin(name, sm->fill);
+	if (loader == 0)
+		return -1;
+	ys_seg_filename(sm->home, id, "dict", name, sizeof name);
+	dict = ys_termdict_create(name, 0);
+	if (dict == 0) {
+		ys_btree_load_end(loader);
+		return -1;
+	}
+	prev_word[0] = 0;
+
+	for (;;) {
+		int first = -1;
+		ys_doccnt_t tf = 0, count = 0;
+		long npos = 0;
+		for (i = 0; i < n; i++) {
+			if (in[i].done)
+				continue;
+			int cmp = first < 0 ? -1 : strcmp((const char *)in[i].word, 
+				(const char *)word);
+			if (cmp < 0) {
+				first = i;
+				strcpy((char *)word, (const char *)in[i].word);
+				tf = in[i].tf;
+			}
+			else if (cmp == 0)
+				tf += in[i].tf;
+		}
+		if (first < 0)
+			break;
+		if (ys_seg_reserve(sm, tf) != 0) {
+			rc = -1;
+			break;
+		}
+		for (i = first; i < n; i++) {
+			if (in[i].done || strcmp((const char *)in[i].word, 
+				(const char *)word) != 0)
+				continue;
+			in[i].postings_file->start_postings(in[i].offset);
+			in[i].postings_file->read_postings(sm->docnums+count,
+				sm->dtfs+count, in[i].tf, 0);
+			if (positional && (npos = ys_seg_read_positions(sm, &in[i], 
+				count, npos)) < 0)
+				break;
+			count += in[i].tf;
+			ys_seg_next_term(&in[i]);
+		}
+		if (npos < 0) {
+			rc = -1;
+			break;
+		}
+		assert(count == tf);
+		if (sm->deleted != 0) {
+			ys_doccnt_t j, live = 0;
+			size_t from = 0, to = 0;
+			for (j = 0; j < count; j++) {
+				ys_doccnt_t dtf = sm->dtfs[j];
+				from += positional ? dtf : 0;
+				if (ys_bs_ismember(sm->deleted, sm->docnums[j]))
+					continue;
+				if (positional) {
+					memmove(sm->positions+to, sm->positions+from-dtf,
+						dtf * sizeof *sm->positions);
+					to += dtf;
+				}
+				sm->docnums[live] = sm->docnums[j];
+				sm->dtfs[live++] = dtf;
+			}
+			sm->npurged += count - live;
+			tf = live;
+			if (tf == 0)
+				continue;
+		}
+
+		int prefixlen = 0;
+		while (word[prefixlen] && word[prefixlen] == prev_word[prefixlen])
+			prefixlen++;
+		int wordlen = strlen((const char *)word) - prefixlen;
+		ys_filepos_t pos = postings_file.get_ppos();
+		ys_file_putc(prefixlen, words_file);
+		ys_file_putc(wordlen, words_file);
+		ys_file_write(word+prefixlen, 1, wordlen, words_file);
+		ys_file_write(&pos, 1, sizeof pos, words_file);
+		ys_file_write(&tf, 1, sizeof tf, words_file);
+		if (positional) {
+			ys_filepos_t offset = posoffset;
+			const ys_docpos_t *p = sm->positions;
+			for (ys_doccnt_t j = 0; j < tf; p += sm->dtfs[j++])
+				posoffset += ys_positions_write(positions_file, p, 
+					sm->dtfs[j]);
+			postings_file.write_postings(sm->docnums, sm->dtfs, tf, offset);
+		}
+		else
+			postings_file.write_postings(sm->docnums, sm->dtfs, tf);
+		strcpy((char *)prev_word, (const char *)word);
+		sm->nterms++;
+		ys_uchar_t key[YS_TERM_LEN+1];
+		key[0] = (ys_uchar_t) (prefixlen + wordlen);
+		memcpy(key+1, word, key[0]);
+		if (ys_btree_load_add(loader, key, pos, tf) != 0 ||
+			ys_termdict_add(dict, key, pos, tf) != 0) {
+			rc = -1;
+			break;
+		}
+	}
+	if (ys_btree_load_end(loader) != 0)
+		rc = -1;
+	if (ys_termdict_finish(dict) != 0)
+		rc = -1;
+
+	postings_file.close();
+	ys_file_close(words_file);
+	if (positions_file != 0)
+		ys_file_close(positions_file);
+	for (i = 0; i < n; i++) {
+		delete in[i].postings_file;
+		ys_file_close(in[i].words_file);
+		if (in[i].positions_file != 0)
+			ys_file_close(in[i].positions_file);
+	}
+	return rc;
+}
+
+/**
+ * Merges segments first..first+n-1 of the list into a new segment, and
+ * publishes the new list.
+ */
+static int
+ys_seg_merge(ys_segmerge_t *sm, ys_seglist_t *list, int first, int n)
+{
+	char wordfile[1024], treefile[1024];
+	ys_segment_t old[YS_MAXSEGMENTS];
+	int i, id = list->nextid;
+
+	printf("merging segments");
+	for (i = first; i < first+n; i++)
+		printf(" %d", list->segs[i].id);
+	printf(" into segment %d\n", id);
+	sm->nterms = 0;
+	sm->npurged = 0;
+	if (ys_seg_merge_files(sm, list->segs+first, n, id) != 0)
+		return -1;
+	if (sm->verify) {
+		ys_seg_filename(sm->home, id, "words", wordfile, 
+			sizeof wordfile);
+		ys_seg_filename(sm->home, id, "btree", treefile, 
+			sizeof treefile);
+		if (ys_btree_verify(treefile, wordfile) != 0)
+			return -1;
+	}
+
+	memcpy(old, list->segs+first, n * sizeof old[0]);
+	for (i = 1; i < n; i++)
+		list->segs[first].ndocs += list->segs[first+i].ndocs;
+	list->segs[first].id = id;
+	memmove(list->segs+first+1, list->segs+first+n, 
+		(list->nsegs-first-n) * sizeof list->segs[0]);
+	list->nsegs -= n-1;
+	list->nextid++;
+	if (ys_seg_write(sm->home, list) != 0)
+		return -1;
+	for (i = 0; i < n; i++)
+		ys_seg_remove(sm->home, old[i].id);
+	printf("segment %d: %lu documents, %lu terms\n", id, 
+		(unsigned long) list->segs[first].ndocs, sm->nterms);
+	if (sm->npurged > 0) {
+		printf("removed %lu postings of deleted documents\n", 
+			sm->npurged);
+		return ys_build_docweights(sm->home);
+	}
+	if (sm->format & YS_POSTINGS_BOUNDS)
+		return ys_build_bounds(sm->home, id);
+	return 0;
+}
+
+static int
+ys_seg_level(ys_docnum_t ndocs, int factor)
+{
+	int level = 0;
+	while (ndocs >= (ys_docnum_t) factor) {
+		ndocs /= factor;
+		level++;
+	}
+	return level;
+}
+
+/**
+ * Finds the first run of factor adjacent segments at the same level.
+ * Returns its start, or -1 if there is none.
+ */
+static int
+ys_seg_find_tier(const ys_seglist_t *list, int factor)
+{
+	int i, start = 0;
+	for (i = 1; i <= list->nsegs; i++) {
+		if (i - start == factor)
+			return start;
+		if (i == list->nsegs)
+			break;
+		if (ys_seg_level(list->segs[i].ndocs, factor) != 
+			ys_seg_level(list->segs[start].ndocs, factor))
+			start = i;
+	}
+	return -1;
+}
+
+static void
+ys_print_merge_help(void)
+{
+	fprintf(stdout, 
+"usage: yasemerge [options]\n"
+"  -H, --yase-home <path>  YASE home directory\n"
+"  -a, --all               merge all segments into one, removing deleted\n"
+"                          documents\n"
+"  -f, --factor <n>        merge n segments of the same size (default 4)\n"
+"  -F, --btree-fill <pct>  fill btree blocks to pct (default 100)\n"
+"  -v, --verify            check the btree of each new segment\n"
+"  -h, --help              show this help\n"
+"  -V, --version           show the version of YASE\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	ys_segmerge_t sm;
+	ys_seglist_t list;
+	ys_docdb_t *docdb;
+	ys_docnum_t numdocs, numfiles;
+	ys_doccnt_t maxdtf, maxtf;
+	ys_bool_t stemmed;
+	bool all = false;
+	int factor = YS_SEGMERGE_FACTOR;
+	int c, start, nextid, rc = 0;
+
+	static struct option long_options[] =
+	{
+		{ "yase-home", required_argument, NULL, 'H' },
+		{ "all", no_argument, NULL, 'a' },
+		{ "factor", required_argument, NULL, 'f' },
+		{ "btree-fill", required_argument, NULL, 'F' },
+		{ "verify", no_argument, NULL, 'v' },
+		{ "help", no_argument, NULL, 'h' },
+		{ "version", no_argument, NULL, 'V' },
+		{ 0, 0, 0, 0 }
+	};
+
+	memset(&sm, 0, sizeof sm);
+	sm.home = ".";
+	opterr = 0;
+	while ((c = getopt_long (argc, argv, "H:af:F:vhV",
+			   long_options, (int *)0)) != EOF) {
+		switch (c) {
+		case 'H': sm.home = optarg; break;
+		case 'a': all = true; break;
+		case 'f': factor = atoi(optarg); break;
+		case 'F': sm.fill = atoi(optarg); break;
+		case 'v': sm.verify = true; break;
+		case 'h': ys_print_merge_help(); return EXIT_SUCCESS;
+		case 'V': 
+			printf("YASE %s segment merge utility\n", Yase_version);
+			return EXIT_SUCCESS;
+		default:
+			fprintf(stderr, "Unrecognised option %c; try --help\n", optopt);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc || factor < 2 || 
+		(sm.fill != 0 && (sm.fill < 10 || sm.fill > 100))) {
+		ys_print_merge_help();
+		return EXIT_FAILURE;
+	}
+
+	docdb = ys_dbopen(sm.home, "r", 0);
+	if (docdb == 0)
+		return EXIT_FAILURE;
+	rc = ys_dbgetinfo(docdb, &numdocs, &numfiles, &maxdtf, &maxtf, &stemmed);
+	sm.format = ys_dbgetpostingsformat(docdb);
+	if (ys_dbgetdeleted(docdb) != 0)
+		sm.deleted = ys_bs_clone(0, ys_dbgetdeleted(docdb));
+	ys_dbclose(docdb);
+	if (rc == 0)
+		rc = ys_seg_read(sm.home, numdocs, &list);
+	if (rc != 0)
+		return EXIT_FAILURE;
+
+	nextid = list.nextid;
+	if (all) {
+		/* A single segment is rewritten to remove deleted documents */
+		if (list.nsegs > 1 || sm.deleted != 0)
+			rc = ys_seg_merge(&sm, &list, 0, list.nsegs);
+	}
+	else {
+		while (rc == 0 && (start = ys_seg_find_tier(&list, factor)) >= 0)
+			rc = ys_seg_merge(&sm, &list, start, factor);
+	}
+	if (rc == 0 && list.nextid != nextid) {
+		docdb = ys_dbopen(sm.home, "r+", 0);
+		if (docdb == 0 || ys_dbnewgeneration(docdb) != 0)
+			rc = -1;
+		if (docdb != 0 && ys_dbclose(docdb) != 0)
+			rc = -1;
+	}
+	printf("%d segment%s\n", list.nsegs, list.nsegs == 1 ? "" : "s");
+	free(sm.docnums);
+	free(sm.dtfs);
+	free(sm.positions);
+	if (sm.deleted != 0)
+		ys_bs_destroy(sm.deleted);
+	return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
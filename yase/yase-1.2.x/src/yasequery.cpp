@@ -21,10 +21,14 @@
 *    Website: www.mazumdar.demon.co.uk/yase_index.html
 */
 /* 26 Jan 2003: YaseQuery class created */
+/* 17 Oct 2026: Added server mode (-s) */
+/* 17 Oct 2026: Uses the query cache file, if one is configured */
 
 #include "query.h"
 #include "util.h"
 #include "properties.h"
+#include "queryserver.h"
+#include "getopt.h"
 
 #ifndef WIN32
 extern char ** environ;
@@ -42,7 +46,8 @@ private:
 public:
 	YaseQuery();
 	~YaseQuery();
-	bool loadProperties(const char *yasequery_location);
+	static bool loadProperties(YASENS Properties *prop, 
+		const char *yasequery_location);
 	void dumpEnv();
 	int process(int argc, const char *argv[]);
 };
@@ -69,8 +74,13 @@ YASENS YaseQuery::~YaseQuery()
 	delete output;
 }
 
+/**
+ * yasequery.properties is looked for in the directory containing
+ * yasequery.
+ */
 bool
-YASENS YaseQuery::loadProperties(const char *yasequery_location)
+YASENS YaseQuery::loadProperties(YASENS Properties *prop, 
+	const char *yasequery_location)
 {
 	char pathname[1024];
 	strncpy(pathname, yasequery_location, sizeof pathname);
@@ -104,7 +114,7 @@ YASENS YaseQuery::process(int argc, const char *argv[])
 {
 	int rc = 0;
 	const char *collection_path = 0;
-	if (! loadProperties(argv[0])) {
+	if (! loadProperties(prop, argv[0])) {
 		output->message("Failed to load yasequery.properties\n");
 		return 1;
 	}
@@ -114,11 +124,14 @@ YASENS YaseQuery::process(int argc, const char *argv[])
 		output->message("Unrecognised Collection %s\n", form->getCollectionPath());
 		return 1;
 	}
-	if (collection->open(collection_path, "r") != 0) {
+	if (YASENS QueryAction::openCollection(collection, prop, 
+		form->getCollectionPath(), collection_path) != 0) {
 		output->message("Failed to open database\n");
 		return 1;
 	}
-	YASENS QueryAction action;
+	YASENS QueryCache *cache = YASENS QueryAction::openCache(prop, 
+		form->getCollectionPath(), collection_path, true);
+	YASENS QueryAction action(cache);
 	YASENS SearchResultSet *rs = action.doSearch(collection, form);
 	if (rs != 0) {
 		output->doOutput(collection, form, input, rs);
@@ -128,12 +141,73 @@ YASENS YaseQuery::process(int argc, const char *argv[])
 		output->message("Failed to process query\n");
 		rc = 1;
 	}
+	delete cache;
 	return rc;
 }
 
+static void
+ys_print_server_help(void)
+{
+	fprintf(stdout, 
+"usage: yasequery -s <socket> [-w <workers>]\n"
+"Without options, yasequery answers a single CGI request.\n"
+"  -s, --server <socket>   serve requests on a Unix domain socket\n"
+"  -w, --workers <n>       number of worker threads (default 4)\n"
+"  -h, --help              show this help\n");
+}
+
+/**
+ * Runs yasequery as a server. Collections named in yasequery.properties 
+ * are opened by each worker when first queried and stay open.
+ */
+static int
+ys_run_server(int argc, char *argv[])
+{
+	const char *sockpath = 0;
+	int nworkers = 4;
+	int c;
+
+	static struct option long_options[] =
+	{
+		{ "server", required_argument, NULL, 's' },
+		{ "workers", required_argument, NULL, 'w' },
+		{ "help", no_argument, NULL, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+
+	opterr = 0;
+	while ((c = getopt_long (argc, argv, "s:w:h",
+			   long_options, (int *)0)) != EOF) {
+		switch (c) {
+		case 's': sockpath = optarg; break;
+		case 'w': nworkers = atoi(optarg); break;
+		case 'h': ys_print_server_help(); return EXIT_SUCCESS;
+		default:
+			fprintf(stderr, "Unrecognised option %c; try --help\n", optopt);
+			return EXIT_FAILURE;
+		}
+	}
+	if (sockpath == 0) {
+		ys_print_server_help();
+		return EXIT_FAILURE;
+	}
+
+	YASENS Properties prop;
+	if (! YASENS YaseQuery::loadProperties(&prop, argv[0])) {
+		fprintf(stderr, "Failed to load yasequery.properties\n");
+		return EXIT_FAILURE;
+	}
+	YASENS QueryServer server(&prop, nworkers);
+	if (server.listen(sockpath) != 0 || server.run() != 0)
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
 int 
 main(int argc, const char *argv[])
 {
+	if (argc > 1 && argv[1][0] == '-')
+		return ys_run_server(argc, (char **) argv);
 	YASENS YaseQuery yq;
 	return yq.process(argc, argv);
 }
@@ -29,6 +29,8 @@
 /*
  * 16-nov-01: Fixed portability problems in ys_file_setpos() and ys_file_getpos().
  * 16-nov-01: Fixed incorrect use of va_start() in ys_file_printf().
+ * 17-oct-26: Added ys_file_setbuf().
+ * 17-oct-26: ys_file_setbuf() with a size of 0 makes the file unbuffered.
  */
 
 #include <stdio.h>
@@ -44,6 +46,7 @@ struct ys_file_t {
 	int error;
 	int flags;
 	char filename[1024];
+	char *buf;		/* set by ys_file_setbuf() */
 };
 
 /**
@@ -102,6 +105,7 @@ ys_file_close( ys_file_t *file )
 	int rc = fclose( file->file );
 	if (rc != 0)
 		report_error( file, "CLOSE" );
+	free(file->buf);
 	free(file);
 	return rc;
 }
@@ -282,6 +286,7 @@ ys_pipe_close( ys_file_t *file )
 			file->filename, rc);
 	}
 #endif
+	free( file->buf );
 	free( file );
 	return prc;
 }
@@ -342,6 +347,29 @@ ys_file_rewind( ys_file_t *file )
 		report_error( file, "REWIND" );
 }
 
+int
+ys_file_setbuf( ys_file_t *file, size_t size )
+{
+	if (size == 0) {
+		if (setvbuf( file->file, 0, _IONBF, 0 ) != 0) {
+			report_error( file, "SETBUF" );
+			return -1;
+		}
+		free(file->buf);
+		file->buf = 0;
+		return 0;
+	}
+	char *buf = (char *) malloc(size);
+	if (buf == 0 || setvbuf( file->file, buf, _IOFBF, size ) != 0) {
+		report_error( file, "SETBUF" );
+		free(buf);
+		return -1;
+	}
+	free(file->buf);
+	file->buf = buf;
+	return 0;
+}
+
 #ifdef _TEST_YSTDIO
 
 int main(int argc, char *argv[])
@@ -85,6 +85,15 @@ ys_file_eof( ys_file_t *file );
 extern void
 ys_file_rewind( ys_file_t *file );
 
+/**
+ * Gives the file a stdio buffer of the given size, for long sequential
+ * reads or writes; a size of 0 leaves it unbuffered, so that every read
+ * sees what other processes have written since. Must be called before 
+ * any other operation.
+ */
+extern int
+ys_file_setbuf( ys_file_t *file, size_t size );
+
 extern ys_file_t *
 ys_pipe_open( const char *command, const char *mode, int flags );
 
@@ -0,0 +1,198 @@
+/***
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.
+*
+*    This program is free software; you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation; either version 2 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program; if not, write to the Free Software
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*    Author : Dibyendu Majumdar
+*    Email  : dibyendu@mazumdar.demon.co.uk
+*    Website: www.mazumdar.demon.co.uk/yase_index.html
+*/
+// 17-10-26: Created
+// 17-10-26: Added ys_thread_create() and ys_thread_join().
+
+#include "ysthread.h"
+
+int
+ys_mutex_init( ys_mutex_t *mutex )
+{
+#ifdef WIN32
+	InitializeCriticalSection(&mutex->cs);
+	return 0;
+#else
+	int rc = pthread_mutex_init(&mutex->mutex, NULL);
+	if (rc != 0) {
+		fprintf(stderr, "Unable to initialize mutex: %s\n", strerror(rc));
+		return -1;
+	}
+	return 0;
+#endif
+}
+
+int
+ys_mutex_destroy( ys_mutex_t *mutex )
+{
+#ifdef WIN32
+	DeleteCriticalSection(&mutex->cs);
+	return 0;
+#else
+	return pthread_mutex_destroy(&mutex->mutex) == 0 ? 0 : -1;
+#endif
+}
+
+void
+ys_mutex_lock( ys_mutex_t *mutex )
+{
+#ifdef WIN32
+	EnterCriticalSection(&mutex->cs);
+#else
+	int rc = pthread_mutex_lock(&mutex->mutex);
+	assert(rc == 0);
+#endif
+}
+
+void
+ys_mutex_unlock( ys_mutex_t *mutex )
+{
+#ifdef WIN32
+	LeaveCriticalSection(&mutex->cs);
+#else
+	int rc = pthread_mutex_unlock(&mutex->mutex);
+	assert(rc == 0);
+#endif
+}
+
+int
+ys_cond_init( ys_cond_t *cond )
+{
+#ifdef WIN32
+	InitializeConditionVariable(&cond->cv);
+	return 0;
+#else
+	int rc = pthread_cond_init(&cond->cond, NULL);
+	if (rc != 0) {
+		fprintf(stderr, "Unable to initialize condition variable: %s\n",
+			strerror(rc));
+		return -1;
+	}
+	return 0;
+#endif
+}
+
+int
+ys_cond_destroy( ys_cond_t *cond )
+{
+#ifdef WIN32
+	return 0;
+#else
+	return pthread_cond_destroy(&cond->cond) == 0 ? 0 : -1;
+#endif
+}
+
+void
+ys_cond_wait( ys_cond_t *cond, ys_mutex_t *mutex )
+{
+#ifdef WIN32
+	SleepConditionVariableCS(&cond->cv, &mutex->cs, INFINITE);
+#else
+	pthread_cond_wait(&cond->cond, &mutex->mutex);
+#endif
+}
+
+void
+ys_cond_broadcast( ys_cond_t *cond )
+{
+#ifdef WIN32
+	WakeAllConditionVariable(&cond->cv);
+#else
+	pthread_cond_broadcast(&cond->cond);
+#endif
+}
+
+#ifdef WIN32
+typedef struct {
+	ys_pfn_thread_start_t *start;
+	void *arg;
+} ys_thread_args_t;
+
+static DWORD WINAPI
+ys_thread_main( LPVOID p )
+{
+	ys_thread_args_t args = *(ys_thread_args_t *)p;
+	free(p);
+	args.start(args.arg);
+	return 0;
+}
+#endif
+
+int
+ys_thread_create( ys_thread_t *thread, ys_pfn_thread_start_t *start, void *arg )
+{
+#ifdef WIN32
+	ys_thread_args_t *args = (ys_thread_args_t *) malloc(sizeof(ys_thread_args_t));
+	if (args == 0) {
+		fprintf(stderr, "Error allocating memory\n");
+		return -1;
+	}
+	args->start = start;
+	args->arg = arg;
+	thread->handle = CreateThread(NULL, 0, ys_thread_main, args, 0, NULL);
+	if (thread->handle == NULL) {
+		fprintf(stderr, "Unable to create thread\n");
+		free(args);
+		return -1;
+	}
+	return 0;
+#else
+	int rc = pthread_create(&thread->thread, NULL, start, arg);
+	if (rc != 0) {
+		fprintf(stderr, "Unable to create thread: %s\n", strerror(rc));
+		return -1;
+	}
+	return 0;
+#endif
+}
+
+int
+ys_thread_join( ys_thread_t *thread )
+{
+#ifdef WIN32
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+	return 0;
+#else
+	return pthread_join(thread->thread, NULL) == 0 ? 0 : -1;
+#endif
+}
+
+ys_thread_id_t
+ys_thread_self( void )
+{
+#ifdef WIN32
+	return GetCurrentThreadId();
+#else
+	return pthread_self();
+#endif
+}
+
+ys_bool_t
+ys_thread_equal( ys_thread_id_t t1, ys_thread_id_t t2 )
+{
+#ifdef WIN32
+	return t1 == t2;
+#else
+	return pthread_equal(t1, t2) != 0;
+#endif
+}
@@ -0,0 +1,118 @@
+/***
+*    YASE (Yet Another Search Engine) 
+*    Copyright (C) 2000-2003  Dibyendu Majumdar.
+*
+*    This program is free software; you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation; either version 2 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program; if not, write to the Free Software
+*    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*    Author : Dibyendu Majumdar
+*    Email  : dibyendu@mazumdar.demon.co.uk
+*    Website: www.mazumdar.demon.co.uk/yase_index.html
+*/
+/**
+ * Minimal wrapper around the platform threads library. As with ystdio,
+ * the intention is to keep #ifdefs for different operating systems out
+ * of the rest of the code.
+ */
+// 17-10-26: Created
+// 17-10-26: Added ys_thread_create() and ys_thread_join().
+
+#ifndef ysthread_h
+#define ysthread_h
+
+#include "yase.h"
+
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
+typedef struct {
+#ifdef WIN32
+	CRITICAL_SECTION cs;
+#else
+	pthread_mutex_t mutex;
+#endif
+} ys_mutex_t;
+
+typedef struct {
+#ifdef WIN32
+	CONDITION_VARIABLE cv;
+#else
+	pthread_cond_t cond;
+#endif
+} ys_cond_t;
+
+#ifdef WIN32
+typedef DWORD ys_thread_id_t;
+#else
+typedef pthread_t ys_thread_id_t;
+#endif
+
+typedef struct {
+#ifdef WIN32
+	HANDLE handle;
+#else
+	pthread_t thread;
+#endif
+} ys_thread_t;
+
+typedef void *ys_pfn_thread_start_t(void *arg);
+
+extern int
+ys_mutex_init( ys_mutex_t *mutex );
+
+extern int
+ys_mutex_destroy( ys_mutex_t *mutex );
+
+extern void
+ys_mutex_lock( ys_mutex_t *mutex );
+
+extern void
+ys_mutex_unlock( ys_mutex_t *mutex );
+
+extern int
+ys_cond_init( ys_cond_t *cond );
+
+extern int
+ys_cond_destroy( ys_cond_t *cond );
+
+/**
+ * Atomically releases the mutex and waits for the condition to be
+ * signalled. The mutex is held again on return.
+ */
+extern void
+ys_cond_wait( ys_cond_t *cond, ys_mutex_t *mutex );
+
+extern void
+ys_cond_broadcast( ys_cond_t *cond );
+
+/**
+ * Starts a new thread running start(arg). Returns -1 on error.
+ */
+extern int
+ys_thread_create( ys_thread_t *thread, ys_pfn_thread_start_t *start, void *arg );
+
+/**
+ * Waits for the thread to finish.
+ */
+extern int
+ys_thread_join( ys_thread_t *thread );
+
+extern ys_thread_id_t
+ys_thread_self( void );
+
+extern ys_bool_t
+ys_thread_equal( ys_thread_id_t t1, ys_thread_id_t t2 );
+
+#endif